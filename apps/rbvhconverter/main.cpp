@@ -27,13 +27,54 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <rbvh/rbvhnode.h>
+#include <rbvh/rbvhstreambuilder.h>
 #include <zrenderer/version.h>
 #include <boost/program_options.hpp>
 #include <iostream>
+#include <memory>
+
+#include <sys/resource.h>
 
 namespace po = boost::program_options;
 
+namespace
+{
+const double MB = 1024.0 * 1024.0;
+
+double getPeakMemory()
+{
+    struct rusage usage;
+    if( ::getrusage( RUSAGE_SELF, &usage ) != 0 )
+        return 0.0;
+
+    // The maximum resident set size is in kilobytes
+    return double( usage.ru_maxrss ) * 1024.0 / MB;
+}
+
+// Opens the files with the RAW_EXTENSION as raw triangle files, the others
+// as binary STL files
+const std::string RAW_EXTENSION = ".tri";
+
+std::unique_ptr< zrenderer::TriangleStream > openInput(
+    const std::string& fileName )
+{
+    if( fileName.size() > RAW_EXTENSION.size() &&
+        fileName.compare( fileName.size() - RAW_EXTENSION.size(),
+                          RAW_EXTENSION.size(), RAW_EXTENSION ) == 0 )
+    {
+        return std::unique_ptr< zrenderer::TriangleStream >(
+                    new zrenderer::RawTriangleStream( fileName ));
+    }
+    return std::unique_ptr< zrenderer::TriangleStream >(
+                new zrenderer::STLTriangleStream( fileName ));
+}
+
+double getThroughput( const double amount, const double secs )
+{
+    return secs > 0.0 ? amount / secs : 0.0;
+}
+}
+
 int main( int argc, char *argv[] )
 {
     // Arguments parsing
@@ -42,7 +83,23 @@ int main( int argc, char *argv[] )
     desc.add_options()
         ("help,h", "show help message.")
         ("version,v", "Show program name/version banner and exit.")
-        ("rev", "Print the git revision number");
+        ("rev", "Print the git revision number")
+        ("input,i", po::value< std::string >(),
+         "Input mesh, a binary STL file of at most 4294967295 triangles, or "
+         "a raw triangle file with the .tri extension: a 64 bit triangle "
+         "count followed by nine floats per triangle.")
+        ("output,o", po::value< std::string >(), "Output paged RBVH file.")
+        ("memory,m", po::value< size_t >()->default_value( 1024 ),
+         "Memory budget of the conversion in MB, which bounds the peak "
+         "resident memory.")
+        ("page-size,p", po::value< size_t >()->default_value( 64 ),
+         "Maximum size of the pages of the RBVH file in KB.")
+        ("threads,t", po::value< size_t >()->default_value( 0 ),
+         "Number of build threads, 0 for the hardware threads.")
+        ("bins", po::value< size_t >()->default_value( 16 ),
+         "Number of SAH bins per axis.")
+        ("leaf-size", po::value< size_t >()->default_value( 8 ),
+         "Maximum number of triangles in a leaf.");
     po::store( parse_command_line( argc, argv, desc ), vm );
     po::notify( vm );
 
@@ -67,5 +124,59 @@ int main( int argc, char *argv[] )
         return EXIT_SUCCESS;
     }
 
+    if( !vm.count( "input" ) || !vm.count( "output" ))
+    {
+        std::cerr << "The input and the output files are required"
+                  << std::endl << desc << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        const std::unique_ptr< zrenderer::TriangleStream > inputStream =
+                openInput( vm["input"].as< std::string >( ));
+        zrenderer::TriangleStream& input = *inputStream;
+        zrenderer::RBVHStreamBuilder builder( vm["threads"].as< size_t >( ));
+        builder.setMemoryBudget( vm["memory"].as< size_t >() * 1024 * 1024 );
+        builder.setPageSize( vm["page-size"].as< size_t >() * 1024 );
+        builder.getBuilder().setBinCount( vm["bins"].as< size_t >( ));
+        builder.getBuilder().setMaxLeafSize( vm["leaf-size"].as< size_t >( ));
+
+        std::cout << "Converting " << input.getTriangleCount()
+                  << " triangles with a memory budget of "
+                  << double( builder.getMemoryBudget( )) / MB << " MB, "
+                  << builder.getMaxPartitionSize()
+                  << " triangles per partition" << std::endl;
+
+        const zrenderer::RBVHStreamBuilder::Statistics statistics =
+                builder.build( input, vm["output"].as< std::string >( ));
+
+        const double inputSize = double( statistics.triangleCount ) *
+                                 sizeof( zrenderer::Triangle ) / MB;
+        std::cout << "  partitions      " << statistics.partitionCount
+                  << std::endl
+                  << "  pages           " << statistics.pageCount << std::endl
+                  << "  file size (MB)  " << double( statistics.fileSize ) / MB
+                  << std::endl
+                  << "  bounds (s)      " << statistics.boundsTime << std::endl
+                  << "  partition (s)   " << statistics.partitionTime
+                  << std::endl
+                  << "  build (s)       " << statistics.buildTime << std::endl
+                  << "  total (s)       " << statistics.totalTime << std::endl
+                  << "  triangles/s     " << getThroughput(
+                         double( statistics.triangleCount ),
+                         statistics.totalTime )
+                  << std::endl
+                  << "  input MB/s      " << getThroughput(
+                         inputSize, statistics.totalTime )
+                  << std::endl
+                  << "  peak RSS (MB)   " << getPeakMemory() << std::endl;
+    }
+    catch( const std::exception& error )
+    {
+        std::cerr << "Conversion failed: " << error.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
     return EXIT_SUCCESS;
 }
\ No newline at end of file
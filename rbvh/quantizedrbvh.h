@@ -0,0 +1,487 @@
+/* Copyright(c) ZombieRendering 2015 - 2016 serkan.ergun@gmail.com
+ *
+ * This file is part of Z-Renderer(https://github.com/ZombieRendering/Z-Renderer)
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met :
+ *
+ * -Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * -Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and / or other materials provided with the distribution.
+ * -Neither the name of Eyescale Software GmbH nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _quantizedrbvh_h_
+#define _quantizedrbvh_h_
+
+#include <rbvh/widerbvh.h>
+
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace zrenderer
+{
+
+/**
+ * Compressed node of a wide RBVH with up to Width children, 80 bytes for
+ * 8 children. The child bounds are 8 bit integers on a grid relative to
+ * the lower corner of the node, with a power of two cell size per axis.
+ * The inner children of a node are next to each other in the node array
+ * and its leaves are next to each other in the primitive array, so the
+ * node only stores where they start and the primitive counts.
+ */
+template< size_t Width >
+struct QuantizedRBVHNode
+{
+    typedef Eigen::Array< float, Width, 1 > Lanes;
+    typedef Eigen::Array< bool, Width, 1 > Mask;
+    typedef Eigen::Array< uint8_t, Width, 1 > Quantized;
+
+    /** Largest quantized coordinate */
+    static const uint8_t MAX_QUANTIZED = 255;
+
+    /** Smallest and largest exponent of the cell sizes */
+    static const int MIN_EXPONENT = -100;
+    static const int MAX_EXPONENT = 127;
+
+    /**
+     * @param axis is the axis
+     * @return the cell size of the grid on the axis
+     */
+    float getScale( const size_t axis ) const
+    {
+        // Normal power of two float made from its exponent bits
+        const uint32_t bits = uint32_t( exponents[ axis ] + 127 ) << 23;
+        float scale;
+        std::memcpy( &scale, &bits, sizeof( scale ));
+        return scale;
+    }
+
+    /**
+     * Decodes a coordinate of a child. The product is exact, so the result
+     * is rounded once and the decoding is the same with or without fused
+     * multiply adds.
+     * @param axis is the axis
+     * @param quantized is the quantized coordinate
+     * @return the coordinate
+     */
+    float decode( const size_t axis, const uint8_t quantized ) const
+    {
+        return origin[ axis ] + float( quantized ) * getScale( axis );
+    }
+
+    /**
+     * @param child is the child slot
+     * @return the decoded bounds of the child, which contain its exact
+     * bounds
+     */
+    AlignedBox3f getBounds( const size_t child ) const
+    {
+        AlignedBox3f bounds;
+        for( size_t axis = 0; axis < 3; ++axis )
+        {
+            bounds.min()[ axis ] = decode( axis, lower[ axis ][ child ]);
+            bounds.max()[ axis ] = decode( axis, upper[ axis ][ child ]);
+        }
+        return bounds;
+    }
+
+    /**
+     * Decodes the bounds of all children and tests them against a ray.
+     * The slots from the child count on are not children.
+     * @param rayOrigin is the origin of the ray
+     * @param inverse is the component wise inverse of the ray direction
+     * @param distance is the maximum distance along the ray
+     * @param entries are set to the distances where the ray enters the
+     * children
+     * @return the children hit within the distance
+     */
+    Mask intersect( const Vector3f& rayOrigin, const Vector3f& inverse,
+                    const float distance, Lanes& entries ) const
+    {
+        Lanes bounds[ 6 ];
+        for( size_t axis = 0; axis < 3; ++axis )
+        {
+            const float scale = getScale( axis );
+            bounds[ axis ] = Eigen::Map< const Quantized >( lower[ axis ])
+                             .template cast< float >() * scale +
+                             origin[ axis ];
+            bounds[ axis + 3 ] = Eigen::Map< const Quantized >( upper[ axis ])
+                                 .template cast< float >() * scale +
+                                 origin[ axis ];
+        }
+        return intersectRayLanes< Width >( bounds[ 0 ], bounds[ 1 ],
+                                           bounds[ 2 ], bounds[ 3 ],
+                                           bounds[ 4 ], bounds[ 5 ],
+                                           rayOrigin, inverse, distance,
+                                           entries );
+    }
+
+    /** @return true if the child is a leaf */
+    bool isLeaf( const size_t child ) const { return counts[ child ] > 0; }
+
+    // Lower corner of the grid
+    float origin[ 3 ];
+
+    // Exponents of the cell sizes of the grid
+    int8_t exponents[ 3 ];
+
+    // Number of used child slots, the first ones
+    uint8_t childCount;
+
+    // Index of the first inner child node
+    uint32_t childOffset;
+
+    // Index of the first primitive of the leaves
+    uint32_t primitiveOffset;
+
+    // Zero for the inner children, the number of primitives for the leaves
+    uint8_t counts[ Width ];
+
+    // Quantized bounds of the children per axis
+    uint8_t lower[ 3 ][ Width ];
+    uint8_t upper[ 3 ][ Width ];
+};
+
+static_assert( sizeof( QuantizedRBVHNode< 8 > ) == 80,
+               "Unexpected quantized RBVH node size" );
+
+/**
+ * Ray tracing bounding volume hierarchy with compressed wide nodes,
+ * encoded from a wide RBVH. The quantized child bounds are rounded
+ * outwards and checked against the exact bounds in float, so the decoded
+ * bounds always contain the exact ones and the traversal finds the same
+ * hits. The primitives are reordered so the leaves of each node are next
+ * to each other.
+ */
+template< size_t Width >
+class QuantizedRBVH
+{
+public:
+
+    typedef QuantizedRBVHNode< Width > Node;
+    typedef std::vector< Node > Nodes;
+    typedef RBVH::Primitives Primitives;
+    typedef RBVH::Hit Hit;
+
+    /** Largest number of primitives in a leaf */
+    static const size_t MAX_LEAF_SIZE = 255;
+
+    /**
+     * Creates an empty hierarchy
+     */
+    QuantizedRBVH() {}
+
+    /**
+     * Encodes a wide hierarchy.
+     * @param rbvh is the wide hierarchy
+     * @throw std::runtime_error if a leaf has more than MAX_LEAF_SIZE
+     * primitives
+     */
+    explicit QuantizedRBVH( const WideRBVH< Width >& rbvh )
+    {
+        typedef typename WideRBVH< Width >::Node WideNode;
+        const typename WideRBVH< Width >::Nodes& wideNodes = rbvh.getNodes();
+        if( wideNodes.empty( ))
+            return;
+
+        _nodes.reserve( wideNodes.size( ));
+        _primitives.reserve( rbvh.getPrimitives().size( ));
+        _nodes.resize( 1 );
+
+        // Breadth first, so the inner children of a node are allocated
+        // next to each other
+        std::vector< std::pair< uint32_t, uint32_t >> queue( 1, { 0, 0 });
+        for( size_t i = 0; i < queue.size(); ++i )
+        {
+            const WideNode& wideNode = wideNodes[ queue[ i ].first ];
+            const uint32_t index = queue[ i ].second;
+
+            size_t childCount = 0;
+            AlignedBox3f bounds;
+            while( childCount < Width &&
+                   wideNode.offsets[ childCount ] != WideNode::EMPTY )
+            {
+                bounds.extend( wideNode.getBounds( childCount++ ));
+            }
+
+            Node node;
+            std::memset( &node, 0, sizeof( node ));
+            node.childCount = uint8_t( childCount );
+            node.childOffset = uint32_t( _nodes.size( ));
+            node.primitiveOffset = uint32_t( _primitives.size( ));
+            _encodeBounds( wideNode, bounds, node );
+
+            for( size_t j = 0; j < childCount; ++j )
+            {
+                if( !wideNode.isLeaf( j ))
+                {
+                    queue.push_back({ wideNode.offsets[ j ],
+                                      uint32_t( _nodes.size( ))});
+                    _nodes.resize( _nodes.size() + 1 );
+                    continue;
+                }
+
+                const uint32_t count = wideNode.counts[ j ];
+                if( count > MAX_LEAF_SIZE )
+                    throw std::runtime_error( "Leaf of " +
+                                              std::to_string( count ) +
+                                              " primitives can not be "
+                                              "quantized" );
+                node.counts[ j ] = uint8_t( count );
+                const uint32_t offset = wideNode.offsets[ j ];
+                _primitives.insert( _primitives.end(),
+                                    rbvh.getPrimitives().begin() + offset,
+                                    rbvh.getPrimitives().begin() + offset +
+                                    count );
+            }
+            _nodes[ index ] = node;
+        }
+    }
+
+    /** @return the nodes, the first one is the root */
+    const Nodes& getNodes() const { return _nodes; }
+
+    /** @return the primitive indices, in the order of the leaves */
+    const Primitives& getPrimitives() const { return _primitives; }
+
+    /** @return the number of levels of the nodes */
+    size_t getDepth() const
+    {
+        if( _nodes.empty( ))
+            return 0;
+
+        size_t depth = 0;
+        std::vector< std::pair< uint32_t, size_t >> stack( 1, { 0, 1 });
+        while( !stack.empty( ))
+        {
+            const Node& node = _nodes[ stack.back().first ];
+            const size_t level = stack.back().second;
+            stack.pop_back();
+            depth = std::max( depth, level );
+            uint32_t child = node.childOffset;
+            for( size_t i = 0; i < node.childCount; ++i )
+            {
+                if( !node.isLeaf( i ))
+                    stack.push_back({ child++, level + 1 });
+            }
+        }
+        return depth;
+    }
+
+    /** @return the size of the nodes and the primitive indices in bytes */
+    size_t getMemorySize() const
+    {
+        return _nodes.size() * sizeof( Node ) +
+               _primitives.size() * sizeof( uint32_t );
+    }
+
+    /**
+     * Calls a function for the primitives in the leaves hit by a ray,
+     * the closer nodes first.
+     * @param origin is the origin of the ray
+     * @param direction is the direction of the ray
+     * @param distance is the maximum distance along the ray, which the
+     * function shortens when it hits a primitive
+     * @param intersectPrimitive is called with the primitive index and
+     * the distance
+     */
+    template< typename F >
+    void intersect( const Vector3f& origin,
+                    const Vector3f& direction,
+                    float& distance,
+                    F&& intersectPrimitive ) const
+    {
+        if( _nodes.empty( ))
+            return;
+
+        // Each level pushes the hit children but the nearest one
+        struct Entry
+        {
+            uint32_t offset;
+            uint32_t count;
+            float distance;
+        };
+        Entry stack[ Width * RBVH_MAX_DEPTH ];
+        stack[ 0 ] = Entry{ 0, 0, 0.0f };
+        size_t size = 1;
+
+        const Vector3f inverse = direction.cwiseInverse();
+        typename Node::Lanes entries;
+        Entry children[ Width ];
+        while( size > 0 )
+        {
+            const Entry current = stack[ --size ];
+            if( current.distance > distance )
+                continue;
+
+            if( current.count > 0 )
+            {
+                for( uint32_t i = current.offset;
+                     i < current.offset + current.count; ++i )
+                {
+                    intersectPrimitive( _primitives[ i ], distance );
+                }
+                continue;
+            }
+
+            const Node& node = _nodes[ current.offset ];
+            const typename Node::Mask hits = node.intersect( origin, inverse,
+                                                             distance,
+                                                             entries );
+
+            // The hit children sorted by their entries, the farthest first
+            uint32_t child = node.childOffset;
+            uint32_t primitive = node.primitiveOffset;
+            size_t nHits = 0;
+            for( size_t i = 0; i < node.childCount; ++i )
+            {
+                const Entry entry = node.isLeaf( i ) ?
+                        Entry{ primitive, node.counts[ i ], entries[ i ]} :
+                        Entry{ child, 0, entries[ i ]};
+                primitive += node.counts[ i ];
+                child += node.isLeaf( i ) ? 0 : 1;
+                if( !hits[ i ])
+                    continue;
+
+                size_t j = nHits++;
+                for( ; j > 0 && children[ j - 1 ].distance < entry.distance;
+                     --j )
+                {
+                    children[ j ] = children[ j - 1 ];
+                }
+                children[ j ] = entry;
+            }
+            for( size_t i = 0; i < nHits; ++i )
+                stack[ size++ ] = children[ i ];
+        }
+    }
+
+    /**
+     * Intersects a ray with the triangles of a mesh, which the hierarchy
+     * is built for.
+     * @param mesh is the mesh
+     * @param origin is the origin of the ray
+     * @param direction is the direction of the ray
+     * @param hit is set to the closest hit, the primitive is the index
+     * of the triangle
+     * @param maxDistance is the maximum distance in the length of the
+     * direction
+     * @return true if a triangle is hit
+     */
+    bool intersect( const Mesh& mesh,
+                    const Vector3f& origin,
+                    const Vector3f& direction,
+                    Hit& hit,
+                    float maxDistance =
+                        std::numeric_limits< float >::max( )) const
+    {
+        bool found = false;
+        intersect( origin, direction, maxDistance,
+                   [&]( const uint32_t triangle, float& distance )
+        {
+            if( mesh.intersect( triangle, origin, direction, distance ))
+            {
+                hit.distance = distance;
+                hit.primitive = triangle;
+                found = true;
+            }
+        });
+        return found;
+    }
+
+private:
+
+    // Quantizes the child bounds on a grid from the lower corner of the
+    // node, with the smallest power of two cell size that covers the node
+    // in MAX_QUANTIZED cells. The bounds are rounded outwards and moved
+    // further out until the decoded bounds contain the exact ones.
+    static void _encodeBounds( const typename WideRBVH< Width >::Node& wide,
+                               const AlignedBox3f& bounds, Node& node )
+    {
+        for( size_t axis = 0; axis < 3; ++axis )
+        {
+            node.origin[ axis ] = bounds.min()[ axis ];
+            const float extent = bounds.max()[ axis ] - bounds.min()[ axis ];
+            int exponent = Node::MIN_EXPONENT;
+            if( extent > 0.0f )
+                std::frexp( extent / float( Node::MAX_QUANTIZED ),
+                            &exponent );
+
+            exponent = std::max( exponent, int( Node::MIN_EXPONENT ));
+            for( ; ; ++exponent )
+            {
+                if( exponent > Node::MAX_EXPONENT )
+                    throw std::runtime_error( "Bounds can not be quantized" );
+
+                node.exponents[ axis ] = int8_t( exponent );
+                if( _quantize( wide, axis, node ))
+                    break;
+            }
+        }
+    }
+
+    // Quantizes the child bounds on an axis, false if they do not fit the
+    // grid
+    static bool _quantize( const typename WideRBVH< Width >::Node& wide,
+                           const size_t axis, Node& node )
+    {
+        const float scale = node.getScale( axis );
+        for( size_t i = 0; i < node.childCount; ++i )
+        {
+            const AlignedBox3f bounds = wide.getBounds( i );
+            const float lower = bounds.min()[ axis ];
+            const float upper = bounds.max()[ axis ];
+
+            // The lower corner of the grid is the smallest lower bound, so
+            // zero always contains it
+            float cell = std::floor(( lower - node.origin[ axis ]) / scale );
+            uint8_t quantized = uint8_t(
+                    std::min( std::max( cell, 0.0f ),
+                              float( Node::MAX_QUANTIZED )));
+            while( quantized > 0 && node.decode( axis, quantized ) > lower )
+                --quantized;
+            node.lower[ axis ][ i ] = quantized;
+
+            cell = std::ceil(( upper - node.origin[ axis ]) / scale );
+            if( !( cell <= float( Node::MAX_QUANTIZED )))
+                return false;
+            quantized = uint8_t( std::max( cell, 0.0f ));
+            while( node.decode( axis, quantized ) < upper )
+            {
+                if( quantized == Node::MAX_QUANTIZED )
+                    return false;
+                ++quantized;
+            }
+            node.upper[ axis ][ i ] = quantized;
+        }
+        return true;
+    }
+
+    Nodes _nodes;
+    Primitives _primitives;
+};
+
+typedef QuantizedRBVH< 4 > QuantizedRBVH4;
+typedef QuantizedRBVH< 8 > QuantizedRBVH8;
+
+}
+
+#endif // _quantizedrbvh_h_
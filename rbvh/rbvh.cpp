@@ -0,0 +1,111 @@
+/* Copyright(c) ZombieRendering 2015 - 2016 serkan.ergun@gmail.com
+ *
+ * This file is part of Z-Renderer(https://github.com/ZombieRendering/Z-Renderer)
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met :
+ *
+ * -Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * -Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and / or other materials provided with the distribution.
+ * -Neither the name of Eyescale Software GmbH nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <rbvh/rbvh.h>
+
+namespace zrenderer
+{
+
+AlignedBox3f RBVH::getBounds() const
+{
+    return _nodes.empty() ? AlignedBox3f() : _nodes[ 0 ].bounds;
+}
+
+size_t RBVH::getDepth() const
+{
+    if( _nodes.empty( ))
+        return 0;
+
+    size_t depth = 0;
+    std::vector< std::pair< uint32_t, size_t >> stack( 1, std::make_pair( 0, 1 ));
+    while( !stack.empty( ))
+    {
+        const std::pair< uint32_t, size_t > entry = stack.back();
+        stack.pop_back();
+        depth = std::max( depth, entry.second );
+
+        const RBVHNode& node = _nodes[ entry.first ];
+        if( node.isLeaf( ))
+            continue;
+        stack.push_back( std::make_pair( node.offset, entry.second + 1 ));
+        stack.push_back( std::make_pair( node.offset + 1, entry.second + 1 ));
+    }
+    return depth;
+}
+
+size_t RBVH::getMemorySize() const
+{
+    return _nodes.size() * sizeof( RBVHNode ) +
+           _primitives.size() * sizeof( uint32_t );
+}
+
+float RBVH::getSAHCost( const float traversalCost,
+                        const float intersectionCost ) const
+{
+    if( _nodes.empty( ))
+        return 0.0f;
+
+    const float rootArea = getArea( _nodes[ 0 ].bounds );
+    if( rootArea <= 0.0f )
+        return 0.0f;
+
+    double cost = 0.0;
+    for( const RBVHNode& node: _nodes )
+    {
+        const double area = getArea( node.bounds );
+        if( node.isLeaf( ))
+            cost += area * node.count * intersectionCost;
+        else
+            cost += area * traversalCost;
+    }
+    return float( cost / rootArea );
+}
+
+bool RBVH::intersect( const Mesh& mesh,
+                      const Vector3f& origin,
+                      const Vector3f& direction,
+                      Hit& hit,
+                      const float maxDistance ) const
+{
+    bool found = false;
+    float distance = maxDistance;
+    intersect( origin, direction, distance,
+               [&]( const uint32_t triangle, float& closest )
+    {
+        if( mesh.intersect( triangle, origin, direction, closest ))
+        {
+            found = true;
+            hit.distance = closest;
+            hit.primitive = triangle;
+        }
+    });
+    return found;
+}
+
+}
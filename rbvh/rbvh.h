@@ -0,0 +1,160 @@
+/* Copyright(c) ZombieRendering 2015 - 2016 serkan.ergun@gmail.com
+ *
+ * This file is part of Z-Renderer(https://github.com/ZombieRendering/Z-Renderer)
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met :
+ *
+ * -Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * -Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and / or other materials provided with the distribution.
+ * -Neither the name of Eyescale Software GmbH nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _rbvh_h_
+#define _rbvh_h_
+
+#include <rbvh/rbvhnode.h>
+#include <zrenderer/common/mesh.h>
+
+#include <limits>
+
+namespace zrenderer
+{
+
+/**
+ * Ray tracing bounding volume hierarchy over a set of primitives, built
+ * by the RBVHBuilder. The first node is the root and the primitive
+ * array maps the ranges of the leaves to the primitive indices.
+ */
+class RBVH
+{
+public:
+
+    typedef std::vector< uint32_t > Primitives;
+
+    /**
+     * Maximum depth of the hierarchy, the size of the traversal stack
+     */
+    static const size_t MAX_DEPTH = RBVH_MAX_DEPTH;
+
+    /**
+     * The closest hit of a ray
+     */
+    struct Hit
+    {
+        /** Distance in the length of the ray direction */
+        float distance;
+
+        /** Index of the hit primitive */
+        uint32_t primitive;
+    };
+
+    /**
+     * Creates an empty hierarchy
+     */
+    RBVH() {}
+
+    /**
+     * @param nodes are the nodes, the first one is the root
+     * @param primitives are the primitive indices of the leaves
+     */
+    RBVH( RBVHNodes&& nodes, Primitives&& primitives )
+        : _nodes( std::move( nodes ))
+        , _primitives( std::move( primitives ))
+    {}
+
+    /** @return the nodes, the first one is the root */
+    const RBVHNodes& getNodes() const { return _nodes; }
+
+    /** @return the primitive indices, in the order of the leaves */
+    const Primitives& getPrimitives() const { return _primitives; }
+
+    /** @return the bounds of all primitives, empty if there are none */
+    AlignedBox3f getBounds() const;
+
+    /** @return the number of levels of the hierarchy */
+    size_t getDepth() const;
+
+    /** @return the size of the nodes and the primitive indices in bytes */
+    size_t getMemorySize() const;
+
+    /**
+     * The surface area heuristic estimates the cost of tracing a random
+     * ray through the hierarchy, relative to the area of the root.
+     * @param traversalCost is the cost of visiting an inner node
+     * @param intersectionCost is the cost of intersecting a primitive
+     * @return the SAH cost of the hierarchy
+     */
+    float getSAHCost( float traversalCost = 1.0f,
+                      float intersectionCost = 1.0f ) const;
+
+    /**
+     * Calls a function for the primitives in the leaves hit by a ray,
+     * the closer nodes first.
+     * @param origin is the origin of the ray
+     * @param direction is the direction of the ray
+     * @param distance is the maximum distance along the ray, which the
+     * function shortens when it hits a primitive
+     * @param intersectPrimitive is called with the primitive index and
+     * the distance
+     */
+    template< typename F >
+    void intersect( const Vector3f& origin,
+                    const Vector3f& direction,
+                    float& distance,
+                    F&& intersectPrimitive ) const
+    {
+        if( _nodes.empty( ))
+            return;
+
+        intersectRBVHNodes( _nodes.data(), origin, direction, distance,
+                            [&]( const uint32_t i, float& primitiveDistance )
+                            { intersectPrimitive( _primitives[ i ],
+                                                  primitiveDistance ); });
+    }
+
+    /**
+     * Intersects a ray with the triangles of a mesh, which the hierarchy
+     * is built for.
+     * @param mesh is the mesh
+     * @param origin is the origin of the ray
+     * @param direction is the direction of the ray
+     * @param hit is set to the closest hit, the primitive is the index
+     * of the triangle
+     * @param maxDistance is the maximum distance in the length of the
+     * direction
+     * @return true if a triangle is hit
+     */
+    bool intersect( const Mesh& mesh,
+                    const Vector3f& origin,
+                    const Vector3f& direction,
+                    Hit& hit,
+                    float maxDistance =
+                        std::numeric_limits< float >::max( )) const;
+
+private:
+
+    RBVHNodes _nodes;
+    Primitives _primitives;
+};
+
+}
+
+#endif // _rbvh_h_
@@ -0,0 +1,535 @@
+/* Copyright(c) ZombieRendering 2015 - 2016 serkan.ergun@gmail.com
+ *
+ * This file is part of Z-Renderer(https://github.com/ZombieRendering/Z-Renderer)
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met :
+ *
+ * -Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * -Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and / or other materials provided with the distribution.
+ * -Neither the name of Eyescale Software GmbH nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <rbvh/rbvhbuilder.h>
+
+#include <zrenderer/common/workstealingpool.h>
+
+namespace zrenderer
+{
+
+namespace
+{
+// The smaller subtrees are built in the task of their parent
+const uint32_t SPAWN_SIZE = 4096;
+
+// The primitives of the larger nodes are binned in parallel chunks
+const uint32_t PARALLEL_BINNING_SIZE = 65536;
+const uint32_t CHUNK_SIZE = 16384;
+
+// The deeper nodes are split at the median, which bounds the depth
+const uint32_t MEDIAN_SPLIT_DEPTH = RBVH::MAX_DEPTH / 2;
+
+struct PrimitiveRef
+{
+    AlignedBox3f bounds;
+    uint32_t index;
+};
+
+Vector3f getCenter( const AlignedBox3f& bounds )
+{
+    return ( bounds.min() + bounds.max( )) * 0.5f;
+}
+
+// Range of the primitive references of a node
+struct Range
+{
+    uint32_t node;
+    uint32_t begin;
+    uint32_t end;
+    uint32_t depth;
+
+    // The bounds of the primitive centers
+    AlignedBox3f centers;
+};
+
+struct Bin
+{
+    void reset()
+    {
+        bounds.setEmpty();
+        centers.setEmpty();
+        count = 0;
+    }
+
+    void extend( const Bin& bin )
+    {
+        bounds.extend( bin.bounds );
+        centers.extend( bin.centers );
+        count += bin.count;
+    }
+
+    AlignedBox3f bounds;
+    AlignedBox3f centers;
+    uint32_t count;
+};
+
+struct Bins
+{
+    void reset( const size_t nBins )
+    {
+        for( size_t axis = 0; axis < 3; ++axis )
+            for( size_t i = 0; i < nBins; ++i )
+                bins[ axis ][ i ].reset();
+    }
+
+    void extend( const Bins& other, const size_t nBins )
+    {
+        for( size_t axis = 0; axis < 3; ++axis )
+            for( size_t i = 0; i < nBins; ++i )
+                bins[ axis ][ i ].extend( other.bins[ axis ][ i ] );
+    }
+
+    Bin bins[ 3 ][ RBVHBuilder::MAX_BIN_COUNT ];
+};
+
+// Maps the primitive centers of a node to the bins
+class Binning
+{
+public:
+
+    Binning( const AlignedBox3f& centers, const size_t nBins )
+        : _min( centers.min( ))
+        , _nBins( std::max< size_t >( nBins, 1 ))
+    {
+        const Vector3f sizes = centers.sizes();
+        for( int axis = 0; axis < 3; ++axis )
+        {
+            // Keeps the maximum center in the last bin
+            _scale[ axis ] = sizes[ axis ] > 0.0f ?
+                                 float( _nBins ) * 0.99999f / sizes[ axis ]
+                               : 0.0f;
+        }
+    }
+
+    bool canSplit( const int axis ) const { return _scale[ axis ] > 0.0f; }
+
+    size_t getBin( const Vector3f& center, const int axis ) const
+    {
+        const float bin = ( center[ axis ] - _min[ axis ] ) * _scale[ axis ];
+        return std::min( size_t( std::max( bin, 0.0f )), _nBins - 1 );
+    }
+
+    void bin( const PrimitiveRef* refs, const uint32_t begin,
+              const uint32_t end, Bins& bins ) const
+    {
+        for( uint32_t i = begin; i < end; ++i )
+        {
+            const Vector3f center = getCenter( refs[ i ].bounds );
+            for( int axis = 0; axis < 3; ++axis )
+            {
+                Bin& bin = bins.bins[ axis ][ getBin( center, axis ) ];
+                bin.bounds.extend( refs[ i ].bounds );
+                bin.centers.extend( center );
+                ++bin.count;
+            }
+        }
+    }
+
+    size_t getBinCount() const { return _nBins; }
+
+private:
+
+    Vector3f _min;
+    Vector3f _scale;
+    size_t _nBins;
+};
+
+struct Split
+{
+    Split()
+        : cost( std::numeric_limits< float >::max( ))
+        , axis( -1 )
+        , bin( 0 )
+    {}
+
+    float cost;
+    int axis;
+
+    // The primitives in the bins before this one are on the left side
+    size_t bin;
+
+    Bin left;
+    Bin right;
+};
+}
+
+struct RBVHBuilder::Impl
+{
+    struct ParallelBinning
+    {
+        ParallelBinning( const Range& range_, const size_t nBins,
+                         const size_t nChunks )
+            : range( range_ )
+            , binning( range_.centers, nBins )
+            , chunks( nChunks )
+            , remaining( nChunks )
+        {}
+
+        const Range range;
+        const Binning binning;
+        std::vector< Bins > chunks;
+        std::atomic< size_t > remaining;
+    };
+
+    Impl( const size_t nThreads )
+        : pool( nThreads )
+        , nBins( 16 )
+        , maxLeafSize( 8 )
+        , traversalCost( 1.0f )
+        , intersectionCost( 1.0f )
+        , refs( 0 )
+        , nodes( 0 )
+        , nodeCount( 0 )
+    {}
+
+    template< typename F >
+    RBVH build( const size_t nPrimitives, const F& getBounds )
+    {
+        if( nPrimitives == 0 )
+            return RBVH();
+
+        std::vector< PrimitiveRef > primitiveRefs( nPrimitives );
+        RBVHNodes rbvhNodes( 2 * nPrimitives - 1 );
+        refs = primitiveRefs.data();
+        nodes = rbvhNodes.data();
+
+        // The references and their bounds are set up in parallel chunks
+        const size_t nChunks = ( nPrimitives + CHUNK_SIZE - 1 ) / CHUNK_SIZE;
+        std::vector< AlignedBox3f > chunkBounds( nChunks );
+        std::vector< AlignedBox3f > chunkCenters( nChunks );
+        pool.run( [&]( const size_t worker )
+        {
+            for( size_t chunk = 0; chunk < nChunks; ++chunk )
+            {
+                pool.spawn( worker, [&, chunk]( size_t )
+                {
+                    const size_t end = std::min( nPrimitives,
+                                                 ( chunk + 1 ) * CHUNK_SIZE );
+                    for( size_t i = chunk * CHUNK_SIZE; i < end; ++i )
+                    {
+                        PrimitiveRef& ref = refs[ i ];
+                        ref.bounds = getBounds( i );
+                        ref.index = uint32_t( i );
+                        chunkBounds[ chunk ].extend( ref.bounds );
+                        chunkCenters[ chunk ].extend( getCenter( ref.bounds ));
+                    }
+                });
+            }
+        });
+
+        Range root = { 0, 0, uint32_t( nPrimitives ), 0, AlignedBox3f() };
+        for( size_t chunk = 0; chunk < nChunks; ++chunk )
+        {
+            nodes[ 0 ].bounds.extend( chunkBounds[ chunk ] );
+            root.centers.extend( chunkCenters[ chunk ] );
+        }
+
+        nodeCount = 1;
+        pool.run( [&]( const size_t worker ) { _build( worker, root ); });
+
+        rbvhNodes.resize( nodeCount );
+        RBVH::Primitives primitives( nPrimitives );
+        for( size_t i = 0; i < nPrimitives; ++i )
+            primitives[ i ] = refs[ i ].index;
+        refs = 0;
+        nodes = 0;
+        return RBVH( std::move( rbvhNodes ), std::move( primitives ));
+    }
+
+    void _build( const size_t worker, const Range& range )
+    {
+        std::vector< Range > stack( 1, range );
+        Bins bins;
+        Range children[ 2 ];
+        while( !stack.empty( ))
+        {
+            const Range current = stack.back();
+            stack.pop_back();
+
+            const uint32_t size = current.end - current.begin;
+            if( size >= PARALLEL_BINNING_SIZE && pool.getWorkerCount() > 1 &&
+                current.depth < MEDIAN_SPLIT_DEPTH )
+            {
+                _binParallel( worker, current );
+                continue;
+            }
+
+            const Binning binning( current.centers,
+                                   std::min< size_t >( nBins, size ));
+            bins.reset( binning.getBinCount( ));
+            if( size > 1 && current.depth < MEDIAN_SPLIT_DEPTH )
+                binning.bin( refs, current.begin, current.end, bins );
+
+            if( !_split( current, bins, binning, children ))
+                continue;
+
+            for( const Range& child: children )
+            {
+                if( child.end - child.begin >= SPAWN_SIZE &&
+                    pool.getWorkerCount() > 1 )
+                {
+                    pool.spawn( worker, [this, child]( const size_t thief )
+                                { _build( thief, child ); });
+                }
+                else
+                    stack.push_back( child );
+            }
+        }
+    }
+
+    void _binParallel( const size_t worker, const Range& range )
+    {
+        const size_t size = range.end - range.begin;
+        const size_t nChunks = std::max< size_t >(
+                                   2, std::min( pool.getWorkerCount() * 4,
+                                                size / CHUNK_SIZE ));
+        std::shared_ptr< ParallelBinning > binning =
+                std::make_shared< ParallelBinning >( range, nBins, nChunks );
+
+        for( size_t chunk = 0; chunk < nChunks; ++chunk )
+        {
+            pool.spawn( worker, [this, binning, chunk]( const size_t thief )
+            {
+                const Range& current = binning->range;
+                const size_t chunkSize = current.end - current.begin;
+                const uint32_t begin = current.begin +
+                        uint32_t( chunkSize * chunk / binning->chunks.size( ));
+                const uint32_t end = current.begin +
+                        uint32_t( chunkSize * ( chunk + 1 ) /
+                                  binning->chunks.size( ));
+
+                Bins& bins = binning->chunks[ chunk ];
+                bins.reset( nBins );
+                binning->binning.bin( refs, begin, end, bins );
+
+                // The last chunk splits the node
+                if( --binning->remaining > 0 )
+                    return;
+
+                for( size_t i = 1; i < binning->chunks.size(); ++i )
+                    binning->chunks[ 0 ].extend( binning->chunks[ i ], nBins );
+
+                Range children[ 2 ];
+                if( !_split( current, binning->chunks[ 0 ], binning->binning,
+                             children ))
+                {
+                    return;
+                }
+                for( const Range& child: children )
+                {
+                    pool.spawn( thief, [this, child]( const size_t builder )
+                                { _build( builder, child ); });
+                }
+            });
+        }
+    }
+
+    Split _findSplit( const Bins& bins, const Binning& binning,
+                      float parentArea ) const
+    {
+        if( parentArea <= 0.0f )
+            parentArea = 1.0f;
+
+        const size_t nNodeBins = binning.getBinCount();
+        Split split;
+        float rightAreas[ MAX_BIN_COUNT ];
+        uint32_t rightCounts[ MAX_BIN_COUNT ];
+        for( int axis = 0; axis < 3; ++axis )
+        {
+            if( !binning.canSplit( axis ))
+                continue;
+
+            // The costs of the right sides, from the last bin
+            const Bin* axisBins = bins.bins[ axis ];
+            AlignedBox3f right;
+            uint32_t rightCount = 0;
+            for( size_t i = nNodeBins - 1; i > 0; --i )
+            {
+                right.extend( axisBins[ i ].bounds );
+                rightCount += axisBins[ i ].count;
+                rightAreas[ i ] = getArea( right );
+                rightCounts[ i ] = rightCount;
+            }
+
+            AlignedBox3f left;
+            uint32_t leftCount = 0;
+            for( size_t i = 1; i < nNodeBins; ++i )
+            {
+                left.extend( axisBins[ i - 1 ].bounds );
+                leftCount += axisBins[ i - 1 ].count;
+                if( leftCount == 0 || rightCounts[ i ] == 0 )
+                    continue;
+
+                const float cost = traversalCost + intersectionCost *
+                        ( getArea( left ) * leftCount +
+                          rightAreas[ i ] * rightCounts[ i ] ) / parentArea;
+                if( cost < split.cost )
+                {
+                    split.cost = cost;
+                    split.axis = axis;
+                    split.bin = i;
+                }
+            }
+        }
+
+        if( split.axis < 0 )
+            return split;
+
+        split.left.reset();
+        split.right.reset();
+        const Bin* axisBins = bins.bins[ split.axis ];
+        for( size_t i = 0; i < nNodeBins; ++i )
+            ( i < split.bin ? split.left : split.right ).extend( axisBins[ i ] );
+        return split;
+    }
+
+    bool _split( const Range& range, const Bins& bins, const Binning& binning,
+                 Range* children )
+    {
+        RBVHNode& node = nodes[ range.node ];
+        const uint32_t size = range.end - range.begin;
+
+        Split split;
+        if( size > 1 && range.depth < MEDIAN_SPLIT_DEPTH )
+            split = _findSplit( bins, binning, getArea( node.bounds ));
+
+        const float leafCost = intersectionCost * float( size );
+        if( size <= 1 || ( size <= maxLeafSize &&
+                           ( split.axis < 0 || split.cost >= leafCost )))
+        {
+            node.offset = range.begin;
+            node.count = size;
+            return false;
+        }
+
+        PrimitiveRef* begin = refs + range.begin;
+        PrimitiveRef* end = refs + range.end;
+        uint32_t middle;
+        if( split.axis >= 0 )
+        {
+            middle = uint32_t( std::partition( begin, end,
+                                   [&]( const PrimitiveRef& ref )
+            {
+                return binning.getBin( getCenter( ref.bounds ), split.axis ) <
+                       split.bin;
+            }) - refs );
+        }
+        else
+        {
+            // Without a binned split, e.g. for equal centers or deep
+            // nodes, the primitives are split at the median
+            Vector3f::Index axis;
+            range.centers.sizes().maxCoeff( &axis );
+            middle = range.begin + size / 2;
+            std::nth_element( begin, refs + middle, end,
+                              [axis]( const PrimitiveRef& a,
+                                      const PrimitiveRef& b )
+            {
+                return getCenter( a.bounds )[ axis ] <
+                       getCenter( b.bounds )[ axis ];
+            });
+
+            split.left.reset();
+            split.right.reset();
+            for( uint32_t i = range.begin; i < range.end; ++i )
+            {
+                Bin& side = i < middle ? split.left : split.right;
+                side.bounds.extend( refs[ i ].bounds );
+                side.centers.extend( getCenter( refs[ i ].bounds ));
+            }
+        }
+
+        const uint32_t first = nodeCount.fetch_add( 2 );
+        node.offset = first;
+        node.count = 0;
+        nodes[ first ].bounds = split.left.bounds;
+        nodes[ first + 1 ].bounds = split.right.bounds;
+        children[ 0 ] = Range{ first, range.begin, middle, range.depth + 1,
+                               split.left.centers };
+        children[ 1 ] = Range{ first + 1, middle, range.end, range.depth + 1,
+                               split.right.centers };
+        return true;
+    }
+
+    WorkStealingPool pool;
+    size_t nBins;
+    size_t maxLeafSize;
+    float traversalCost;
+    float intersectionCost;
+
+    // The state of the current build
+    PrimitiveRef* refs;
+    RBVHNode* nodes;
+    std::atomic< uint32_t > nodeCount;
+};
+
+RBVHBuilder::RBVHBuilder( const size_t nThreads )
+    : _impl( new RBVHBuilder::Impl( nThreads ))
+{}
+
+RBVHBuilder::~RBVHBuilder()
+{}
+
+void RBVHBuilder::setBinCount( const size_t nBins )
+{
+    _impl->nBins = std::min( std::max< size_t >( nBins, 2 ),
+                             size_t( MAX_BIN_COUNT ));
+}
+
+void RBVHBuilder::setMaxLeafSize( const size_t maxLeafSize )
+{
+    _impl->maxLeafSize = std::max< size_t >( maxLeafSize, 1 );
+}
+
+void RBVHBuilder::setCosts( const float traversalCost,
+                            const float intersectionCost )
+{
+    _impl->traversalCost = traversalCost;
+    _impl->intersectionCost = intersectionCost;
+}
+
+size_t RBVHBuilder::getThreadCount() const
+{
+    return _impl->pool.getWorkerCount();
+}
+
+RBVH RBVHBuilder::build( const AlignedBox3fs& bounds )
+{
+    return _impl->build( bounds.size(), [&]( const size_t i )
+                         { return bounds[ i ]; });
+}
+
+RBVH RBVHBuilder::build( const Mesh& mesh )
+{
+    return _impl->build( mesh.getTriangleCount(), [&]( const size_t i )
+                         { return mesh.getTriangleBounds( i ); });
+}
+
+}
@@ -0,0 +1,112 @@
+/* Copyright(c) ZombieRendering 2015 - 2016 serkan.ergun@gmail.com
+ *
+ * This file is part of Z-Renderer(https://github.com/ZombieRendering/Z-Renderer)
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met :
+ *
+ * -Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * -Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and / or other materials provided with the distribution.
+ * -Neither the name of Eyescale Software GmbH nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _rbvhbuilder_h_
+#define _rbvhbuilder_h_
+
+#include <rbvh/rbvh.h>
+
+namespace zrenderer
+{
+
+/**
+ * Builds RBVHs with the binned surface area heuristic. The primitives
+ * of a node are binned by their centers along the three axes and the
+ * node is split at the bin boundary with the lowest SAH cost, or made a
+ * leaf if that is cheaper. The large subtrees are built in parallel on
+ * a work stealing pool, and the primitives of the large nodes at the
+ * top, where there are few subtrees, are binned in parallel chunks.
+ * The builder is not thread safe.
+ */
+class RBVHBuilder
+{
+public:
+
+    /**
+     * Maximum number of bins per axis
+     */
+    static const size_t MAX_BIN_COUNT = 64;
+
+    /**
+     * @param nThreads is the number of build threads, including the
+     * calling thread. If it is 0, the number of hardware threads is used.
+     */
+    explicit RBVHBuilder( size_t nThreads = 0 );
+    ~RBVHBuilder();
+
+    /**
+     * @param nBins is the number of bins per axis, 16 by default,
+     * clamped to [2, MAX_BIN_COUNT]
+     */
+    void setBinCount( size_t nBins );
+
+    /**
+     * @param maxLeafSize is the maximum number of primitives in a leaf,
+     * 8 by default
+     */
+    void setMaxLeafSize( size_t maxLeafSize );
+
+    /**
+     * Sets the costs of the surface area heuristic, 1 by default.
+     * @param traversalCost is the cost of visiting an inner node
+     * @param intersectionCost is the cost of intersecting a primitive
+     */
+    void setCosts( float traversalCost, float intersectionCost );
+
+    /**
+     * @return the number of build threads
+     */
+    size_t getThreadCount() const;
+
+    /**
+     * Builds the hierarchy of a set of boxes.
+     * @param bounds are the boxes of the primitives
+     * @return the hierarchy
+     */
+    RBVH build( const AlignedBox3fs& bounds );
+
+    /**
+     * Builds the hierarchy of the triangles of a mesh.
+     * @param mesh is the mesh
+     * @return the hierarchy, the primitives are the triangle indices
+     */
+    RBVH build( const Mesh& mesh );
+
+private:
+
+    RBVHBuilder( const RBVHBuilder& ) = delete;
+    RBVHBuilder& operator=( const RBVHBuilder& ) = delete;
+
+    struct Impl;
+    std::unique_ptr<Impl> _impl;
+};
+
+}
+
+#endif // _rbvhbuilder_h_
@@ -0,0 +1,624 @@
+/* Copyright(c) ZombieRendering 2015 - 2016 serkan.ergun@gmail.com
+ *
+ * This file is part of Z-Renderer(https://github.com/ZombieRendering/Z-Renderer)
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met :
+ *
+ * -Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * -Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and / or other materials provided with the distribution.
+ * -Neither the name of Eyescale Software GmbH nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <rbvh/rbvhfile.h>
+
+#include <zrenderer/common/mappedfile.h>
+
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace zrenderer
+{
+
+namespace
+{
+const char MAGIC[ 8 ] = { 'Z', 'R', 'B', 'V', 'H', 0, 0, 0 };
+
+struct FileHeader
+{
+    char magic[ 8 ];
+    uint32_t version;
+    uint32_t pageCount;
+    uint64_t triangleCount;
+    uint32_t topNodeCount;
+    uint32_t pageSize;
+    uint64_t topNodesOffset;
+    uint64_t pagesOffset;
+    float bounds[ 6 ];
+};
+
+// The page has the nodes, the triangles and the ids from its offset
+struct FilePage
+{
+    uint64_t offset;
+    uint32_t nodeCount;
+    uint32_t triangleCount;
+    float bounds[ 6 ];
+};
+
+static_assert( sizeof( FileHeader ) == 72, "Unexpected file header size" );
+static_assert( sizeof( FilePage ) == 40, "Unexpected file page size" );
+
+uint64_t align( const uint64_t offset, const uint64_t alignment )
+{
+    return ( offset + alignment - 1 ) & ~( alignment - 1 );
+}
+
+uint64_t getIdsOffset( const uint64_t nodeCount, const uint64_t triangleCount )
+{
+    return align( nodeCount * sizeof( RBVHNode ) +
+                  triangleCount * sizeof( Triangle ), sizeof( uint64_t ));
+}
+
+uint64_t getPageDataSize( const uint64_t nodeCount,
+                          const uint64_t triangleCount )
+{
+    return getIdsOffset( nodeCount, triangleCount ) +
+           triangleCount * sizeof( uint64_t );
+}
+
+// The range check does not overflow for corrupt offsets
+bool isInRange( const uint64_t offset, const uint64_t size,
+                const uint64_t rangeSize )
+{
+    return offset <= rangeSize && size <= rangeSize - offset;
+}
+
+// Checks that the nodes are a tree from the first one, no deeper than
+// RBVH_MAX_DEPTH, with the children and the leaf ranges in the arrays
+bool isValidHierarchy( const RBVHNode* nodes, const uint64_t nodeCount,
+                       const uint64_t primitiveCount )
+{
+    if( nodeCount == 0 )
+        return false;
+
+    std::vector< bool > visited( nodeCount, false );
+    std::vector< std::pair< uint32_t, size_t >> stack( 1, { 0, 1 });
+    while( !stack.empty( ))
+    {
+        const uint32_t index = stack.back().first;
+        const size_t level = stack.back().second;
+        stack.pop_back();
+        if( visited[ index ] || level > RBVH_MAX_DEPTH )
+            return false;
+        visited[ index ] = true;
+
+        const RBVHNode& node = nodes[ index ];
+        if( node.isLeaf( ))
+        {
+            if( !isInRange( node.offset, node.count, primitiveCount ))
+                return false;
+            continue;
+        }
+
+        if( !isInRange( node.offset, 2, nodeCount ))
+            return false;
+        stack.push_back({ node.offset, level + 1 });
+        stack.push_back({ node.offset + 1, level + 1 });
+    }
+    return true;
+}
+
+void writeBounds( float* values, const AlignedBox3f& bounds )
+{
+    std::memcpy( values, bounds.min().data(), 3 * sizeof( float ));
+    std::memcpy( values + 3, bounds.max().data(), 3 * sizeof( float ));
+}
+
+AlignedBox3f readBounds( const float* values )
+{
+    return AlignedBox3f( Vector3f( values[ 0 ], values[ 1 ], values[ 2 ]),
+                         Vector3f( values[ 3 ], values[ 4 ], values[ 5 ]));
+}
+
+void writeAt( std::ofstream& file, const uint64_t offset,
+              const void* data, const size_t size )
+{
+    file.seekp( std::streamoff( offset ));
+    file.write( static_cast< const char* >( data ), std::streamsize( size ));
+}
+
+// Copies the subtree of a source node to a destination node, keeping the
+// children next to each other. The leaves are set by the function, which
+// may copy another hierarchy below them.
+template< typename F >
+void copyNodes( const RBVHNode* source, const uint32_t sourceRoot,
+                RBVHNodes& destination, const uint32_t root, const F& setLeaf )
+{
+    std::vector< std::pair< uint32_t, uint32_t >> stack( 1, { sourceRoot,
+                                                               root });
+    while( !stack.empty( ))
+    {
+        const uint32_t from = stack.back().first;
+        const uint32_t to = stack.back().second;
+        stack.pop_back();
+
+        const RBVHNode& node = source[ from ];
+        if( node.isLeaf( ))
+        {
+            setLeaf( node, to );
+            continue;
+        }
+
+        const uint32_t first = uint32_t( destination.size( ));
+        destination.resize( first + 2 );
+        destination[ to ] = RBVHNode{ node.bounds, first, 0 };
+        for( uint32_t i = 0; i < 2; ++i )
+        {
+            destination[ first + i ].bounds = source[ node.offset + i ].bounds;
+            stack.push_back({ node.offset + i, first + i });
+        }
+    }
+}
+
+size_t getDepth( const RBVHNodes& nodes )
+{
+    if( nodes.empty( ))
+        return 0;
+
+    std::vector< std::pair< uint32_t, size_t >> stack( 1, { 0, 1 });
+    size_t depth = 0;
+    while( !stack.empty( ))
+    {
+        const RBVHNode& node = nodes[ stack.back().first ];
+        const size_t level = stack.back().second;
+        stack.pop_back();
+        depth = std::max( depth, level );
+        if( !node.isLeaf( ))
+        {
+            stack.push_back({ node.offset, level + 1 });
+            stack.push_back({ node.offset + 1, level + 1 });
+        }
+    }
+    return depth;
+}
+}
+
+struct RBVHFile::Writer::Impl
+{
+    Impl( const std::string& fileName_, const size_t pageSize_ )
+        : fileName( fileName_ )
+        , file( fileName_.c_str(), std::ios::binary | std::ios::trunc )
+        , pageSize( std::max( pageSize_, size_t( MIN_PAGE_SIZE )))
+        , nTriangles( 0 )
+        , end( align( sizeof( FileHeader ), PAGE_ALIGNMENT ))
+    {
+        if( !file )
+            throw std::runtime_error( "Can not create " + fileName );
+    }
+
+    // Writes the treelet of a node as a page and makes the node a leaf
+    // referring to it
+    RBVHNode writePage( const RBVH& rbvh, const uint32_t root,
+                        const Triangles& triangles, const TriangleIds& ids )
+    {
+        const RBVHNodes& nodes = rbvh.getNodes();
+        const RBVH::Primitives& primitives = rbvh.getPrimitives();
+        pageNodes.assign( 1, nodes[ root ]);
+        pageTriangles.clear();
+        pageIds.clear();
+        copyNodes( nodes.data(), root, pageNodes, 0,
+                   [&]( const RBVHNode& leaf, const uint32_t to )
+        {
+            pageNodes[ to ] = RBVHNode{ leaf.bounds,
+                                        uint32_t( pageTriangles.size( )),
+                                        leaf.count };
+            for( uint32_t i = leaf.offset; i < leaf.offset + leaf.count; ++i )
+            {
+                pageTriangles.push_back( triangles[ primitives[ i ]]);
+                pageIds.push_back( ids[ primitives[ i ]]);
+            }
+        });
+
+        FilePage page;
+        page.offset = end;
+        page.nodeCount = uint32_t( pageNodes.size( ));
+        page.triangleCount = uint32_t( pageTriangles.size( ));
+        writeBounds( page.bounds, nodes[ root ].bounds );
+
+        writeAt( file, page.offset, pageNodes.data(),
+                 pageNodes.size() * sizeof( RBVHNode ));
+        writeAt( file, page.offset + pageNodes.size() * sizeof( RBVHNode ),
+                 pageTriangles.data(),
+                 pageTriangles.size() * sizeof( Triangle ));
+        writeAt( file, page.offset + getIdsOffset( page.nodeCount,
+                                                   page.triangleCount ),
+                 pageIds.data(), pageIds.size() * sizeof( uint64_t ));
+        if( !file )
+            throw std::runtime_error( "Can not write " + fileName );
+
+        end = align( page.offset + getPageDataSize( page.nodeCount,
+                                                    page.triangleCount ),
+                     PAGE_ALIGNMENT );
+        pages.push_back( page );
+        return RBVHNode{ nodes[ root ].bounds, uint32_t( pages.size() - 1 ),
+                         1 };
+    }
+
+    const std::string fileName;
+    std::ofstream file;
+    const size_t pageSize;
+    std::vector< FilePage > pages;
+
+    // The nodes of the partitions above their treelets, whose leaves
+    // refer to the pages
+    std::vector< RBVHNodes > partitions;
+    AlignedBox3fs partitionBounds;
+
+    AlignedBox3f bounds;
+    uint64_t nTriangles;
+    uint64_t end;
+
+    // The page being written
+    RBVHNodes pageNodes;
+    Triangles pageTriangles;
+    TriangleIds pageIds;
+};
+
+RBVHFile::Writer::Writer( const std::string& fileName, const size_t pageSize )
+    : _impl( new RBVHFile::Writer::Impl( fileName, pageSize ))
+{}
+
+RBVHFile::Writer::~Writer()
+{}
+
+void RBVHFile::Writer::addPartition( const RBVH& rbvh,
+                                     const Triangles& triangles,
+                                     const TriangleIds& ids )
+{
+    const RBVHNodes& nodes = rbvh.getNodes();
+    if( nodes.empty() || rbvh.getPrimitives().size() != triangles.size() ||
+        ids.size() != triangles.size( ))
+    {
+        throw std::runtime_error( "Invalid partition for " + _impl->fileName );
+    }
+
+    // The sizes of the subtrees, the children are after their parents
+    std::vector< uint32_t > nodeCounts( nodes.size( ));
+    std::vector< uint32_t > triangleCounts( nodes.size( ));
+    for( size_t i = nodes.size(); i-- > 0; )
+    {
+        const RBVHNode& node = nodes[ i ];
+        if( node.isLeaf( ))
+        {
+            nodeCounts[ i ] = 1;
+            triangleCounts[ i ] = node.count;
+            continue;
+        }
+        nodeCounts[ i ] = 1 + nodeCounts[ node.offset ] +
+                          nodeCounts[ node.offset + 1 ];
+        triangleCounts[ i ] = triangleCounts[ node.offset ] +
+                              triangleCounts[ node.offset + 1 ];
+    }
+
+    // The largest subtrees fitting into a page are the treelets, a leaf
+    // is a treelet even if it does not fit
+    RBVHNodes upperNodes( 1, nodes[ 0 ]);
+
+    std::vector< std::pair< uint32_t, uint32_t >> stack( 1, { 0, 0 });
+    while( !stack.empty( ))
+    {
+        const uint32_t from = stack.back().first;
+        const uint32_t to = stack.back().second;
+        stack.pop_back();
+
+        const RBVHNode& node = nodes[ from ];
+        if( node.isLeaf() || getPageDataSize( nodeCounts[ from ],
+                                              triangleCounts[ from ]) <=
+                             _impl->pageSize )
+        {
+            upperNodes[ to ] = _impl->writePage( rbvh, from, triangles, ids );
+            continue;
+        }
+
+        const uint32_t first = uint32_t( upperNodes.size( ));
+        upperNodes.resize( first + 2 );
+        upperNodes[ to ] = RBVHNode{ node.bounds, first, 0 };
+        stack.push_back({ node.offset, first });
+        stack.push_back({ node.offset + 1, first + 1 });
+    }
+
+    _impl->nTriangles += triangles.size();
+    _impl->bounds.extend( nodes[ 0 ].bounds );
+    _impl->partitions.push_back( std::move( upperNodes ));
+    _impl->partitionBounds.push_back( nodes[ 0 ].bounds );
+}
+
+const AlignedBox3fs& RBVHFile::Writer::getPartitionBounds() const
+{
+    return _impl->partitionBounds;
+}
+
+size_t RBVHFile::Writer::getPageCount() const
+{
+    return _impl->pages.size();
+}
+
+uint64_t RBVHFile::Writer::close( const RBVH& top )
+{
+    const RBVHNodes& partitionNodes = top.getNodes();
+    const RBVH::Primitives& primitives = top.getPrimitives();
+    if( primitives.size() != _impl->partitions.size( ))
+        throw std::runtime_error( "Invalid top level for " + _impl->fileName );
+
+    // The partitions replace the leaves of their hierarchy
+    RBVHNodes topNodes;
+    if( !partitionNodes.empty( ))
+    {
+        topNodes.push_back( partitionNodes[ 0 ]);
+        copyNodes( partitionNodes.data(), 0, topNodes, 0,
+                   [&]( const RBVHNode& leaf, const uint32_t to )
+        {
+            if( leaf.count != 1 )
+                throw std::runtime_error( "Invalid top level for " +
+                                          _impl->fileName );
+
+            const RBVHNodes& upperNodes =
+                    _impl->partitions[ primitives[ leaf.offset ]];
+            topNodes[ to ] = upperNodes[ 0 ];
+            copyNodes( upperNodes.data(), 0, topNodes, to,
+                       [&]( const RBVHNode& pageLeaf, const uint32_t pageTo )
+                       { topNodes[ pageTo ] = pageLeaf; });
+        });
+    }
+    if( getDepth( topNodes ) > RBVH_MAX_DEPTH )
+        throw std::runtime_error( "Too deep top level for " +
+                                  _impl->fileName );
+
+    const std::vector< FilePage >& pages = _impl->pages;
+    FileHeader header;
+    std::memcpy( header.magic, MAGIC, sizeof( MAGIC ));
+    header.version = VERSION;
+    header.pageCount = uint32_t( pages.size( ));
+    header.triangleCount = _impl->nTriangles;
+    header.topNodeCount = uint32_t( topNodes.size( ));
+    header.pageSize = uint32_t( _impl->pageSize );
+    header.topNodesOffset = _impl->end;
+    header.pagesOffset = align( header.topNodesOffset +
+                                topNodes.size() * sizeof( RBVHNode ),
+                                sizeof( uint64_t ));
+    writeBounds( header.bounds, _impl->bounds );
+
+    std::ofstream& file = _impl->file;
+    writeAt( file, header.topNodesOffset, topNodes.data(),
+             topNodes.size() * sizeof( RBVHNode ));
+    writeAt( file, header.pagesOffset, pages.data(),
+             pages.size() * sizeof( FilePage ));
+    writeAt( file, 0, &header, sizeof( header ));
+    file.close();
+    if( !file )
+        throw std::runtime_error( "Can not write " + _impl->fileName );
+
+    return header.pagesOffset + pages.size() * sizeof( FilePage );
+}
+
+struct RBVHFile::Impl
+{
+    Impl( const std::string& fileName )
+        : _file( std::make_shared< MappedFile >( fileName ))
+    {
+        const uint8_t* data = _file->getData();
+        const size_t size = _file->getSize();
+        if( size < sizeof( FileHeader ))
+            throw std::runtime_error( "Invalid RBVH file " + fileName );
+
+        std::memcpy( &_header, data, sizeof( FileHeader ));
+        if( std::memcmp( _header.magic, MAGIC, sizeof( MAGIC )) != 0 )
+            throw std::runtime_error( "Invalid RBVH file " + fileName );
+        if( _header.version != VERSION )
+            throw std::runtime_error( "Unsupported RBVH file version in " +
+                                      fileName );
+
+        // The sections of an empty file are past its end
+        if(( _header.topNodeCount > 0 &&
+             !isInRange( _header.topNodesOffset,
+                         uint64_t( _header.topNodeCount ) * sizeof( RBVHNode ),
+                         size )) ||
+           ( _header.pageCount > 0 &&
+             !isInRange( _header.pagesOffset,
+                         uint64_t( _header.pageCount ) * sizeof( FilePage ),
+                         size )) ||
+           _header.topNodesOffset % sizeof( uint64_t ) != 0 ||
+           _header.pagesOffset % sizeof( uint64_t ) != 0 ||
+           ( _header.topNodeCount == 0 ) != ( _header.pageCount == 0 ))
+        {
+            throw std::runtime_error( "Invalid RBVH file " + fileName );
+        }
+
+        // The index stays in the memory, the mapped pages of the
+        // sections are released
+        const RBVHNode* topNodes = reinterpret_cast< const RBVHNode* >(
+                                       data + _header.topNodesOffset );
+        const FilePage* pages = reinterpret_cast< const FilePage* >(
+                                    data + _header.pagesOffset );
+        _topNodes.assign( topNodes, topNodes + _header.topNodeCount );
+        _pages.assign( pages, pages + _header.pageCount );
+        _file->dontNeed( 0, sizeof( FileHeader ));
+        if( _header.topNodesOffset < size )
+            _file->dontNeed( _header.topNodesOffset,
+                             size - _header.topNodesOffset );
+
+        for( const FilePage& page: _pages )
+        {
+            if( page.offset % PAGE_ALIGNMENT != 0 ||
+                !isInRange( page.offset, getPageDataSize( page.nodeCount,
+                                                          page.triangleCount ),
+                            size ))
+            {
+                throw std::runtime_error( "Invalid RBVH file " + fileName );
+            }
+        }
+        if( !_topNodes.empty() &&
+            !isValidHierarchy( _topNodes.data(), _topNodes.size(),
+                               _pages.size( )))
+        {
+            throw std::runtime_error( "Invalid RBVH file " + fileName );
+        }
+
+        // The pages are validated when they are read the first time
+        _validPages.reset( new std::atomic< bool >[ _pages.size() ]);
+        for( size_t i = 0; i < _pages.size(); ++i )
+            _validPages[ i ] = false;
+    }
+
+    RBVHFile::Page getPage( const size_t index ) const
+    {
+        if( index >= _pages.size( ))
+            throw std::out_of_range( "Invalid RBVH page index" );
+
+        const FilePage& filePage = _pages[ index ];
+        const uint8_t* data = _file->getData() + filePage.offset;
+        RBVHFile::Page page;
+        page.nodes = reinterpret_cast< const RBVHNode* >( data );
+        page.nodeCount = filePage.nodeCount;
+        page.triangles = reinterpret_cast< const Triangle* >(
+                             data + filePage.nodeCount * sizeof( RBVHNode ));
+        page.ids = reinterpret_cast< const uint64_t* >(
+                       data + getIdsOffset( filePage.nodeCount,
+                                            filePage.triangleCount ));
+        page.triangleCount = filePage.triangleCount;
+        page.bounds = readBounds( filePage.bounds );
+        page.offset = filePage.offset;
+        page.size = getPageDataSize( filePage.nodeCount,
+                                     filePage.triangleCount );
+
+        // Concurrent first reads validate the page more than once
+        if( !_validPages[ index ] )
+        {
+            if( !isValidHierarchy( page.nodes, page.nodeCount,
+                                   page.triangleCount ))
+            {
+                throw std::runtime_error( "Invalid RBVH page " +
+                                          std::to_string( index ));
+            }
+            _validPages[ index ] = true;
+        }
+        return page;
+    }
+
+    const MappedFilePtr _file;
+    FileHeader _header;
+    RBVHNodes _topNodes;
+    std::vector< FilePage > _pages;
+    std::unique_ptr< std::atomic< bool >[] > _validPages;
+};
+
+RBVHFile::RBVHFile( const std::string& fileName )
+    : _impl( new RBVHFile::Impl( fileName ))
+{}
+
+RBVHFile::~RBVHFile()
+{}
+
+const MappedFilePtr& RBVHFile::getMappedFile() const
+{
+    return _impl->_file;
+}
+
+uint64_t RBVHFile::getTriangleCount() const
+{
+    return _impl->_header.triangleCount;
+}
+
+AlignedBox3f RBVHFile::getBounds() const
+{
+    if( _impl->_pages.empty( ))
+        return AlignedBox3f();
+    return readBounds( _impl->_header.bounds );
+}
+
+size_t RBVHFile::getPageSize() const
+{
+    return _impl->_header.pageSize;
+}
+
+size_t RBVHFile::getTopNodeCount() const
+{
+    return _impl->_topNodes.size();
+}
+
+const RBVHNode* RBVHFile::getTopNodes() const
+{
+    return _impl->_topNodes.data();
+}
+
+size_t RBVHFile::getPageCount() const
+{
+    return _impl->_pages.size();
+}
+
+RBVHFile::Page RBVHFile::getPage( const size_t index ) const
+{
+    return _impl->getPage( index );
+}
+
+bool RBVHFile::intersect( const Vector3f& origin,
+                          const Vector3f& direction,
+                          Hit& hit,
+                          float maxDistance ) const
+{
+    if( getTopNodeCount() == 0 )
+        return false;
+
+    bool found = false;
+    intersectRBVHNodes( getTopNodes(), origin, direction, maxDistance,
+                        [&]( const uint32_t index, float& distance )
+    {
+        if( _intersect( getPage( index ), origin, direction, distance, hit ))
+            found = true;
+    });
+    return found;
+}
+
+bool RBVHFile::_intersect( const Page& page, const Vector3f& origin,
+                           const Vector3f& direction, float& distance,
+                           Hit& hit ) const
+{
+    bool found = false;
+    intersectRBVHNodes( page.nodes, origin, direction, distance,
+                        [&]( const uint32_t i, float& triangleDistance )
+    {
+        const Triangle& triangle = page.triangles[ i ];
+        if( intersectRayTriangle( triangle.vertices[ 0 ],
+                                  triangle.vertices[ 1 ],
+                                  triangle.vertices[ 2 ],
+                                  origin, direction, triangleDistance ))
+        {
+            hit.distance = triangleDistance;
+            hit.triangle = page.ids[ i ];
+            found = true;
+        }
+    });
+    return found;
+}
+
+}
@@ -0,0 +1,274 @@
+/* Copyright(c) ZombieRendering 2015 - 2016 serkan.ergun@gmail.com
+ *
+ * This file is part of Z-Renderer(https://github.com/ZombieRendering/Z-Renderer)
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met :
+ *
+ * -Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * -Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and / or other materials provided with the distribution.
+ * -Neither the name of Eyescale Software GmbH nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _rbvhfile_h_
+#define _rbvhfile_h_
+
+#include <rbvh/rbvh.h>
+#include <rbvh/trianglestream.h>
+
+namespace zrenderer
+{
+
+/**
+ * Paged RBVH file, which is mapped into the memory. The hierarchy is cut
+ * into treelets, subtrees which fit into a fixed page size, and each
+ * page holds the nodes of a treelet and its triangles in the order of
+ * the leaves. The nodes above the treelets are the top level index,
+ * whose leaves refer to one page each. The index is copied into the
+ * memory, and the pages are aligned to the memory pages, so they are
+ * read and released independently, i.e. as RBVHPage objects of a Cache.
+ */
+class RBVHFile
+{
+public:
+
+    static const uint32_t VERSION = 2;
+
+    /**
+     * Alignment of the pages in the file
+     */
+    static const size_t PAGE_ALIGNMENT = 4096;
+
+    /**
+     * Default and minimum maximum size of the pages in bytes
+     */
+    static const size_t DEFAULT_PAGE_SIZE = 65536;
+    static const size_t MIN_PAGE_SIZE = 4096;
+
+    /**
+     * View of a page in the mapped file
+     */
+    struct Page
+    {
+        /** The nodes of the treelet, the first one is the root */
+        const RBVHNode* nodes;
+        uint32_t nodeCount;
+
+        /** The triangles in the order of the leaves */
+        const Triangle* triangles;
+
+        /** The indices of the triangles in the converted mesh */
+        const uint64_t* ids;
+        uint32_t triangleCount;
+
+        AlignedBox3f bounds;
+
+        /** The range of the page in the file */
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    /**
+     * The closest hit of a ray
+     */
+    struct Hit
+    {
+        /** Distance in the length of the ray direction */
+        float distance;
+
+        /** Index of the hit triangle in the converted mesh */
+        uint64_t triangle;
+    };
+
+    /**
+     * Writes a file partition by partition, so only one partition is in
+     * the memory at a time.
+     */
+    class Writer
+    {
+    public:
+
+        /**
+         * @param fileName is the file to write
+         * @param pageSize is the maximum size of the pages in bytes, at
+         * least MIN_PAGE_SIZE
+         * @throw std::runtime_error if the file can not be created
+         */
+        explicit Writer( const std::string& fileName,
+                         size_t pageSize = DEFAULT_PAGE_SIZE );
+        ~Writer();
+
+        /**
+         * Cuts the hierarchy of a partition into treelets and appends
+         * their pages to the file.
+         * @param rbvh is the hierarchy of the triangles of the partition
+         * @param triangles are the triangles, which are written in the
+         * order of the leaves
+         * @param ids are the indices of the triangles in the mesh
+         * @throw std::runtime_error if the pages can not be written
+         */
+        void addPartition( const RBVH& rbvh, const Triangles& triangles,
+                           const TriangleIds& ids );
+
+        /**
+         * @return the bounds of the partitions, in the order they are
+         * added
+         */
+        const AlignedBox3fs& getPartitionBounds() const;
+
+        /** @return the number of pages written */
+        size_t getPageCount() const;
+
+        /**
+         * Writes the top level index, which joins the hierarchy of the
+         * partitions with the nodes of the partitions above the treelets,
+         * and the page table, and closes the file.
+         * @param top is the hierarchy of the partition bounds, with a
+         * partition per leaf
+         * @return the size of the file in bytes
+         * @throw std::runtime_error if the file can not be written
+         */
+        uint64_t close( const RBVH& top );
+
+    private:
+
+        Writer( const Writer& ) = delete;
+        Writer& operator=( const Writer& ) = delete;
+
+        struct Impl;
+        std::unique_ptr<Impl> _impl;
+    };
+
+    /**
+     * Maps a file and validates its header, the section and page ranges
+     * and the top level index. The nodes of a page are validated when it
+     * is read the first time.
+     * @param fileName is the RBVH file to map
+     * @throw std::runtime_error if the file can not be mapped or it is
+     * not a valid RBVH file
+     */
+    explicit RBVHFile( const std::string& fileName );
+    ~RBVHFile();
+
+    /** @return the mapped file */
+    const MappedFilePtr& getMappedFile() const;
+
+    /** @return the number of triangles */
+    uint64_t getTriangleCount() const;
+
+    /** @return the bounds of the triangles, empty if there are none */
+    AlignedBox3f getBounds() const;
+
+    /** @return the maximum size of the pages in bytes */
+    size_t getPageSize() const;
+
+    /** @return the number of top level index nodes */
+    size_t getTopNodeCount() const;
+
+    /**
+     * @return the top level index nodes, the first one is the root, and
+     * the leaves refer to the page at their offset
+     */
+    const RBVHNode* getTopNodes() const;
+
+    /** @return the number of pages */
+    size_t getPageCount() const;
+
+    /**
+     * @param index is the index of the page
+     * @return the view of the page
+     * @throw std::out_of_range if the index is invalid
+     * @throw std::runtime_error if the nodes of the page are not a valid
+     * hierarchy of its triangles
+     */
+    Page getPage( size_t index ) const;
+
+    /**
+     * Intersects a ray with the triangles, reading the pages through
+     * the mapping.
+     * @param origin is the origin of the ray
+     * @param direction is the direction of the ray
+     * @param hit is set to the closest hit
+     * @param maxDistance is the maximum distance in the length of the
+     * direction
+     * @return true if a triangle is hit
+     */
+    bool intersect( const Vector3f& origin,
+                    const Vector3f& direction,
+                    Hit& hit,
+                    float maxDistance =
+                        std::numeric_limits< float >::max( )) const;
+
+    /**
+     * Intersects a ray with the triangles, loading the pages as RBVHPage
+     * objects of a cache, keyed by the page index. Only the page being
+     * intersected is referenced, so the memory use stays within the
+     * cache budget. If the cache can not hold the page, i.e. while the
+     * other threads reference all of its pages, the page is read through
+     * the mapping.
+     * @param origin is the origin of the ray
+     * @param direction is the direction of the ray
+     * @param cache is the page cache of the file, e.g. an RBVHPageCache
+     * @param hit is set to the closest hit
+     * @param maxDistance is the maximum distance in the length of the
+     * direction
+     * @return true if a triangle is hit
+     */
+    template< typename PageCache >
+    bool intersect( const Vector3f& origin,
+                    const Vector3f& direction,
+                    PageCache& cache,
+                    Hit& hit,
+                    float maxDistance =
+                        std::numeric_limits< float >::max( )) const
+    {
+        if( getTopNodeCount() == 0 )
+            return false;
+
+        bool found = false;
+        intersectRBVHNodes( getTopNodes(), origin, direction, maxDistance,
+                            [&]( const uint32_t index, float& distance )
+        {
+            const auto page = cache.create( size_t( index ), *this );
+            if( _intersect( page ? page->getPage() : getPage( index ),
+                            origin, direction, distance, hit ))
+            {
+                found = true;
+            }
+        });
+        return found;
+    }
+
+private:
+
+    RBVHFile( const RBVHFile& ) = delete;
+    RBVHFile& operator=( const RBVHFile& ) = delete;
+
+    bool _intersect( const Page& page, const Vector3f& origin,
+                     const Vector3f& direction, float& distance,
+                     Hit& hit ) const;
+
+    struct Impl;
+    std::unique_ptr<Impl> _impl;
+};
+
+}
+
+#endif // _rbvhfile_h_
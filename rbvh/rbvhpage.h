@@ -0,0 +1,80 @@
+/* Copyright(c) ZombieRendering 2015 - 2016 serkan.ergun@gmail.com
+ *
+ * This file is part of Z-Renderer(https://github.com/ZombieRendering/Z-Renderer)
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met :
+ *
+ * -Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * -Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and / or other materials provided with the distribution.
+ * -Neither the name of Eyescale Software GmbH nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _rbvhpage_h_
+#define _rbvhpage_h_
+
+#include <rbvh/rbvhfile.h>
+#include <zrenderer/common/cache/cache.h>
+#include <zrenderer/common/cache/mappedcachable.h>
+
+namespace zrenderer
+{
+
+/**
+ * Page of an RBVHFile as a cache object, keyed by the page index.
+ * Constructing it loads the pages of the treelet from the mapped file,
+ * destructing it releases them.
+ */
+class RBVHPage : public MappedCachable< size_t >
+{
+public:
+
+    /**
+     * Constructor called by the Cache.
+     * @param index is the index of the page
+     * @param file is the RBVH file
+     * @throw std::out_of_range if the index is invalid
+     */
+    template< typename Allocator >
+    RBVHPage( const size_t index, const RBVHFile& file, Allocator& )
+        : RBVHPage( index, file, file.getPage( index ))
+    {}
+
+    /** @return the view of the page */
+    const RBVHFile::Page& getPage() const { return _page; }
+
+private:
+
+    RBVHPage( const size_t index, const RBVHFile& file,
+              const RBVHFile::Page& page )
+        : MappedCachable< size_t >( index, file.getMappedFile(),
+                                    page.offset, page.size )
+        , _page( page )
+    {}
+
+    const RBVHFile::Page _page;
+};
+
+typedef std::shared_ptr< RBVHPage > RBVHPagePtr;
+typedef Cache< RBVHPage, std::allocator< RBVHPage >> RBVHPageCache;
+
+}
+
+#endif // _rbvhpage_h_
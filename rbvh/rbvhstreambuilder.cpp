@@ -0,0 +1,408 @@
+/* Copyright(c) ZombieRendering 2015 - 2016 serkan.ergun@gmail.com
+ *
+ * This file is part of Z-Renderer(https://github.com/ZombieRendering/Z-Renderer)
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met :
+ *
+ * -Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * -Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and / or other materials provided with the distribution.
+ * -Neither the name of Eyescale Software GmbH nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <rbvh/rbvhstreambuilder.h>
+#include <rbvh/rbvhfile.h>
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+namespace zrenderer
+{
+
+namespace
+{
+const size_t CELL_COUNT = size_t( 1 ) << ( 3 * RBVHStreamBuilder::MORTON_BITS );
+const size_t MIN_CHUNK_SIZE = 1024;
+const size_t MIN_BUFFER_SIZE = 256;
+const size_t READ_CHUNK_SIZE = 16384;
+
+typedef std::chrono::steady_clock Clock;
+
+// Record of the temporary partition file
+struct PartitionTriangle
+{
+    Triangle triangle;
+    uint64_t id;
+};
+
+static_assert( sizeof( PartitionTriangle ) == 48,
+               "Unexpected partition triangle size" );
+
+// Range of a partition in the temporary file
+struct Partition
+{
+    uint64_t offset;
+    uint64_t count;
+    std::vector< PartitionTriangle > buffer;
+    uint64_t nWritten;
+};
+
+double getSecs( const Clock::time_point& start )
+{
+    return std::chrono::duration< double >( Clock::now() - start ).count();
+}
+
+Vector3f getCenter( const Triangle& triangle )
+{
+    return ( triangle.vertices[ 0 ] + triangle.vertices[ 1 ] +
+             triangle.vertices[ 2 ]) / 3.0f;
+}
+
+// Inserts two zero bits before each of the lower ten bits
+uint32_t expandBits( uint32_t value )
+{
+    value = ( value * 0x00010001u ) & 0xFF0000FFu;
+    value = ( value * 0x00000101u ) & 0x0F00F00Fu;
+    value = ( value * 0x00000011u ) & 0xC30C30C3u;
+    value = ( value * 0x00000005u ) & 0x49249249u;
+    return value;
+}
+
+// Maps the triangle centers to the Morton order of a grid in their bounds
+class MortonGrid
+{
+public:
+
+    explicit MortonGrid( const AlignedBox3f& centers )
+        : _min( centers.min( ))
+    {
+        const float resolution =
+                float( 1 << RBVHStreamBuilder::MORTON_BITS ) * 0.99999f;
+        const Vector3f sizes = centers.sizes();
+        for( int axis = 0; axis < 3; ++axis )
+            _scale[ axis ] = sizes[ axis ] > 0.0f ? resolution / sizes[ axis ]
+                                                  : 0.0f;
+    }
+
+    size_t getCell( const Triangle& triangle ) const
+    {
+        const Vector3f position = ( getCenter( triangle ) - _min )
+                                  .cwiseProduct( _scale );
+        uint32_t cell = 0;
+        for( int axis = 0; axis < 3; ++axis )
+        {
+            const uint32_t coordinate = std::min(
+                uint32_t( std::max( position[ axis ], 0.0f )),
+                uint32_t(( 1 << RBVHStreamBuilder::MORTON_BITS ) - 1 ));
+            cell |= expandBits( coordinate ) << ( 2 - axis );
+        }
+        return cell;
+    }
+
+private:
+
+    Vector3f _min;
+    Vector3f _scale;
+};
+}
+
+struct RBVHStreamBuilder::Impl
+{
+    Impl( const size_t nThreads )
+        : builder( nThreads )
+        , budget( 1024 * 1024 * 1024 )
+        , pageSize( RBVHFile::DEFAULT_PAGE_SIZE )
+    {}
+
+    size_t getMaxPartitionSize() const
+    {
+        return budget / BYTES_PER_TRIANGLE;
+    }
+
+    size_t getChunkSize() const
+    {
+        return std::max( MIN_CHUNK_SIZE, budget / 4 / sizeof( Triangle ));
+    }
+
+    // Calls a function for the chunks of the input and their first ids
+    template< typename F >
+    void stream( TriangleStream& input, const uint64_t nTriangles,
+                 const F& process )
+    {
+        Triangles chunk( std::min< uint64_t >( getChunkSize(), nTriangles ));
+        input.rewind();
+        uint64_t id = 0;
+        while( id < nTriangles )
+        {
+            const size_t nRead = input.read( chunk.data(), chunk.size( ));
+            if( nRead == 0 )
+                throw std::runtime_error( "Unexpected end of the input" );
+            process( chunk.data(), std::min< uint64_t >( nRead,
+                                                         nTriangles - id ), id );
+            id += nRead;
+        }
+    }
+
+    AlignedBox3f computeCenterBounds( TriangleStream& input,
+                                      const uint64_t nTriangles )
+    {
+        AlignedBox3f centers;
+        stream( input, nTriangles, [&]( const Triangle* triangles,
+                                        const size_t count, uint64_t )
+        {
+            for( size_t i = 0; i < count; ++i )
+                centers.extend( getCenter( triangles[ i ]));
+        });
+        return centers;
+    }
+
+    // Cuts the Morton order of the cells into partitions of at most the
+    // maximum partition size, except for the cells larger than that
+    std::vector< Partition > partition( TriangleStream& input,
+                                        const uint64_t nTriangles,
+                                        const MortonGrid& grid,
+                                        std::vector< uint32_t >& cellPartitions )
+    {
+        std::vector< uint64_t > histogram( CELL_COUNT, 0 );
+        stream( input, nTriangles, [&]( const Triangle* triangles,
+                                        const size_t count, uint64_t )
+        {
+            for( size_t i = 0; i < count; ++i )
+                ++histogram[ grid.getCell( triangles[ i ])];
+        });
+
+        const uint64_t maxSize = getMaxPartitionSize();
+        std::vector< Partition > partitions;
+        cellPartitions.resize( CELL_COUNT );
+        uint64_t offset = 0;
+        for( size_t cell = 0; cell < CELL_COUNT; ++cell )
+        {
+            if( partitions.empty() ||
+                ( partitions.back().count > 0 &&
+                  partitions.back().count + histogram[ cell ] > maxSize ))
+            {
+                partitions.push_back( Partition{ offset, 0, {}, 0 });
+            }
+            cellPartitions[ cell ] = uint32_t( partitions.size() - 1 );
+            partitions.back().count += histogram[ cell ];
+            offset += histogram[ cell ];
+        }
+        if( !partitions.empty() && partitions.back().count == 0 )
+            partitions.pop_back();
+        return partitions;
+    }
+
+    void flush( std::fstream& file, Partition& partition )
+    {
+        file.seekp( std::streamoff(( partition.offset + partition.nWritten ) *
+                                   sizeof( PartitionTriangle )));
+        file.write( reinterpret_cast< const char* >( partition.buffer.data( )),
+                    std::streamsize( partition.buffer.size() *
+                                     sizeof( PartitionTriangle )));
+        partition.nWritten += partition.buffer.size();
+        partition.buffer.clear();
+    }
+
+    void scatter( TriangleStream& input, const uint64_t nTriangles,
+                  const MortonGrid& grid,
+                  const std::vector< uint32_t >& cellPartitions,
+                  std::vector< Partition >& partitions, std::fstream& file )
+    {
+        // The buffers of all partitions share a quarter of the budget
+        const size_t bufferSize = std::max( MIN_BUFFER_SIZE,
+                                    budget / 4 / sizeof( PartitionTriangle ) /
+                                    partitions.size( ));
+        stream( input, nTriangles, [&]( const Triangle* triangles,
+                                        const size_t count,
+                                        const uint64_t firstId )
+        {
+            for( size_t i = 0; i < count; ++i )
+            {
+                Partition& partition =
+                        partitions[ cellPartitions[ grid.getCell( triangles[ i ])]];
+                if( partition.buffer.capacity() < bufferSize )
+                    partition.buffer.reserve( bufferSize );
+                partition.buffer.push_back(
+                            PartitionTriangle{ triangles[ i ], firstId + i });
+                if( partition.buffer.size() == bufferSize )
+                    flush( file, partition );
+            }
+        });
+
+        for( Partition& partition: partitions )
+        {
+            if( !partition.buffer.empty( ))
+                flush( file, partition );
+            std::vector< PartitionTriangle >().swap( partition.buffer );
+        }
+    }
+
+    // Builds the pages of the partitions, the ones larger than the maximum
+    // partition size are built in pieces
+    void buildPartitions( std::vector< Partition >& partitions, std::fstream& file,
+                     RBVHFile::Writer& writer )
+    {
+        const uint64_t maxSize = getMaxPartitionSize();
+        // The partitions take the budget, so they are read in small chunks
+        const size_t chunkSize = READ_CHUNK_SIZE;
+        std::vector< PartitionTriangle > chunk;
+        for( const Partition& partition: partitions )
+        {
+            for( uint64_t begin = 0; begin < partition.count; begin += maxSize )
+            {
+                const size_t size = size_t( std::min( maxSize,
+                                                      partition.count - begin ));
+                Triangles triangles;
+                TriangleIds ids;
+                AlignedBox3fs bounds;
+                triangles.reserve( size );
+                ids.reserve( size );
+                bounds.reserve( size );
+                file.seekg( std::streamoff(( partition.offset + begin ) *
+                                           sizeof( PartitionTriangle )));
+                for( size_t i = 0; i < size; i += chunk.size( ))
+                {
+                    chunk.resize( std::min( chunkSize, size - i ));
+                    file.read( reinterpret_cast< char* >( chunk.data( )),
+                               std::streamsize( chunk.size() *
+                                                sizeof( PartitionTriangle )));
+                    for( const PartitionTriangle& triangle: chunk )
+                    {
+                        triangles.push_back( triangle.triangle );
+                        ids.push_back( triangle.id );
+                        bounds.push_back( triangle.triangle.getBounds( ));
+                    }
+                }
+                if( !file )
+                    throw std::runtime_error( "Can not read the partitions" );
+
+                const RBVH rbvh = builder.build( bounds );
+                AlignedBox3fs().swap( bounds );
+                writer.addPartition( rbvh, triangles, ids );
+            }
+        }
+    }
+
+    RBVHBuilder builder;
+    size_t budget;
+    size_t pageSize;
+};
+
+RBVHStreamBuilder::RBVHStreamBuilder( const size_t nThreads )
+    : _impl( new RBVHStreamBuilder::Impl( nThreads ))
+{}
+
+RBVHStreamBuilder::~RBVHStreamBuilder()
+{}
+
+void RBVHStreamBuilder::setMemoryBudget( const size_t budget )
+{
+    _impl->budget = std::max( budget, size_t( MIN_MEMORY_BUDGET ));
+}
+
+size_t RBVHStreamBuilder::getMemoryBudget() const
+{
+    return _impl->budget;
+}
+
+size_t RBVHStreamBuilder::getMaxPartitionSize() const
+{
+    return _impl->getMaxPartitionSize();
+}
+
+void RBVHStreamBuilder::setPageSize( const size_t pageSize )
+{
+    _impl->pageSize = std::max( pageSize, size_t( RBVHFile::MIN_PAGE_SIZE ));
+}
+
+size_t RBVHStreamBuilder::getPageSize() const
+{
+    return _impl->pageSize;
+}
+
+RBVHBuilder& RBVHStreamBuilder::getBuilder()
+{
+    return _impl->builder;
+}
+
+RBVHStreamBuilder::Statistics RBVHStreamBuilder::build(
+        TriangleStream& input, const std::string& fileName )
+{
+    const Clock::time_point start = Clock::now();
+    Statistics statistics = Statistics();
+    statistics.triangleCount = input.getTriangleCount();
+
+    const AlignedBox3f centers =
+            _impl->computeCenterBounds( input, statistics.triangleCount );
+    statistics.boundsTime = getSecs( start );
+
+    const Clock::time_point partitionStart = Clock::now();
+    const std::string partitionFileName = fileName + ".partitions";
+    std::fstream partitionFile( partitionFileName.c_str(),
+                                std::ios::binary | std::ios::in |
+                                std::ios::out | std::ios::trunc );
+    if( !partitionFile )
+        throw std::runtime_error( "Can not create " + partitionFileName );
+
+    std::vector< Partition > partitions;
+    try
+    {
+        const MortonGrid grid( centers );
+        {
+            std::vector< uint32_t > cellPartitions;
+            partitions = _impl->partition( input, statistics.triangleCount,
+                                           grid, cellPartitions );
+            if( !partitions.empty( ))
+                _impl->scatter( input, statistics.triangleCount, grid,
+                                cellPartitions, partitions, partitionFile );
+        }
+        partitionFile.flush();
+        if( !partitionFile )
+            throw std::runtime_error( "Can not write " + partitionFileName );
+        statistics.partitionCount = partitions.size();
+        statistics.partitionTime = getSecs( partitionStart );
+
+        const Clock::time_point buildStart = Clock::now();
+        RBVHFile::Writer writer( fileName, _impl->pageSize );
+        _impl->buildPartitions( partitions, partitionFile, writer );
+
+        RBVHBuilder topBuilder( 1 );
+        topBuilder.setMaxLeafSize( 1 );
+        statistics.pageCount = writer.getPageCount();
+        statistics.fileSize = writer.close(
+                              topBuilder.build( writer.getPartitionBounds( )));
+        statistics.buildTime = getSecs( buildStart );
+    }
+    catch( ... )
+    {
+        partitionFile.close();
+        std::remove( partitionFileName.c_str( ));
+        throw;
+    }
+
+    partitionFile.close();
+    std::remove( partitionFileName.c_str( ));
+    statistics.totalTime = getSecs( start );
+    return statistics;
+}
+
+}
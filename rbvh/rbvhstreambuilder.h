@@ -0,0 +1,150 @@
+/* Copyright(c) ZombieRendering 2015 - 2016 serkan.ergun@gmail.com
+ *
+ * This file is part of Z-Renderer(https://github.com/ZombieRendering/Z-Renderer)
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met :
+ *
+ * -Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * -Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and / or other materials provided with the distribution.
+ * -Neither the name of Eyescale Software GmbH nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _rbvhstreambuilder_h_
+#define _rbvhstreambuilder_h_
+
+#include <rbvh/rbvhbuilder.h>
+#include <rbvh/trianglestream.h>
+
+namespace zrenderer
+{
+
+/**
+ * Builds the paged RBVH file of a mesh, which may be larger than the
+ * memory, within a memory budget. The triangles are streamed from the
+ * input in chunks: the first pass computes the bounds of the triangle
+ * centers, the second one a histogram of the Morton codes of the centers,
+ * which is cut into spatially coherent partitions of the Morton order
+ * fitting the budget, and the third one scatters the triangles into the
+ * partitions in a temporary file. Then the hierarchy of each partition is
+ * built in the memory and written as treelet pages of the RBVHFile, and
+ * the top level hierarchy is built over the bounds of the partitions.
+ */
+class RBVHStreamBuilder
+{
+public:
+
+    /**
+     * Estimated memory use of building the hierarchy of a triangle in a
+     * partition, which bounds the partition size
+     */
+    static const size_t BYTES_PER_TRIANGLE = 192;
+
+    /**
+     * Minimum memory budget, which leaves room for the Morton histogram
+     */
+    static const size_t MIN_MEMORY_BUDGET = 8 * 1024 * 1024;
+
+    /**
+     * Number of bits per axis of the Morton codes of the partitioning
+     */
+    static const size_t MORTON_BITS = 6;
+
+    /**
+     * Statistics of a build
+     */
+    struct Statistics
+    {
+        uint64_t triangleCount;
+        size_t partitionCount;
+        size_t pageCount;
+        uint64_t fileSize;
+
+        /** The durations of the passes in seconds */
+        double boundsTime;
+        double partitionTime;
+        double buildTime;
+        double totalTime;
+    };
+
+    /**
+     * @param nThreads is the number of threads building the partition
+     * hierarchies. If it is 0, the number of hardware threads is used.
+     */
+    explicit RBVHStreamBuilder( size_t nThreads = 0 );
+    ~RBVHStreamBuilder();
+
+    /**
+     * Sets the memory budget of the build, 1 GB by default. The budget
+     * covers the chunks, the histogram, the scatter buffers and the
+     * partition hierarchies, not the program itself.
+     * @param budget is the memory budget in bytes, at least
+     * MIN_MEMORY_BUDGET
+     */
+    void setMemoryBudget( size_t budget );
+
+    /** @return the memory budget in bytes */
+    size_t getMemoryBudget() const;
+
+    /**
+     * @return the maximum number of triangles in a partition, which is
+     * built in the memory
+     */
+    size_t getMaxPartitionSize() const;
+
+    /**
+     * @param pageSize is the maximum size of the pages of the file in
+     * bytes, RBVHFile::DEFAULT_PAGE_SIZE by default
+     */
+    void setPageSize( size_t pageSize );
+
+    /** @return the maximum size of the pages of the file in bytes */
+    size_t getPageSize() const;
+
+    /**
+     * @return the builder of the partition hierarchies, to configure the
+     * bins, the leaf size and the costs
+     */
+    RBVHBuilder& getBuilder();
+
+    /**
+     * Builds the paged RBVH file of the triangles of a stream. The
+     * partitions are stored in a temporary file next to the output file,
+     * which is removed after the build.
+     * @param input is the triangle stream, which is rewound for each pass
+     * @param fileName is the RBVH file to write
+     * @return the statistics of the build
+     * @throw std::runtime_error if the input can not be read or a file
+     * can not be written
+     */
+    Statistics build( TriangleStream& input, const std::string& fileName );
+
+private:
+
+    RBVHStreamBuilder( const RBVHStreamBuilder& ) = delete;
+    RBVHStreamBuilder& operator=( const RBVHStreamBuilder& ) = delete;
+
+    struct Impl;
+    std::unique_ptr<Impl> _impl;
+};
+
+}
+
+#endif // _rbvhstreambuilder_h_
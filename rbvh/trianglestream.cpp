@@ -0,0 +1,220 @@
+/* Copyright(c) ZombieRendering 2015 - 2016 serkan.ergun@gmail.com
+ *
+ * This file is part of Z-Renderer(https://github.com/ZombieRendering/Z-Renderer)
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met :
+ *
+ * -Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * -Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and / or other materials provided with the distribution.
+ * -Neither the name of Eyescale Software GmbH nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <rbvh/trianglestream.h>
+
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace zrenderer
+{
+
+namespace
+{
+// The 80 byte header is followed by the triangle count, and each triangle
+// by a normal, the vertices and a 16 bit attribute
+const size_t STL_HEADER_SIZE = 80;
+const size_t STL_TRIANGLE_SIZE = 50;
+const size_t STL_VERTICES_OFFSET = 12;
+const size_t CHUNK_SIZE = 65536;
+
+// The raw triangle files have a 64 bit triangle count and the triangles
+const size_t RAW_HEADER_SIZE = sizeof( uint64_t );
+}
+
+STLTriangleStream::STLTriangleStream( const std::string& fileName )
+    : _fileName( fileName )
+    , _file( fileName.c_str(), std::ios::binary )
+    , _nTriangles( 0 )
+    , _nRead( 0 )
+{
+    if( !_file )
+        throw std::runtime_error( "Can not open " + fileName );
+
+    char header[ STL_HEADER_SIZE ];
+    uint32_t nTriangles = 0;
+    _file.read( header, STL_HEADER_SIZE );
+    _file.read( reinterpret_cast< char* >( &nTriangles ), sizeof( nTriangles ));
+    _file.seekg( 0, std::ios::end );
+    const uint64_t size = uint64_t( _file.tellg( ));
+    if( !_file || size < STL_HEADER_SIZE + sizeof( nTriangles ) +
+                         uint64_t( nTriangles ) * STL_TRIANGLE_SIZE )
+    {
+        throw std::runtime_error( "Invalid binary STL file " + fileName );
+    }
+
+    _nTriangles = nTriangles;
+    rewind();
+}
+
+size_t STLTriangleStream::read( Triangle* triangles, size_t count )
+{
+    count = size_t( std::min< uint64_t >( count, _nTriangles - _nRead ));
+    size_t nRead = 0;
+    while( nRead < count )
+    {
+        const size_t chunk = std::min( count - nRead, CHUNK_SIZE );
+        _buffer.resize( chunk * STL_TRIANGLE_SIZE );
+        _file.read( _buffer.data(), std::streamsize( _buffer.size( )));
+        if( !_file )
+            throw std::runtime_error( "Can not read " + _fileName );
+
+        for( size_t i = 0; i < chunk; ++i )
+        {
+            std::memcpy( static_cast< void* >( &triangles[ nRead + i ]),
+                         _buffer.data() + i * STL_TRIANGLE_SIZE +
+                         STL_VERTICES_OFFSET, sizeof( Triangle ));
+        }
+        nRead += chunk;
+    }
+    _nRead += nRead;
+    return nRead;
+}
+
+void STLTriangleStream::rewind()
+{
+    _file.clear();
+    _file.seekg( std::streamoff( STL_HEADER_SIZE + sizeof( uint32_t )));
+    _nRead = 0;
+}
+
+void STLTriangleStream::write( TriangleStream& input,
+                               const std::string& fileName )
+{
+    const uint64_t nTriangles = input.getTriangleCount();
+    if( nTriangles > std::numeric_limits< uint32_t >::max( ))
+        throw std::runtime_error( "Too many triangles for " + fileName );
+
+    std::ofstream file( fileName.c_str(), std::ios::binary | std::ios::trunc );
+    char header[ STL_HEADER_SIZE ] = "Z-Renderer binary STL";
+    const uint32_t count = uint32_t( nTriangles );
+    file.write( header, STL_HEADER_SIZE );
+    file.write( reinterpret_cast< const char* >( &count ), sizeof( count ));
+
+    Triangles triangles( CHUNK_SIZE );
+    std::vector< char > buffer( CHUNK_SIZE * STL_TRIANGLE_SIZE, 0 );
+    uint64_t nWritten = 0;
+    while( nWritten < nTriangles )
+    {
+        const size_t nRead = input.read( triangles.data(), size_t(
+                             std::min< uint64_t >( CHUNK_SIZE,
+                                                   nTriangles - nWritten )));
+        if( nRead == 0 )
+            break;
+
+        // The normals are left zero, which the readers compute
+        for( size_t i = 0; i < nRead; ++i )
+        {
+            std::memcpy( buffer.data() + i * STL_TRIANGLE_SIZE +
+                         STL_VERTICES_OFFSET, &triangles[ i ],
+                         sizeof( Triangle ));
+        }
+        file.write( buffer.data(),
+                    std::streamsize( nRead * STL_TRIANGLE_SIZE ));
+        nWritten += nRead;
+    }
+
+    file.close();
+    if( !file || nWritten != nTriangles )
+        throw std::runtime_error( "Can not write " + fileName );
+}
+
+
+RawTriangleStream::RawTriangleStream( const std::string& fileName )
+    : _fileName( fileName )
+    , _file( fileName.c_str(), std::ios::binary )
+    , _nTriangles( 0 )
+    , _nRead( 0 )
+{
+    if( !_file )
+        throw std::runtime_error( "Can not open " + fileName );
+
+    uint64_t nTriangles = 0;
+    _file.read( reinterpret_cast< char* >( &nTriangles ), RAW_HEADER_SIZE );
+    _file.seekg( 0, std::ios::end );
+    const uint64_t size = uint64_t( _file.tellg( ));
+    if( !_file || size < RAW_HEADER_SIZE ||
+        ( size - RAW_HEADER_SIZE ) / sizeof( Triangle ) < nTriangles )
+    {
+        throw std::runtime_error( "Invalid raw triangle file " + fileName );
+    }
+
+    _nTriangles = nTriangles;
+    rewind();
+}
+
+size_t RawTriangleStream::read( Triangle* triangles, size_t count )
+{
+    count = size_t( std::min< uint64_t >( count, _nTriangles - _nRead ));
+    _file.read( reinterpret_cast< char* >( triangles ),
+                std::streamsize( count * sizeof( Triangle )));
+    if( !_file )
+        throw std::runtime_error( "Can not read " + _fileName );
+
+    _nRead += count;
+    return count;
+}
+
+void RawTriangleStream::rewind()
+{
+    _file.clear();
+    _file.seekg( std::streamoff( RAW_HEADER_SIZE ));
+    _nRead = 0;
+}
+
+void RawTriangleStream::write( TriangleStream& input,
+                               const std::string& fileName )
+{
+    const uint64_t nTriangles = input.getTriangleCount();
+    std::ofstream file( fileName.c_str(), std::ios::binary | std::ios::trunc );
+    file.write( reinterpret_cast< const char* >( &nTriangles ),
+                RAW_HEADER_SIZE );
+
+    Triangles triangles( CHUNK_SIZE );
+    uint64_t nWritten = 0;
+    while( nWritten < nTriangles )
+    {
+        const size_t nRead = input.read( triangles.data(), size_t(
+                             std::min< uint64_t >( CHUNK_SIZE,
+                                                   nTriangles - nWritten )));
+        if( nRead == 0 )
+            break;
+
+        file.write( reinterpret_cast< const char* >( triangles.data( )),
+                    std::streamsize( nRead * sizeof( Triangle )));
+        nWritten += nRead;
+    }
+
+    file.close();
+    if( !file || nWritten != nTriangles )
+        throw std::runtime_error( "Can not write " + fileName );
+}
+
+}
@@ -0,0 +1,176 @@
+/* Copyright(c) ZombieRendering 2015 - 2016 serkan.ergun@gmail.com
+ *
+ * This file is part of Z-Renderer(https://github.com/ZombieRendering/Z-Renderer)
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met :
+ *
+ * -Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * -Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and / or other materials provided with the distribution.
+ * -Neither the name of Eyescale Software GmbH nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _trianglestream_h_
+#define _trianglestream_h_
+
+#include <zrenderer/common/mathtypes.h>
+
+#include <fstream>
+#include <string>
+
+namespace zrenderer
+{
+
+/**
+ * Triangle with its three vertices, 36 bytes
+ */
+struct Triangle
+{
+    /** @return the bounds of the vertices */
+    AlignedBox3f getBounds() const
+    {
+        AlignedBox3f bounds( vertices[ 0 ]);
+        bounds.extend( vertices[ 1 ]);
+        bounds.extend( vertices[ 2 ]);
+        return bounds;
+    }
+
+    Vector3f vertices[ 3 ];
+};
+
+typedef std::vector< Triangle > Triangles;
+typedef std::vector< uint64_t > TriangleIds;
+
+static_assert( sizeof( Triangle ) == 36, "Unexpected triangle size" );
+
+/**
+ * Sequential source of the triangles of a mesh, which is read in chunks
+ * and may be larger than the memory.
+ */
+class TriangleStream
+{
+public:
+
+    virtual ~TriangleStream() {}
+
+    /** @return the number of triangles in the stream */
+    virtual uint64_t getTriangleCount() const = 0;
+
+    /**
+     * Reads the next triangles.
+     * @param triangles is filled with the triangles
+     * @param count is the maximum number of triangles to read
+     * @return the number of triangles read, 0 at the end of the stream
+     * @throw std::runtime_error if the triangles can not be read
+     */
+    virtual size_t read( Triangle* triangles, size_t count ) = 0;
+
+    /**
+     * Restarts the stream from the first triangle.
+     */
+    virtual void rewind() = 0;
+};
+
+/**
+ * Reads the triangles of a binary STL file. The format stores the triangle
+ * count in 32 bits, which limits a file to 4294967295 triangles; larger
+ * meshes use RawTriangleStream.
+ */
+class STLTriangleStream : public TriangleStream
+{
+public:
+
+    /**
+     * @param fileName is the STL file
+     * @throw std::runtime_error if the file can not be opened or it is
+     * not a binary STL file
+     */
+    explicit STLTriangleStream( const std::string& fileName );
+
+    /** @copydoc TriangleStream::getTriangleCount */
+    uint64_t getTriangleCount() const final { return _nTriangles; }
+
+    /** @copydoc TriangleStream::read */
+    size_t read( Triangle* triangles, size_t count ) final;
+
+    /** @copydoc TriangleStream::rewind */
+    void rewind() final;
+
+    /**
+     * Writes the triangles of a stream to a binary STL file, in chunks.
+     * @param input is the stream, which is read from the current position
+     * @param fileName is the STL file
+     * @throw std::runtime_error if the file can not be written or the
+     * stream has more than 4294967295 triangles
+     */
+    static void write( TriangleStream& input, const std::string& fileName );
+
+private:
+
+    const std::string _fileName;
+    std::ifstream _file;
+    uint64_t _nTriangles;
+    uint64_t _nRead;
+    std::vector< char > _buffer;
+};
+
+/**
+ * Reads the triangles of a raw triangle file, which has a 64 bit triangle
+ * count followed by the packed triangles, nine floats each.
+ */
+class RawTriangleStream : public TriangleStream
+{
+public:
+
+    /**
+     * @param fileName is the raw triangle file
+     * @throw std::runtime_error if the file can not be opened or it is
+     * shorter than its triangle count
+     */
+    explicit RawTriangleStream( const std::string& fileName );
+
+    /** @copydoc TriangleStream::getTriangleCount */
+    uint64_t getTriangleCount() const final { return _nTriangles; }
+
+    /** @copydoc TriangleStream::read */
+    size_t read( Triangle* triangles, size_t count ) final;
+
+    /** @copydoc TriangleStream::rewind */
+    void rewind() final;
+
+    /**
+     * Writes the triangles of a stream to a raw triangle file, in chunks.
+     * @param input is the stream, which is read from the current position
+     * @param fileName is the raw triangle file
+     * @throw std::runtime_error if the file can not be written
+     */
+    static void write( TriangleStream& input, const std::string& fileName );
+
+private:
+
+    const std::string _fileName;
+    std::ifstream _file;
+    uint64_t _nTriangles;
+    uint64_t _nRead;
+};
+
+}
+
+#endif // _trianglestream_h_
@@ -0,0 +1,414 @@
+/* Copyright(c) ZombieRendering 2015 - 2016 serkan.ergun@gmail.com
+ *
+ * This file is part of Z-Renderer(https://github.com/ZombieRendering/Z-Renderer)
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met :
+ *
+ * -Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * -Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and / or other materials provided with the distribution.
+ * -Neither the name of Eyescale Software GmbH nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _widerbvh_h_
+#define _widerbvh_h_
+
+#include <rbvh/rbvh.h>
+
+namespace zrenderer
+{
+
+/**
+ * Slab test of a ray against Width boxes, one SIMD lane per box.
+ * @param minX, minY, minZ, maxX, maxY, maxZ are the bounds of the boxes
+ * @param origin is the origin of the ray
+ * @param inverse is the component wise inverse of the ray direction
+ * @param distance is the maximum distance along the ray
+ * @param entries are set to the distances where the ray enters the boxes
+ * @return the boxes hit within the distance
+ */
+template< size_t Width >
+Eigen::Array< bool, Width, 1 > intersectRayLanes(
+        const Eigen::Array< float, Width, 1 >& minX,
+        const Eigen::Array< float, Width, 1 >& minY,
+        const Eigen::Array< float, Width, 1 >& minZ,
+        const Eigen::Array< float, Width, 1 >& maxX,
+        const Eigen::Array< float, Width, 1 >& maxY,
+        const Eigen::Array< float, Width, 1 >& maxZ,
+        const Vector3f& origin, const Vector3f& inverse,
+        const float distance, Eigen::Array< float, Width, 1 >& entries )
+{
+    typedef Eigen::Array< float, Width, 1 > Lanes;
+    const Lanes x0 = ( minX - origin.x( )) * inverse.x();
+    const Lanes x1 = ( maxX - origin.x( )) * inverse.x();
+    const Lanes y0 = ( minY - origin.y( )) * inverse.y();
+    const Lanes y1 = ( maxY - origin.y( )) * inverse.y();
+    const Lanes z0 = ( minZ - origin.z( )) * inverse.z();
+    const Lanes z1 = ( maxZ - origin.z( )) * inverse.z();
+    entries = x0.min( x1 ).max( y0.min( y1 )).max( z0.min( z1 )).max( 0.0f );
+    const Lanes exits = x0.max( x1 ).min( y0.max( y1 )).min( z0.max( z1 ));
+    return ( entries <= exits ) && ( entries <= distance );
+}
+
+/**
+ * Node of a wide RBVH with up to Width children. The child bounds are
+ * stored as structure of arrays, one SIMD lane per child, so a ray is
+ * tested against all children with one vectorized slab test.
+ */
+template< size_t Width >
+struct WideRBVHNode
+{
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    typedef Eigen::Array< float, Width, 1 > Lanes;
+    typedef Eigen::Array< bool, Width, 1 > Mask;
+
+    /** Offset of the empty child slots */
+    static const uint32_t EMPTY = std::numeric_limits< uint32_t >::max();
+
+    WideRBVHNode()
+        : minX( Lanes::Constant( std::numeric_limits< float >::infinity( )))
+        , minY( minX ), minZ( minX ), maxX( minX ), maxY( minX ), maxZ( minX )
+    {
+        std::fill( offsets, offsets + Width, EMPTY );
+        std::fill( counts, counts + Width, 0 );
+    }
+
+    /**
+     * @param child is the child slot
+     * @param bounds are the bounds of the child
+     */
+    void setBounds( const size_t child, const AlignedBox3f& bounds )
+    {
+        minX[ child ] = bounds.min().x();
+        minY[ child ] = bounds.min().y();
+        minZ[ child ] = bounds.min().z();
+        maxX[ child ] = bounds.max().x();
+        maxY[ child ] = bounds.max().y();
+        maxZ[ child ] = bounds.max().z();
+    }
+
+    /**
+     * @param child is the child slot
+     * @return the bounds of the child
+     */
+    AlignedBox3f getBounds( const size_t child ) const
+    {
+        return AlignedBox3f(
+                    Vector3f( minX[ child ], minY[ child ], minZ[ child ]),
+                    Vector3f( maxX[ child ], maxY[ child ], maxZ[ child ]));
+    }
+
+    /**
+     * Slab test of a ray against the bounds of all children. The empty
+     * slots are at the infinity, which no ray reaches within a finite
+     * distance.
+     * @param origin is the origin of the ray
+     * @param inverse is the component wise inverse of the ray direction
+     * @param distance is the maximum distance along the ray
+     * @param entries are set to the distances where the ray enters the
+     * children
+     * @return the children hit within the distance
+     */
+    Mask intersect( const Vector3f& origin, const Vector3f& inverse,
+                    const float distance, Lanes& entries ) const
+    {
+        return intersectRayLanes< Width >( minX, minY, minZ, maxX, maxY, maxZ,
+                                           origin, inverse, distance,
+                                           entries );
+    }
+
+    /** @return true if the child is a leaf */
+    bool isLeaf( const size_t child ) const { return counts[ child ] > 0; }
+
+    Lanes minX, minY, minZ, maxX, maxY, maxZ;
+
+    // Index of the child node for the inner children, of the first
+    // primitive for the leaves, EMPTY for the empty slots
+    uint32_t offsets[ Width ];
+
+    // Zero for the inner children, the number of primitives for the leaves
+    uint32_t counts[ Width ];
+};
+
+template< size_t Width >
+const uint32_t WideRBVHNode< Width >::EMPTY;
+
+/**
+ * Ray tracing bounding volume hierarchy with up to Width children per
+ * node, collapsed from a binary RBVH. Each wide node takes the children
+ * of a binary node and replaces the inner child with the largest surface
+ * area by its children until it has Width children, so the hierarchy
+ * has about a (Width - 1)th of the binary nodes and fewer levels. The
+ * primitives are the ones of the binary hierarchy.
+ */
+template< size_t Width >
+class WideRBVH
+{
+public:
+
+    static_assert( Width >= 2, "Wide RBVH nodes need two children" );
+
+    typedef WideRBVHNode< Width > Node;
+    typedef std::vector< Node, Eigen::aligned_allocator< Node >> Nodes;
+    typedef RBVH::Primitives Primitives;
+    typedef RBVH::Hit Hit;
+
+    /**
+     * Creates an empty hierarchy
+     */
+    WideRBVH() {}
+
+    /**
+     * Collapses a binary hierarchy.
+     * @param rbvh is the binary hierarchy
+     */
+    explicit WideRBVH( const RBVH& rbvh )
+        : _primitives( rbvh.getPrimitives( ))
+    {
+        const RBVHNodes& binaryNodes = rbvh.getNodes();
+        if( binaryNodes.empty( ))
+            return;
+
+        // A leaf root is the only child of the wide root
+        _nodes.resize( 1 );
+        std::vector< std::pair< uint32_t, uint32_t >> stack;
+        if( binaryNodes[ 0 ].isLeaf( ))
+            _setChild( 0, 0, binaryNodes[ 0 ], stack );
+        else
+            stack.push_back({ 0, 0 });
+
+        std::vector< uint32_t > children;
+        while( !stack.empty( ))
+        {
+            const uint32_t binary = stack.back().first;
+            const uint32_t wide = stack.back().second;
+            stack.pop_back();
+
+            const RBVHNode& node = binaryNodes[ binary ];
+            children.assign({ node.offset, node.offset + 1 });
+            while( children.size() < Width )
+            {
+                float maxArea = -1.0f;
+                size_t largest = children.size();
+                for( size_t i = 0; i < children.size(); ++i )
+                {
+                    const RBVHNode& child = binaryNodes[ children[ i ]];
+                    const float area = getArea( child.bounds );
+                    if( !child.isLeaf() && area > maxArea )
+                    {
+                        maxArea = area;
+                        largest = i;
+                    }
+                }
+                if( largest == children.size( ))
+                    break;
+
+                const uint32_t first = binaryNodes[ children[ largest ]].offset;
+                children[ largest ] = first;
+                children.push_back( first + 1 );
+            }
+
+            for( size_t i = 0; i < children.size(); ++i )
+                _setChild( wide, i, binaryNodes[ children[ i ]], stack,
+                           children[ i ]);
+        }
+    }
+
+    /** @return the nodes, the first one is the root */
+    const Nodes& getNodes() const { return _nodes; }
+
+    /** @return the primitive indices, in the order of the leaves */
+    const Primitives& getPrimitives() const { return _primitives; }
+
+    /** @return the number of levels of the wide nodes */
+    size_t getDepth() const
+    {
+        if( _nodes.empty( ))
+            return 0;
+
+        size_t depth = 0;
+        std::vector< std::pair< uint32_t, size_t >> stack( 1, { 0, 1 });
+        while( !stack.empty( ))
+        {
+            const Node& node = _nodes[ stack.back().first ];
+            const size_t level = stack.back().second;
+            stack.pop_back();
+            depth = std::max( depth, level );
+            for( size_t i = 0; i < Width; ++i )
+            {
+                if( node.offsets[ i ] != Node::EMPTY && !node.isLeaf( i ))
+                    stack.push_back({ node.offsets[ i ], level + 1 });
+            }
+        }
+        return depth;
+    }
+
+    /** @return the size of the nodes and the primitive indices in bytes */
+    size_t getMemorySize() const
+    {
+        return _nodes.size() * sizeof( Node ) +
+               _primitives.size() * sizeof( uint32_t );
+    }
+
+    /**
+     * Calls a function for the primitives in the leaves hit by a ray,
+     * the closer nodes first.
+     * @param origin is the origin of the ray
+     * @param direction is the direction of the ray
+     * @param distance is the maximum distance along the ray, which the
+     * function shortens when it hits a primitive
+     * @param intersectPrimitive is called with the primitive index and
+     * the distance
+     */
+    template< typename F >
+    void intersect( const Vector3f& origin,
+                    const Vector3f& direction,
+                    float& distance,
+                    F&& intersectPrimitive ) const
+    {
+        if( _nodes.empty( ))
+            return;
+
+        // Each level pushes the hit children but the nearest one
+        struct Entry
+        {
+            uint32_t offset;
+            uint32_t count;
+            float distance;
+        };
+        Entry stack[ Width * RBVH_MAX_DEPTH ];
+        stack[ 0 ] = Entry{ 0, 0, 0.0f };
+        size_t size = 1;
+
+        const Vector3f inverse = direction.cwiseInverse();
+        typename Node::Lanes entries;
+        size_t order[ Width ];
+        while( size > 0 )
+        {
+            const Entry current = stack[ --size ];
+            if( current.distance > distance )
+                continue;
+
+            if( current.count > 0 )
+            {
+                for( uint32_t i = current.offset;
+                     i < current.offset + current.count; ++i )
+                {
+                    intersectPrimitive( _primitives[ i ], distance );
+                }
+                continue;
+            }
+
+            const Node& node = _nodes[ current.offset ];
+            const typename Node::Mask hits = node.intersect( origin, inverse,
+                                                             distance,
+                                                             entries );
+            if( !hits.any( ))
+                continue;
+
+            // The hit children sorted by their entries, the farthest first
+            size_t nHits = 0;
+            for( size_t i = 0; i < Width; ++i )
+            {
+                if( !hits[ i ] || node.offsets[ i ] == Node::EMPTY )
+                    continue;
+
+                size_t j = nHits++;
+                for( ; j > 0 && entries[ order[ j - 1 ]] < entries[ i ]; --j )
+                    order[ j ] = order[ j - 1 ];
+                order[ j ] = i;
+            }
+            for( size_t i = 0; i < nHits; ++i )
+            {
+                const size_t child = order[ i ];
+                stack[ size++ ] = Entry{ node.offsets[ child ],
+                                         node.counts[ child ],
+                                         entries[ child ]};
+            }
+        }
+    }
+
+    /**
+     * Intersects a ray with the triangles of a mesh, which the hierarchy
+     * is built for.
+     * @param mesh is the mesh
+     * @param origin is the origin of the ray
+     * @param direction is the direction of the ray
+     * @param hit is set to the closest hit, the primitive is the index
+     * of the triangle
+     * @param maxDistance is the maximum distance in the length of the
+     * direction
+     * @return true if a triangle is hit
+     */
+    bool intersect( const Mesh& mesh,
+                    const Vector3f& origin,
+                    const Vector3f& direction,
+                    Hit& hit,
+                    float maxDistance =
+                        std::numeric_limits< float >::max( )) const
+    {
+        bool found = false;
+        intersect( origin, direction, maxDistance,
+                   [&]( const uint32_t triangle, float& distance )
+        {
+            if( mesh.intersect( triangle, origin, direction, distance ))
+            {
+                hit.distance = distance;
+                hit.primitive = triangle;
+                found = true;
+            }
+        });
+        return found;
+    }
+
+private:
+
+    // Sets a child slot of a wide node from a binary node, the inner
+    // children get a new wide node, which is collapsed later
+    void _setChild( const uint32_t wide, const size_t slot,
+                    const RBVHNode& binaryNode,
+                    std::vector< std::pair< uint32_t, uint32_t >>& stack,
+                    const uint32_t binary = 0 )
+    {
+        uint32_t offset = binaryNode.offset;
+        if( !binaryNode.isLeaf( ))
+        {
+            offset = uint32_t( _nodes.size( ));
+            _nodes.resize( _nodes.size() + 1 );
+            stack.push_back({ binary, offset });
+        }
+
+        Node& node = _nodes[ wide ];
+        node.setBounds( slot, binaryNode.bounds );
+        node.offsets[ slot ] = offset;
+        node.counts[ slot ] = binaryNode.count;
+    }
+
+    Nodes _nodes;
+    Primitives _primitives;
+};
+
+typedef WideRBVH< 4 > RBVH4;
+typedef WideRBVH< 8 > RBVH8;
+
+}
+
+#endif // _widerbvh_h_
@@ -21,8 +21,20 @@
 #include <zrenderer/common/cache/cachable.h>
 #include <zrenderer/common/cache/cache.h>
 #include <zrenderer/common/cache/lrucachepolicy.h>
+#include <zrenderer/common/cache/mappedcachable.h>
+#include <zrenderer/common/cache/prefetcher.h>
+#include <zrenderer/common/cache/clockcachepolicy.h>
+#include <zrenderer/common/cache/twoqcachepolicy.h>
+#include <zrenderer/common/cache/arccachepolicy.h>
+#include <zrenderer/common/cache/costawarecachepolicy.h>
+#include <zrenderer/common/cache/shardedcache.h>
+#include <zrenderer/common/cache/tieredcache.h>
+#include <zrenderer/common/slaballocator.h>
 
+#include <fstream>
 #include <memory>
+#include <sstream>
+#include <thread>
 
 #define BOOST_TEST_MODULE cache
 #include <boost/test/unit_test.hpp>
@@ -44,11 +56,113 @@ private:
     size_t _size;
 };
 
+class SlowObject : public zrenderer::Cachable< std::string >
+{
+public:
+
+    SlowObject( const std::string& key,
+                std::atomic< size_t >* nLoads,
+                std::allocator<SlowObject>& )
+        : Cachable( key )
+    {
+        ++*nLoads;
+        std::this_thread::sleep_for( std::chrono::milliseconds( 100 ));
+    }
+
+    size_t getSize() const { return 1; }
+};
+
+class TieredObject : public zrenderer::Cachable< std::string >
+{
+public:
+
+    TieredObject( const std::string& key,
+                  size_t size,
+                  std::atomic< size_t >* nLoads,
+                  std::allocator<TieredObject>& )
+        : Cachable( key )
+    {
+        ++*nLoads;
+        for( size_t i = 0; i < size; ++i )
+            _data.push_back( uint8_t( key[ i % key.size() ] ));
+    }
+
+    TieredObject( const std::string& key,
+                  const zrenderer::ByteBuffer& data,
+                  std::allocator<TieredObject>& )
+        : Cachable( key )
+        , _data( data )
+    {}
+
+    void serialize( zrenderer::ByteBuffer& data ) const { data = _data; }
+
+    const zrenderer::ByteBuffer& getData() const { return _data; }
+
+    size_t getSize() const { return _data.size(); }
+
+private:
+    zrenderer::ByteBuffer _data;
+};
+
+class SlabObject : public zrenderer::Cachable< size_t >
+{
+public:
+
+    SlabObject( const size_t& key,
+                size_t size,
+                zrenderer::SlabAllocator< SlabObject >& allocator )
+        : Cachable( key )
+        , _data( size, 0, allocator )
+    {}
+
+    size_t getSize() const { return _data.size(); }
+
+private:
+    std::vector< uint8_t, zrenderer::SlabAllocator< uint8_t >> _data;
+};
+
+class IndexObject : public zrenderer::Cachable< uint64_t >
+{
+public:
+
+    IndexObject( const uint64_t& key,
+                 std::allocator<IndexObject>& )
+        : Cachable( key )
+    {}
+
+    size_t getSize() const { return 1; }
+};
+
 typedef std::shared_ptr< TestObject > TestObjectPtr;
+typedef std::shared_ptr< SlowObject > SlowObjectPtr;
+typedef std::shared_ptr< TieredObject > TieredObjectPtr;
 
 typedef zrenderer::Cache< TestObject,
                           std::allocator< TestObject > > Cache;
 
+typedef zrenderer::ShardedCache< TestObject,
+                                 std::allocator< TestObject > > ShardedCache;
+
+typedef zrenderer::Cache< SlowObject,
+                          std::allocator< SlowObject > > SlowCache;
+typedef zrenderer::ShardedCache< SlowObject,
+                                 std::allocator< SlowObject > > ShardedSlowCache;
+
+typedef zrenderer::Cache< SlabObject,
+                          zrenderer::SlabAllocator< SlabObject >> SlabCache;
+
+typedef zrenderer::Cache< IndexObject,
+                          std::allocator< IndexObject > > IndexCache;
+typedef zrenderer::Prefetcher< IndexCache > Prefetcher;
+
+typedef zrenderer::MappedCachable< size_t > MappedObject;
+typedef std::shared_ptr< MappedObject > MappedObjectPtr;
+typedef zrenderer::Cache< MappedObject,
+                          std::allocator< MappedObject > > MappedCache;
+
+typedef zrenderer::TieredCache< TieredObject,
+                                std::allocator< TieredObject > > TieredCache;
+
 
 BOOST_AUTO_TEST_CASE( construct_cache_object )
 {
@@ -95,3 +209,529 @@ BOOST_AUTO_TEST_CASE( construct_cache_object )
     BOOST_CHECK( !cacheObject1 );
 
 }
+
+BOOST_AUTO_TEST_CASE( sharded_cache_budget )
+{
+    std::allocator<TestObject> allocator;
+    ShardedCache cache( allocator, 100, 4 );
+    BOOST_CHECK( cache.getShardCount() == 4 );
+
+    TestObjectPtr pinned = cache.create( "pinned", 10 );
+    BOOST_CHECK( pinned );
+
+    for( size_t i = 0; i < 100; ++i )
+    {
+        TestObjectPtr cacheObject = cache.create( std::to_string( i ), 10 );
+        BOOST_CHECK( cacheObject );
+        BOOST_CHECK( cache.getUsage() <= cache.getMaxMemory( ));
+    }
+
+    // Referenced objects are never evicted for the global budget
+    BOOST_CHECK( cache.get( "pinned" ).get() == pinned.get( ));
+    BOOST_CHECK( cache.get( "99" ));
+    BOOST_CHECK( !cache.get( "0" ));
+
+    size_t usage = 0;
+    for( size_t i = 0; i < cache.getShardCount(); ++i )
+        usage += cache.getShard( i ).getPolicy().getUsage();
+    BOOST_CHECK( usage == cache.getUsage( ));
+}
+
+BOOST_AUTO_TEST_CASE( concurrent_access )
+{
+    std::allocator<TestObject> allocator;
+    Cache cache( allocator, 100 );
+
+    TestObjectPtr pinned = cache.create( "pinned", 10 );
+    std::atomic< size_t > errors( 0 );
+    std::vector< std::thread > threads;
+    for( size_t i = 0; i < 4; ++i )
+    {
+        // Boost.Test checks are not thread safe, errors are counted
+        threads.emplace_back( [&cache, &pinned, &errors, i]
+        {
+            for( size_t j = 0; j < 10000; ++j )
+            {
+                const std::string key = std::to_string(( i * 7 + j ) % 50 );
+                TestObjectPtr cacheObject = cache.get( key );
+                if( !cacheObject )
+                    cacheObject = cache.create( key, 10 );
+                if( cacheObject && ( cacheObject->getKey() != key ||
+                                     cacheObject->getRefCount() == 0 ))
+                {
+                    ++errors;
+                }
+                if( cache.get( "pinned" ).get() != pinned.get( ))
+                    ++errors;
+            }
+        });
+    }
+
+    for( std::thread& thread: threads )
+        thread.join();
+
+    BOOST_CHECK( errors == 0 );
+    BOOST_CHECK( pinned->getRefCount() == 1 );
+    BOOST_CHECK( cache.getPolicy().getUsage() <= 100 );
+}
+
+BOOST_AUTO_TEST_CASE( async_create )
+{
+    std::allocator<SlowObject> allocator;
+    SlowCache cache( allocator, 100 );
+    std::atomic< size_t > nLoads( 0 );
+
+    SlowObjectPtr woody = cache.create( "woody", &nLoads );
+    BOOST_CHECK( nLoads == 1 );
+
+    std::vector< SlowCache::CacheObjectFuture > futures;
+    for( size_t i = 0; i < 8; ++i )
+        futures.push_back( cache.createAsync( "allen", &nLoads ));
+
+    // Hits are not blocked by the load in flight
+    BOOST_CHECK( futures[ 0 ].wait_for( std::chrono::seconds( 0 )) ==
+                 std::future_status::timeout );
+    BOOST_CHECK( cache.get( "woody" ).get() == woody.get( ));
+    BOOST_CHECK( cache.createAsync( "woody", &nLoads ).get().get() ==
+                 woody.get( ));
+
+    // Synchronous creates share the load in flight as well
+    SlowObjectPtr allen = cache.create( "allen", &nLoads );
+    BOOST_CHECK( allen );
+    for( const SlowCache::CacheObjectFuture& future: futures )
+        BOOST_CHECK( future.get().get() == allen.get( ));
+    BOOST_CHECK( nLoads == 2 );
+
+    ShardedSlowCache shardedCache( allocator, 100, 4 );
+    SlowCache::CacheObjectFuture future1 =
+            shardedCache.createAsync( "alien", &nLoads );
+    SlowCache::CacheObjectFuture future2 =
+            shardedCache.createAsync( "alien", &nLoads );
+    BOOST_CHECK( future1.get() );
+    BOOST_CHECK( future1.get().get() == future2.get().get( ));
+    BOOST_CHECK( nLoads == 3 );
+
+    // The calls for a key in flight share one load task and its future
+    SlowCache::CacheObjectFuture future3 =
+            shardedCache.createAsync( "ripley", &nLoads );
+    SlowCache::CacheObjectFuture future4 =
+            shardedCache.createAsync( "ripley", &nLoads );
+    BOOST_CHECK( &future3.get() == &future4.get( ));
+    BOOST_CHECK( nLoads == 4 );
+}
+
+typedef boost::mpl::list< zrenderer::LRUCachePolicy< TestObject >,
+                          zrenderer::ClockCachePolicy< TestObject >,
+                          zrenderer::TwoQCachePolicy< TestObject >,
+                          zrenderer::ARCCachePolicy< TestObject >,
+                          zrenderer::CostAwareCachePolicy< TestObject >>
+                          CachePolicies;
+
+BOOST_AUTO_TEST_CASE_TEMPLATE( cache_policies, CachePolicy, CachePolicies )
+{
+    typedef zrenderer::Cache< TestObject,
+                              std::allocator< TestObject >,
+                              CachePolicy > PolicyCache;
+
+    std::allocator<TestObject> allocator;
+    PolicyCache cache( allocator, 100 );
+
+    TestObjectPtr pinned = cache.create( "pinned", 10 );
+    for( size_t i = 0; i < 100; ++i )
+    {
+        BOOST_CHECK( cache.create( std::to_string( i ), 10 ));
+        BOOST_CHECK( cache.getPolicy().getUsage() <= 100 );
+    }
+
+    BOOST_CHECK( cache.get( "pinned" ).get() == pinned.get( ));
+    BOOST_CHECK( cache.getPolicy().getKeys().size() == 10 );
+    BOOST_CHECK( !cache.create( "alien", 1000 ));
+}
+
+namespace
+{
+// Replays the trace on the policy and evicts objects in the order given
+// by the policy. Returns the number of hits.
+template< class CachePolicy >
+size_t replay( CachePolicy& policy, const std::vector< std::string >& trace )
+{
+    std::allocator<TestObject> allocator;
+    std::set< std::string > cached;
+    size_t hits = 0;
+    for( const std::string& key: trace )
+    {
+        if( cached.count( key ))
+            ++hits;
+        cached.insert( key );
+        policy.insert( TestObject( key, 1, allocator ));
+        policy.visitKeys( [&]( const std::string& evictKey )
+        {
+            if( !policy.cleanCache( ))
+                return false;
+            // The key is owned by the policy
+            const std::string removedKey = evictKey;
+            policy.remove( TestObject( removedKey, 1, allocator ));
+            cached.erase( removedKey );
+            return true;
+        });
+    }
+    return hits;
+}
+}
+
+BOOST_AUTO_TEST_CASE( scan_resistant_policies )
+{
+    // A hot set is used twice between scans of objects used only once.
+    // The reuse distance of the hot set across the scans exceeds the
+    // cache size.
+    std::vector< std::string > trace;
+    for( size_t round = 0; round < 50; ++round )
+    {
+        for( size_t i = 0; i < 8; ++i )
+            trace.push_back( "hot" + std::to_string( i % 4 ));
+        for( size_t i = 0; i < 8; ++i )
+            trace.push_back( "scan" + std::to_string( round * 8 + i ));
+    }
+
+    zrenderer::LRUCachePolicy< TestObject > lru( 11 );
+    zrenderer::ClockCachePolicy< TestObject > clock( 11 );
+    zrenderer::TwoQCachePolicy< TestObject > twoQ( 11 );
+    zrenderer::ARCCachePolicy< TestObject > arc( 11 );
+
+    const size_t lruHits = replay( lru, trace );
+    BOOST_CHECK_EQUAL( lruHits, 200 );
+    BOOST_CHECK( replay( clock, trace ) >= lruHits );
+    BOOST_CHECK( replay( twoQ, trace ) > lruHits + 100 );
+    BOOST_CHECK( replay( arc, trace ) > lruHits + 100 );
+}
+
+BOOST_AUTO_TEST_CASE( cost_aware_policy )
+{
+    std::allocator<TestObject> allocator;
+    zrenderer::CostAwareCachePolicy< TestObject > policy( 100 );
+    policy.insert( TestObject( "large", 50, allocator ));
+    policy.insert( TestObject( "small", 5, allocator ));
+
+    // The large object has a lower priority per byte
+    BOOST_CHECK( policy.getKeys().front() == "large" );
+    policy.remove( TestObject( "large", 50, allocator ));
+    BOOST_CHECK( policy.getUsage() == 5 );
+
+    // Objects inserted after an eviction inherit its priority
+    policy.insert( TestObject( "larger", 60, allocator ));
+    BOOST_CHECK( policy.getKeys().front() == "larger" );
+    BOOST_CHECK( policy.getKeys().back() == "small" );
+}
+
+BOOST_AUTO_TEST_CASE( tiered_cache )
+{
+    const size_t objectSize = 1000;
+    zrenderer::ByteBuffer compressed;
+    zrenderer::ZlibCodec::compress( zrenderer::ByteBuffer( objectSize, 'a' ),
+                                    compressed );
+    const size_t compressedSize = compressed.size();
+
+    // Two objects fit in each of the RAM tiers
+    std::allocator<TieredObject> allocator;
+    std::atomic< size_t > nLoads( 0 );
+    TieredCache cache( allocator, 2 * objectSize, 2 * compressedSize,
+                       "tiered_cache.spill", 2 * compressedSize );
+
+    const std::string keys[] = { "a", "b", "c", "d", "e" };
+    for( const std::string& key: keys )
+        BOOST_CHECK( cache.create( key, objectSize, &nLoads ));
+
+    BOOST_CHECK_EQUAL( nLoads, 5 );
+    BOOST_CHECK_EQUAL( cache.getTier( "a" ), TieredCache::TIER_DISK );
+    BOOST_CHECK_EQUAL( cache.getTier( "b" ), TieredCache::TIER_COMPRESSED );
+    BOOST_CHECK_EQUAL( cache.getTier( "c" ), TieredCache::TIER_COMPRESSED );
+    BOOST_CHECK_EQUAL( cache.getTier( "e" ), TieredCache::TIER_HOT );
+    BOOST_CHECK_EQUAL( cache.getCompressedUsage(), 2 * compressedSize );
+    BOOST_CHECK_EQUAL( cache.getDiskUsage(), compressedSize );
+
+    // Promoted from the disk without loading it again
+    TieredObjectPtr object = cache.get( "a" );
+    BOOST_CHECK( object );
+    BOOST_CHECK( object->getData() == zrenderer::ByteBuffer( objectSize, 'a' ));
+    BOOST_CHECK_EQUAL( cache.getTier( "a" ), TieredCache::TIER_HOT );
+    object = cache.create( "c", objectSize, &nLoads );
+    BOOST_CHECK( object->getData() == zrenderer::ByteBuffer( objectSize, 'c' ));
+    BOOST_CHECK_EQUAL( nLoads, 5 );
+    object.reset();
+
+    // The spill file drops the oldest objects beyond its budget
+    const std::string moreKeys[] = { "f", "g", "h", "i" };
+    for( const std::string& key: moreKeys )
+        BOOST_CHECK( cache.create( key, objectSize, &nLoads ));
+
+    BOOST_CHECK( cache.getDiskUsage() <= 2 * compressedSize );
+    BOOST_CHECK_EQUAL( cache.getTier( "b" ), TieredCache::TIER_NONE );
+    BOOST_CHECK( !cache.get( "b" ));
+    BOOST_CHECK( cache.create( "b", objectSize, &nLoads ));
+    BOOST_CHECK_EQUAL( nLoads, 10 );
+}
+
+BOOST_AUTO_TEST_CASE( spill_file )
+{
+    typedef zrenderer::SpillFile< std::string > SpillFile;
+    SpillFile file( "spill_file.spill", 100 );
+    const zrenderer::ByteBuffer first( 10, 'a' );
+    const zrenderer::ByteBuffer second( 10, 'b' );
+    file.write( "a", first );
+
+    // A block found before is read without the state of the file
+    SpillFile::Block block;
+    BOOST_REQUIRE( file.find( "a", block ));
+    zrenderer::ByteBuffer data;
+    BOOST_CHECK( file.read( block, data ));
+    BOOST_CHECK( data == first );
+    BOOST_CHECK( file.isCurrent( "a", block ));
+
+    // A replacement in the same place of the file is detected
+    file.write( "a", second );
+    SpillFile::Block replaced;
+    BOOST_REQUIRE( file.find( "a", replaced ));
+    BOOST_CHECK_EQUAL( replaced.offset, block.offset );
+    BOOST_CHECK( !file.isCurrent( "a", block ));
+    BOOST_CHECK( file.isCurrent( "a", replaced ));
+
+    file.remove( "a" );
+    BOOST_CHECK( !file.isCurrent( "a", replaced ));
+    BOOST_CHECK( !file.find( "a", block ));
+}
+
+BOOST_AUTO_TEST_CASE( slab_allocator )
+{
+    zrenderer::SlabArena arena( 4096, 256 );
+    void* first = arena.allocate( 24 );
+    void* second = arena.allocate( 32 );
+    BOOST_CHECK( first != second );
+    BOOST_CHECK_EQUAL( arena.getReservedBytes(), 4096 );
+    BOOST_CHECK_EQUAL( arena.getUsedBytes(), 64 );
+
+    // Released slots are reused by the same size class
+    arena.deallocate( first, 24 );
+    BOOST_CHECK( arena.allocate( 20 ) == first );
+
+    // Allocations larger than the largest slot are not from the slabs
+    void* large = arena.allocate( 1000 );
+    BOOST_CHECK_EQUAL( arena.getReservedBytes(), 5096 );
+    arena.deallocate( large, 1000 );
+    BOOST_CHECK_EQUAL( arena.getReservedBytes(), 4096 );
+
+    // The cache objects and their data are released to the arena
+    zrenderer::SlabAllocator< SlabObject > allocator;
+    const zrenderer::SlabArenaPtr& cacheArena = allocator.getArena();
+    {
+        SlabCache cache( allocator, 10 * 1024 );
+        for( size_t i = 0; i < 1000; ++i )
+            BOOST_CHECK( cache.create( i, 1024 ));
+
+        const size_t reserved = cacheArena->getReservedBytes();
+        for( size_t i = 1000; i < 100000; ++i )
+            BOOST_CHECK( cache.create( i, 1024 ));
+        BOOST_CHECK_EQUAL( cacheArena->getReservedBytes(), reserved );
+    }
+    BOOST_CHECK_EQUAL( cacheArena->getUsedBytes(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( mapped_cachable )
+{
+    const size_t pageSize = zrenderer::MappedFile::getPageSize();
+    const size_t brickSize = 2 * pageSize;
+    const size_t nBricks = 8;
+    {
+        std::ofstream file( "mapped_cachable.bin", std::ios::binary );
+        for( size_t i = 0; i < nBricks * brickSize; ++i )
+            file.put( char( i / brickSize ));
+    }
+
+    const zrenderer::MappedFilePtr file =
+        std::make_shared< zrenderer::MappedFile >( "mapped_cachable.bin" );
+    BOOST_CHECK_EQUAL( file->getSize(), nBricks * brickSize );
+
+    std::allocator< MappedObject > allocator;
+    MappedCache cache( allocator, 4 * brickSize );
+    for( size_t i = 0; i < nBricks; ++i )
+    {
+        const MappedObjectPtr brick = cache.create( i, file, i * brickSize,
+                                                    brickSize );
+        BOOST_CHECK( brick );
+        BOOST_CHECK_EQUAL( brick->getSize(), brickSize );
+        BOOST_CHECK_EQUAL( brick->getDataSize(), brickSize );
+        BOOST_CHECK_EQUAL( brick->getData()[ 0 ], i );
+        BOOST_CHECK_EQUAL( brick->getData()[ brickSize - 1 ], i );
+        BOOST_CHECK( brick->getData() == file->getData() + i * brickSize );
+    }
+
+    BOOST_CHECK_EQUAL( cache.getPolicy().getUsage(), 4 * brickSize );
+    BOOST_CHECK( !cache.get( 0 ));
+    BOOST_CHECK( cache.get( nBricks - 1 ));
+
+    BOOST_CHECK_THROW( cache.create( nBricks, file, nBricks * brickSize, 1 ),
+                       std::out_of_range );
+    std::remove( "mapped_cachable.bin" );
+}
+
+BOOST_AUTO_TEST_CASE( low_priority_create )
+{
+    std::allocator<TestObject> allocator;
+    Cache cache( allocator, 4 );
+    const std::string keys[] = { "a", "b", "c", "d" };
+    for( const std::string& key: keys )
+        cache.create( key, 1 );
+
+    // The accessed objects are not evicted by the prefetches
+    BOOST_CHECK( cache.get( "a" ));
+    BOOST_CHECK( cache.get( "c" ));
+    BOOST_CHECK( cache.prefetch( "e", 1 ));
+    BOOST_CHECK( cache.contains( "a" ));
+    BOOST_CHECK( !cache.contains( "b" ));
+
+    // Only the older half of the objects can be evicted
+    BOOST_CHECK( !cache.prefetch( "f", 1 ));
+    BOOST_CHECK( cache.contains( "d" ));
+
+    // Normal priority evicts the accessed objects too
+    BOOST_CHECK( cache.create( "f", 1 ));
+    BOOST_CHECK_EQUAL( cache.getPolicy().getUsage(), 4 );
+}
+
+BOOST_AUTO_TEST_CASE( prefetcher )
+{
+    std::allocator<IndexObject> allocator;
+    IndexCache cache( allocator, 100 );
+    size_t nEvicted = 0;
+    cache.setEvictionCallback( [&]( const IndexObject& ) { ++nEvicted; });
+    Prefetcher cachePrefetcher( cache, [&cache]( const uint64_t& key )
+                                       { return cache.prefetch( key ); });
+
+    const Prefetcher::Hints hints = { { 10, 1.0f }, { 11, 2.0f }, { 12, 0.5f }};
+    cachePrefetcher.hint( hints );
+    cachePrefetcher.wait();
+    BOOST_CHECK( cache.contains( 10 ));
+    BOOST_CHECK( cache.contains( 11 ));
+    BOOST_CHECK( cache.contains( 12 ));
+    BOOST_CHECK_EQUAL( cachePrefetcher.getStatistics().loaded, 3 );
+
+    // The accesses to the cache are reported to the prefetcher
+    BOOST_CHECK( cache.get( 10 ));
+    cachePrefetcher.wait();
+    BOOST_CHECK_EQUAL( cachePrefetcher.getStatistics().useful, 1 );
+
+    // A repeated stride is continued
+    const uint64_t accesses[] = { 100, 102, 104 };
+    for( const uint64_t key: accesses )
+        cache.create( key );
+    cachePrefetcher.wait();
+    BOOST_CHECK( cache.contains( 106 ));
+    BOOST_CHECK( cache.contains( 108 ));
+    BOOST_CHECK( !cache.contains( 110 ));
+
+    // The key following an access is remembered
+    cache.get( 100 );
+    cachePrefetcher.wait();
+    BOOST_CHECK_EQUAL( cachePrefetcher.getStatistics().loaded, 5 );
+
+    // The neighbours are prefetched
+    cachePrefetcher.setNeighbourFunction(
+        []( const uint64_t& key, std::vector< uint64_t >& neighbours )
+        { neighbours.push_back( key + 1000 ); });
+    cache.get( 106 );
+    cachePrefetcher.wait();
+    BOOST_CHECK( cache.contains( 1106 ));
+
+    const Prefetcher::Statistics statistics = cachePrefetcher.getStatistics();
+    BOOST_CHECK_EQUAL( statistics.loaded, 6 );
+    BOOST_CHECK_EQUAL( statistics.useful, 2 );
+    BOOST_CHECK_EQUAL( statistics.wasted, 0 );
+    BOOST_CHECK_CLOSE( statistics.getAccuracy(), 1.0 / 3.0, 0.001 );
+
+    // Unused prefetched objects are wasted when they are evicted, the
+    // callback set before the prefetcher is still called
+    cache.evict( 100 );
+    cachePrefetcher.wait();
+    BOOST_CHECK_EQUAL( nEvicted, 9 );
+    BOOST_CHECK_EQUAL( cachePrefetcher.getStatistics().wasted, 4 );
+    BOOST_CHECK_EQUAL( cachePrefetcher.getStatistics().wastedBytes, 4 );
+
+    // A prefetched object evicted and loaded again on demand is not
+    // useful. A destructed prefetcher restores the callbacks it chains.
+    {
+        Prefetcher chained( cache, [&cache]( const uint64_t& key )
+                                   { return cache.prefetch( key ); });
+    }
+    cachePrefetcher.hint( { { 2000, 1.0f }});
+    cachePrefetcher.wait();
+    cache.evict( 100 );
+    cachePrefetcher.wait();
+    BOOST_CHECK_EQUAL( nEvicted, 10 );
+    BOOST_CHECK_EQUAL( cachePrefetcher.getStatistics().wasted, 5 );
+    BOOST_CHECK( cache.create( 2000 ));
+    cachePrefetcher.wait();
+    BOOST_CHECK_EQUAL( cachePrefetcher.getStatistics().useful, 2 );
+}
+
+BOOST_AUTO_TEST_CASE( prefetcher_thread_histories )
+{
+    std::allocator<IndexObject> allocator;
+    IndexCache cache( allocator, 100 );
+    Prefetcher cachePrefetcher( cache, [&cache]( const uint64_t& key )
+                                       { return cache.prefetch( key ); });
+
+    // The access of another thread does not break the stride of this one
+    cache.create( 300 );
+    cache.create( 302 );
+    std::thread other( [&cache] { cache.create( 1 ); });
+    other.join();
+    cache.create( 304 );
+    cachePrefetcher.wait();
+    BOOST_CHECK( cache.contains( 306 ));
+    BOOST_CHECK( cache.contains( 308 ));
+    BOOST_CHECK_EQUAL( cachePrefetcher.getStatistics().loaded, 2 );
+}
+
+BOOST_AUTO_TEST_CASE( cache_statistics )
+{
+    std::allocator<TestObject> allocator;
+    Cache cache( allocator, 10 );
+    cache.getStatistics().setTracing( true );
+
+    BOOST_CHECK( cache.create( "woody", 5 ));
+    BOOST_CHECK( cache.create( "woody", 5 ));
+    BOOST_CHECK( !cache.get( "buzz" ));
+    BOOST_CHECK( cache.create( "buzz", 10 ));
+    BOOST_CHECK( !cache.create( "rex", 100 ));
+
+    const zrenderer::CacheStatistics::Snapshot snapshot =
+        cache.getStatistics().getSnapshot();
+    BOOST_CHECK_EQUAL( snapshot.hits, 1 );
+    BOOST_CHECK_EQUAL( snapshot.misses, 4 );
+    BOOST_CHECK_EQUAL( snapshot.loads, 3 );
+    BOOST_CHECK_EQUAL( snapshot.bytesLoaded, 115 );
+    BOOST_CHECK_EQUAL( snapshot.evictions, 1 );
+    BOOST_CHECK_EQUAL( snapshot.bytesEvicted, 5 );
+    BOOST_CHECK_CLOSE( snapshot.getHitRatio(), 0.2, 0.001 );
+
+    uint64_t nCreates = 0;
+    for( const uint64_t count: snapshot.createLatency )
+        nCreates += count;
+    BOOST_CHECK_EQUAL( nCreates, 4 );
+
+    // Loads and evictions are traced
+    BOOST_CHECK_EQUAL( cache.getStatistics().getTraceEventCount(), 4 );
+    std::ostringstream trace;
+    cache.getStatistics().writeChromeTrace( trace );
+    BOOST_CHECK( trace.str().find( "\"name\":\"evict\"" ) != std::string::npos );
+
+    std::ostringstream json;
+    snapshot.writeJSON( json );
+    BOOST_CHECK( json.str().find( "\"misses\":4" ) != std::string::npos );
+
+    zrenderer::LatencyHistogram::Buckets buckets;
+    buckets.fill( 0 );
+    buckets[ 3 ] = 50;
+    buckets[ 10 ] = 50;
+    BOOST_CHECK_EQUAL( zrenderer::LatencyHistogram::getPercentile( buckets, 0.5 ), 8 );
+    BOOST_CHECK_EQUAL( zrenderer::LatencyHistogram::getPercentile( buckets, 0.99 ), 1024 );
+}
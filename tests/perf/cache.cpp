@@ -0,0 +1,115 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <zrenderer/common/cache/cachable.h>
+#include <zrenderer/common/cache/cache.h>
+#include <zrenderer/common/cache/lrucachepolicy.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+#define BOOST_TEST_MODULE perf_cache
+#include <boost/test/unit_test.hpp>
+
+// Usage: perf_cache_cpp -- [maxEntries]
+// Measures the cache hit latency for entry counts from 1K to maxEntries
+// ( default 10M ). The latency should stay flat as the entry count grows.
+
+namespace
+{
+const size_t nLookups = 1000000;
+
+class TestObject : public zrenderer::Cachable< uint64_t >
+{
+public:
+
+    TestObject( const uint64_t& key,
+                std::allocator< TestObject >& )
+        : Cachable( key )
+    {}
+
+    size_t getSize() const { return 1; }
+};
+
+typedef zrenderer::Cache< TestObject,
+                          std::allocator< TestObject > > Cache;
+typedef std::chrono::high_resolution_clock Clock;
+
+size_t getMaxEntries()
+{
+    const auto& suite = boost::unit_test::framework::master_test_suite();
+    if( suite.argc > 1 )
+        return std::strtoull( suite.argv[ suite.argc - 1 ], 0, 10 );
+    return 10000000;
+}
+
+double getNanoSecs( const Clock::time_point& start, size_t count )
+{
+    const auto duration = Clock::now() - start;
+    return double( std::chrono::duration_cast< std::chrono::nanoseconds >(
+                       duration ).count( )) / double( count );
+}
+}
+
+BOOST_AUTO_TEST_CASE( cache_hit_latency )
+{
+    const size_t maxEntries = getMaxEntries();
+    std::mt19937_64 generator( 42 );
+
+    std::cout << "entries  create(ns)  get(ns)  policy insert(ns)"
+              << std::endl;
+    for( size_t nEntries = 1000; nEntries <= maxEntries; nEntries *= 10 )
+    {
+        std::allocator< TestObject > allocator;
+        Cache cache( allocator, nEntries );
+
+        Clock::time_point start = Clock::now();
+        for( uint64_t i = 0; i < nEntries; ++i )
+            cache.create( i );
+        const double createTime = getNanoSecs( start, nEntries );
+        BOOST_CHECK_EQUAL( cache.getPolicy().getUsage(), nEntries );
+
+        std::uniform_int_distribution< uint64_t > distribution( 0,
+                                                                nEntries - 1 );
+        std::vector< uint64_t > keys( nLookups );
+        for( uint64_t& key: keys )
+            key = distribution( generator );
+
+        size_t hits = 0;
+        start = Clock::now();
+        for( const uint64_t key: keys )
+            hits += cache.get( key ) ? 1 : 0;
+        const double getTime = getNanoSecs( start, nLookups );
+        BOOST_CHECK_EQUAL( hits, nLookups );
+
+        zrenderer::LRUCachePolicy< TestObject > policy( nEntries );
+        for( uint64_t i = 0; i < nEntries; ++i )
+            policy.insert( TestObject( i, allocator ));
+
+        start = Clock::now();
+        for( const uint64_t key: keys )
+            policy.insert( TestObject( key, allocator ));
+        const double insertTime = getNanoSecs( start, nLookups );
+
+        std::cout << nEntries << "  " << createTime << "  " << getTime
+                  << "  " << insertTime << std::endl;
+    }
+}
@@ -0,0 +1,193 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <zrenderer/common/cache/cachable.h>
+#include <zrenderer/common/cache/cache.h>
+#include <zrenderer/common/cache/lrucachepolicy.h>
+#include <zrenderer/common/cache/clockcachepolicy.h>
+#include <zrenderer/common/cache/twoqcachepolicy.h>
+#include <zrenderer/common/cache/arccachepolicy.h>
+#include <zrenderer/common/cache/costawarecachepolicy.h>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+#define BOOST_TEST_MODULE perf_cachepolicies
+#include <boost/test/unit_test.hpp>
+
+// Usage: perf_cachepolicies_cpp -- [traceFile maxMemory]
+// Replays access traces on caches with the different policies and
+// reports the hit rate and the time per access. A trace file has one
+// access per line, given as "key [size [loadCost]]". Without a trace
+// file, synthetic traces are replayed.
+
+namespace
+{
+struct Access
+{
+    uint64_t key;
+    size_t size;
+    double loadCost;
+};
+
+typedef std::vector< Access > Trace;
+
+class TraceObject : public zrenderer::Cachable< uint64_t >
+{
+public:
+
+    TraceObject( const uint64_t& key,
+                 size_t size,
+                 double loadCost,
+                 std::allocator< TraceObject >& )
+        : Cachable( key )
+        , _size( size )
+        , _loadCost( loadCost )
+    {}
+
+    size_t getSize() const { return _size; }
+    double getLoadCost() const { return _loadCost; }
+
+private:
+    size_t _size;
+    double _loadCost;
+};
+
+typedef std::chrono::high_resolution_clock Clock;
+
+template< class CachePolicy >
+void replay( const std::string& policyName, const Trace& trace,
+             const size_t maxMemory )
+{
+    typedef zrenderer::Cache< TraceObject, std::allocator< TraceObject >,
+                              CachePolicy > Cache;
+    std::allocator< TraceObject > allocator;
+    Cache cache( allocator, maxMemory );
+
+    size_t hits = 0;
+    double missCost = 0.0;
+    const Clock::time_point start = Clock::now();
+    for( const Access& access: trace )
+    {
+        if( cache.get( access.key ))
+            ++hits;
+        else
+        {
+            missCost += access.loadCost;
+            cache.create( access.key, access.size, access.loadCost );
+        }
+    }
+    const double nanoSecs = double(
+            std::chrono::duration_cast< std::chrono::nanoseconds >(
+                Clock::now() - start ).count( )) / double( trace.size( ));
+
+    std::cout << "  " << policyName << "  hit rate "
+              << 100.0 * double( hits ) / double( trace.size( ))
+              << "%  miss cost " << missCost << "  " << nanoSecs << " ns/op"
+              << std::endl;
+}
+
+void replayAll( const std::string& traceName, const Trace& trace,
+                const size_t maxMemory )
+{
+    std::cout << traceName << ": " << trace.size() << " accesses, budget "
+              << maxMemory << std::endl;
+    replay< zrenderer::LRUCachePolicy< TraceObject >>( "LRU  ", trace,
+                                                       maxMemory );
+    replay< zrenderer::ClockCachePolicy< TraceObject >>( "CLOCK", trace,
+                                                         maxMemory );
+    replay< zrenderer::TwoQCachePolicy< TraceObject >>( "2Q   ", trace,
+                                                        maxMemory );
+    replay< zrenderer::ARCCachePolicy< TraceObject >>( "ARC  ", trace,
+                                                       maxMemory );
+    replay< zrenderer::CostAwareCachePolicy< TraceObject >>( "COST ", trace,
+                                                             maxMemory );
+}
+
+Trace readTrace( const std::string& fileName )
+{
+    Trace trace;
+    std::ifstream file( fileName.c_str( ));
+    std::string line;
+    while( std::getline( file, line ))
+    {
+        std::istringstream stream( line );
+        Access access = { 0, 1, 1.0 };
+        if( stream >> access.key )
+        {
+            stream >> access.size >> access.loadCost;
+            trace.push_back( access );
+        }
+    }
+    return trace;
+}
+
+// A camera flying through a working set slightly larger than the budget,
+// while a small set of objects ( i.e. the environment ) is always used.
+Trace createFlyThroughTrace( const size_t nFrames, const size_t workingSet )
+{
+    Trace trace;
+    for( size_t frame = 0; frame < nFrames; ++frame )
+    {
+        for( uint64_t key = 0; key < workingSet / 10; ++key )
+            trace.push_back( { key, 1, 1.0 });
+        for( uint64_t key = 0; key < workingSet; ++key )
+            trace.push_back( { workingSet + ( frame * 16 + key ) % ( 2 * workingSet ),
+                               1, 1.0 });
+    }
+    return trace;
+}
+
+// Zipf distributed accesses to objects of varying size and load cost
+Trace createZipfTrace( const size_t nAccesses, const size_t nObjects )
+{
+    std::vector< double > weights( nObjects );
+    for( size_t i = 0; i < nObjects; ++i )
+        weights[ i ] = 1.0 / double( i + 1 );
+
+    std::mt19937_64 generator( 42 );
+    std::discrete_distribution< uint64_t > distribution( weights.begin(),
+                                                         weights.end( ));
+    Trace trace;
+    trace.reserve( nAccesses );
+    for( size_t i = 0; i < nAccesses; ++i )
+    {
+        const uint64_t key = distribution( generator );
+        trace.push_back( { key, 1 + key % 8, 1.0 + double( key % 3 ) });
+    }
+    return trace;
+}
+}
+
+BOOST_AUTO_TEST_CASE( trace_replay )
+{
+    const auto& suite = boost::unit_test::framework::master_test_suite();
+    if( suite.argc > 2 )
+    {
+        const Trace trace = readTrace( suite.argv[ suite.argc - 2 ] );
+        replayAll( suite.argv[ suite.argc - 2 ], trace,
+                   std::strtoull( suite.argv[ suite.argc - 1 ], 0, 10 ));
+        return;
+    }
+
+    replayAll( "fly-through", createFlyThroughTrace( 200, 10000 ), 10000 );
+    replayAll( "zipf", createZipfTrace( 1000000, 100000 ), 50000 );
+}
@@ -0,0 +1,423 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <rbvh/quantizedrbvh.h>
+#include <rbvh/rbvhbuilder.h>
+#include <rbvh/rbvhfile.h>
+#include <rbvh/rbvhpage.h>
+#include <rbvh/rbvhstreambuilder.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+
+#define BOOST_TEST_MODULE perf_rbvh
+#include <boost/test/unit_test.hpp>
+
+// Usage: perf_rbvh_cpp -- [nTriangles]
+// Builds the RBVH of a mesh of nTriangles ( default 10M ) small random
+// triangles on a sphere, with one thread and with all
+// hardware threads, and reports the build throughput, the SAH cost of
+// the hierarchy and the ray throughput. Compares the ray throughput of
+// the binary hierarchy with its 4 and 8 wide collapses and their
+// quantized encodings.
+
+namespace
+{
+const size_t nRays = 1000000;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+size_t getTriangleCount()
+{
+    const auto& suite = boost::unit_test::framework::master_test_suite();
+    if( suite.argc > 1 )
+        return std::strtoull( suite.argv[ suite.argc - 1 ], 0, 10 );
+    return 10000000;
+}
+
+double getSecs( const Clock::time_point& start )
+{
+    return std::chrono::duration< double >( Clock::now() - start ).count();
+}
+
+// Generates the triangles of a latitude longitude sphere grid on the fly
+class SphereTriangleStream : public zrenderer::TriangleStream
+{
+public:
+
+    explicit SphereTriangleStream( const size_t nTriangles )
+        : _nRows( std::max< size_t >(
+                      1, size_t( std::sqrt( double( nTriangles ) / 4 ))))
+        , _nColumns( std::max< size_t >( 1, nTriangles / ( 2 * _nRows )))
+        , _position( 0 )
+    {}
+
+    uint64_t getTriangleCount() const final { return 2 * _nRows * _nColumns; }
+
+    size_t read( zrenderer::Triangle* triangles, size_t count ) final
+    {
+        count = std::min< size_t >( count, getTriangleCount() - _position );
+        for( size_t i = 0; i < count; ++i, ++_position )
+        {
+            const size_t cell = _position / 2;
+            const size_t row = cell / _nColumns;
+            const size_t column = cell % _nColumns;
+            const zrenderer::Vector3f corner = _getVertex( row, column );
+            const zrenderer::Vector3f diagonal = _getVertex( row + 1,
+                                                             column + 1 );
+            triangles[ i ].vertices[ 0 ] = corner;
+            triangles[ i ].vertices[ 1 ] = _position % 2 ?
+                                               diagonal
+                                             : _getVertex( row, column + 1 );
+            triangles[ i ].vertices[ 2 ] = _position % 2 ?
+                                               _getVertex( row + 1, column )
+                                             : diagonal;
+        }
+        return count;
+    }
+
+    void rewind() final { _position = 0; }
+
+private:
+
+    zrenderer::Vector3f _getVertex( const size_t row,
+                                    const size_t column ) const
+    {
+        const float pi = 3.14159265f;
+        const float theta = pi * float( row ) / float( _nRows );
+        const float phi = 2 * pi * float( column ) / float( _nColumns );
+        return zrenderer::Vector3f( std::sin( theta ) * std::cos( phi ),
+                                    std::sin( theta ) * std::sin( phi ),
+                                    std::cos( theta ));
+    }
+
+    const size_t _nRows;
+    const size_t _nColumns;
+    size_t _position;
+};
+
+// Returns a memory field of /proc/self/status, e.g. "VmRSS", in MB
+double getMemory( const std::string& field )
+{
+    std::ifstream status( "/proc/self/status" );
+    std::string line;
+    while( std::getline( status, line ))
+        if( line.compare( 0, field.size() + 1, field + ":" ) == 0 )
+            return std::stod( line.substr( field.size() + 1 )) / 1024.0;
+    return 0;
+}
+
+// Resets the peak RSS of the process (VmHWM) to the current RSS, so the
+// following peak is not the one of an earlier test case. Returns false if
+// the kernel does not support it.
+bool resetPeakMemory()
+{
+    std::ofstream clearRefs( "/proc/self/clear_refs" );
+    clearRefs << "5";
+    clearRefs.flush();
+    return bool( clearRefs );
+}
+
+// Traces the rays from outside of the unit sphere through random points
+// inside, and returns the duration
+template< typename F >
+double traceRays( size_t& nHits, const F& intersect )
+{
+    std::mt19937 generator( 7 );
+    std::normal_distribution< float > normal( 0.0f, 1.0f );
+    const Clock::time_point start = Clock::now();
+    for( size_t i = 0; i < nRays; ++i )
+    {
+        const zrenderer::Vector3f origin =
+            zrenderer::Vector3f( normal( generator ), normal( generator ),
+                                 normal( generator )).normalized() * 3;
+        const zrenderer::Vector3f target( normal( generator ) * 0.3f,
+                                          normal( generator ) * 0.3f,
+                                          normal( generator ) * 0.3f );
+        if( intersect( origin, target - origin ))
+            ++nHits;
+    }
+    return getSecs( start );
+}
+
+zrenderer::MeshPtr createSphereMesh( const size_t nTriangles )
+{
+    // Latitude longitude grid with two triangles per cell and noise on
+    // the vertices, so the triangles are small and have various sizes
+    const size_t nRows = std::max< size_t >(
+                             1, size_t( std::sqrt( double( nTriangles ) / 4 )));
+    const size_t nColumns = std::max< size_t >( 1, nTriangles / ( 2 * nRows ));
+    std::mt19937 generator( 42 );
+    std::uniform_real_distribution< float > noise( -0.3f, 0.3f );
+
+    const float pi = 3.14159265f;
+    zrenderer::Vector3fs positions;
+    positions.reserve(( nRows + 1 ) * ( nColumns + 1 ));
+    for( size_t row = 0; row <= nRows; ++row )
+    {
+        for( size_t column = 0; column <= nColumns; ++column )
+        {
+            const float theta = pi * ( float( row ) +
+                                ( row % nRows ? noise( generator ) : 0 )) /
+                                float( nRows );
+            const float phi = 2 * pi * ( float( column ) +
+                                         noise( generator )) /
+                              float( nColumns );
+            positions.push_back( zrenderer::Vector3f(
+                                     std::sin( theta ) * std::cos( phi ),
+                                     std::sin( theta ) * std::sin( phi ),
+                                     std::cos( theta )));
+        }
+    }
+
+    zrenderer::Mesh::Indices indices;
+    indices.reserve( nRows * nColumns * 6 );
+    for( size_t row = 0; row < nRows; ++row )
+    {
+        for( size_t column = 0; column < nColumns; ++column )
+        {
+            const uint32_t corner = uint32_t( row * ( nColumns + 1 ) + column );
+            const uint32_t below = corner + uint32_t( nColumns + 1 );
+            indices.insert( indices.end(), { corner, corner + 1, below + 1,
+                                             corner, below + 1, below });
+        }
+    }
+    return std::make_shared< zrenderer::Mesh >( positions, indices );
+}
+
+template< typename T >
+void printTraversal( const std::string& name, const T& hierarchy,
+                     const zrenderer::Mesh& mesh )
+{
+    size_t nHits = 0;
+    zrenderer::RBVH::Hit hit;
+    const double rayTime = traceRays( nHits,
+        [&]( const zrenderer::Vector3f& origin,
+             const zrenderer::Vector3f& direction )
+    {
+        return hierarchy.intersect( mesh, origin, direction, hit );
+    });
+
+    std::cout << name << std::endl
+              << "  nodes             " << hierarchy.getNodes().size()
+              << std::endl
+              << "  depth             " << hierarchy.getDepth() << std::endl
+              << "  memory(MB)        "
+              << hierarchy.getMemorySize() / 1024.0 / 1024.0 << std::endl
+              << "  bytes/triangle    "
+              << double( hierarchy.getMemorySize( )) /
+                 double( mesh.getTriangleCount( )) << std::endl
+              << "  rays(Mrays/s)     " << nRays / rayTime / 1e6 << std::endl
+              << "  hits(%)           " << 100.0 * nHits / nRays << std::endl;
+}
+}
+
+BOOST_AUTO_TEST_CASE( binned_sah_build )
+{
+    const size_t nTriangles = getTriangleCount();
+    const zrenderer::MeshPtr mesh = createSphereMesh( nTriangles );
+
+    std::vector< size_t > threadCounts( 1, 1 );
+    if( std::thread::hardware_concurrency() > 1 )
+        threadCounts.push_back( std::thread::hardware_concurrency( ));
+
+    for( const size_t nThreads: threadCounts )
+    {
+        zrenderer::RBVHBuilder builder( nThreads );
+        Clock::time_point start = Clock::now();
+        const zrenderer::RBVH rbvh = builder.build( *mesh );
+        const double buildTime = getSecs( start );
+        BOOST_CHECK_EQUAL( rbvh.getPrimitives().size(),
+                           mesh->getTriangleCount( ));
+
+        std::mt19937 generator( 7 );
+        std::normal_distribution< float > normal( 0.0f, 1.0f );
+        size_t nHits = 0;
+        zrenderer::RBVH::Hit hit;
+        start = Clock::now();
+        for( size_t i = 0; i < nRays; ++i )
+        {
+            // From outside of the sphere through a random point inside
+            const zrenderer::Vector3f origin =
+                zrenderer::Vector3f( normal( generator ), normal( generator ),
+                                     normal( generator )).normalized() * 3;
+            const zrenderer::Vector3f target( normal( generator ) * 0.3f,
+                                              normal( generator ) * 0.3f,
+                                              normal( generator ) * 0.3f );
+            if( rbvh.intersect( *mesh, origin, target - origin, hit ))
+                ++nHits;
+        }
+        const double rayTime = getSecs( start );
+
+        std::cout << "Binned SAH RBVH, " << mesh->getTriangleCount()
+                  << " triangles, "
+                  << nThreads << " threads" << std::endl
+                  << "  build(s)          " << buildTime << std::endl
+                  << "  build(Mtris/s)    "
+                  << mesh->getTriangleCount() / buildTime / 1e6
+                  << std::endl
+                  << "  SAH cost          " << rbvh.getSAHCost() << std::endl
+                  << "  nodes             " << rbvh.getNodes().size()
+                  << std::endl
+                  << "  depth             " << rbvh.getDepth() << std::endl
+                  << "  memory(MB)        "
+                  << rbvh.getMemorySize() / 1024.0 / 1024.0 << std::endl
+                  << "  rays(Mrays/s)     " << nRays / rayTime / 1e6
+                  << std::endl
+                  << "  hits(%)           " << 100.0 * nHits / nRays
+                  << std::endl;
+    }
+}
+
+BOOST_AUTO_TEST_CASE( streaming_build )
+{
+    const std::string stlFileName = "perf_rbvh.stl";
+    const std::string fileName = "perf_rbvh.rbvh";
+    SphereTriangleStream sphere( getTriangleCount( ));
+    zrenderer::STLTriangleStream::write( sphere, stlFileName );
+    zrenderer::STLTriangleStream input( stlFileName );
+    const uint64_t nTriangles = input.getTriangleCount();
+
+    // binned_sah_build already raised the peak with a full in-memory mesh,
+    // so measure the streaming build from a reset peak and the RSS before
+    const bool peakReset = resetPeakMemory();
+    const double startMemory = getMemory( "VmRSS" );
+
+    zrenderer::RBVHStreamBuilder builder;
+    builder.setMemoryBudget(
+        nTriangles * zrenderer::RBVHStreamBuilder::BYTES_PER_TRIANGLE / 8 );
+    const zrenderer::RBVHStreamBuilder::Statistics statistics =
+            builder.build( input, fileName );
+    BOOST_CHECK_EQUAL( statistics.triangleCount, nTriangles );
+
+    // The mapped pages of the traced file count as resident
+    const double buildMemory = getMemory( "VmHWM" );
+    const zrenderer::RBVHFile file( fileName );
+    size_t nHits = 0;
+    const double rayTime = traceRays( nHits,
+        [&]( const zrenderer::Vector3f& origin,
+             const zrenderer::Vector3f& direction )
+    {
+        zrenderer::RBVHFile::Hit hit;
+        return file.intersect( origin, direction, hit );
+    });
+
+    // The pages are loaded through a cache holding an eighth of the file
+    const size_t cacheSize = statistics.fileSize / 8;
+    std::allocator< zrenderer::RBVHPage > allocator;
+    zrenderer::RBVHPageCache cache( allocator, cacheSize );
+    size_t nCachedHits = 0;
+    const double cachedRayTime = traceRays( nCachedHits,
+        [&]( const zrenderer::Vector3f& origin,
+             const zrenderer::Vector3f& direction )
+    {
+        zrenderer::RBVHFile::Hit hit;
+        return file.intersect( origin, direction, cache, hit );
+    });
+    BOOST_CHECK_EQUAL( nHits, nCachedHits );
+
+    std::cout << "Streaming RBVH build, " << nTriangles << " triangles, "
+              << builder.getBuilder().getThreadCount() << " threads"
+              << std::endl
+              << "  budget(MB)        "
+              << builder.getMemoryBudget() / 1024.0 / 1024.0 << std::endl
+              << "  partitions        " << statistics.partitionCount
+              << std::endl
+              << "  pages             " << statistics.pageCount << std::endl
+              << "  bounds(s)         " << statistics.boundsTime << std::endl
+              << "  partition(s)      " << statistics.partitionTime
+              << std::endl
+              << "  build(s)          " << statistics.buildTime << std::endl
+              << "  total(Mtris/s)    "
+              << nTriangles / statistics.totalTime / 1e6 << std::endl
+              << "  file(MB)          "
+              << statistics.fileSize / 1024.0 / 1024.0 << std::endl
+              << "  start RSS(MB)     " << startMemory << std::endl
+              << "  peak RSS(MB)      " << buildMemory
+              << ( peakReset ? "" : " (not reset, process-wide)" ) << std::endl
+              << "  build RSS(MB)     " << buildMemory - startMemory
+              << std::endl
+              << "  rays(Mrays/s)     " << nRays / rayTime / 1e6 << std::endl
+              << "  hits(%)           " << 100.0 * nHits / nRays << std::endl
+              << "  cache(MB)         " << cacheSize / 1024.0 / 1024.0
+              << std::endl
+              << "  cached(Mrays/s)   " << nRays / cachedRayTime / 1e6
+              << std::endl
+              << "  page hits(%)      " << 100.0 *
+                 cache.getStatistics().getSnapshot().getHitRatio()
+              << std::endl;
+
+    std::remove( stlFileName.c_str( ));
+    std::remove( fileName.c_str( ));
+}
+
+BOOST_AUTO_TEST_CASE( wide_traversal )
+{
+    const zrenderer::MeshPtr mesh = createSphereMesh( getTriangleCount( ));
+    zrenderer::RBVHBuilder builder;
+    const zrenderer::RBVH rbvh = builder.build( *mesh );
+
+    Clock::time_point start = Clock::now();
+    const zrenderer::RBVH4 rbvh4( rbvh );
+    const double collapse4Time = getSecs( start );
+    start = Clock::now();
+    const zrenderer::RBVH8 rbvh8( rbvh );
+    const double collapse8Time = getSecs( start );
+
+    std::cout << "Wide RBVH traversal, " << mesh->getTriangleCount()
+              << " triangles" << std::endl
+              << "  collapse4(s)      " << collapse4Time << std::endl
+              << "  collapse8(s)      " << collapse8Time << std::endl;
+    printTraversal( "Binary RBVH", rbvh, *mesh );
+    printTraversal( "RBVH4", rbvh4, *mesh );
+    printTraversal( "RBVH8", rbvh8, *mesh );
+}
+
+BOOST_AUTO_TEST_CASE( quantized_traversal )
+{
+    const zrenderer::MeshPtr mesh = createSphereMesh( getTriangleCount( ));
+    zrenderer::RBVHBuilder builder;
+    const zrenderer::RBVH rbvh = builder.build( *mesh );
+    const zrenderer::RBVH4 rbvh4( rbvh );
+    const zrenderer::RBVH8 rbvh8( rbvh );
+
+    Clock::time_point start = Clock::now();
+    const zrenderer::QuantizedRBVH4 quantized4( rbvh4 );
+    const double encode4Time = getSecs( start );
+    start = Clock::now();
+    const zrenderer::QuantizedRBVH8 quantized8( rbvh8 );
+    const double encode8Time = getSecs( start );
+
+    std::cout << "Quantized RBVH traversal, " << mesh->getTriangleCount()
+              << " triangles" << std::endl
+              << "  encode4(s)        " << encode4Time << std::endl
+              << "  encode8(s)        " << encode8Time << std::endl;
+    printTraversal( "Binary RBVH", rbvh, *mesh );
+    printTraversal( "RBVH4", rbvh4, *mesh );
+    printTraversal( "Quantized RBVH4", quantized4, *mesh );
+    printTraversal( "RBVH8", rbvh8, *mesh );
+    printTraversal( "Quantized RBVH8", quantized8, *mesh );
+}
@@ -0,0 +1,467 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <zrenderer/scenegraph/geometrydata.h>
+#include <zrenderer/scenegraph/instancehierarchy.h>
+#include <zrenderer/scenegraph/scenefile.h>
+#include <zrenderer/scenegraph/scenegraph.h>
+#include <zrenderer/scenegraph/snapshot.h>
+#include <zrenderer/scenegraph/transformdata.h>
+#include <zrenderer/scenegraph/visitor.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+#define BOOST_TEST_MODULE perf_scenegraph
+#include <boost/test/unit_test.hpp>
+
+// Usage: perf_scenegraph_cpp -- [maxNodes]
+// Builds an 8-ary tree of maxNodes ( default 10M ) nodes with the NodeId
+// API and measures the build, query and traversal times. The name based
+// API is measured on 1/10th of the nodes for comparison.
+
+namespace
+{
+const size_t fanOut = 8;
+const size_t nQueries = 1000000;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+size_t getMaxNodes()
+{
+    const auto& suite = boost::unit_test::framework::master_test_suite();
+    if( suite.argc > 1 )
+        return std::strtoull( suite.argv[ suite.argc - 1 ], 0, 10 );
+    return 10000000;
+}
+
+double getNanoSecs( const Clock::time_point& start, size_t count )
+{
+    const auto duration = Clock::now() - start;
+    return double( std::chrono::duration_cast< std::chrono::nanoseconds >(
+                       duration ).count( )) / double( count );
+}
+
+class CountVisitor : public zrenderer::Visitor
+{
+public:
+
+    CountVisitor() : count( 0 ) {}
+
+    void visit( const zrenderer::SceneGraph&, zrenderer::NodeId ) final
+    {
+        ++count;
+    }
+
+    size_t count;
+};
+
+class SnapshotCountVisitor : public zrenderer::Visitor
+{
+public:
+
+    SnapshotCountVisitor() : count( 0 ) {}
+
+    void visit( const zrenderer::Snapshot&, zrenderer::NodeId ) final
+    {
+        ++count;
+    }
+
+    size_t count;
+};
+
+class ParallelCountVisitor : public CountVisitor
+{
+public:
+
+    zrenderer::VisitorPtr fork() const final
+    {
+        return std::make_shared< ParallelCountVisitor >();
+    }
+
+    void join( zrenderer::Visitor& visitor ) final
+    {
+        count += static_cast< const CountVisitor& >( visitor ).count;
+    }
+};
+}
+
+BOOST_AUTO_TEST_CASE( node_id_api )
+{
+    const size_t nNodes = getMaxNodes();
+    zrenderer::SceneGraph scenegraph;
+    zrenderer::NodeIds ids;
+    ids.reserve( nNodes );
+    ids.push_back( zrenderer::ROOT_NODE_ID );
+
+    Clock::time_point start = Clock::now();
+    for( size_t i = 1; i < nNodes; ++i )
+    {
+        const zrenderer::NodeId id = scenegraph.addNode();
+        scenegraph.addChild( ids[( i - 1 ) / fanOut ], id );
+        ids.push_back( id );
+    }
+    const double buildTime = getNanoSecs( start, nNodes );
+
+    std::mt19937_64 generator( 42 );
+    std::uniform_int_distribution< size_t > random( 0, nNodes - 1 );
+    size_t checkSum = 0;
+    zrenderer::NodeIds children;
+    start = Clock::now();
+    for( size_t i = 0; i < nQueries; ++i )
+    {
+        const zrenderer::NodeId id = ids[ random( generator )];
+        scenegraph.getChildren( id, children );
+        checkSum += children.size();
+        checkSum += scenegraph.getParent( id ) != zrenderer::INVALID_NODE_ID;
+        checkSum += scenegraph.hasChild( id, ids[ random( generator )]);
+    }
+    const double queryTime = getNanoSecs( start, nQueries );
+
+    CountVisitor visitor;
+    start = Clock::now();
+    scenegraph.traverse( visitor, zrenderer::ROOT_NODE_ID );
+    const double traverseTime = getNanoSecs( start, nNodes );
+    BOOST_CHECK_EQUAL( visitor.count, nNodes );
+
+    // Without changes the traversal is a scan of the stored preorder
+    start = Clock::now();
+    scenegraph.traverse( visitor, zrenderer::ROOT_NODE_ID );
+    const double scanTime = getNanoSecs( start, nNodes );
+
+    ParallelCountVisitor parallelVisitor;
+    start = Clock::now();
+    scenegraph.traverseParallel( parallelVisitor );
+    const double parallelTime = getNanoSecs( start, nNodes );
+    BOOST_CHECK_EQUAL( parallelVisitor.count, nNodes );
+
+    // The first publish copies all the chunks, the next one only the
+    // chunks of the changed nodes
+    start = Clock::now();
+    scenegraph.publish();
+    const double publishTime = getNanoSecs( start, 1 ) / 1000000.0;
+    scenegraph.addChild( ids.back(), scenegraph.addNode( ));
+    start = Clock::now();
+    zrenderer::ConstSnapshotPtr snapshot = scenegraph.publish();
+    const double republishTime = getNanoSecs( start, 1 ) / 1000000.0;
+
+    SnapshotCountVisitor snapshotVisitor;
+    start = Clock::now();
+    snapshot->traverse( snapshotVisitor );
+    const double snapshotTime = getNanoSecs( start, nNodes );
+    BOOST_CHECK_EQUAL( snapshotVisitor.count, nNodes + 1 );
+
+    std::cout << "NodeId API, " << nNodes << " nodes" << std::endl
+              << "  build(ns/node)    " << buildTime << std::endl
+              << "  query(ns/query)   " << queryTime << std::endl
+              << "  traverse(ns/node) " << traverseTime << std::endl
+              << "  rescan(ns/node)   " << scanTime << std::endl
+              << "  parallel(ns/node) " << parallelTime << std::endl
+              << "  publish(ms)       " << publishTime << std::endl
+              << "  republish(ms)     " << republishTime << std::endl
+              << "  snapshot(ns/node) " << snapshotTime << std::endl
+              << "  checksum          " << checkSum << std::endl;
+}
+
+BOOST_AUTO_TEST_CASE( name_api )
+{
+    const size_t nNodes = getMaxNodes() / 10;
+    zrenderer::SceneGraph scenegraph;
+    std::vector< std::string > names;
+    names.reserve( nNodes );
+    names.push_back( zrenderer::ROOT_NODE );
+
+    Clock::time_point start = Clock::now();
+    for( size_t i = 1; i < nNodes; ++i )
+    {
+        names.push_back( std::to_string( i ));
+        scenegraph.createNode( names.back( ));
+        scenegraph.addChild( names[( i - 1 ) / fanOut ], names.back( ));
+    }
+    const double buildTime = getNanoSecs( start, nNodes );
+
+    std::mt19937_64 generator( 42 );
+    std::uniform_int_distribution< size_t > random( 0, nNodes - 1 );
+    size_t checkSum = 0;
+    start = Clock::now();
+    for( size_t i = 0; i < nQueries; ++i )
+    {
+        const std::string& name = names[ random( generator )];
+        checkSum += scenegraph.getChildren( name ).size();
+        checkSum += scenegraph.getParent( name ) != nullptr;
+        checkSum += scenegraph.hasChild( name, names[ random( generator )]);
+    }
+    const double queryTime = getNanoSecs( start, nQueries );
+
+    std::cout << "Name API, " << nNodes << " nodes" << std::endl
+              << "  build(ns/node)    " << buildTime << std::endl
+              << "  query(ns/query)   " << queryTime << std::endl
+              << "  checksum          " << checkSum << std::endl;
+}
+
+BOOST_AUTO_TEST_CASE( transaction_build )
+{
+    const size_t nNodes = getMaxNodes();
+    zrenderer::SceneGraph scenegraph;
+    zrenderer::NodeIds ids;
+    ids.reserve( nNodes );
+    ids.push_back( zrenderer::ROOT_NODE_ID );
+
+    Clock::time_point start = Clock::now();
+    zrenderer::SceneGraph::Transaction transaction( scenegraph );
+    for( size_t i = 1; i < nNodes; ++i )
+    {
+        const zrenderer::NodeId id = transaction.addNode();
+        transaction.addChild( ids[( i - 1 ) / fanOut ], id );
+        ids.push_back( id );
+    }
+    const double stageTime = getNanoSecs( start, nNodes );
+
+    start = Clock::now();
+    BOOST_CHECK_EQUAL( transaction.commit(), 0 );
+    const double commitTime = getNanoSecs( start, nNodes );
+    BOOST_CHECK_EQUAL( scenegraph.getNodeCount(), nNodes );
+
+    std::cout << "Transaction, " << nNodes << " nodes" << std::endl
+              << "  stage(ns/node)    " << stageTime << std::endl
+              << "  commit(ns/node)   " << commitTime << std::endl;
+}
+
+BOOST_AUTO_TEST_CASE( transform_update )
+{
+    const size_t nNodes = getMaxNodes() / 10;
+    zrenderer::SceneGraph scenegraph;
+    zrenderer::NodeIds ids;
+    ids.reserve( nNodes );
+    ids.push_back( zrenderer::ROOT_NODE_ID );
+
+    // Transforms on the inner nodes, bounds on the leaves
+    const zrenderer::AlignedBox3f unitBox( zrenderer::Vector3f( 0, 0, 0 ),
+                                           zrenderer::Vector3f( 1, 1, 1 ));
+    zrenderer::SceneGraph::Transaction transaction( scenegraph );
+    for( size_t i = 1; i < nNodes; ++i )
+    {
+        zrenderer::NodeDataPtr data;
+        if( i * fanOut + 1 < nNodes )
+            data.reset( new zrenderer::TransformData(
+                            zrenderer::Affine3f( Eigen::Translation3f(
+                                                     float( i ), 0, 0 ))));
+        else
+            data.reset( new zrenderer::BoundsData( unitBox ));
+        const zrenderer::NodeId id = transaction.addNode( data );
+        transaction.addChild( ids[( i - 1 ) / fanOut ], id );
+        ids.push_back( id );
+    }
+    transaction.commit();
+    for( zrenderer::NodeId& id: ids )
+        id = transaction.getNodeId( id );
+
+    Clock::time_point start = Clock::now();
+    const size_t nFull = scenegraph.updateTransforms();
+    const double fullTime = getNanoSecs( start, 1 ) / 1000000.0;
+
+    // Moves a node with a subtree of about a thousand nodes
+    const zrenderer::NodeId moved = ids[ 100 ];
+    scenegraph.setNodeData( moved, std::make_shared<
+                                zrenderer::TransformData >( ));
+    start = Clock::now();
+    const size_t nMoved = scenegraph.updateTransforms();
+    const double moveTime = getNanoSecs( start, 1 ) / 1000000.0;
+
+    std::cout << "Transform update, " << nNodes << " nodes" << std::endl
+              << "  full(ms)          " << fullTime << " for " << nFull
+              << " nodes" << std::endl
+              << "  move(ms)          " << moveTime << " for " << nMoved
+              << " nodes" << std::endl;
+}
+
+BOOST_AUTO_TEST_CASE( component_iteration )
+{
+    const size_t nNodes = getMaxNodes() / 10;
+    zrenderer::SceneGraph scenegraph;
+    zrenderer::ComponentStore& components = scenegraph.getComponents();
+    zrenderer::NodeIds ids;
+    ids.reserve( nNodes );
+    for( size_t i = 0; i < nNodes; ++i )
+    {
+        ids.push_back( scenegraph.addNode(
+            std::make_shared< zrenderer::BoundsData >( )));
+        components.add< zrenderer::AlignedBox3f >( ids.back( ));
+        components.add< float >( ids.back(), 1.0f );
+    }
+
+    // Casting the node data of every node
+    Clock::time_point start = Clock::now();
+    size_t nEmpty = 0;
+    for( const zrenderer::NodeId id: ids )
+    {
+        const auto bounds = std::dynamic_pointer_cast< zrenderer::BoundsData >(
+                                scenegraph.getNodeData( id ));
+        nEmpty += bounds->getBounds().isEmpty();
+    }
+    const double castTime = getNanoSecs( start, nNodes );
+
+    start = Clock::now();
+    size_t nComponents = 0;
+    components.forEach< zrenderer::AlignedBox3f, float >(
+        [&]( zrenderer::NodeId, const zrenderer::AlignedBox3f& bounds,
+             float& )
+        {
+            nComponents += bounds.isEmpty();
+        });
+    const double componentTime = getNanoSecs( start, nNodes );
+    BOOST_CHECK_EQUAL( nEmpty, nComponents );
+
+    std::cout << "Node data access, " << nNodes << " nodes" << std::endl
+              << "  cast(ns/node)      " << castTime << std::endl
+              << "  component(ns/node) " << componentTime << std::endl;
+}
+
+BOOST_AUTO_TEST_CASE( scene_file )
+{
+    const size_t nNodes = getMaxNodes() / 10;
+    zrenderer::SceneGraph source;
+    zrenderer::NodeIds ids;
+    ids.reserve( nNodes );
+    ids.push_back( zrenderer::ROOT_NODE_ID );
+
+    zrenderer::SceneGraph::Transaction transaction( source );
+    for( size_t i = 1; i < nNodes; ++i )
+    {
+        const zrenderer::NodeId id = transaction.addNode(
+            std::make_shared< zrenderer::TransformData >(
+                zrenderer::Affine3f( Eigen::Translation3f( float( i ), 0, 0 ))));
+        transaction.addChild( ids[( i - 1 ) / fanOut ], id );
+        ids.push_back( id );
+    }
+    transaction.commit();
+    source.publish();
+
+    const std::string fileName = "perf_scenegraph.zscene";
+    Clock::time_point start = Clock::now();
+    zrenderer::SceneFile::write( *source.getSnapshot(),
+                                 zrenderer::ROOT_NODE_ID, fileName );
+    const double writeTime = getNanoSecs( start, nNodes );
+
+    // The time to the first frame does not depend on the size of the file
+    start = Clock::now();
+    zrenderer::SceneGraph scenegraph;
+    zrenderer::SceneFile file( fileName );
+    const zrenderer::NodeId root = file.attach( scenegraph,
+                                                zrenderer::ROOT_NODE_ID );
+    file.expand( scenegraph, root );
+    const double openTime = getNanoSecs( start, 1000 );
+
+    start = Clock::now();
+    CountVisitor visitor;
+    file.traverse( scenegraph, visitor, root );
+    const double expandTime = getNanoSecs( start, nNodes );
+    BOOST_CHECK_EQUAL( visitor.count, nNodes );
+    BOOST_CHECK_EQUAL( file.getMaterializedCount(), nNodes );
+    std::remove( fileName.c_str( ));
+
+    std::cout << "Scene file, " << nNodes << " nodes" << std::endl
+              << "  write(ns/node)    " << writeTime << std::endl
+              << "  open+attach(us)   " << openTime << std::endl
+              << "  expand(ns/node)   " << expandTime << std::endl;
+}
+
+BOOST_AUTO_TEST_CASE( instancing )
+{
+    // A grid mesh of 2 * 64 * 64 triangles instanced on a square grid
+    const size_t nInstances = getMaxNodes() / 10;
+    const size_t gridSize = 64;
+    zrenderer::Vector3fs positions;
+    zrenderer::Mesh::Indices indices;
+    for( size_t y = 0; y <= gridSize; ++y )
+        for( size_t x = 0; x <= gridSize; ++x )
+            positions.push_back( zrenderer::Vector3f( float( x ) / gridSize,
+                                                      float( y ) / gridSize,
+                                                      0 ));
+    for( size_t y = 0; y < gridSize; ++y )
+    {
+        for( size_t x = 0; x < gridSize; ++x )
+        {
+            const uint32_t corner = uint32_t( y * ( gridSize + 1 ) + x );
+            const uint32_t above = corner + uint32_t( gridSize + 1 );
+            indices.insert( indices.end(), { corner, corner + 1, above + 1,
+                                             corner, above + 1, above });
+        }
+    }
+    const zrenderer::MeshPtr mesh =
+            std::make_shared< zrenderer::Mesh >( positions, indices );
+    const zrenderer::GeometryDataPtr geometry =
+            std::make_shared< zrenderer::GeometryData >( mesh );
+
+    const size_t side = size_t( std::ceil( std::sqrt( double( nInstances ))));
+    const zrenderer::InstanceDataPtr instances =
+            std::make_shared< zrenderer::InstanceData >( geometry );
+    instances->reserve( nInstances );
+    for( size_t i = 0; i < nInstances; ++i )
+        instances->addInstance( zrenderer::AffineCompact3f(
+            Eigen::Translation3f( float( i % side ) * 2,
+                                  float( i / side ) * 2, 0 )));
+
+    zrenderer::SceneGraph scenegraph;
+    scenegraph.addChild( zrenderer::ROOT_NODE_ID,
+                         scenegraph.addNode( instances ));
+
+    Clock::time_point start = Clock::now();
+    const zrenderer::InstanceHierarchy hierarchy( scenegraph );
+    const double buildTime = getNanoSecs( start, nInstances );
+    BOOST_CHECK_EQUAL( hierarchy.getInstanceCount(), nInstances );
+
+    // Rays straight down on random points of the instance grid
+    const size_t nRays = nQueries;
+    std::mt19937 generator( 42 );
+    std::uniform_real_distribution< float > distribution( 0, float( side ) * 2 );
+    size_t nHits = 0;
+    zrenderer::InstanceHierarchy::Hit hit;
+    start = Clock::now();
+    for( size_t i = 0; i < nRays; ++i )
+    {
+        const zrenderer::Vector3f origin( distribution( generator ),
+                                          distribution( generator ), 1 );
+        if( hierarchy.intersect( origin, zrenderer::Vector3f( 0, 0, -1 ),
+                                 hit ))
+        {
+            ++nHits;
+        }
+    }
+    const double rayTime = getNanoSecs( start, nRays );
+
+    const double mb = 1024.0 * 1024.0;
+    const size_t instancedSize = mesh->getMemorySize() +
+                                 geometry->getHierarchy().getMemorySize() +
+                                 instances->getMemorySize() +
+                                 hierarchy.getMemorySize();
+    std::cout << "Instancing, " << nInstances << " instances of "
+              << mesh->getTriangleCount() << " triangles" << std::endl
+              << "  build(ns/instance)  " << buildTime << std::endl
+              << "  ray(ns/ray)         " << rayTime << std::endl
+              << "  hits(%)             " << 100.0 * nHits / nRays << std::endl
+              << "  instanced(MB)       " << instancedSize / mb << std::endl
+              << "  flattened(MB)       "
+              << double( nInstances ) * mesh->getMemorySize() / mb
+              << std::endl;
+}
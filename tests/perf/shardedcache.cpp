@@ -0,0 +1,117 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <zrenderer/common/cache/cachable.h>
+#include <zrenderer/common/cache/cache.h>
+#include <zrenderer/common/cache/shardedcache.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <thread>
+
+#define BOOST_TEST_MODULE perf_shardedcache
+#include <boost/test/unit_test.hpp>
+
+// Usage: perf_shardedcache_cpp -- [maxThreads]
+// Measures the hit throughput of Cache and ShardedCache for 1 up to
+// maxThreads ( default 2 x hardware threads ) concurrent readers.
+
+namespace
+{
+const size_t nEntries = 100000;
+const size_t nLookups = 1000000;
+
+class TestObject : public zrenderer::Cachable< uint64_t >
+{
+public:
+
+    TestObject( const uint64_t& key,
+                std::allocator< TestObject >& )
+        : Cachable( key )
+    {}
+
+    size_t getSize() const { return 1; }
+};
+
+typedef zrenderer::Cache< TestObject,
+                          std::allocator< TestObject > > Cache;
+typedef zrenderer::ShardedCache< TestObject,
+                                 std::allocator< TestObject > > ShardedCache;
+typedef std::chrono::high_resolution_clock Clock;
+
+size_t getMaxThreads()
+{
+    const auto& suite = boost::unit_test::framework::master_test_suite();
+    if( suite.argc > 1 )
+        return std::strtoull( suite.argv[ suite.argc - 1 ], 0, 10 );
+    return 2 * std::max( std::thread::hardware_concurrency(), 1u );
+}
+
+template< class CacheType >
+double getHitThroughput( const CacheType& cache, const size_t nThreads )
+{
+    std::atomic< size_t > hits( 0 );
+    std::vector< std::thread > threads;
+
+    const Clock::time_point start = Clock::now();
+    for( size_t i = 0; i < nThreads; ++i )
+    {
+        threads.emplace_back( [&cache, &hits, i]
+        {
+            std::mt19937_64 generator( i );
+            std::uniform_int_distribution< uint64_t > distribution(
+                        0, nEntries - 1 );
+            size_t threadHits = 0;
+            for( size_t j = 0; j < nLookups; ++j )
+                threadHits += cache.get( distribution( generator )) ? 1 : 0;
+            hits += threadHits;
+        });
+    }
+
+    for( std::thread& thread: threads )
+        thread.join();
+
+    const double secs = std::chrono::duration< double >(
+                            Clock::now() - start ).count();
+    BOOST_CHECK_EQUAL( hits, nThreads * nLookups );
+    return double( nThreads * nLookups ) / secs / 1e6;
+}
+}
+
+BOOST_AUTO_TEST_CASE( cache_hit_scaling )
+{
+    std::allocator< TestObject > allocator;
+    Cache cache( allocator, nEntries );
+    ShardedCache shardedCache( allocator, nEntries, 64 );
+    for( uint64_t i = 0; i < nEntries; ++i )
+    {
+        cache.create( i );
+        shardedCache.create( i );
+    }
+
+    std::cout << "threads  Cache(Mops/s)  ShardedCache(Mops/s)" << std::endl;
+    for( size_t nThreads = 1; nThreads <= getMaxThreads(); nThreads *= 2 )
+    {
+        std::cout << nThreads << "  " << getHitThroughput( cache, nThreads )
+                  << "  " << getHitThroughput( shardedCache, nThreads )
+                  << std::endl;
+    }
+}
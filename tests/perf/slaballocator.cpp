@@ -0,0 +1,121 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <zrenderer/common/cache/cachable.h>
+#include <zrenderer/common/cache/cache.h>
+#include <zrenderer/common/slaballocator.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+#include <unistd.h>
+
+#define BOOST_TEST_MODULE perf_slaballocator
+#include <boost/test/unit_test.hpp>
+
+// Usage: perf_slaballocator_cpp -- [nCycles]
+// Measures the create/evict throughput and the resident memory growth
+// of a cache of brick sized objects, with the standard allocator and
+// with the slab allocator, over nCycles ( default 1M ) creates.
+
+namespace
+{
+const size_t brickSizes[] = { 512, 4096, 32768 };
+const size_t cacheSize = 64 * 1024 * 1024;
+
+template< template< typename > class AllocatorT >
+class BrickObject : public zrenderer::Cachable< uint64_t >
+{
+public:
+
+    BrickObject( const uint64_t& key,
+                 size_t size,
+                 AllocatorT< BrickObject >& allocator )
+        : Cachable( key )
+        , _data( size, 0, allocator )
+    {}
+
+    size_t getSize() const { return _data.size(); }
+
+private:
+    std::vector< uint8_t, AllocatorT< uint8_t >> _data;
+};
+
+typedef std::chrono::high_resolution_clock Clock;
+
+size_t getCycles()
+{
+    const auto& suite = boost::unit_test::framework::master_test_suite();
+    if( suite.argc > 1 )
+        return std::strtoull( suite.argv[ suite.argc - 1 ], 0, 10 );
+    return 1000000;
+}
+
+size_t getResidentBytes()
+{
+    size_t size = 0, resident = 0;
+    std::ifstream statm( "/proc/self/statm" );
+    statm >> size >> resident;
+    return resident * size_t( ::sysconf( _SC_PAGESIZE ));
+}
+
+template< template< typename > class AllocatorT >
+void benchmark( const std::string& name )
+{
+    typedef BrickObject< AllocatorT > Object;
+    typedef zrenderer::Cache< Object, AllocatorT< Object >> Cache;
+
+    const size_t nCycles = getCycles();
+    std::mt19937_64 generator( 42 );
+    std::uniform_int_distribution< size_t > distribution( 0, 2 );
+
+    AllocatorT< Object > allocator;
+    Cache cache( allocator, cacheSize );
+    const size_t startResident = getResidentBytes();
+    size_t warmResident = 0;
+
+    const Clock::time_point start = Clock::now();
+    for( uint64_t i = 0; i < nCycles; ++i )
+    {
+        BOOST_CHECK( cache.create( i, brickSizes[ distribution( generator )]));
+        if( i == nCycles / 10 )
+            warmResident = getResidentBytes();
+    }
+    const double seconds = std::chrono::duration< double >(
+                               Clock::now() - start ).count();
+    const size_t endResident = getResidentBytes();
+
+    std::cout << name << "  " << double( nCycles ) / seconds / 1e6 << "  "
+              << double( warmResident - startResident ) / 1048576.0 << "  "
+              << ( double( endResident ) - double( warmResident )) / 1048576.0
+              << std::endl;
+}
+}
+
+BOOST_AUTO_TEST_CASE( slab_allocator_throughput )
+{
+    std::cout << "allocator  Mcreates/s  warm-up RSS(MB)  RSS growth(MB)"
+              << std::endl;
+    // The second run reuses the heap pages released by the first one
+    benchmark< zrenderer::SlabAllocator >( "slab" );
+    benchmark< std::allocator >( "std" );
+}
@@ -0,0 +1,838 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <rbvh/quantizedrbvh.h>
+#include <rbvh/rbvhbuilder.h>
+#include <rbvh/rbvhfile.h>
+#include <rbvh/rbvhpage.h>
+#include <rbvh/rbvhstreambuilder.h>
+
+#include <cstdio>
+#include <fstream>
+#include <random>
+
+#define BOOST_TEST_MODULE rbvh
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+zrenderer::MeshPtr createRandomMesh( const size_t nTriangles,
+                                     const uint32_t seed )
+{
+    std::mt19937 generator( seed );
+    std::uniform_real_distribution< float > position( -10.0f, 10.0f );
+    std::uniform_real_distribution< float > offset( -0.5f, 0.5f );
+
+    zrenderer::Vector3fs positions;
+    zrenderer::Mesh::Indices indices;
+    for( size_t i = 0; i < nTriangles; ++i )
+    {
+        const zrenderer::Vector3f center( position( generator ),
+                                          position( generator ),
+                                          position( generator ));
+        for( size_t j = 0; j < 3; ++j )
+        {
+            indices.push_back( uint32_t( positions.size( )));
+            positions.push_back( center + zrenderer::Vector3f(
+                                     offset( generator ), offset( generator ),
+                                     offset( generator )));
+        }
+    }
+    return std::make_shared< zrenderer::Mesh >( positions, indices );
+}
+
+void checkHierarchy( const zrenderer::RBVH& rbvh,
+                     const zrenderer::AlignedBox3fs& bounds,
+                     const size_t maxLeafSize )
+{
+    const zrenderer::RBVHNodes& nodes = rbvh.getNodes();
+    const zrenderer::RBVH::Primitives& primitives = rbvh.getPrimitives();
+    BOOST_REQUIRE_EQUAL( primitives.size(), bounds.size( ));
+
+    // Every primitive is in exactly one leaf, inside the leaf bounds
+    std::vector< size_t > references( bounds.size(), 0 );
+    std::vector< size_t > parents( nodes.size(), 0 );
+    for( size_t i = 0; i < nodes.size(); ++i )
+    {
+        const zrenderer::RBVHNode& node = nodes[ i ];
+        if( node.isLeaf( ))
+        {
+            BOOST_CHECK_LE( node.count, maxLeafSize );
+            for( uint32_t j = node.offset; j < node.offset + node.count; ++j )
+            {
+                ++references[ primitives[ j ]];
+                BOOST_CHECK( node.bounds.contains( bounds[ primitives[ j ]] ));
+            }
+            continue;
+        }
+
+        BOOST_REQUIRE_LT( node.offset + 1, nodes.size( ));
+        ++parents[ node.offset ];
+        ++parents[ node.offset + 1 ];
+        BOOST_CHECK( node.bounds.contains( nodes[ node.offset ].bounds ));
+        BOOST_CHECK( node.bounds.contains( nodes[ node.offset + 1 ].bounds ));
+    }
+
+    for( const size_t count: references )
+        BOOST_CHECK_EQUAL( count, 1 );
+    BOOST_CHECK_EQUAL( parents[ 0 ], 0 );
+    for( size_t i = 1; i < parents.size(); ++i )
+        BOOST_CHECK_EQUAL( parents[ i ], 1 );
+    BOOST_CHECK_LE( rbvh.getDepth(), size_t( zrenderer::RBVH::MAX_DEPTH ));
+}
+
+// Streams the triangles of a mesh
+class MeshTriangleStream : public zrenderer::TriangleStream
+{
+public:
+
+    explicit MeshTriangleStream( const zrenderer::Mesh& mesh )
+        : _mesh( mesh )
+        , _position( 0 )
+    {}
+
+    uint64_t getTriangleCount() const final
+    {
+        return _mesh.getTriangleCount();
+    }
+
+    size_t read( zrenderer::Triangle* triangles, size_t count ) final
+    {
+        count = std::min( count, _mesh.getTriangleCount() - _position );
+        for( size_t i = 0; i < count; ++i, ++_position )
+            triangles[ i ] = getTriangle( _mesh, _position );
+        return count;
+    }
+
+    void rewind() final { _position = 0; }
+
+    static zrenderer::Triangle getTriangle( const zrenderer::Mesh& mesh,
+                                            const size_t index )
+    {
+        zrenderer::Triangle triangle;
+        for( size_t i = 0; i < 3; ++i )
+            triangle.vertices[ i ] =
+                    mesh.getPositions()[ mesh.getIndices()[ 3 * index + i ]];
+        return triangle;
+    }
+
+private:
+
+    const zrenderer::Mesh& _mesh;
+    size_t _position;
+};
+
+// Overwrites a value in a file
+template< typename T >
+void patchFile( const std::string& fileName, const uint64_t offset,
+                const T& value )
+{
+    std::fstream file( fileName.c_str(),
+                       std::ios::in | std::ios::out | std::ios::binary );
+    file.seekp( std::streamoff( offset ));
+    file.write( reinterpret_cast< const char* >( &value ), sizeof( value ));
+}
+
+template< typename T >
+T readFile( const std::string& fileName, const uint64_t offset )
+{
+    std::ifstream file( fileName.c_str(), std::ios::binary );
+    file.seekg( std::streamoff( offset ));
+    T value;
+    file.read( reinterpret_cast< char* >( &value ), sizeof( value ));
+    return value;
+}
+
+bool fileExists( const std::string& fileName )
+{
+    return std::ifstream( fileName.c_str( )).good();
+}
+
+zrenderer::AlignedBox3fs getTriangleBounds( const zrenderer::Mesh& mesh )
+{
+    zrenderer::AlignedBox3fs bounds( mesh.getTriangleCount( ));
+    for( size_t i = 0; i < bounds.size(); ++i )
+        bounds[ i ] = mesh.getTriangleBounds( i );
+    return bounds;
+}
+
+template< size_t Width >
+void checkWideHierarchy( const zrenderer::WideRBVH< Width >& wide,
+                         const zrenderer::RBVH& rbvh )
+{
+    typedef typename zrenderer::WideRBVH< Width >::Node Node;
+    const typename zrenderer::WideRBVH< Width >::Nodes& nodes =
+            wide.getNodes();
+    BOOST_REQUIRE( !nodes.empty( ));
+    BOOST_CHECK_LT( nodes.size(), rbvh.getNodes().size( ));
+    BOOST_CHECK_LT( wide.getDepth(), rbvh.getDepth( ));
+
+    // Every primitive is in exactly one leaf and every node but the root
+    // has one parent, which contains its bounds
+    std::vector< size_t > references( wide.getPrimitives().size(), 0 );
+    std::vector< size_t > parents( nodes.size(), 0 );
+    for( const Node& node: nodes )
+    {
+        for( size_t i = 0; i < Width; ++i )
+        {
+            if( node.offsets[ i ] == Node::EMPTY )
+                continue;
+
+            if( node.isLeaf( i ))
+            {
+                for( uint32_t j = node.offsets[ i ];
+                     j < node.offsets[ i ] + node.counts[ i ]; ++j )
+                {
+                    ++references[ j ];
+                }
+                continue;
+            }
+
+            BOOST_REQUIRE_LT( node.offsets[ i ], nodes.size( ));
+            ++parents[ node.offsets[ i ]];
+            const Node& child = nodes[ node.offsets[ i ]];
+            for( size_t j = 0; j < Width; ++j )
+            {
+                if( child.offsets[ j ] != Node::EMPTY )
+                    BOOST_CHECK( node.getBounds( i ).contains(
+                                     child.getBounds( j )));
+            }
+        }
+    }
+
+    for( const size_t count: references )
+        BOOST_CHECK_EQUAL( count, 1 );
+    BOOST_CHECK_EQUAL( parents[ 0 ], 0 );
+    for( size_t i = 1; i < parents.size(); ++i )
+        BOOST_CHECK_EQUAL( parents[ i ], 1 );
+}
+
+// Checks that the decoded bounds of the children of a quantized node
+// contain the bounds of the primitives below them, returns their union
+zrenderer::AlignedBox3f checkQuantizedNode(
+        const zrenderer::QuantizedRBVH8& rbvh,
+        const zrenderer::AlignedBox3fs& bounds, const uint32_t index,
+        std::vector< size_t >& references )
+{
+    const zrenderer::QuantizedRBVH8::Node& node = rbvh.getNodes()[ index ];
+    BOOST_CHECK_GT( node.childCount, 0 );
+    BOOST_CHECK_LE( node.childCount, 8 );
+
+    zrenderer::AlignedBox3f nodeBounds;
+    uint32_t child = node.childOffset;
+    uint32_t primitive = node.primitiveOffset;
+    for( size_t i = 0; i < node.childCount; ++i )
+    {
+        zrenderer::AlignedBox3f childBounds;
+        if( node.isLeaf( i ))
+        {
+            for( size_t j = 0; j < node.counts[ i ]; ++j, ++primitive )
+            {
+                const uint32_t id = rbvh.getPrimitives()[ primitive ];
+                ++references[ id ];
+                childBounds.extend( bounds[ id ]);
+            }
+        }
+        else
+        {
+            BOOST_REQUIRE_LT( child, rbvh.getNodes().size( ));
+            childBounds = checkQuantizedNode( rbvh, bounds, child++,
+                                              references );
+        }
+        BOOST_CHECK( node.getBounds( i ).contains( childBounds ));
+        nodeBounds.extend( childBounds );
+    }
+    return nodeBounds;
+}
+}
+
+BOOST_AUTO_TEST_CASE( empty )
+{
+    zrenderer::RBVHBuilder builder( 1 );
+    const zrenderer::RBVH rbvh = builder.build( zrenderer::AlignedBox3fs( ));
+    BOOST_CHECK( rbvh.getNodes().empty( ));
+    BOOST_CHECK( rbvh.getBounds().isEmpty( ));
+    BOOST_CHECK_EQUAL( rbvh.getDepth(), 0 );
+
+    float distance = 1.0f;
+    size_t nCalls = 0;
+    rbvh.intersect( zrenderer::Vector3f::Zero(), zrenderer::Vector3f::UnitX(),
+                    distance, [&]( uint32_t, float& ) { ++nCalls; });
+    BOOST_CHECK_EQUAL( nCalls, 0 );
+}
+
+BOOST_AUTO_TEST_CASE( build_and_intersect )
+{
+    const zrenderer::MeshPtr mesh = createRandomMesh( 20000, 7 );
+    const zrenderer::AlignedBox3fs bounds = getTriangleBounds( *mesh );
+
+    for( const size_t nThreads: { 1, 4 })
+    {
+        zrenderer::RBVHBuilder builder( nThreads );
+        BOOST_CHECK_EQUAL( builder.getThreadCount(), nThreads );
+        const zrenderer::RBVH rbvh = builder.build( *mesh );
+        checkHierarchy( rbvh, bounds, 8 );
+        BOOST_CHECK( rbvh.getBounds().isApprox( mesh->getBounds( )));
+
+        // The SAH split is better than the cost of a single leaf
+        BOOST_CHECK_GT( rbvh.getSAHCost(), 1.0f );
+        BOOST_CHECK_LT( rbvh.getSAHCost(), float( bounds.size( )) / 100 );
+
+        // Same closest hits as testing all triangles
+        std::mt19937 generator( 11 );
+        std::uniform_real_distribution< float > position( -12.0f, 12.0f );
+        size_t nHits = 0;
+        for( size_t i = 0; i < 1000; ++i )
+        {
+            const zrenderer::Vector3f origin( position( generator ),
+                                              position( generator ), -20.0f );
+            const zrenderer::Vector3f direction =
+                    zrenderer::Vector3f( position( generator ),
+                                         position( generator ), 20.0f )
+                    - origin;
+
+            float closest = std::numeric_limits< float >::max();
+            uint32_t closestTriangle = 0;
+            for( size_t j = 0; j < mesh->getTriangleCount(); ++j )
+            {
+                if( mesh->intersect( j, origin, direction, closest ))
+                    closestTriangle = uint32_t( j );
+            }
+
+            zrenderer::RBVH::Hit hit;
+            const bool found = rbvh.intersect( *mesh, origin, direction, hit );
+            BOOST_CHECK_EQUAL( found,
+                               closest < std::numeric_limits< float >::max( ));
+            if( !found )
+                continue;
+
+            ++nHits;
+            BOOST_CHECK_EQUAL( hit.primitive, closestTriangle );
+            BOOST_CHECK_EQUAL( hit.distance, closest );
+        }
+        BOOST_CHECK_GT( nHits, 100 );
+    }
+}
+
+BOOST_AUTO_TEST_CASE( build_parameters )
+{
+    const zrenderer::MeshPtr mesh = createRandomMesh( 5000, 3 );
+    const zrenderer::AlignedBox3fs bounds = getTriangleBounds( *mesh );
+
+    zrenderer::RBVHBuilder builder( 2 );
+    builder.setMaxLeafSize( 2 );
+    builder.setBinCount( 1000 );
+    const zrenderer::RBVH fine = builder.build( bounds );
+    checkHierarchy( fine, bounds, 2 );
+
+    // Expensive traversals make the leaves as large as allowed
+    builder.setMaxLeafSize( 16 );
+    builder.setBinCount( 4 );
+    builder.setCosts( 100.0f, 1.0f );
+    const zrenderer::RBVH coarse = builder.build( bounds );
+    checkHierarchy( coarse, bounds, 16 );
+    BOOST_CHECK_LT( coarse.getNodes().size(), fine.getNodes().size( ));
+    BOOST_CHECK_LT( coarse.getMemorySize(), fine.getMemorySize( ));
+}
+
+BOOST_AUTO_TEST_CASE( degenerate_primitives )
+{
+    // Equal boxes can not be split by their centers
+    const zrenderer::AlignedBox3f box( zrenderer::Vector3f( 0, 0, 0 ),
+                                       zrenderer::Vector3f( 1, 1, 1 ));
+    const zrenderer::AlignedBox3fs bounds( 100000, box );
+
+    zrenderer::RBVHBuilder builder( 4 );
+    const zrenderer::RBVH rbvh = builder.build( bounds );
+    checkHierarchy( rbvh, bounds, 8 );
+    BOOST_CHECK( rbvh.getBounds().isApprox( box ));
+
+    // A single primitive is a leaf root
+    const zrenderer::RBVH single =
+            builder.build( zrenderer::AlignedBox3fs( 1, box ));
+    BOOST_REQUIRE_EQUAL( single.getNodes().size(), 1 );
+    BOOST_CHECK( single.getNodes()[ 0 ].isLeaf( ));
+    BOOST_CHECK_EQUAL( single.getDepth(), 1 );
+}
+
+BOOST_AUTO_TEST_CASE( stream_build )
+{
+    const zrenderer::MeshPtr mesh = createRandomMesh( 100000, 5 );
+    const std::string stlFileName = "rbvh_stream_test.stl";
+    const std::string fileName = "rbvh_stream_test.rbvh";
+    {
+        MeshTriangleStream meshStream( *mesh );
+        zrenderer::STLTriangleStream::write( meshStream, stlFileName );
+    }
+
+    zrenderer::STLTriangleStream input( stlFileName );
+    BOOST_REQUIRE_EQUAL( input.getTriangleCount(), mesh->getTriangleCount( ));
+
+    // The smallest budget needs several partitions
+    zrenderer::RBVHStreamBuilder builder( 2 );
+    builder.setMemoryBudget( 0 );
+    BOOST_CHECK_EQUAL( builder.getMemoryBudget(),
+                       size_t( zrenderer::RBVHStreamBuilder::MIN_MEMORY_BUDGET ));
+    const zrenderer::RBVHStreamBuilder::Statistics statistics =
+            builder.build( input, fileName );
+    BOOST_CHECK_EQUAL( statistics.triangleCount, mesh->getTriangleCount( ));
+    BOOST_CHECK_GE( statistics.partitionCount,
+                    mesh->getTriangleCount() / builder.getMaxPartitionSize( ));
+    BOOST_CHECK_GT( statistics.pageCount, statistics.partitionCount );
+    BOOST_CHECK( !fileExists( fileName + ".partitions" ));
+
+    const zrenderer::RBVHFile file( fileName );
+    BOOST_CHECK_EQUAL( file.getTriangleCount(), mesh->getTriangleCount( ));
+    BOOST_CHECK_EQUAL( file.getPageCount(), statistics.pageCount );
+    BOOST_CHECK( file.getBounds().isApprox( mesh->getBounds( )));
+
+    // Every page is in one leaf of the index
+    std::vector< size_t > pageReferences( file.getPageCount(), 0 );
+    for( size_t i = 0; i < file.getTopNodeCount(); ++i )
+    {
+        const zrenderer::RBVHNode& node = file.getTopNodes()[ i ];
+        if( !node.isLeaf( ))
+            continue;
+        BOOST_CHECK_EQUAL( node.count, 1 );
+        BOOST_REQUIRE_LT( node.offset, file.getPageCount( ));
+        ++pageReferences[ node.offset ];
+        BOOST_CHECK( node.bounds.isApprox( file.getPage( node.offset ).bounds ));
+    }
+    for( const size_t count: pageReferences )
+        BOOST_CHECK_EQUAL( count, 1 );
+
+    // Every triangle is in one page, inside its bounds
+    std::vector< size_t > references( mesh->getTriangleCount(), 0 );
+    for( size_t i = 0; i < file.getPageCount(); ++i )
+    {
+        const zrenderer::RBVHFile::Page page = file.getPage( i );
+        BOOST_CHECK_LE( page.size, file.getPageSize( ));
+        BOOST_CHECK_EQUAL( page.offset % zrenderer::RBVHFile::PAGE_ALIGNMENT,
+                           0 );
+        BOOST_CHECK_EQUAL( page.nodes[ 0 ].bounds.min(), page.bounds.min( ));
+        for( uint32_t j = 0; j < page.triangleCount; ++j )
+        {
+            const uint64_t id = page.ids[ j ];
+            BOOST_REQUIRE_LT( id, references.size( ));
+            ++references[ id ];
+            const zrenderer::Triangle expected =
+                    MeshTriangleStream::getTriangle( *mesh, id );
+            BOOST_CHECK( page.triangles[ j ].vertices[ 2 ] ==
+                         expected.vertices[ 2 ]);
+            BOOST_CHECK( page.bounds.contains(
+                             page.triangles[ j ].getBounds( )));
+        }
+    }
+    for( const size_t count: references )
+        BOOST_CHECK_EQUAL( count, 1 );
+    BOOST_CHECK_THROW( file.getPage( file.getPageCount( )), std::out_of_range );
+
+    // Same closest hits as testing all triangles
+    std::mt19937 generator( 13 );
+    std::uniform_real_distribution< float > position( -12.0f, 12.0f );
+    size_t nHits = 0;
+    for( size_t i = 0; i < 200; ++i )
+    {
+        const zrenderer::Vector3f origin( position( generator ),
+                                          position( generator ), -20.0f );
+        const zrenderer::Vector3f direction =
+                zrenderer::Vector3f( position( generator ),
+                                     position( generator ), 20.0f ) - origin;
+
+        float closest = std::numeric_limits< float >::max();
+        for( size_t j = 0; j < mesh->getTriangleCount(); ++j )
+            mesh->intersect( j, origin, direction, closest );
+
+        zrenderer::RBVHFile::Hit hit;
+        const bool found = file.intersect( origin, direction, hit );
+        BOOST_CHECK_EQUAL( found,
+                           closest < std::numeric_limits< float >::max( ));
+        if( !found )
+            continue;
+
+        ++nHits;
+        BOOST_CHECK_EQUAL( hit.distance, closest );
+        float distance = std::numeric_limits< float >::max();
+        BOOST_CHECK( mesh->intersect( hit.triangle, origin, direction,
+                                      distance ));
+    }
+    BOOST_CHECK_GT( nHits, 50 );
+
+    std::remove( stlFileName.c_str( ));
+    std::remove( fileName.c_str( ));
+    BOOST_CHECK_THROW( zrenderer::STLTriangleStream missing( stlFileName ),
+                       std::runtime_error );
+    BOOST_CHECK_THROW( zrenderer::RBVHFile missing( fileName ),
+                       std::runtime_error );
+}
+
+BOOST_AUTO_TEST_CASE( raw_triangle_stream )
+{
+    const zrenderer::MeshPtr mesh = createRandomMesh( 1000, 5 );
+    const std::string rawFileName = "rbvh_raw_test.tri";
+    {
+        MeshTriangleStream meshStream( *mesh );
+        zrenderer::RawTriangleStream::write( meshStream, rawFileName );
+    }
+
+    zrenderer::RawTriangleStream input( rawFileName );
+    BOOST_REQUIRE_EQUAL( input.getTriangleCount(), mesh->getTriangleCount( ));
+    zrenderer::Triangles triangles( mesh->getTriangleCount() + 1 );
+    for( size_t pass = 0; pass < 2; ++pass )
+    {
+        BOOST_REQUIRE_EQUAL( input.read( triangles.data(), 300 ), 300 );
+        BOOST_REQUIRE_EQUAL( input.read( triangles.data() + 300,
+                                         triangles.size() - 300 ),
+                             mesh->getTriangleCount() - 300 );
+        BOOST_CHECK_EQUAL( input.read( triangles.data(), 1 ), 0 );
+        for( size_t i = 0; i < mesh->getTriangleCount(); ++i )
+        {
+            const zrenderer::Triangle expected =
+                    MeshTriangleStream::getTriangle( *mesh, i );
+            for( size_t j = 0; j < 3; ++j )
+                BOOST_CHECK( triangles[ i ].vertices[ j ] ==
+                             expected.vertices[ j ]);
+        }
+        input.rewind();
+    }
+
+    // A file shorter than its triangle count is invalid
+    patchFile( rawFileName, 0, uint64_t( mesh->getTriangleCount() + 1 ));
+    BOOST_CHECK_THROW( zrenderer::RawTriangleStream invalid( rawFileName ),
+                       std::runtime_error );
+    std::remove( rawFileName.c_str( ));
+    BOOST_CHECK_THROW( zrenderer::RawTriangleStream missing( rawFileName ),
+                       std::runtime_error );
+}
+
+BOOST_AUTO_TEST_CASE( stream_build_dense_partition )
+{
+    // The triangles of a single Morton cell larger than the budget are
+    // built in several pages
+    const zrenderer::Vector3fs positions = {
+        zrenderer::Vector3f( 0, 0, 0 ), zrenderer::Vector3f( 1, 0, 0 ),
+        zrenderer::Vector3f( 0, 1, 0 ) };
+    zrenderer::RBVHStreamBuilder builder( 1 );
+    builder.setMemoryBudget( 0 );
+    const size_t nTriangles = builder.getMaxPartitionSize() * 2 + 1;
+    const zrenderer::Mesh mesh( positions,
+                                zrenderer::Mesh::Indices( 3 * nTriangles, 0 ));
+    MeshTriangleStream input( mesh );
+
+    const std::string fileName = "rbvh_dense_test.rbvh";
+    const zrenderer::RBVHStreamBuilder::Statistics statistics =
+            builder.build( input, fileName );
+    BOOST_CHECK_EQUAL( statistics.partitionCount, 1 );
+    BOOST_CHECK_GE( statistics.pageCount, 3 );
+
+    const zrenderer::RBVHFile file( fileName );
+    BOOST_CHECK_EQUAL( file.getTriangleCount(), nTriangles );
+    BOOST_CHECK_EQUAL( file.getPageCount(), statistics.pageCount );
+    std::remove( fileName.c_str( ));
+
+    // An empty stream makes an empty file
+    const zrenderer::Mesh empty{ zrenderer::Vector3fs(),
+                                 zrenderer::Mesh::Indices() };
+    MeshTriangleStream emptyInput( empty );
+    builder.build( emptyInput, fileName );
+    const zrenderer::RBVHFile emptyFile( fileName );
+    BOOST_CHECK_EQUAL( emptyFile.getTriangleCount(), 0 );
+    BOOST_CHECK_EQUAL( emptyFile.getPageCount(), 0 );
+    BOOST_CHECK( emptyFile.getBounds().isEmpty( ));
+    zrenderer::RBVHFile::Hit hit;
+    BOOST_CHECK( !emptyFile.intersect( zrenderer::Vector3f::Zero(),
+                                       zrenderer::Vector3f::UnitX(), hit ));
+    std::remove( fileName.c_str( ));
+}
+
+BOOST_AUTO_TEST_CASE( paged_cache_traversal )
+{
+    const zrenderer::MeshPtr mesh = createRandomMesh( 50000, 9 );
+    const std::string fileName = "rbvh_paged_test.rbvh";
+    MeshTriangleStream input( *mesh );
+    zrenderer::RBVHStreamBuilder builder( 2 );
+    builder.setPageSize( 0 );
+    BOOST_CHECK_EQUAL( builder.getPageSize(),
+                       size_t( zrenderer::RBVHFile::MIN_PAGE_SIZE ));
+    builder.build( input, fileName );
+
+    const zrenderer::RBVHFile file( fileName );
+    BOOST_CHECK_EQUAL( file.getPageSize(),
+                       size_t( zrenderer::RBVHFile::MIN_PAGE_SIZE ));
+    BOOST_CHECK_GT( file.getPageCount(), 100 );
+
+    // The budget holds a few pages of the file
+    const size_t budget = 16 * size_t( zrenderer::RBVHFile::PAGE_ALIGNMENT );
+    std::allocator< zrenderer::RBVHPage > allocator;
+    zrenderer::RBVHPageCache cache( allocator, budget );
+
+    const zrenderer::RBVHPagePtr page = cache.create( 0, file );
+    BOOST_REQUIRE( page );
+    BOOST_CHECK_EQUAL( page->getPage().nodes, file.getPage( 0 ).nodes );
+    BOOST_CHECK_EQUAL( page->getDataSize(), file.getPage( 0 ).size );
+    BOOST_CHECK_THROW( cache.create( file.getPageCount(), file ),
+                       std::out_of_range );
+
+    // Same hits as reading the pages through the mapping
+    std::mt19937 generator( 17 );
+    std::uniform_real_distribution< float > position( -12.0f, 12.0f );
+    size_t nHits = 0;
+    for( size_t i = 0; i < 500; ++i )
+    {
+        const zrenderer::Vector3f origin( position( generator ),
+                                          position( generator ), -20.0f );
+        const zrenderer::Vector3f direction =
+                zrenderer::Vector3f( position( generator ),
+                                     position( generator ), 20.0f ) - origin;
+
+        zrenderer::RBVHFile::Hit expected, hit;
+        const bool found = file.intersect( origin, direction, expected );
+        BOOST_CHECK_EQUAL( file.intersect( origin, direction, cache, hit ),
+                           found );
+        if( !found )
+            continue;
+
+        ++nHits;
+        BOOST_CHECK_EQUAL( hit.triangle, expected.triangle );
+        BOOST_CHECK_EQUAL( hit.distance, expected.distance );
+        BOOST_CHECK_LE( cache.getPolicy().getUsage(), budget );
+    }
+    BOOST_CHECK_GT( nHits, 100 );
+
+    const zrenderer::CacheStatistics::Snapshot statistics =
+            cache.getStatistics().getSnapshot();
+    BOOST_CHECK_GT( statistics.hits, 0 );
+    BOOST_CHECK_GT( statistics.evictions, 0 );
+    std::remove( fileName.c_str( ));
+}
+
+BOOST_AUTO_TEST_CASE( wide_collapse )
+{
+    const zrenderer::MeshPtr mesh = createRandomMesh( 20000, 5 );
+    zrenderer::RBVHBuilder builder( 2 );
+    const zrenderer::RBVH rbvh = builder.build( *mesh );
+    const zrenderer::RBVH4 rbvh4( rbvh );
+    const zrenderer::RBVH8 rbvh8( rbvh );
+    checkWideHierarchy( rbvh4, rbvh );
+    checkWideHierarchy( rbvh8, rbvh );
+    BOOST_CHECK_LT( rbvh8.getNodes().size(), rbvh4.getNodes().size( ));
+
+    // Same closest hits as the binary hierarchy
+    std::mt19937 generator( 13 );
+    std::uniform_real_distribution< float > position( -12.0f, 12.0f );
+    size_t nHits = 0;
+    for( size_t i = 0; i < 1000; ++i )
+    {
+        const zrenderer::Vector3f origin( position( generator ),
+                                          position( generator ), -20.0f );
+        const zrenderer::Vector3f direction =
+                zrenderer::Vector3f( position( generator ),
+                                     position( generator ), 20.0f ) - origin;
+
+        zrenderer::RBVH::Hit expected, hit4, hit8;
+        const bool found = rbvh.intersect( *mesh, origin, direction,
+                                           expected );
+        BOOST_CHECK_EQUAL( rbvh4.intersect( *mesh, origin, direction, hit4 ),
+                           found );
+        BOOST_CHECK_EQUAL( rbvh8.intersect( *mesh, origin, direction, hit8 ),
+                           found );
+        if( !found )
+            continue;
+
+        ++nHits;
+        BOOST_CHECK_EQUAL( hit4.primitive, expected.primitive );
+        BOOST_CHECK_EQUAL( hit4.distance, expected.distance );
+        BOOST_CHECK_EQUAL( hit8.primitive, expected.primitive );
+        BOOST_CHECK_EQUAL( hit8.distance, expected.distance );
+    }
+    BOOST_CHECK_GT( nHits, 100 );
+
+    // A leaf root is the only child of the wide root
+    const zrenderer::AlignedBox3f box( zrenderer::Vector3f( 0, 0, 0 ),
+                                       zrenderer::Vector3f( 1, 1, 1 ));
+    const zrenderer::RBVH4 single(
+                builder.build( zrenderer::AlignedBox3fs( 1, box )));
+    BOOST_REQUIRE_EQUAL( single.getNodes().size(), 1 );
+    BOOST_CHECK( single.getNodes()[ 0 ].isLeaf( 0 ));
+    BOOST_CHECK_EQUAL( single.getNodes()[ 0 ].offsets[ 1 ],
+                       uint32_t( zrenderer::RBVH4::Node::EMPTY ));
+    BOOST_CHECK_EQUAL( single.getDepth(), 1 );
+    BOOST_CHECK( zrenderer::RBVH4().getNodes().empty( ));
+}
+
+BOOST_AUTO_TEST_CASE( quantized_nodes )
+{
+    // Far from the origin the grid cells are close to the float precision
+    const zrenderer::MeshPtr mesh = createRandomMesh( 20000, 19 );
+    zrenderer::Vector3fs positions = mesh->getPositions();
+    for( zrenderer::Vector3f& position: positions )
+        position += zrenderer::Vector3f( 10000.0f, -300.0f, 0.0f );
+    const zrenderer::Mesh farMesh( positions, mesh->getIndices( ));
+
+    zrenderer::RBVHBuilder builder( 2 );
+    for( const zrenderer::Mesh* current:
+         { static_cast< const zrenderer::Mesh* >( mesh.get( )), &farMesh })
+    {
+        const zrenderer::AlignedBox3fs bounds = getTriangleBounds( *current );
+        const zrenderer::RBVH rbvh = builder.build( *current );
+        const zrenderer::RBVH8 rbvh8( rbvh );
+        const zrenderer::QuantizedRBVH8 quantized( rbvh8 );
+        BOOST_CHECK_EQUAL( quantized.getNodes().size(),
+                           rbvh8.getNodes().size( ));
+        BOOST_CHECK_EQUAL( quantized.getDepth(), rbvh8.getDepth( ));
+        BOOST_CHECK_LT( quantized.getNodes().size() *
+                        sizeof( zrenderer::QuantizedRBVH8::Node ) * 3,
+                        rbvh8.getNodes().size() *
+                        sizeof( zrenderer::RBVH8::Node ));
+
+        std::vector< size_t > references( bounds.size(), 0 );
+        checkQuantizedNode( quantized, bounds, 0, references );
+        for( const size_t count: references )
+            BOOST_CHECK_EQUAL( count, 1 );
+
+        // Same closest hits as the binary hierarchy
+        const zrenderer::Vector3f center = current->getBounds().center();
+        std::mt19937 generator( 23 );
+        std::uniform_real_distribution< float > position( -12.0f, 12.0f );
+        size_t nHits = 0;
+        for( size_t i = 0; i < 1000; ++i )
+        {
+            const zrenderer::Vector3f origin =
+                    center + zrenderer::Vector3f( position( generator ),
+                                                  position( generator ),
+                                                  -20.0f );
+            const zrenderer::Vector3f direction =
+                    center + zrenderer::Vector3f( position( generator ),
+                                                  position( generator ),
+                                                  20.0f ) - origin;
+
+            zrenderer::RBVH::Hit expected, hit;
+            const bool found = rbvh.intersect( *current, origin, direction,
+                                               expected );
+            BOOST_CHECK_EQUAL( quantized.intersect( *current, origin,
+                                                    direction, hit ), found );
+            if( !found )
+                continue;
+
+            ++nHits;
+            BOOST_CHECK_EQUAL( hit.primitive, expected.primitive );
+            BOOST_CHECK_EQUAL( hit.distance, expected.distance );
+        }
+        BOOST_CHECK_GT( nHits, 100 );
+    }
+
+    // Flat and single primitive hierarchies
+    const zrenderer::AlignedBox3f flat( zrenderer::Vector3f( 1, 2, 3 ),
+                                        zrenderer::Vector3f( 1, 5, 3 ));
+    const zrenderer::QuantizedRBVH4 single( zrenderer::RBVH4(
+                builder.build( zrenderer::AlignedBox3fs( 1, flat ))));
+    BOOST_REQUIRE_EQUAL( single.getNodes().size(), 1 );
+    BOOST_CHECK_EQUAL( single.getNodes()[ 0 ].childCount, 1 );
+    BOOST_CHECK( single.getNodes()[ 0 ].getBounds( 0 ).contains( flat ));
+    BOOST_CHECK( zrenderer::QuantizedRBVH4().getNodes().empty( ));
+
+    // Leaf sizes are limited to 8 bits
+    builder.setMaxLeafSize( 1000 );
+    builder.setCosts( 100.0f, 1.0f );
+    const zrenderer::RBVH4 large( builder.build(
+                                      zrenderer::AlignedBox3fs( 1000, flat )));
+    BOOST_CHECK_THROW( zrenderer::QuantizedRBVH4 quantized( large ),
+                       std::runtime_error );
+}
+
+BOOST_AUTO_TEST_CASE( corrupt_rbvh_files )
+{
+    const zrenderer::MeshPtr mesh = createRandomMesh( 5000, 21 );
+    const std::string validName = "rbvh_valid_test.rbvh";
+    const std::string fileName = "rbvh_corrupt_test.rbvh";
+    MeshTriangleStream input( *mesh );
+    zrenderer::RBVHStreamBuilder builder( 1 );
+    builder.setPageSize( 0 );
+    builder.build( input, validName );
+
+    // Offsets in the header and the page table of the file format
+    const uint64_t topNodesOffset = 32;
+    const uint64_t pagesOffset = 40;
+    const uint64_t pageSize = 40;
+    const uint64_t topNodes =
+            readFile< uint64_t >( validName, topNodesOffset );
+    const uint64_t pages = readFile< uint64_t >( validName, pagesOffset );
+    const uint64_t page = readFile< uint64_t >( validName, pages );
+    {
+        const zrenderer::RBVHFile file( validName );
+        BOOST_REQUIRE_GT( file.getPageCount(), 2 );
+        BOOST_REQUIRE( !file.getTopNodes()[ 0 ].isLeaf( ));
+    }
+
+    const auto corrupt = [&]( const uint64_t offset, const uint64_t value )
+    {
+        std::ifstream source( validName.c_str(), std::ios::binary );
+        std::ofstream destination( fileName.c_str(),
+                                   std::ios::binary | std::ios::trunc );
+        destination << source.rdbuf();
+        destination.close();
+        patchFile( fileName, offset, value );
+    };
+
+    // Section offsets which overflow or are not aligned
+    corrupt( topNodesOffset, std::numeric_limits< uint64_t >::max() - 8 );
+    BOOST_CHECK_THROW( zrenderer::RBVHFile file( fileName ),
+                       std::runtime_error );
+    corrupt( pagesOffset, pages + 4 );
+    BOOST_CHECK_THROW( zrenderer::RBVHFile file( fileName ),
+                       std::runtime_error );
+
+    // Page offsets which overflow or are not aligned
+    corrupt( pages + pageSize, std::numeric_limits< uint64_t >::max( ));
+    BOOST_CHECK_THROW( zrenderer::RBVHFile file( fileName ),
+                       std::runtime_error );
+    corrupt( pages, page + 8 );
+    BOOST_CHECK_THROW( zrenderer::RBVHFile file( fileName ),
+                       std::runtime_error );
+
+    // A root which is its own child is a cycle of the index
+    const uint64_t rootOffset = topNodes + sizeof( zrenderer::AlignedBox3f );
+    corrupt( rootOffset, uint64_t( 0 ));
+    BOOST_CHECK_THROW( zrenderer::RBVHFile file( fileName ),
+                       std::runtime_error );
+
+    // A leaf range beyond the triangles of the first page is found when
+    // the page is read
+    const uint32_t pageNodeCount = readFile< uint32_t >( validName,
+                                                         pages + 8 );
+    const uint32_t pageTriangleCount = readFile< uint32_t >( validName,
+                                                             pages + 12 );
+    for( uint32_t i = 0; i < pageNodeCount; ++i )
+    {
+        const uint64_t node = page + i * sizeof( zrenderer::RBVHNode ) +
+                              sizeof( zrenderer::AlignedBox3f );
+        if( readFile< uint32_t >( validName, node + 4 ) == 0 )
+            continue;
+
+        corrupt( node, uint64_t( pageTriangleCount ) << 32 |
+                       uint64_t( pageTriangleCount ));
+        break;
+    }
+    const zrenderer::RBVHFile file( fileName );
+    BOOST_CHECK_THROW( file.getPage( 0 ), std::runtime_error );
+    BOOST_CHECK_NO_THROW( file.getPage( 1 ));
+
+    std::remove( validName.c_str( ));
+    std::remove( fileName.c_str( ));
+}
@@ -18,9 +18,18 @@
  */
 
 #include <zrenderer/scenegraph/scenegraph.h>
+#include <zrenderer/scenegraph/geometrydata.h>
+#include <zrenderer/scenegraph/instancehierarchy.h>
 #include <zrenderer/scenegraph/node.h>
+#include <zrenderer/scenegraph/scenefile.h>
+#include <zrenderer/scenegraph/snapshot.h>
+#include <zrenderer/scenegraph/transformdata.h>
 #include <zrenderer/scenegraph/visitor.h>
 
+#include <cstdio>
+#include <fstream>
+#include <thread>
+
 #define BOOST_TEST_MODULE scenegraph
 #include <boost/test/unit_test.hpp>
 
@@ -158,3 +167,1053 @@ BOOST_AUTO_TEST_CASE( add_node_and_visit )
     BOOST_CHECK( visitor2.endVisited == 2 );
 }
 
+
+class IdVisitor : public zrenderer::Visitor
+{
+public:
+
+    void visit( const zrenderer::SceneGraph&,
+                const zrenderer::NodeId id ) final
+    {
+        ids.push_back( id );
+    }
+
+    zrenderer::NodeIds ids;
+};
+
+BOOST_AUTO_TEST_CASE( node_ids )
+{
+    zrenderer::SceneGraph scenegraph;
+    BOOST_CHECK_EQUAL( scenegraph.getNodeCount(), 1 );
+    BOOST_CHECK_EQUAL( scenegraph.getRoot()->getId(),
+                       zrenderer::ROOT_NODE_ID );
+    BOOST_CHECK_EQUAL( scenegraph.findNodeId( zrenderer::ROOT_NODE ),
+                       zrenderer::ROOT_NODE_ID );
+
+    const zrenderer::NodeId parent = scenegraph.addNode( parentName,
+                                                         nullptr );
+    const zrenderer::NodeId child1 = scenegraph.addNode();
+    const zrenderer::NodeId child2 = scenegraph.addNode();
+    BOOST_CHECK_EQUAL( scenegraph.addNode( parentName, nullptr ),
+                       zrenderer::INVALID_NODE_ID );
+    BOOST_CHECK_EQUAL( scenegraph.getNodeCount(), 4 );
+    BOOST_CHECK_EQUAL( scenegraph.findNodeId( parentName ), parent );
+    BOOST_CHECK_EQUAL( scenegraph.getName( parent ), parentName );
+    BOOST_CHECK( scenegraph.getName( child1 ).empty( ));
+
+    BOOST_CHECK( scenegraph.addChild( zrenderer::ROOT_NODE_ID, parent ));
+    BOOST_CHECK( scenegraph.addChild( parent, child1 ));
+    BOOST_CHECK( scenegraph.addChild( parent, child2 ));
+
+    // A node has one parent and cycles are rejected
+    BOOST_CHECK( !scenegraph.addChild( zrenderer::ROOT_NODE_ID, child1 ));
+    BOOST_CHECK( !scenegraph.addChild( child1, zrenderer::ROOT_NODE_ID ));
+    BOOST_CHECK( !scenegraph.addChild( child1, child1 ));
+
+    BOOST_CHECK_EQUAL( scenegraph.getParent( child1 ), parent );
+    BOOST_CHECK_EQUAL( scenegraph.getParent( zrenderer::ROOT_NODE_ID ),
+                       zrenderer::INVALID_NODE_ID );
+    BOOST_CHECK_EQUAL( scenegraph.getChildCount( parent ), 2 );
+    BOOST_CHECK( scenegraph.hasChild( parent, child2 ));
+    BOOST_CHECK( !scenegraph.hasChild( zrenderer::ROOT_NODE_ID, child2 ));
+
+    zrenderer::NodeIds children;
+    scenegraph.getChildren( parent, children );
+    BOOST_REQUIRE_EQUAL( children.size(), 2 );
+    BOOST_CHECK_EQUAL( children[ 0 ], child1 );
+    BOOST_CHECK_EQUAL( children[ 1 ], child2 );
+
+    // The name based queries and the nodes agree with the ids
+    BOOST_CHECK_EQUAL( scenegraph.getParent( parentName )->getId(),
+                       zrenderer::ROOT_NODE_ID );
+    zrenderer::NodePtr node = scenegraph.getNode( child2 );
+    BOOST_CHECK_EQUAL( node->getId(), child2 );
+    BOOST_CHECK_EQUAL( node->getParent()->getName(), parentName );
+    BOOST_CHECK( node == scenegraph.getNode( child2 ));
+
+    IdVisitor visitor;
+    scenegraph.traverse( visitor, zrenderer::ROOT_NODE_ID );
+    BOOST_REQUIRE_EQUAL( visitor.ids.size(), 4 );
+    BOOST_CHECK_EQUAL( visitor.ids[ 0 ], zrenderer::ROOT_NODE_ID );
+    BOOST_CHECK_EQUAL( visitor.ids[ 1 ], parent );
+    BOOST_CHECK_EQUAL( visitor.ids[ 2 ], child1 );
+    BOOST_CHECK_EQUAL( visitor.ids[ 3 ], child2 );
+
+    // Removing detaches the children and invalidates the id
+    BOOST_CHECK( scenegraph.removeNode( parent ));
+    BOOST_CHECK( !scenegraph.removeNode( parent ));
+    BOOST_CHECK( !scenegraph.removeNode( zrenderer::ROOT_NODE_ID ));
+    BOOST_CHECK( !scenegraph.hasNode( parent ));
+    BOOST_CHECK( !scenegraph.getNode( parent ));
+    BOOST_CHECK_EQUAL( scenegraph.findNodeId( parentName ),
+                       zrenderer::INVALID_NODE_ID );
+    BOOST_CHECK_EQUAL( scenegraph.getParent( child1 ),
+                       zrenderer::INVALID_NODE_ID );
+    BOOST_CHECK_EQUAL( scenegraph.getChildCount( zrenderer::ROOT_NODE_ID ), 0 );
+
+    // The slot is reused with a new id
+    const zrenderer::NodeId reused = scenegraph.addNode( parentName,
+                                                         nullptr );
+    BOOST_CHECK( reused != parent );
+    BOOST_CHECK( scenegraph.hasNode( reused ));
+    BOOST_CHECK( !scenegraph.hasNode( parent ));
+    BOOST_CHECK( scenegraph.addChild( reused, child1 ));
+}
+
+BOOST_AUTO_TEST_CASE( hierarchy_changes )
+{
+    zrenderer::SceneGraph scenegraph;
+    zrenderer::NodeIds ids;
+    for( size_t i = 0; i < 4; ++i )
+    {
+        ids.push_back( scenegraph.addNode( ));
+        BOOST_CHECK( scenegraph.addChild( zrenderer::ROOT_NODE_ID,
+                                          ids.back( )));
+    }
+    const zrenderer::NodeId grandChild = scenegraph.addNode();
+    BOOST_CHECK( scenegraph.addChild( ids[ 2 ], grandChild ));
+
+    IdVisitor visitor1;
+    scenegraph.traverse( visitor1, zrenderer::ROOT_NODE_ID );
+    const zrenderer::NodeIds order1 = { zrenderer::ROOT_NODE_ID, ids[ 0 ],
+                                        ids[ 1 ], ids[ 2 ], grandChild,
+                                        ids[ 3 ] };
+    BOOST_CHECK_EQUAL_COLLECTIONS( visitor1.ids.begin(), visitor1.ids.end(),
+                                   order1.begin(), order1.end( ));
+
+    // Removing the first, a middle and the last child keeps the order
+    BOOST_CHECK( scenegraph.removeNode( ids[ 0 ] ));
+    BOOST_CHECK( scenegraph.removeNode( ids[ 3 ] ));
+    const zrenderer::NodeId added = scenegraph.addNode();
+    BOOST_CHECK( scenegraph.addChild( zrenderer::ROOT_NODE_ID, added ));
+    BOOST_CHECK( scenegraph.removeNode( ids[ 1 ] ));
+
+    zrenderer::NodeIds children;
+    scenegraph.getChildren( zrenderer::ROOT_NODE_ID, children );
+    const zrenderer::NodeIds expected = { ids[ 2 ], added };
+    BOOST_CHECK_EQUAL_COLLECTIONS( children.begin(), children.end(),
+                                   expected.begin(), expected.end( ));
+
+    IdVisitor visitor2;
+    scenegraph.traverse( visitor2, zrenderer::ROOT_NODE_ID );
+    const zrenderer::NodeIds order2 = { zrenderer::ROOT_NODE_ID, ids[ 2 ],
+                                        grandChild, added };
+    BOOST_CHECK_EQUAL_COLLECTIONS( visitor2.ids.begin(), visitor2.ids.end(),
+                                   order2.begin(), order2.end( ));
+
+    // A detached subtree can be traversed on its own
+    BOOST_CHECK( scenegraph.removeNode( zrenderer::ROOT_NODE_ID ) == false );
+    const zrenderer::NodeId detached = scenegraph.addNode();
+    const zrenderer::NodeId detachedChild = scenegraph.addNode();
+    BOOST_CHECK( scenegraph.addChild( detached, detachedChild ));
+
+    IdVisitor visitor3;
+    scenegraph.traverse( visitor3, detached );
+    const zrenderer::NodeIds order3 = { detached, detachedChild };
+    BOOST_CHECK_EQUAL_COLLECTIONS( visitor3.ids.begin(), visitor3.ids.end(),
+                                   order3.begin(), order3.end( ));
+
+    IdVisitor visitor4;
+    scenegraph.traverse( visitor4, ids[ 2 ] );
+    BOOST_CHECK_EQUAL( visitor4.ids.size(), 2 );
+}
+
+class GatherVisitor : public zrenderer::Visitor
+{
+public:
+
+    GatherVisitor() : ended( false ) {}
+
+    zrenderer::VisitorPtr fork() const final
+    {
+        return std::make_shared< GatherVisitor >();
+    }
+
+    void join( zrenderer::Visitor& visitor ) final
+    {
+        const GatherVisitor& forked =
+                static_cast< const GatherVisitor& >( visitor );
+        ids.insert( ids.end(), forked.ids.begin(), forked.ids.end( ));
+    }
+
+    void visit( const zrenderer::SceneGraph&,
+                const zrenderer::NodeId id ) final
+    {
+        ids.push_back( id );
+    }
+
+    void onEnd( const zrenderer::SceneGraph& ) final
+    {
+        ended = true;
+    }
+
+    zrenderer::NodeIds ids;
+    bool ended;
+};
+
+class SharedVisitor : public zrenderer::Visitor
+{
+public:
+
+    SharedVisitor() : count( 0 ) {}
+
+    void visit( const zrenderer::SceneGraph&, zrenderer::NodeId ) final
+    {
+        ++count;
+    }
+
+    std::atomic< size_t > count;
+};
+
+// Traverses the subtree of a node in parallel again when visiting it
+class NestedVisitor : public zrenderer::Visitor
+{
+public:
+
+    NestedVisitor( zrenderer::SceneGraph& scenegraph_,
+                   const zrenderer::NodeId nestedId_ )
+        : scenegraph( scenegraph_ )
+        , nestedId( nestedId_ )
+    {}
+
+    void visit( const zrenderer::SceneGraph&, zrenderer::NodeId id ) final
+    {
+        if( id == nestedId )
+            scenegraph.traverseParallel( nested, nestedId );
+    }
+
+    zrenderer::SceneGraph& scenegraph;
+    const zrenderer::NodeId nestedId;
+    SharedVisitor nested;
+};
+
+BOOST_AUTO_TEST_CASE( parallel_traversal )
+{
+    zrenderer::SceneGraph scenegraph( 4 );
+
+    // A deep chain, a wide node and a balanced tree under the root
+    zrenderer::NodeIds ids( 1, zrenderer::ROOT_NODE_ID );
+    zrenderer::NodeId parent = zrenderer::ROOT_NODE_ID;
+    for( size_t i = 0; i < 5000; ++i )
+    {
+        ids.push_back( scenegraph.addNode( ));
+        BOOST_CHECK( scenegraph.addChild( parent, ids.back( )));
+        parent = ids.back();
+    }
+
+    const zrenderer::NodeId wide = scenegraph.addNode();
+    ids.push_back( wide );
+    scenegraph.addChild( zrenderer::ROOT_NODE_ID, wide );
+    for( size_t i = 0; i < 5000; ++i )
+    {
+        ids.push_back( scenegraph.addNode( ));
+        scenegraph.addChild( wide, ids.back( ));
+    }
+
+    const size_t balancedBegin = ids.size();
+    for( size_t i = 0; i < 20000; ++i )
+    {
+        ids.push_back( scenegraph.addNode( ));
+        const zrenderer::NodeId balancedParent =
+                i == 0 ? zrenderer::ROOT_NODE_ID
+                       : ids[ balancedBegin + ( i - 1 ) / 4 ];
+        scenegraph.addChild( balancedParent, ids.back( ));
+    }
+
+    GatherVisitor visitor;
+    scenegraph.traverseParallel( visitor );
+    BOOST_CHECK( visitor.ended );
+    std::sort( visitor.ids.begin(), visitor.ids.end( ));
+    std::sort( ids.begin(), ids.end( ));
+    BOOST_CHECK_EQUAL_COLLECTIONS( visitor.ids.begin(), visitor.ids.end(),
+                                   ids.begin(), ids.end( ));
+
+    SharedVisitor sharedVisitor;
+    scenegraph.traverseParallel( sharedVisitor, wide );
+    BOOST_CHECK_EQUAL( sharedVisitor.count, 5001 );
+
+    // A traversal from a visitor runs on the worker of the visitor
+    NestedVisitor nestedVisitor( scenegraph, wide );
+    scenegraph.traverseParallel( nestedVisitor );
+    BOOST_CHECK_EQUAL( nestedVisitor.nested.count, 5001 );
+
+    SharedVisitor invalidVisitor;
+    scenegraph.traverseParallel( invalidVisitor, zrenderer::INVALID_NODE_ID );
+    BOOST_CHECK_EQUAL( invalidVisitor.count, 0 );
+}
+
+// Uses the scene graph while visiting, which locks it again
+class NodeDataVisitor : public zrenderer::Visitor
+{
+public:
+
+    explicit NodeDataVisitor( zrenderer::SceneGraph& scenegraph_ )
+        : scenegraph( scenegraph_ )
+        , count( 0 )
+    {}
+
+    void visit( const zrenderer::SceneGraph&, zrenderer::NodePtr node ) final
+    {
+        node->getNodeData< zrenderer::NodeData >();
+        if( count++ == 0 )
+            scenegraph.createNode( "visited" );
+    }
+
+    zrenderer::SceneGraph& scenegraph;
+    size_t count;
+};
+
+BOOST_AUTO_TEST_CASE( traversal_with_concurrent_writer )
+{
+    zrenderer::SceneGraph scenegraph( 2 );
+    for( size_t i = 0; i < 1000; ++i )
+        scenegraph.addChild( zrenderer::ROOT_NODE_ID, scenegraph.addNode( ));
+
+    std::atomic< bool > stopped( false );
+    std::thread writer( [&]
+    {
+        while( !stopped )
+        {
+            const zrenderer::NodeId id = scenegraph.addNode();
+            scenegraph.addChild( zrenderer::ROOT_NODE_ID, id );
+            scenegraph.removeNode( id );
+        }
+    });
+
+    // The visitors lock the scene graph again while the writer waits
+    for( size_t i = 0; i < 100; ++i )
+    {
+        NodeDataVisitor visitor( scenegraph );
+        scenegraph.traverse( visitor, zrenderer::ROOT_NODE_ID );
+        BOOST_CHECK_GT( visitor.count, 1000 );
+
+        SharedVisitor sharedVisitor;
+        scenegraph.traverseParallel( sharedVisitor );
+        BOOST_CHECK_GT( sharedVisitor.count, 1000 );
+    }
+    stopped = true;
+    writer.join();
+}
+
+class SnapshotVisitor : public zrenderer::Visitor
+{
+public:
+
+    void visit( const zrenderer::Snapshot&,
+                const zrenderer::NodeId id ) final
+    {
+        ids.push_back( id );
+    }
+
+    zrenderer::NodeIds ids;
+};
+
+BOOST_AUTO_TEST_CASE( snapshots )
+{
+    zrenderer::SceneGraph scenegraph;
+    zrenderer::ConstSnapshotPtr snapshot1 = scenegraph.getSnapshot();
+    BOOST_REQUIRE( snapshot1 );
+    BOOST_CHECK_EQUAL( snapshot1->getNodeCount(), 1 );
+    BOOST_CHECK_EQUAL( snapshot1->findNodeId( zrenderer::ROOT_NODE ),
+                       zrenderer::ROOT_NODE_ID );
+
+    const zrenderer::NodeId parent = scenegraph.addNode( parentName,
+                                                         nullptr );
+    const zrenderer::NodeId child = scenegraph.addNode();
+    scenegraph.addChild( zrenderer::ROOT_NODE_ID, parent );
+    scenegraph.addChild( parent, child );
+
+    // The changes are not visible until they are published
+    BOOST_CHECK( scenegraph.getSnapshot() == snapshot1 );
+    BOOST_CHECK( !snapshot1->hasNode( parent ));
+
+    zrenderer::ConstSnapshotPtr snapshot2 = scenegraph.publish();
+    BOOST_CHECK( scenegraph.getSnapshot() == snapshot2 );
+    BOOST_CHECK( scenegraph.publish() == snapshot2 );
+    BOOST_CHECK_GT( snapshot2->getVersion(), snapshot1->getVersion( ));
+    BOOST_CHECK_EQUAL( snapshot2->getNodeCount(), 3 );
+    BOOST_CHECK_EQUAL( snapshot2->findNodeId( parentName ), parent );
+    BOOST_CHECK_EQUAL( snapshot2->getName( parent ), parentName );
+    BOOST_CHECK_EQUAL( snapshot2->getParent( child ), parent );
+    BOOST_CHECK( snapshot2->hasChild( parent, child ));
+    BOOST_CHECK_EQUAL( snapshot2->getChildCount( zrenderer::ROOT_NODE_ID ),
+                       1 );
+
+    scenegraph.removeNode( parent );
+    const zrenderer::NodeId sibling = scenegraph.addNode();
+    scenegraph.addChild( zrenderer::ROOT_NODE_ID, sibling );
+    zrenderer::ConstSnapshotPtr snapshot3 = scenegraph.publish();
+
+    // The old snapshot still shows the old frame
+    SnapshotVisitor visitor2;
+    snapshot2->traverse( visitor2 );
+    const zrenderer::NodeIds order2 = { zrenderer::ROOT_NODE_ID, parent,
+                                        child };
+    BOOST_CHECK_EQUAL_COLLECTIONS( visitor2.ids.begin(), visitor2.ids.end(),
+                                   order2.begin(), order2.end( ));
+
+    SnapshotVisitor visitor3;
+    snapshot3->traverse( visitor3 );
+    const zrenderer::NodeIds order3 = { zrenderer::ROOT_NODE_ID, sibling };
+    BOOST_CHECK_EQUAL_COLLECTIONS( visitor3.ids.begin(), visitor3.ids.end(),
+                                   order3.begin(), order3.end( ));
+    BOOST_CHECK( !snapshot3->hasNode( parent ));
+    BOOST_CHECK_EQUAL( snapshot3->findNodeId( parentName ),
+                       zrenderer::INVALID_NODE_ID );
+    BOOST_CHECK_EQUAL( snapshot3->getParent( child ),
+                       zrenderer::INVALID_NODE_ID );
+
+    zrenderer::NodeIds children;
+    snapshot3->getChildren( zrenderer::ROOT_NODE_ID, children );
+    BOOST_REQUIRE_EQUAL( children.size(), 1 );
+    BOOST_CHECK_EQUAL( children[ 0 ], sibling );
+}
+
+BOOST_AUTO_TEST_CASE( snapshot_readers )
+{
+    zrenderer::SceneGraph scenegraph;
+    std::atomic< bool > stopped( false );
+    std::atomic< size_t > inconsistent( 0 );
+    std::atomic< size_t > nReads( 0 );
+
+    // Every published frame has all its nodes under the root
+    std::thread reader( [&]
+    {
+        while( !stopped )
+        {
+            zrenderer::ConstSnapshotPtr snapshot = scenegraph.getSnapshot();
+            SnapshotVisitor visitor;
+            snapshot->traverse( visitor );
+            if( visitor.ids.size() != snapshot->getNodeCount( ))
+                ++inconsistent;
+            ++nReads;
+        }
+    });
+
+    // Only leaves are removed, so every node stays under the root
+    zrenderer::NodeIds ids;
+    for( size_t i = 0; i < 20000; ++i )
+    {
+        ids.push_back( scenegraph.addNode( ));
+        const zrenderer::NodeId parent = ids[ i / 2 ];
+        if( i % 2 == 0 || !scenegraph.addChild( parent, ids.back( )))
+            scenegraph.addChild( zrenderer::ROOT_NODE_ID, ids.back( ));
+
+        if( i % 100 == 99 )
+        {
+            scenegraph.removeNode( ids.back( ));
+            scenegraph.publish();
+        }
+    }
+    stopped = true;
+    reader.join();
+
+    BOOST_CHECK_EQUAL( inconsistent, 0 );
+    BOOST_CHECK_GT( nReads, 0 );
+}
+
+BOOST_AUTO_TEST_CASE( transactions )
+{
+    zrenderer::SceneGraph scenegraph;
+    const zrenderer::NodeId existing = scenegraph.addNode( childName2,
+                                                           nullptr );
+
+    zrenderer::SceneGraph::Transaction transaction( scenegraph );
+    const zrenderer::NodeId parent = transaction.addNode( parentName,
+                                                          nullptr );
+    const zrenderer::NodeId child1 = transaction.addNode( childName1,
+                                                          nullptr );
+    const zrenderer::NodeId child2 = transaction.addNode();
+    const zrenderer::NodeId duplicate = transaction.addNode( childName2,
+                                                             nullptr );
+    transaction.addChild( zrenderer::ROOT_NODE_ID, parent );
+    transaction.addChild( parent, child1 );
+    transaction.addChild( parent, child2 );
+    transaction.addChild( parent, existing );
+    transaction.addChild( parent, duplicate );
+    transaction.removeNode( child2 );
+    transaction.setNodeData( parent, nullptr );
+    BOOST_CHECK_EQUAL( transaction.getSize(), 11 );
+
+    // Nothing is visible before the commit
+    BOOST_CHECK_EQUAL( scenegraph.getNodeCount(), 2 );
+    BOOST_CHECK_EQUAL( scenegraph.findNodeId( parentName ),
+                       zrenderer::INVALID_NODE_ID );
+
+    // The duplicate name and the child of it fail
+    BOOST_CHECK_EQUAL( transaction.commit(), 2 );
+    BOOST_CHECK_EQUAL( transaction.getSize(), 0 );
+    BOOST_CHECK_EQUAL( scenegraph.getNodeCount(), 4 );
+    BOOST_CHECK_EQUAL( transaction.getNodeId( duplicate ),
+                       zrenderer::INVALID_NODE_ID );
+    BOOST_CHECK_EQUAL( transaction.getNodeId( existing ), existing );
+    BOOST_CHECK( !scenegraph.hasNode( transaction.getNodeId( child2 )));
+
+    const zrenderer::NodeId parentId = transaction.getNodeId( parent );
+    BOOST_CHECK_EQUAL( scenegraph.findNodeId( parentName ), parentId );
+    BOOST_CHECK_EQUAL( scenegraph.getParent( parentId ),
+                       zrenderer::ROOT_NODE_ID );
+
+    zrenderer::NodeIds children;
+    scenegraph.getChildren( parentId, children );
+    const zrenderer::NodeIds expected = { transaction.getNodeId( child1 ),
+                                          existing };
+    BOOST_CHECK_EQUAL_COLLECTIONS( children.begin(), children.end(),
+                                   expected.begin(), expected.end( ));
+
+    // A transaction can be reused
+    transaction.removeNode( parentId );
+    BOOST_CHECK_EQUAL( transaction.commit(), 0 );
+    BOOST_CHECK( !scenegraph.hasNode( parentId ));
+    BOOST_CHECK_EQUAL( scenegraph.getParent( existing ),
+                       zrenderer::INVALID_NODE_ID );
+}
+
+BOOST_AUTO_TEST_CASE( transforms_and_bounds )
+{
+    using zrenderer::Affine3f;
+    using zrenderer::AlignedBox3f;
+    using zrenderer::Vector3f;
+
+    zrenderer::SceneGraph scenegraph;
+    const AlignedBox3f unitBox( Vector3f( -1, -1, -1 ), Vector3f( 1, 1, 1 ));
+
+    // root -> translate( 10, 0, 0 ) -> { box, scale( 2 ) -> box }
+    std::shared_ptr< zrenderer::TransformData > translation(
+        new zrenderer::TransformData(
+            Affine3f( Eigen::Translation3f( 10, 0, 0 ))));
+    const zrenderer::NodeId group = scenegraph.addNode( translation );
+    const zrenderer::NodeId box1 = scenegraph.addNode(
+        std::make_shared< zrenderer::BoundsData >( unitBox ));
+    const zrenderer::NodeId scaled = scenegraph.addNode(
+        std::make_shared< zrenderer::TransformData >(
+            Affine3f( Eigen::Scaling( 2.0f ))));
+    const zrenderer::NodeId box2 = scenegraph.addNode(
+        std::make_shared< zrenderer::BoundsData >( unitBox ));
+    scenegraph.addChild( zrenderer::ROOT_NODE_ID, group );
+    scenegraph.addChild( group, box1 );
+    scenegraph.addChild( group, scaled );
+    scenegraph.addChild( scaled, box2 );
+
+    Affine3f transform;
+    BOOST_CHECK( !scenegraph.getWorldTransform( box2, transform ));
+    BOOST_CHECK_EQUAL( scenegraph.updateTransforms(), 5 );
+
+    BOOST_REQUIRE( scenegraph.getWorldTransform( box2, transform ));
+    BOOST_CHECK( transform.isApprox( Eigen::Translation3f( 10, 0, 0 ) *
+                                     Eigen::Scaling( 2.0f )));
+
+    AlignedBox3f bounds;
+    BOOST_REQUIRE( scenegraph.getWorldBounds( box1, bounds ));
+    BOOST_CHECK( bounds.isApprox( AlignedBox3f( Vector3f( 9, -1, -1 ),
+                                                Vector3f( 11, 1, 1 ))));
+    BOOST_REQUIRE( scenegraph.getWorldBounds( zrenderer::ROOT_NODE_ID,
+                                              bounds ));
+    BOOST_CHECK( bounds.isApprox( AlignedBox3f( Vector3f( 8, -2, -2 ),
+                                                Vector3f( 12, 2, 2 ))));
+
+    // Nothing is dirty
+    BOOST_CHECK_EQUAL( scenegraph.updateTransforms(), 0 );
+
+    // Moving a subtree updates it and the bounds of its ancestors
+    translation->setTransform( Affine3f( Eigen::Translation3f( 0, 5, 0 )));
+    scenegraph.markDirty( group );
+    BOOST_CHECK_EQUAL( scenegraph.updateTransforms(), 5 );
+    BOOST_REQUIRE( scenegraph.getWorldBounds( zrenderer::ROOT_NODE_ID,
+                                              bounds ));
+    BOOST_CHECK( bounds.isApprox( AlignedBox3f( Vector3f( -2, 3, -2 ),
+                                                Vector3f( 2, 7, 2 ))));
+
+    scenegraph.setNodeData( scaled, std::make_shared<
+                                zrenderer::TransformData >( ));
+    BOOST_CHECK_EQUAL( scenegraph.updateTransforms(), 4 );
+    BOOST_REQUIRE( scenegraph.getWorldBounds( group, bounds ));
+    BOOST_CHECK( bounds.isApprox( AlignedBox3f( Vector3f( -1, 4, -1 ),
+                                                Vector3f( 1, 6, 1 ))));
+
+    // Removing a node shrinks the bounds of its ancestors
+    BOOST_CHECK( scenegraph.removeNode( scaled ));
+    scenegraph.updateTransforms();
+    BOOST_REQUIRE( scenegraph.getWorldBounds( zrenderer::ROOT_NODE_ID,
+                                              bounds ));
+    BOOST_CHECK( bounds.isApprox( AlignedBox3f( Vector3f( -1, 4, -1 ),
+                                                Vector3f( 1, 6, 1 ))));
+
+    // The detached child is a root now
+    BOOST_REQUIRE( scenegraph.getWorldTransform( box2, transform ));
+    BOOST_CHECK( transform.isApprox( Affine3f::Identity( )));
+}
+
+namespace
+{
+struct Mesh
+{
+    Mesh( size_t nTriangles_ = 0 ) : nTriangles( nTriangles_ ) {}
+    size_t nTriangles;
+};
+
+struct Material
+{
+    float roughness;
+};
+}
+
+BOOST_AUTO_TEST_CASE( components )
+{
+    zrenderer::SceneGraph scenegraph;
+    zrenderer::ComponentStore& store = scenegraph.getComponents();
+
+    zrenderer::NodeIds ids;
+    for( size_t i = 0; i < 10; ++i )
+    {
+        ids.push_back( scenegraph.addNode( ));
+        store.add< Mesh >( ids.back(), i );
+        if( i % 2 == 0 )
+            store.add< Material >( ids.back(), Material{ 0.5f });
+    }
+
+    BOOST_CHECK_EQUAL( store.getSize< Mesh >(), 10 );
+    BOOST_CHECK_EQUAL( store.getSize< Material >(), 5 );
+    BOOST_CHECK( store.has< Material >( ids[ 2 ] ));
+    BOOST_CHECK( !store.has< Material >( ids[ 3 ] ));
+    BOOST_CHECK_EQUAL( store.get< Mesh >( ids[ 3 ] )->nTriangles, 3 );
+
+    // Adding again replaces the component
+    store.add< Mesh >( ids[ 3 ], 30 );
+    BOOST_CHECK_EQUAL( store.getSize< Mesh >(), 10 );
+    BOOST_CHECK_EQUAL( scenegraph.getNode( ids[ 3 ] )->getComponent< Mesh >()
+                           ->nTriangles, 30 );
+
+    size_t nVisited = 0;
+    size_t nTriangles = 0;
+    store.forEach< Mesh, Material >(
+        [&]( zrenderer::NodeId, Mesh& mesh, Material& material )
+        {
+            ++nVisited;
+            nTriangles += mesh.nTriangles;
+            material.roughness = 1.0f;
+        });
+    BOOST_CHECK_EQUAL( nVisited, 5 );
+    BOOST_CHECK_EQUAL( nTriangles, 0 + 2 + 4 + 6 + 8 );
+    BOOST_CHECK_EQUAL( store.get< Material >( ids[ 4 ] )->roughness, 1.0f );
+
+    // The components are removed with the node and the last component
+    // fills the gap
+    BOOST_CHECK( scenegraph.removeNode( ids[ 0 ] ));
+    BOOST_CHECK( store.remove< Mesh >( ids[ 5 ] ));
+    BOOST_CHECK( !store.remove< Mesh >( ids[ 5 ] ));
+    BOOST_CHECK_EQUAL( store.getSize< Mesh >(), 8 );
+    BOOST_CHECK_EQUAL( store.getSize< Material >(), 4 );
+    BOOST_CHECK( !store.has< Mesh >( ids[ 0 ] ));
+    BOOST_CHECK_EQUAL( store.get< Mesh >( ids[ 9 ] )->nTriangles, 9 );
+
+    // A new node in the slot of the removed one has no components
+    const zrenderer::NodeId reused = scenegraph.addNode();
+    BOOST_CHECK_EQUAL( uint32_t( reused ), uint32_t( ids[ 0 ] ));
+    BOOST_CHECK( !store.has< Mesh >( reused ));
+
+    nVisited = 0;
+    store.forEach< Mesh >( [&]( zrenderer::NodeId, Mesh& )
+                           { ++nVisited; });
+    BOOST_CHECK_EQUAL( nVisited, 8 );
+
+    const zrenderer::ComponentStore& constComponents = store;
+    BOOST_CHECK( !constComponents.get< float >( ids[ 1 ] ));
+}
+
+BOOST_AUTO_TEST_CASE( components_with_concurrent_removal )
+{
+    zrenderer::SceneGraph scenegraph;
+    zrenderer::ComponentStore& store = scenegraph.getComponents();
+    zrenderer::NodeIds ids;
+    for( size_t i = 0; i < 10000; ++i )
+    {
+        ids.push_back( scenegraph.addNode( ));
+        store.add< Mesh >( ids.back(), i );
+    }
+
+    // The iteration sees consistent arrays while the nodes are removed
+    std::thread remover( [&]
+    {
+        for( const zrenderer::NodeId id: ids )
+            scenegraph.removeNode( id );
+    });
+
+    size_t nVisited = 1;
+    while( nVisited > 0 )
+    {
+        nVisited = 0;
+        store.forEach< Mesh >( [&]( const zrenderer::NodeId id,
+                                    const Mesh& mesh )
+        {
+            BOOST_REQUIRE_EQUAL( mesh.nTriangles, size_t( uint32_t( id )) - 1 );
+            ++nVisited;
+        });
+    }
+    remover.join();
+    BOOST_CHECK_EQUAL( store.getSize< Mesh >(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( scene_file )
+{
+    using zrenderer::Affine3f;
+    using zrenderer::AlignedBox3f;
+    using zrenderer::Vector3f;
+
+    // Albert -> { Batman -> { 4 boxes }, Robin }
+    zrenderer::SceneGraph source;
+    const zrenderer::NodeId albert = source.addNode( parentName,
+        std::make_shared< zrenderer::TransformData >(
+            Affine3f( Eigen::Translation3f( 1, 2, 3 ))));
+    const zrenderer::NodeId batman = source.addNode( childName1,
+                                                     zrenderer::NodeDataPtr( ));
+    const zrenderer::NodeId robin = source.addNode( childName2,
+                                                    zrenderer::NodeDataPtr( ));
+    source.addChild( zrenderer::ROOT_NODE_ID, albert );
+    source.addChild( albert, batman );
+    source.addChild( albert, robin );
+    for( size_t i = 0; i < 4; ++i )
+    {
+        const Vector3f min( float( i ), 0, 0 );
+        const zrenderer::NodeId box = source.addNode(
+            std::make_shared< zrenderer::BoundsData >(
+                AlignedBox3f( min, min + Vector3f( 1, 1, 1 ))));
+        source.addChild( batman, box );
+    }
+
+    // Geometry is not stored, only its node
+    const zrenderer::Vector3fs positions = { Vector3f( 0, 0, 0 ),
+                                             Vector3f( 1, 0, 0 ),
+                                             Vector3f( 0, 1, 0 ) };
+    const zrenderer::NodeId geometry = source.addNode(
+        std::make_shared< zrenderer::GeometryData >(
+            std::make_shared< zrenderer::Mesh >(
+                positions, zrenderer::Mesh::Indices{ 0, 1, 2 }), 1 ));
+    source.addChild( robin, geometry );
+    source.publish();
+
+    const std::string fileName = "scenegraph_test.zscene";
+    zrenderer::SceneFile::write( *source.getSnapshot(), albert, fileName );
+
+    // The scene graph outlives the scene files attached to it
+    zrenderer::SceneGraph scenegraph;
+    zrenderer::SceneFile file( fileName );
+    BOOST_CHECK_EQUAL( file.getNodeCount(), 8 );
+
+    // Only the root node of the file is created when it is attached
+    const zrenderer::NodeId root = file.attach( scenegraph,
+                                                zrenderer::ROOT_NODE_ID );
+    BOOST_REQUIRE( root != zrenderer::INVALID_NODE_ID );
+    BOOST_CHECK_EQUAL( scenegraph.getNodeCount(), 2 );
+    BOOST_CHECK_EQUAL( file.getMaterializedCount(), 1 );
+    BOOST_CHECK( file.isExpandable( root ));
+    BOOST_CHECK_EQUAL( scenegraph.getName( root ), parentName );
+    BOOST_CHECK_EQUAL( scenegraph.getParent( root ), zrenderer::ROOT_NODE_ID );
+
+    const auto& transform = std::dynamic_pointer_cast< zrenderer::TransformData >(
+                                scenegraph.getNodeData( root ));
+    BOOST_REQUIRE( transform );
+    BOOST_CHECK( transform->getTransform().isApprox(
+                     Affine3f( Eigen::Translation3f( 1, 2, 3 ))));
+
+    BOOST_CHECK_EQUAL( file.expand( scenegraph, root ), 2 );
+    BOOST_CHECK_EQUAL( file.expand( scenegraph, root ), 0 );
+    BOOST_CHECK( !file.isExpandable( root ));
+    const zrenderer::NodeId batmanId = scenegraph.findNodeId( childName1 );
+    const zrenderer::NodeId robinId = scenegraph.findNodeId( childName2 );
+    zrenderer::NodeIds children;
+    scenegraph.getChildren( root, children );
+    BOOST_REQUIRE_EQUAL( children.size(), 2 );
+    BOOST_CHECK_EQUAL( children[ 0 ], batmanId );
+    BOOST_CHECK_EQUAL( children[ 1 ], robinId );
+    BOOST_CHECK( file.isExpandable( batmanId ));
+    BOOST_CHECK( file.isExpandable( robinId ));
+    BOOST_CHECK_EQUAL( scenegraph.getChildCount( batmanId ), 0 );
+
+    // Traversing expands the rest of the subtree in depth first order
+    IdVisitor visitor;
+    file.traverse( scenegraph, visitor, root );
+    BOOST_CHECK_EQUAL( visitor.ids.size(), 8 );
+    BOOST_CHECK_EQUAL( file.getMaterializedCount(), 8 );
+    BOOST_CHECK_EQUAL( scenegraph.getNodeCount(), 9 );
+    BOOST_CHECK_EQUAL( visitor.ids[ 1 ], batmanId );
+    BOOST_CHECK_EQUAL( visitor.ids[ 6 ], robinId );
+    BOOST_CHECK( !scenegraph.getNodeData( visitor.ids[ 7 ] ));
+    BOOST_CHECK_EQUAL( zrenderer::InstanceHierarchy(
+                           scenegraph, root ).getInstanceCount(), 0 );
+    for( size_t i = 0; i < 4; ++i )
+    {
+        const auto& bounds = std::dynamic_pointer_cast< zrenderer::BoundsData >(
+                                 scenegraph.getNodeData( visitor.ids[ i + 2 ]));
+        BOOST_REQUIRE( bounds );
+        const Vector3f min( float( i ), 0, 0 );
+        BOOST_CHECK( bounds->getBounds().isApprox(
+                         AlignedBox3f( min, min + Vector3f( 1, 1, 1 ))));
+    }
+
+    // A second instance gets unnamed nodes, as the names are taken
+    zrenderer::SceneFile second( fileName );
+    const zrenderer::NodeId instance = second.attach( scenegraph, root );
+    BOOST_REQUIRE( instance != zrenderer::INVALID_NODE_ID );
+    BOOST_CHECK( scenegraph.getName( instance ).empty( ));
+    BOOST_CHECK_EQUAL( scenegraph.findNodeId( parentName ), root );
+    BOOST_CHECK_THROW( second.attach( source, zrenderer::ROOT_NODE_ID ),
+                       std::runtime_error );
+
+    // The removed nodes are dropped from the expandable ones
+    BOOST_CHECK( second.isExpandable( instance ));
+    BOOST_CHECK( scenegraph.removeNode( instance ));
+    BOOST_CHECK( !second.isExpandable( instance ));
+    BOOST_CHECK_EQUAL( second.expand( scenegraph, instance ), 0 );
+
+    // Invalid files are rejected
+    {
+        std::ofstream invalid( fileName.c_str(), std::ios::trunc );
+        invalid << "Not a scene file";
+    }
+    BOOST_CHECK_THROW( zrenderer::SceneFile invalidFile( fileName ),
+                       std::runtime_error );
+    BOOST_CHECK_THROW( zrenderer::SceneFile missingFile( "missing.zscene" ),
+                       std::runtime_error );
+    std::remove( fileName.c_str( ));
+}
+
+BOOST_AUTO_TEST_CASE( instancing )
+{
+    using zrenderer::AffineCompact3f;
+    using zrenderer::AlignedBox3f;
+    using zrenderer::Vector3f;
+
+    // Unit quad in the xy plane
+    const zrenderer::Vector3fs positions = { Vector3f( 0, 0, 0 ),
+                                             Vector3f( 1, 0, 0 ),
+                                             Vector3f( 1, 1, 0 ),
+                                             Vector3f( 0, 1, 0 ) };
+    const zrenderer::Mesh::Indices indices = { 0, 1, 2, 0, 2, 3 };
+    const zrenderer::MeshPtr mesh =
+            std::make_shared< zrenderer::Mesh >( positions, indices );
+    BOOST_CHECK_EQUAL( mesh->getTriangleCount(), 2 );
+    BOOST_CHECK_THROW( zrenderer::Mesh( positions, { 0, 1, 4 } ),
+                       std::runtime_error );
+
+    const zrenderer::GeometryDataPtr geometry =
+            std::make_shared< zrenderer::GeometryData >( mesh, 7 );
+
+    // Three quads along x, the middle one with its own material
+    const zrenderer::InstanceDataPtr instances =
+            std::make_shared< zrenderer::InstanceData >( geometry );
+    for( size_t i = 0; i < 3; ++i )
+        instances->addInstance(
+            AffineCompact3f( Eigen::Translation3f( float( i ) * 2, 0, 0 )),
+            i == 1 ? 3 : zrenderer::InstanceData::GEOMETRY_MATERIAL );
+    BOOST_CHECK_EQUAL( instances->getInstanceCount(), 3 );
+    BOOST_CHECK_EQUAL( instances->getMaterial( 0 ), 7 );
+    BOOST_CHECK_EQUAL( instances->getMaterial( 1 ), 3 );
+    BOOST_CHECK( instances->getBounds().isApprox(
+                     AlignedBox3f( Vector3f( 0, 0, 0 ), Vector3f( 5, 1, 0 ))));
+
+    // The instances are 10 units behind the geometry node
+    zrenderer::SceneGraph scenegraph;
+    const zrenderer::NodeId group = scenegraph.addNode(
+        std::make_shared< zrenderer::TransformData >(
+            zrenderer::Affine3f( Eigen::Translation3f( 0, 0, -10 ))));
+    const zrenderer::NodeId forest = scenegraph.addNode( instances );
+    const zrenderer::NodeId single = scenegraph.addNode( geometry );
+    scenegraph.addChild( zrenderer::ROOT_NODE_ID, group );
+    scenegraph.addChild( group, forest );
+    scenegraph.addChild( zrenderer::ROOT_NODE_ID, single );
+
+    const zrenderer::InstanceHierarchy hierarchy( scenegraph );
+    BOOST_CHECK_EQUAL( hierarchy.getInstanceCount(), 4 );
+    BOOST_CHECK_EQUAL( hierarchy.getGeometryCount(), 1 );
+    BOOST_CHECK( hierarchy.getBounds().isApprox(
+                     AlignedBox3f( Vector3f( 0, 0, -10 ), Vector3f( 5, 1, 0 ))));
+
+    AlignedBox3f bounds;
+    BOOST_REQUIRE( scenegraph.getWorldBounds( zrenderer::ROOT_NODE_ID,
+                                              bounds ));
+    BOOST_CHECK( bounds.isApprox( hierarchy.getBounds( )));
+
+    // The geometry node is in front of the first instance
+    zrenderer::InstanceHierarchy::Hit hit;
+    BOOST_REQUIRE( hierarchy.intersect( Vector3f( 0.25f, 0.5f, 5 ),
+                                        Vector3f( 0, 0, -1 ), hit ));
+    BOOST_CHECK_EQUAL( hit.node, single );
+    BOOST_CHECK_CLOSE( hit.distance, 5.0f, 0.001f );
+    BOOST_CHECK_EQUAL( hit.material, 7 );
+    BOOST_CHECK_EQUAL( hit.triangle, 1 );
+
+    BOOST_REQUIRE( hierarchy.intersect( Vector3f( 2.75f, 0.25f, 5 ),
+                                        Vector3f( 0, 0, -1 ), hit ));
+    BOOST_CHECK_EQUAL( hit.node, forest );
+    BOOST_CHECK_EQUAL( hit.instance, 1 );
+    BOOST_CHECK_EQUAL( hit.triangle, 0 );
+    BOOST_CHECK_EQUAL( hit.material, 3 );
+    BOOST_CHECK_CLOSE( hit.distance, 15.0f, 0.001f );
+
+    // Between the instances, behind and beyond the maximum distance
+    BOOST_CHECK( !hierarchy.intersect( Vector3f( 1.5f, 0.5f, 5 ),
+                                       Vector3f( 0, 0, -1 ), hit ));
+    BOOST_CHECK( !hierarchy.intersect( Vector3f( 4.5f, 0.5f, 5 ),
+                                       Vector3f( 0, 0, 1 ), hit ));
+    BOOST_CHECK( !hierarchy.intersect( Vector3f( 4.5f, 0.5f, 5 ),
+                                       Vector3f( 0, 0, -1 ), hit, 10 ));
+
+    // Built while another thread changes the scene graph, the instances
+    // and their transforms are of the same state
+    std::atomic< bool > stopped( false );
+    std::thread writer( [&]
+    {
+        for( size_t i = 0; !stopped; ++i )
+        {
+            const zrenderer::NodeId id = scenegraph.addNode( geometry );
+            scenegraph.addChild( group, id );
+            scenegraph.setNodeData( group,
+                std::make_shared< zrenderer::TransformData >(
+                    zrenderer::Affine3f( Eigen::Translation3f(
+                        0, 0, i % 2 ? -20.0f : -10.0f ))));
+            scenegraph.removeNode( id );
+        }
+    });
+    for( size_t i = 0; i < 100; ++i )
+    {
+        const zrenderer::InstanceHierarchy current( scenegraph );
+        BOOST_CHECK_GE( current.getInstanceCount(), 4 );
+        BOOST_CHECK_LE( current.getInstanceCount(), 5 );
+
+        const float depth = -current.getBounds().min().z();
+        BOOST_CHECK( depth == 10.0f || depth == 20.0f );
+        BOOST_REQUIRE( current.intersect( Vector3f( 2.75f, 0.25f, 5 ),
+                                          Vector3f( 0, 0, -1 ), hit ));
+        BOOST_CHECK_CLOSE( hit.distance, 5.0f + depth, 0.001f );
+    }
+    stopped = true;
+    writer.join();
+}
+
+BOOST_AUTO_TEST_CASE( change_journal )
+{
+    zrenderer::SceneGraph scenegraph;
+    uint64_t cursor = scenegraph.getChangeVersion();
+
+    zrenderer::Changes received;
+    const size_t subscription = scenegraph.subscribe(
+        [&]( const zrenderer::Change& change )
+        { received.push_back( change ); });
+
+    const zrenderer::NodeId parent = scenegraph.addNode();
+    const zrenderer::NodeId child = scenegraph.addNode();
+    scenegraph.addChild( zrenderer::ROOT_NODE_ID, parent );
+    scenegraph.addChild( parent, child );
+    scenegraph.setNodeData( child, zrenderer::NodeDataPtr( ));
+    scenegraph.markDirty( parent );
+    BOOST_CHECK( !scenegraph.addChild( parent, parent ));
+    scenegraph.removeNode( parent );
+
+    zrenderer::Changes changes;
+    BOOST_REQUIRE( scenegraph.getChanges( cursor, changes ));
+    BOOST_CHECK_EQUAL( cursor, scenegraph.getChangeVersion( ));
+    BOOST_REQUIRE_EQUAL( changes.size(), 8 );
+    BOOST_CHECK_EQUAL( changes[ 0 ].type, zrenderer::CHANGE_NODE_ADDED );
+    BOOST_CHECK_EQUAL( changes[ 0 ].id, parent );
+    BOOST_CHECK_EQUAL( changes[ 2 ].type, zrenderer::CHANGE_PARENT_CHANGED );
+    BOOST_CHECK_EQUAL( changes[ 2 ].parent, zrenderer::ROOT_NODE_ID );
+    BOOST_CHECK_EQUAL( changes[ 3 ].id, child );
+    BOOST_CHECK_EQUAL( changes[ 3 ].parent, parent );
+    BOOST_CHECK_EQUAL( changes[ 4 ].type,
+                       zrenderer::CHANGE_NODE_DATA_CHANGED );
+    BOOST_CHECK_EQUAL( changes[ 5 ].type,
+                       zrenderer::CHANGE_NODE_DATA_CHANGED );
+    BOOST_CHECK_EQUAL( changes[ 5 ].id, parent );
+
+    // Removing a node detaches its children
+    BOOST_CHECK_EQUAL( changes[ 6 ].type, zrenderer::CHANGE_PARENT_CHANGED );
+    BOOST_CHECK_EQUAL( changes[ 6 ].id, child );
+    BOOST_CHECK_EQUAL( changes[ 6 ].parent, zrenderer::INVALID_NODE_ID );
+    BOOST_CHECK_EQUAL( changes[ 7 ].type, zrenderer::CHANGE_NODE_REMOVED );
+    BOOST_CHECK_EQUAL( changes[ 7 ].parent, zrenderer::ROOT_NODE_ID );
+    for( size_t i = 1; i < changes.size(); ++i )
+        BOOST_CHECK_EQUAL( changes[ i ].version, changes[ i - 1 ].version + 1 );
+
+    // The subscriber got the same changes, in order
+    BOOST_REQUIRE_EQUAL( received.size(), changes.size( ));
+    for( size_t i = 0; i < changes.size(); ++i )
+        BOOST_CHECK_EQUAL( received[ i ].version, changes[ i ].version );
+
+    // A transaction notifies after the commit
+    received.clear();
+    zrenderer::SceneGraph::Transaction transaction( scenegraph );
+    const zrenderer::NodeId staged = transaction.addNode();
+    transaction.addChild( zrenderer::ROOT_NODE_ID, staged );
+    transaction.commit();
+    BOOST_REQUIRE_EQUAL( received.size(), 2 );
+    BOOST_CHECK_EQUAL( received[ 1 ].id, transaction.getNodeId( staged ));
+
+    // Nothing new for an up to date cursor
+    changes.clear();
+    BOOST_CHECK( scenegraph.getChanges( cursor, changes ));
+    BOOST_CHECK_EQUAL( changes.size(), 2 );
+    BOOST_CHECK( scenegraph.getChanges( cursor, changes ));
+    BOOST_CHECK_EQUAL( changes.size(), 2 );
+
+    BOOST_CHECK( scenegraph.unsubscribe( subscription ));
+    BOOST_CHECK( !scenegraph.unsubscribe( subscription ));
+    received.clear();
+    scenegraph.addNode();
+    BOOST_CHECK( received.empty( ));
+
+    // A cursor behind the kept changes has to rebuild
+    scenegraph.setChangeJournalCapacity( 4 );
+    uint64_t lateCursor = scenegraph.getChangeVersion();
+    for( size_t i = 0; i < 5; ++i )
+        scenegraph.addNode();
+    changes.clear();
+    BOOST_CHECK( !scenegraph.getChanges( lateCursor, changes ));
+    BOOST_CHECK( changes.empty( ));
+    BOOST_CHECK_EQUAL( lateCursor, scenegraph.getChangeVersion( ));
+    BOOST_CHECK( !scenegraph.getChanges( cursor, changes ));
+
+    scenegraph.addNode();
+    BOOST_CHECK( scenegraph.getChanges( lateCursor, changes ));
+    BOOST_CHECK_EQUAL( changes.size(), 1 );
+
+    // The subscribers are reset if a commit overflows the journal
+    received.clear();
+    scenegraph.subscribe( [&]( const zrenderer::Change& change )
+                          { received.push_back( change ); });
+    for( size_t i = 0; i < 5; ++i )
+        transaction.addNode();
+    transaction.commit();
+    BOOST_REQUIRE_EQUAL( received.size(), 1 );
+    BOOST_CHECK_EQUAL( received[ 0 ].type, zrenderer::CHANGE_RESET );
+    BOOST_CHECK_EQUAL( received[ 0 ].version, scenegraph.getChangeVersion( ));
+}
+
+BOOST_AUTO_TEST_CASE( subscribe_in_callback )
+{
+    zrenderer::SceneGraph scenegraph;
+
+    // A one shot subscriber unsubscribes itself and subscribes another
+    size_t nOnce = 0;
+    size_t nLater = 0;
+    size_t once = 0;
+    once = scenegraph.subscribe( [&]( const zrenderer::Change& )
+    {
+        ++nOnce;
+        BOOST_CHECK( scenegraph.unsubscribe( once ));
+        scenegraph.subscribe( [&]( const zrenderer::Change& )
+                              { ++nLater; });
+    });
+
+    // The unsubscribed callback is not called for the rest of the
+    // delivered changes, the new one only for the later changes
+    zrenderer::SceneGraph::Transaction transaction( scenegraph );
+    const zrenderer::NodeId staged = transaction.addNode();
+    transaction.addChild( zrenderer::ROOT_NODE_ID, staged );
+    transaction.commit();
+    BOOST_CHECK_EQUAL( nOnce, 1 );
+    BOOST_CHECK_EQUAL( nLater, 0 );
+    scenegraph.removeNode( transaction.getNodeId( staged ));
+    BOOST_CHECK_EQUAL( nOnce, 1 );
+    BOOST_CHECK_EQUAL( nLater, 1 );
+}
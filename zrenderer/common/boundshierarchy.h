@@ -0,0 +1,175 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _boundshierarchy_h_
+#define _boundshierarchy_h_
+
+#include <zrenderer/common/bvhnode.h>
+
+#include <algorithm>
+
+namespace zrenderer
+{
+
+/**
+ * Bounding volume hierarchy over a set of boxes. The items are split at
+ * the median of their centers along the widest axis, which is quick to
+ * build and good enough for the top level of a scene or for small
+ * meshes. It has the node layout and the traversal of the RBVH, with
+ * the leaf ranges indexing the item array.
+ */
+class BoundsHierarchy
+{
+public:
+
+    typedef RBVHNode Node;
+    typedef RBVHNodes Nodes;
+    typedef std::vector< uint32_t > Items;
+
+    /**
+     * Default maximum number of items in a leaf
+     */
+    static const size_t MAX_LEAF_SIZE = 4;
+
+    /**
+     * Builds an empty hierarchy
+     */
+    BoundsHierarchy() {}
+
+    /**
+     * Builds the hierarchy.
+     * @param bounds are the boxes of the items
+     * @param maxLeafSize is the maximum number of items in a leaf
+     */
+    explicit BoundsHierarchy( const AlignedBox3fs& bounds,
+                              const size_t maxLeafSize = MAX_LEAF_SIZE )
+    {
+        if( bounds.empty( ))
+            return;
+
+        _items.resize( bounds.size( ));
+        Vector3fs centers( bounds.size( ));
+        for( size_t i = 0; i < bounds.size(); ++i )
+        {
+            _items[ i ] = uint32_t( i );
+            centers[ i ] = bounds[ i ].center();
+        }
+
+        struct Range
+        {
+            uint32_t node;
+            uint32_t begin;
+            uint32_t end;
+        };
+
+        const size_t leafSize = std::max< size_t >( maxLeafSize, 1 );
+        _nodes.reserve( 2 * bounds.size() / leafSize + 1 );
+        _nodes.push_back( Node( ));
+        std::vector< Range > stack( 1, Range{ 0, 0, uint32_t( bounds.size( )) });
+        while( !stack.empty( ))
+        {
+            const Range range = stack.back();
+            stack.pop_back();
+
+            AlignedBox3f nodeBounds;
+            AlignedBox3f centerBounds;
+            for( uint32_t i = range.begin; i < range.end; ++i )
+            {
+                nodeBounds.extend( bounds[ _items[ i ]] );
+                centerBounds.extend( centers[ _items[ i ]] );
+            }
+
+            Node& node = _nodes[ range.node ];
+            node.bounds = nodeBounds;
+            if( range.end - range.begin <= leafSize )
+            {
+                node.offset = range.begin;
+                node.count = range.end - range.begin;
+                continue;
+            }
+
+            Vector3f::Index axis;
+            centerBounds.sizes().maxCoeff( &axis );
+            const uint32_t middle = range.begin + ( range.end - range.begin ) / 2;
+            std::nth_element( _items.begin() + range.begin,
+                              _items.begin() + middle,
+                              _items.begin() + range.end,
+                              [&]( const uint32_t a, const uint32_t b )
+                              { return centers[ a ][ axis ] <
+                                       centers[ b ][ axis ]; });
+
+            const uint32_t left = uint32_t( _nodes.size( ));
+            node.offset = left;
+            node.count = 0;
+            _nodes.resize( _nodes.size() + 2 );
+            stack.push_back( Range{ left, range.begin, middle });
+            stack.push_back( Range{ left + 1, middle, range.end });
+        }
+    }
+
+    /** @return the bounds of all items, empty if there are none */
+    AlignedBox3f getBounds() const
+    {
+        return _nodes.empty() ? AlignedBox3f() : _nodes[ 0 ].bounds;
+    }
+
+    /** @return the nodes, the first one is the root */
+    const Nodes& getNodes() const { return _nodes; }
+
+    /** @return the item indices, in the order of the leaves */
+    const Items& getItems() const { return _items; }
+
+    /** @return the size of the nodes and the items in bytes */
+    size_t getMemorySize() const
+    {
+        return _nodes.size() * sizeof( Node ) + _items.size() * sizeof( uint32_t );
+    }
+
+    /**
+     * Calls a function for the items whose boxes are hit by a ray, the
+     * closer nodes first.
+     * @param origin is the origin of the ray
+     * @param direction is the direction of the ray
+     * @param distance is the maximum distance along the ray, which the
+     * function shortens when it hits an item
+     * @param intersectItem is called with the item index and the distance
+     */
+    template< typename F >
+    void intersect( const Vector3f& origin,
+                    const Vector3f& direction,
+                    float& distance,
+                    F&& intersectItem ) const
+    {
+        if( _nodes.empty( ))
+            return;
+
+        intersectRBVHNodes( _nodes.data(), origin, direction, distance,
+                            [&]( const uint32_t i, float& hitDistance )
+                            { intersectItem( _items[ i ], hitDistance ); });
+    }
+
+private:
+
+    Nodes _nodes;
+    Items _items;
+};
+
+}
+
+#endif // _boundshierarchy_h_
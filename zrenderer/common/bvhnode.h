@@ -0,0 +1,142 @@
+/* Copyright(c) ZombieRendering 2015 - 2016 serkan.ergun@gmail.com
+ *
+ * This file is part of Z-Renderer(https://github.com/ZombieRendering/Z-Renderer)
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met :
+ *
+ * -Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * -Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and / or other materials provided with the distribution.
+ * -Neither the name of Eyescale Software GmbH nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _bvhnode_h_
+#define _bvhnode_h_
+
+#include <zrenderer/common/mathtypes.h>
+
+namespace zrenderer
+{
+
+/**
+ * Node of the ray tracing bounding volume hierarchy, 32 bytes. The two
+ * children of an inner node are next to each other in the node array
+ * and the primitives of a leaf are a range of the primitive array.
+ */
+struct RBVHNode
+{
+    /** @return true if the node is a leaf */
+    bool isLeaf() const { return count > 0; }
+
+    AlignedBox3f bounds;
+
+    // Index of the first child for the inner nodes, of the first
+    // primitive for the leaves
+    uint32_t offset;
+
+    // Zero for the inner nodes, the number of primitives for the leaves
+    uint32_t count;
+};
+
+typedef std::vector< RBVHNode > RBVHNodes;
+
+static_assert( sizeof( RBVHNode ) == 32, "Unexpected RBVH node size" );
+
+/**
+ * Maximum depth of the hierarchies, the size of the traversal stack
+ */
+const size_t RBVH_MAX_DEPTH = 64;
+
+/**
+ * Calls a function for the primitives in the leaves hit by a ray, the
+ * closer nodes first.
+ * @param nodes are the nodes of a hierarchy, the first one is the root
+ * @param origin is the origin of the ray
+ * @param direction is the direction of the ray
+ * @param distance is the maximum distance along the ray, which the
+ * function shortens when it hits a primitive
+ * @param intersectPrimitive is called with the index of the primitive in
+ * the leaf ranges and the distance
+ */
+template< typename F >
+void intersectRBVHNodes( const RBVHNode* nodes,
+                         const Vector3f& origin,
+                         const Vector3f& direction,
+                         float& distance,
+                         F&& intersectPrimitive )
+{
+    const Vector3f inverse = direction.cwiseInverse();
+    float entry;
+    if( !intersectRayBox( nodes[ 0 ].bounds, origin, inverse, distance,
+                          entry ))
+    {
+        return;
+    }
+
+    uint32_t stack[ RBVH_MAX_DEPTH ];
+    size_t size = 0;
+    uint32_t current = 0;
+    while( true )
+    {
+        const RBVHNode& node = nodes[ current ];
+        if( node.isLeaf( ))
+        {
+            for( uint32_t i = node.offset; i < node.offset + node.count; ++i )
+                intersectPrimitive( i, distance );
+        }
+        else
+        {
+            float leftEntry, rightEntry;
+            const bool hitLeft = intersectRayBox( nodes[ node.offset ].bounds,
+                                                  origin, inverse, distance,
+                                                  leftEntry );
+            const bool hitRight = intersectRayBox(
+                                      nodes[ node.offset + 1 ].bounds,
+                                      origin, inverse, distance,
+                                      rightEntry );
+            if( hitLeft && hitRight )
+            {
+                const bool leftFirst = leftEntry <= rightEntry;
+                stack[ size++ ] = node.offset + ( leftFirst ? 1 : 0 );
+                current = node.offset + ( leftFirst ? 0 : 1 );
+                continue;
+            }
+            if( hitLeft || hitRight )
+            {
+                current = node.offset + ( hitLeft ? 0 : 1 );
+                continue;
+            }
+        }
+
+        // The nodes on the stack may be farther than a closer hit
+        do
+        {
+            if( size == 0 )
+                return;
+            current = stack[ --size ];
+        }
+        while( !intersectRayBox( nodes[ current ].bounds, origin, inverse,
+                                 distance, entry ));
+    }
+}
+
+}
+
+#endif // _bvhnode_h_
@@ -0,0 +1,282 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _arccachepolicy_h_
+#define _arccachepolicy_h_
+
+#include <zrenderer/common/types.h>
+#include <zrenderer/common/cache/cachable.h>
+
+namespace zrenderer
+{
+
+/**
+ * Adaptive replacement cache ( ARC ) policy. Objects used once are kept
+ * in the T1 list and objects used more than once in the T2 list, both in
+ * LRU order. The keys of the objects evicted from them are remembered in
+ * the ghost lists B1 and B2. A request for a key in a ghost list adapts
+ * the target memory for T1, so the policy balances between recency and
+ * frequency depending on the access pattern. The lists are measured in
+ * bytes, so objects of different sizes can be cached.
+ */
+template< class CacheObject,
+          class Hash = std::hash< typename CacheObject::key_type > >
+class ARCCachePolicy
+{
+public:
+
+    typedef typename CacheObject::key_type Key;
+    typedef std::vector< Key > Keys;
+
+    /**
+     * @param maxMemory Max memory for the cache
+     */
+    ARCCachePolicy( size_t maxMemory )
+        : _maxMemory( maxMemory )
+        , _target( 0 )
+        , _currentMemory( 0 )
+    {
+        _memory[ T1 ] = _memory[ T2 ] = _memory[ B1 ] = _memory[ B2 ] = 0;
+    }
+
+    /**
+     * Inserts a cachable object into T1. If the key is in one of the
+     * ghost lists, the target size of T1 is adapted and the object is
+     * inserted into T2. If object is already in T1 or T2, it is pushed
+     * to the back of T2.
+     * @param cachable the cachable object
+     */
+    void insert( const CacheObject& cachable )
+    {
+        typename ListIndex::iterator it = _listIndex.find( cachable.getKey( ));
+        if( it == _listIndex.end( ))
+        {
+            it = _listIndex.insert( std::make_pair( cachable.getKey(),
+                                                    Entry( ))).first;
+            it->second.list = T1;
+            it->second.position = _lists[ T1 ].insert( _lists[ T1 ].end(),
+                                                       &*it );
+            it->second.size = cachable.getSize();
+            _memory[ T1 ] += it->second.size;
+            _currentMemory += it->second.size;
+            _trimGhosts();
+            return;
+        }
+
+        Entry& entry = it->second;
+        switch( entry.list )
+        {
+        case T1:
+        case T2:
+            _move( entry, T2 );
+            return;
+        case B1:
+        {
+            const size_t delta = _getDelta( entry.size, _memory[ B2 ],
+                                            _memory[ B1 ] );
+            _target = std::min( _target + delta, _maxMemory );
+            break;
+        }
+        case B2:
+        {
+            const size_t delta = _getDelta( entry.size, _memory[ B1 ],
+                                            _memory[ B2 ] );
+            _target = _target > delta ? _target - delta : 0;
+            break;
+        }
+        }
+
+        _memory[ entry.list ] -= entry.size;
+        entry.size = cachable.getSize();
+        _memory[ entry.list ] += entry.size;
+        _move( entry, T2 );
+        _currentMemory += entry.size;
+        _trimGhosts();
+    }
+
+    /**
+     * Removes a cachable object from T1 or T2 and remembers its key in
+     * the corresponding ghost list.
+     * @param cachable
+     */
+    void remove( const CacheObject& cachable )
+    {
+        typename ListIndex::iterator it = _listIndex.find( cachable.getKey( ));
+        if( it == _listIndex.end() ||
+            it->second.list == B1 || it->second.list == B2 )
+        {
+            return;
+        }
+
+        _currentMemory -= it->second.size;
+        _move( it->second, it->second.list == T1 ? B1 : B2 );
+        _trimGhosts();
+    }
+
+    /**
+     * Visits the keys in eviction order. If T1 exceeds its target size,
+     * the keys of T1 are visited first, followed by the keys of T2.
+     * Otherwise T2 is visited first. Both lists are visited in LRU order.
+     * The visitor may remove the visited key from the policy or insert
+     * it again.
+     * @param visitor is called with each key and returns false to stop
+     * the visiting.
+     */
+    template< class KeyVisitor >
+    void visitKeys( KeyVisitor visitor )
+    {
+        const List first = _memory[ T1 ] > _target ? T1 : T2;
+        if( _visitList( first, visitor ))
+            _visitList( first == T1 ? T2 : T1, visitor );
+    }
+
+    /**
+     * @return the list of cachable keys in eviction order
+     */
+    Keys getKeys() const
+    {
+        Keys keys;
+        const List first = _memory[ T1 ] > _target ? T1 : T2;
+        for( const List list: { first, first == T1 ? T2 : T1 })
+        {
+            for( const typename ListIndex::value_type* value: _lists[ list ])
+                keys.push_back( value->first );
+        }
+        return keys;
+    }
+
+    /**
+     * @return true if cache has tobe cleaned
+     */
+    bool cleanCache() const
+    {
+        return _currentMemory >= _maxMemory;
+    }
+
+    /**
+     * @return true if cache is empty
+     */
+    bool isEmpty() const
+    {
+        return _lists[ T1 ].empty() && _lists[ T2 ].empty();
+    }
+
+    /**
+     * @return Return the current memory usage. It can be queried
+     * without holding the cache lock.
+     */
+    size_t getUsage() const { return _currentMemory; }
+
+    /**
+     * @return Return the max memory
+     */
+    size_t getMaxMemory() const { return _maxMemory; }
+
+    /**
+     * @return the adapted target memory for the objects used once
+     */
+    size_t getTarget() const { return _target; }
+
+private:
+
+    enum List
+    {
+        T1 = 0,
+        T2,
+        B1,
+        B2
+    };
+
+    struct Entry;
+    typedef std::unordered_map< Key, Entry, Hash > ListIndex;
+    typedef std::list< typename ListIndex::value_type* > KeyList;
+
+    struct Entry
+    {
+        List list;
+        typename KeyList::iterator position;
+        size_t size;
+    };
+
+    static size_t _getDelta( size_t size, size_t otherGhosts, size_t ghosts )
+    {
+        if( ghosts == 0 || otherGhosts <= ghosts )
+            return size;
+        return size_t( double( size ) * double( otherGhosts ) / double( ghosts ));
+    }
+
+    void _move( Entry& entry, const List list )
+    {
+        _memory[ entry.list ] -= entry.size;
+        _lists[ list ].splice( _lists[ list ].end(),
+                               _lists[ entry.list ], entry.position );
+        entry.list = list;
+        _memory[ list ] += entry.size;
+    }
+
+    void _dropGhost( const List list )
+    {
+        typename ListIndex::value_type* ghost = _lists[ list ].front();
+        _memory[ list ] -= ghost->second.size;
+        _lists[ list ].pop_front();
+        _listIndex.erase( ghost->first );
+    }
+
+    void _trimGhosts()
+    {
+        while( !_lists[ B1 ].empty() &&
+               _memory[ T1 ] + _memory[ B1 ] > _maxMemory )
+        {
+            _dropGhost( B1 );
+        }
+
+        while( !_lists[ B2 ].empty() &&
+               _memory[ T1 ] + _memory[ T2 ] + _memory[ B1 ] + _memory[ B2 ]
+                   > 2 * _maxMemory )
+        {
+            _dropGhost( B2 );
+        }
+    }
+
+    template< class KeyVisitor >
+    bool _visitList( const List list, KeyVisitor& visitor )
+    {
+        KeyList& keyList = _lists[ list ];
+        typename KeyList::iterator it = keyList.begin();
+        for( size_t i = keyList.size(); i > 0 && it != keyList.end(); --i )
+        {
+            const Key& key = ( *it )->first;
+            ++it;
+            if( !visitor( key ))
+                return false;
+        }
+        return true;
+    }
+
+    KeyList _lists[ 4 ];
+    size_t _memory[ 4 ];
+    ListIndex _listIndex;
+    size_t _maxMemory;
+    size_t _target;
+    std::atomic< size_t > _currentMemory;
+};
+
+}
+
+#endif
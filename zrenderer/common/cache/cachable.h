@@ -36,6 +36,7 @@ public:
     Cachable( const Key& key )
         : _key( key )
         , _refCount( 0 )
+        , _touched( false )
     {}
 
     virtual ~Cachable() {}
@@ -47,15 +48,33 @@ public:
      */
     virtual size_t getSize() const = 0;
 
+    /**
+     * @return the relative cost of loading the object again after it is
+     * evicted ( i.e. the time to read and decode it ). Used by the cost
+     * aware policies.
+     */
+    virtual double getLoadCost() const { return 1.0; }
+
     /**
      * @return the key of the cachable object
      */
     const Key& getKey() const { return _key; }
 
     /**
-     * Increases the ref count
+     * Increases the ref count, unless the object is evicted.
+     * @return false if the object is evicted
      */
-    void increaseRef() { ++_refCount; }
+    bool increaseRef()
+    {
+        uint64_t refCount = _refCount.load();
+        do
+        {
+            if( refCount & _evicted )
+                return false;
+        }
+        while( !_refCount.compare_exchange_weak( refCount, refCount + 1 ));
+        return true;
+    }
 
     /**
      * Decreases the ref count
@@ -65,12 +84,54 @@ public:
     /**
      * @return the ref count
      */
-    uint64_t getRefCount() const { return _refCount; }
+    uint64_t getRefCount() const { return _refCount.load() & ~_evicted; }
+
+    /**
+     * Marks the object as evicted if it is not referenced. Afterwards
+     * the ref count can not be increased anymore.
+     * @return true if the object is marked as evicted
+     */
+    bool evict()
+    {
+        uint64_t refCount = 0;
+        return _refCount.compare_exchange_strong( refCount, _evicted );
+    }
+
+    /**
+     * Records an access to the object, which is applied to the cache
+     * policy when the cache looks for objects to evict.
+     */
+    void touch()
+    {
+        if( !_touched.load( std::memory_order_relaxed ))
+            _touched.store( true, std::memory_order_relaxed );
+    }
+
+    /**
+     * Clears the access record
+     * @return true if the object has been accessed since the last call
+     */
+    bool clearTouched()
+    {
+        return _touched.exchange( false, std::memory_order_relaxed );
+    }
+
+    /**
+     * @return true if the object has been accessed since the last
+     * clearTouched call
+     */
+    bool isTouched() const
+    {
+        return _touched.load( std::memory_order_relaxed );
+    }
 
 private:
 
+    static const uint64_t _evicted = 1ull << 63;
+
     Key _key;
-    uint64_t _refCount;
+    std::atomic< uint64_t > _refCount;
+    std::atomic< bool > _touched;
 };
 
 }
@@ -21,10 +21,17 @@
 #define _cache_h_
 
 #include <zrenderer/common/types.h>
+#include <zrenderer/common/epoch.h>
+#include <zrenderer/common/threadpool.h>
+#include <zrenderer/common/cache/cachestatistics.h>
+#include <zrenderer/common/cache/concurrenthashmap.h>
 #include <zrenderer/common/cache/lrucachepolicy.h>
 
 #include <boost/mpl/list.hpp>
 
+#include <future>
+#include <limits>
+
 namespace zrenderer
 {
 
@@ -35,30 +42,72 @@ namespace zrenderer
  *
  * Also given the allocator, it transfers it to the cache object on the
  * construction time. So, cache object can allocate with the given memory
- * region/algorithm etc.
+ * region/algorithm etc. The cache objects themselves are allocated and
+ * released with the allocator rebound to the cache object type.
+ *
+ * Finding an existing object and releasing it do not take any lock. The
+ * lookup is protected by an Epoch::Guard and the accesses are recorded
+ * in the objects, to be applied to the policy when objects are evicted.
+ * Evicted objects are deleted only when no reader can access them.
+ *
+ * Cache objects are constructed without holding the cache lock, so a
+ * slow load does not stall the other threads. Concurrent creates of the
+ * same key share a single construction. As objects can be constructed
+ * concurrently, the allocator has to be thread safe.
  */
 template< typename CacheObject,
           typename Allocator,
-          typename CachePolicy = LRUCachePolicy< CacheObject > >
+          typename CachePolicy = LRUCachePolicy< CacheObject >,
+          typename Hash = std::hash< typename CacheObject::key_type > >
 class Cache
 {
 public:
 
     typedef typename CacheObject::key_type Key;
+    typedef Hash hasher;
 
-    typedef std::map< Key, std::unique_ptr<CacheObject> > DataMap;
-    typedef std::pair< Key, std::unique_ptr<CacheObject> > DataPair;
+    typedef ConcurrentHashMap< Key, CacheObject*, Hash > DataMap;
     typedef std::vector< Key > Keys;
+    typedef std::shared_ptr< CacheObject > CacheObjectPtr;
+    typedef std::shared_future< std::shared_ptr< CacheObject >> CacheObjectFuture;
+    typedef std::function< void( const CacheObject& ) > EvictionCallback;
+    typedef std::function< void( const Key&, bool ) > AccessCallback;
 
     /**
      * Construct a cache with a given allocator.
      * @param allocator C++ allocator.
+     * @param maxMemory is the memory budget
+     * @param loaders is the thread pool executing the asynchronous
+     * creates. If empty, the cache creates its own pool.
      */
-    Cache( const Allocator& allocator, size_t maxMemory )
+    Cache( const Allocator& allocator,
+           size_t maxMemory,
+           const ThreadPoolPtr& loaders = ThreadPoolPtr( ))
         : _allocator( allocator )
+        , _objectAllocator( allocator )
         , _cachePolicy( maxMemory )
+        , _loaders( loaders ? loaders : std::make_shared< ThreadPool >( ))
     {}
 
+    ~Cache()
+    {
+        // The loads in flight refer to the cache
+        std::vector< CacheObjectFuture > loading;
+        {
+            WriteLock lock( _mutex );
+            for( const typename LoadingMap::value_type& load: _loading )
+                loading.push_back( load.second.future );
+        }
+        for( const CacheObjectFuture& future: loading )
+            future.wait();
+
+        // Loaders release the lock after fulfilling the promise
+        WriteLock lock( _mutex );
+
+        _dataMap.forEach( [this]( const Key&, CacheObject* cacheObject )
+                          { _destroy( cacheObject ); });
+    }
+
     /**
      * Construct a cache object. If an object with the same key
      * was created before, returns this object. If cache is
@@ -68,6 +117,9 @@ public:
      * of the cache object where cache object can use to it
      * to allocate its own data structures.
      *
+     * If the object is being created by another thread, waits for
+     * it instead of constructing it again.
+     *
      * @param key is id of the cache object
      * @param args are the constructor parameters
      * @throw bad_alloc when allocator does not allow more memory
@@ -77,101 +129,413 @@ public:
     std::shared_ptr< CacheObject > create( const Key& key,
                                            Args&&... args )
     {
+        const CacheStatistics::Clock::time_point start =
+            CacheStatistics::Clock::now();
+        std::shared_ptr< CacheObject > cacheObject = get( key );
+        if( !cacheObject )
         {
-            ReadLock lock( _mutex );
-            typename DataMap::const_iterator it = _dataMap.find( key );
-            if( it != _dataMap.end( ))
-            {
-                it->second->increaseRef();
-                _cachePolicy.insert( *it->second );
-                return std::shared_ptr< CacheObject >( it->second.get( ),
-                                                       std::bind( &Cache::_onDelete,
-                                                                  this,
-                                                                  std::placeholders::_1 ));
-            }
+            LoadPromisePtr promise;
+            const CacheObjectFuture future = _startLoad( key, promise, false );
+            if( promise )
+                _load( promise, key, std::forward< Args >( args )... );
+            cacheObject = future.get();
         }
 
-        WriteLock lock( _mutex );
-        typename DataMap::const_iterator it = _dataMap.find( key );
-        if( it != _dataMap.end( ))
-            return std::shared_ptr< CacheObject >( it->second.get( ));
-
-        CacheObject* cacheObject = _allocator.allocate( sizeof( CacheObject ));
-        _allocator.construct( cacheObject, key, args..., _allocator );
+        _statistics.recordCreate( start );
+        return cacheObject;
+    }
 
-        const size_t objectSize = cacheObject->getSize();
-        const size_t maxMemory =  _cachePolicy.getMaxMemory();
+    /**
+     * Construct a cache object with a low priority, i.e. for prefetching.
+     * To make space for it, only the unreferenced objects in the older
+     * half of the policy order, which are not accessed since the last
+     * eviction, are evicted. If a create for the same key joins the
+     * construction, the object is inserted with the normal priority.
+     *
+     * @param key is id of the cache object
+     * @param args are the constructor parameters
+     * @return the cache object. If it does not fit into the cache, an
+     * empty ptr is returned.
+     * @see create
+     */
+    template< class... Args >
+    std::shared_ptr< CacheObject > prefetch( const Key& key,
+                                             Args&&... args )
+    {
+        std::shared_ptr< CacheObject > cacheObject = _get( key, false );
+        if( cacheObject )
+            return cacheObject;
 
-        if( objectSize + _cachePolicy.getUsage() > maxMemory )
-            _cleanCache();
+        LoadPromisePtr promise;
+        const CacheObjectFuture future = _startLoad( key, promise, true );
+        if( promise )
+            _load( promise, key, std::forward< Args >( args )... );
+        return future.get();
+    }
 
-        if( objectSize + _cachePolicy.getUsage() > maxMemory )
+    /**
+     * Construct a cache object asynchronously on the loader threads.
+     * The arguments are copied, as the construction happens after the
+     * function returns.
+     *
+     * @param key is id of the cache object
+     * @param args are the constructor parameters
+     * @return the future for the created object, which is ready if the
+     * object is in the cache. Concurrent calls for the same key share
+     * the same future. The future holds an empty ptr if the cache is
+     * overcommitting and rethrows the construction errors.
+     * @see create
+     */
+    template< class... Args >
+    CacheObjectFuture createAsync( const Key& key, Args&&... args )
+    {
+        std::shared_ptr< CacheObject > cacheObject = get( key );
+        if( cacheObject )
         {
-            delete cacheObject;
-            return std::shared_ptr< CacheObject >();
+            std::promise< std::shared_ptr< CacheObject >> promise;
+            promise.set_value( cacheObject );
+            return promise.get_future().share();
         }
 
-        _cachePolicy.insert( *cacheObject );
-        cacheObject->increaseRef();
-        _dataMap.insert( std::move( DataPair( key,
-                                              std::unique_ptr<CacheObject>( cacheObject ))));
-        return std::shared_ptr< CacheObject >( cacheObject,
-                                               std::bind( &Cache::_onDelete,
-                                                          this,
-                                                          std::placeholders::_1 ));
+        LoadPromisePtr promise;
+        const CacheObjectFuture future = _startLoad( key, promise, false );
+        if( promise )
+        {
+            // The task must not keep the promise after the load, as the
+            // promise can hold the last reference to the object
+            _loaders->submit(
+                std::bind( &Cache::_loadAsync< typename std::decay< Args >::type&... >,
+                           this, std::make_shared< LoadPromisePtr >( promise ),
+                           key, std::forward< Args >( args )... ));
+        }
+        return future;
     }
 
     /**
+     * Does not block on the cache lock.
      * @param key is the key of the cache object
      * @return a cache object. If there is no cache object with key,
      * empty ptr is returned.
      */
     std::shared_ptr< CacheObject > get( const Key& key ) const
+    {
+        return _get( key, true );
+    }
+
+    /**
+     * Does not block on the cache lock, and does not count as an access
+     * to the object.
+     * @param key is the key of the cache object
+     * @return true if the object is in the cache
+     */
+    bool contains( const Key& key ) const
+    {
+        Epoch::Guard guard;
+        return _dataMap.find( key ) != 0;
+    }
+
+    /**
+     * Evicts unreferenced objects in the order given by the policy,
+     * until the given amount of memory is released or there is no
+     * object left to evict.
+     * @param bytes is the amount of memory to release
+     * @return the amount of memory released
+     */
+    size_t evict( size_t bytes )
+    {
+        WriteLock lock( _mutex, boost::defer_lock );
+        _lock( lock );
+        return _cleanCache( bytes );
+    }
+
+    /**
+     * Sets the function called for every object evicted by the policy,
+     * before the object is deleted. The callback is called with the cache
+     * lock held, so it must not call the cache. It has to be set before
+     * the cache is used concurrently.
+     * @param callback is the function to call
+     */
+    void setEvictionCallback( const EvictionCallback& callback )
+    {
+        WriteLock lock( _mutex );
+        _evictionCallback = callback;
+    }
+
+    /** @return the function called for the evicted objects */
+    EvictionCallback getEvictionCallback() const
     {
         ReadLock lock( _mutex );
-        typename DataMap::const_iterator it = _dataMap.find( key );
-        if( it == _dataMap.end( ))
-            return std::shared_ptr< CacheObject >();
+        return _evictionCallback;
+    }
+
+    /**
+     * Sets the function called for every access with get, create and
+     * createAsync, with the key and whether the object is in the cache.
+     * The prefetches are not accesses. The callback is called without the
+     * cache lock on the accessing thread. It has to be set before the
+     * cache is used concurrently.
+     * @param callback is the function to call
+     */
+    void setAccessCallback( const AccessCallback& callback )
+    {
+        WriteLock lock( _mutex );
+        _accessCallback = callback;
+    }
 
-        _cachePolicy.insert( *it->second );
-        it->second->increaseRef();
-        return typename std::shared_ptr< CacheObject >( it->second.get(),
-                                                        std::bind( &Cache::_onDelete,
-                                                                   this,
-                                                                   std::placeholders::_1 ));
+    /** @return the function called for the accesses */
+    AccessCallback getAccessCallback() const
+    {
+        ReadLock lock( _mutex );
+        return _accessCallback;
     }
 
     const CachePolicy& getPolicy() const { return _cachePolicy; }
 
+    /** @return the statistics of the cache */
+    CacheStatistics& getStatistics() { return _statistics; }
+    const CacheStatistics& getStatistics() const { return _statistics; }
+
 private:
 
     Cache( const Cache& ) = delete;
     Cache& operator=( const Cache& ) = delete;
 
-    void _onDelete( CacheObject* cacheObject ) const
+    typedef std::promise< std::shared_ptr< CacheObject >> LoadPromise;
+    typedef std::shared_ptr< LoadPromise > LoadPromisePtr;
+    struct Load
     {
-        WriteLock lock( _mutex );
-        cacheObject->decreaseRef();
+        CacheObjectFuture future;
+        bool lowPriority;
+    };
+
+    typedef std::unordered_map< Key, Load, Hash > LoadingMap;
+
+    typedef typename std::allocator_traits< Allocator >::template
+        rebind_alloc< CacheObject > ObjectAllocator;
+    typedef std::allocator_traits< ObjectAllocator > ObjectAllocatorTraits;
+
+    std::shared_ptr< CacheObject > _get( const Key& key,
+                                         const bool access ) const
+    {
+        const bool sample = CacheStatistics::sampleGet();
+        const CacheStatistics::Clock::time_point start =
+            sample ? CacheStatistics::Clock::now()
+                   : CacheStatistics::Clock::time_point();
+
+        std::shared_ptr< CacheObject > cacheObject = _find( key );
+        if( cacheObject )
+            _statistics.hit();
+        else
+            _statistics.miss();
+
+        if( sample )
+            _statistics.recordGet( start );
+        if( access && _accessCallback )
+            _accessCallback( key, bool( cacheObject ));
+        return cacheObject;
     }
 
-    void _cleanCache()
+    std::shared_ptr< CacheObject > _find( const Key& key ) const
     {
-        for( const Key& deleteKey: _cachePolicy.getKeys())
+        Epoch::Guard guard;
+        CacheObject* cacheObject = _dataMap.find( key );
+        if( !cacheObject || !cacheObject->increaseRef( ))
+            return std::shared_ptr< CacheObject >();
+
+        cacheObject->touch();
+        return _makePtr( cacheObject );
+    }
+
+    void _lock( WriteLock& lock ) const
+    {
+        // The wait is measured only if the lock is contended
+        if( lock.try_lock( ))
+            return;
+
+        const CacheStatistics::Clock::time_point start =
+            CacheStatistics::Clock::now();
+        lock.lock();
+        _statistics.recordLockWait( start );
+    }
+
+    CacheObjectFuture _startLoad( const Key& key, LoadPromisePtr& promise,
+                                  bool lowPriority )
+    {
+        WriteLock lock( _mutex, boost::defer_lock );
+        _lock( lock );
+        std::shared_ptr< CacheObject > cacheObject = _find( key );
+        if( cacheObject )
+        {
+            std::promise< std::shared_ptr< CacheObject >> ready;
+            ready.set_value( cacheObject );
+            return ready.get_future().share();
+        }
+
+        typename LoadingMap::iterator it = _loading.find( key );
+        if( it != _loading.end( ))
         {
-            const CacheObject& cacheObject = *_dataMap[ deleteKey ];
-            if( cacheObject.getRefCount() == 0 )
+            it->second.lowPriority = it->second.lowPriority && lowPriority;
+            return it->second.future;
+        }
+
+        promise = std::make_shared< LoadPromise >();
+        const Load load = { promise->get_future().share(), lowPriority };
+        _loading.insert( std::make_pair( key, load ));
+        return load.future;
+    }
+
+    template< class... Args >
+    void _loadAsync( const std::shared_ptr< LoadPromisePtr >& promise,
+                     const Key& key, Args&&... args )
+    {
+        _load( *promise, key, std::forward< Args >( args )... );
+    }
+
+    template< class... Args >
+    void _load( LoadPromisePtr& promise, const Key& key, Args&&... args )
+    {
+        // The key is registered as loading, so the object is constructed
+        // by this thread only and without holding the lock.
+        const CacheStatistics::Clock::time_point start =
+            CacheStatistics::Clock::now();
+        try
+        {
+            CacheObject* cacheObject =
+                ObjectAllocatorTraits::allocate( _objectAllocator, 1 );
+            try
             {
-                _cachePolicy.remove( cacheObject );
-                _dataMap.erase( deleteKey );
-                if( !_cachePolicy.cleanCache( ))
-                    return;
+                ObjectAllocatorTraits::construct( _objectAllocator, cacheObject, key,
+                                                  std::forward< Args >( args )...,
+                                                  _allocator );
             }
+            catch( ... )
+            {
+                ObjectAllocatorTraits::deallocate( _objectAllocator, cacheObject, 1 );
+                throw;
+            }
+            _statistics.recordLoad( start, cacheObject->getSize( ));
+
+            WriteLock lock( _mutex, boost::defer_lock );
+            _lock( lock );
+            const bool lowPriority = _loading[ key ].lowPriority;
+            _loading.erase( key );
+            promise->set_value( _insert( cacheObject, lowPriority ));
+            promise.reset();
         }
+        catch( ... )
+        {
+            _statistics.recordLoadFailure();
+            WriteLock lock( _mutex, boost::defer_lock );
+            _lock( lock );
+            _loading.erase( key );
+            promise->set_exception( std::current_exception( ));
+            promise.reset();
+        }
+    }
+
+    std::shared_ptr< CacheObject > _insert( CacheObject* cacheObject,
+                                            bool lowPriority )
+    {
+        _retireList.reclaim();
+
+        const size_t objectSize = cacheObject->getSize();
+        const size_t maxMemory =  _cachePolicy.getMaxMemory();
+
+        // Objects larger than the budget do not evict the others in vain
+        if( objectSize <= maxMemory && objectSize + _cachePolicy.getUsage() > maxMemory )
+            _cleanCache( objectSize + _cachePolicy.getUsage() - maxMemory,
+                         lowPriority );
+
+        if( objectSize + _cachePolicy.getUsage() > maxMemory )
+        {
+            _destroy( cacheObject );
+            return std::shared_ptr< CacheObject >();
+        }
+
+        cacheObject->increaseRef();
+        _cachePolicy.insert( *cacheObject );
+        _dataMap.insert( cacheObject->getKey(), cacheObject );
+        return _makePtr( cacheObject );
+    }
+
+    std::shared_ptr< CacheObject > _makePtr( CacheObject* cacheObject ) const
+    {
+        return std::shared_ptr< CacheObject >( cacheObject, &Cache::_onDelete );
+    }
+
+    static void _onDelete( CacheObject* cacheObject )
+    {
+        cacheObject->decreaseRef();
+    }
+
+    void _destroy( CacheObject* cacheObject )
+    {
+        ObjectAllocatorTraits::destroy( _objectAllocator, cacheObject );
+        ObjectAllocatorTraits::deallocate( _objectAllocator, cacheObject, 1 );
+    }
+
+    size_t _cleanCache( size_t bytes, bool lowPriority = false )
+    {
+        // The first pass gives the objects accessed since the last
+        // eviction a second chance, by applying the access to the policy.
+        // Low priority cleaning keeps the accessed objects and does not
+        // go beyond the older half of the objects.
+        const CacheStatistics::Clock::time_point start =
+            CacheStatistics::Clock::now();
+        const size_t usage = _cachePolicy.getUsage();
+        size_t nEvicted = 0;
+        const size_t maxVisits = lowPriority ? _dataMap.size() / 2
+                                             : std::numeric_limits< size_t >::max();
+        size_t nVisits = 0;
+        for( size_t pass = 0; pass < ( lowPriority ? 1 : 2 ); ++pass )
+        {
+            _cachePolicy.visitKeys( [&]( const Key& deleteKey )
+            {
+                if( nVisits++ >= maxVisits )
+                    return false;
+
+                CacheObject* cacheObject = _dataMap.find( deleteKey );
+                if( lowPriority && cacheObject->isTouched( ))
+                    return true;
+
+                if( cacheObject->clearTouched( ))
+                {
+                    _cachePolicy.insert( *cacheObject );
+                    return true;
+                }
+
+                if( !cacheObject->evict( ))
+                    return true;
+
+                if( _evictionCallback )
+                    _evictionCallback( *cacheObject );
+
+                _cachePolicy.remove( *cacheObject );
+                _dataMap.erase( cacheObject->getKey( ));
+                _retireList.retire( [this, cacheObject] { _destroy( cacheObject ); });
+                ++nEvicted;
+                return usage - _cachePolicy.getUsage() < bytes;
+            });
+
+            if( usage - _cachePolicy.getUsage() >= bytes )
+                break;
+        }
+
+        const size_t released = usage - _cachePolicy.getUsage();
+        _statistics.recordEvictions( start, nEvicted, released );
+        return released;
     }
 
     Allocator _allocator;
-    mutable CachePolicy _cachePolicy;
+    ObjectAllocator _objectAllocator;
+    CachePolicy _cachePolicy;
     DataMap _dataMap;
+    RetireList _retireList;
+    LoadingMap _loading;
+    ThreadPoolPtr _loaders;
+    EvictionCallback _evictionCallback;
+    AccessCallback _accessCallback;
+    mutable CacheStatistics _statistics;
     mutable ReadWriteMutex _mutex;
 };
 
@@ -0,0 +1,430 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _cachestatistics_h_
+#define _cachestatistics_h_
+
+#include <zrenderer/common/types.h>
+
+#include <array>
+#include <chrono>
+#include <ostream>
+#include <thread>
+
+namespace zrenderer
+{
+
+/**
+ * Counter, which is incremented without contention by many threads.
+ * The threads increment separate cache lines, which are summed on read.
+ */
+class StripedCounter
+{
+public:
+
+    StripedCounter()
+    {
+        for( Stripe& stripe: _stripes )
+            stripe.value.store( 0, std::memory_order_relaxed );
+    }
+
+    void add( uint64_t value )
+    {
+        _stripes[ _getStripe() ].value.fetch_add( value, std::memory_order_relaxed );
+    }
+
+    uint64_t get() const
+    {
+        uint64_t sum = 0;
+        for( const Stripe& stripe: _stripes )
+            sum += stripe.value.load( std::memory_order_relaxed );
+        return sum;
+    }
+
+private:
+
+    StripedCounter( const StripedCounter& ) = delete;
+    StripedCounter& operator=( const StripedCounter& ) = delete;
+
+    static const size_t _nStripes = 16;
+
+    struct Stripe
+    {
+        std::atomic< uint64_t > value;
+        char padding[ 64 - sizeof( std::atomic< uint64_t >) ];
+    };
+
+    static size_t _getStripe()
+    {
+        static std::atomic< size_t > nThreads( 0 );
+        static thread_local const size_t stripe = nThreads++ % _nStripes;
+        return stripe;
+    }
+
+    Stripe _stripes[ _nStripes ];
+};
+
+/**
+ * Histogram of durations with power of two nanosecond buckets. The
+ * bucket i counts the durations in [2^(i-1), 2^i) nanoseconds.
+ */
+class LatencyHistogram
+{
+public:
+
+    static const size_t nBuckets = 40;
+    typedef std::array< uint64_t, nBuckets > Buckets;
+
+    LatencyHistogram()
+    {
+        for( std::atomic< uint64_t >& bucket: _buckets )
+            bucket.store( 0, std::memory_order_relaxed );
+    }
+
+    /** @param nanoSecs is the duration to record */
+    void record( uint64_t nanoSecs )
+    {
+        size_t bucket = 0;
+        while( nanoSecs > 0 && bucket < nBuckets - 1 )
+        {
+            nanoSecs >>= 1;
+            ++bucket;
+        }
+        _buckets[ bucket ].fetch_add( 1, std::memory_order_relaxed );
+    }
+
+    /** @return the bucket counts */
+    Buckets getBuckets() const
+    {
+        Buckets buckets;
+        for( size_t i = 0; i < nBuckets; ++i )
+            buckets[ i ] = _buckets[ i ].load( std::memory_order_relaxed );
+        return buckets;
+    }
+
+    /**
+     * @param buckets are the bucket counts
+     * @param percentile is in [0, 1]
+     * @return the upper bound of the bucket holding the percentile in
+     * nanoseconds
+     */
+    static uint64_t getPercentile( const Buckets& buckets, double percentile )
+    {
+        uint64_t count = 0;
+        for( const uint64_t bucket: buckets )
+            count += bucket;
+        if( count == 0 )
+            return 0;
+
+        const uint64_t rank = std::max< uint64_t >( 1, uint64_t( percentile * count + 0.5 ));
+        uint64_t sum = 0;
+        for( size_t i = 0; i < nBuckets; ++i )
+        {
+            sum += buckets[ i ];
+            if( sum >= rank )
+                return uint64_t( 1 ) << i;
+        }
+        return uint64_t( 1 ) << ( nBuckets - 1 );
+    }
+
+private:
+
+    LatencyHistogram( const LatencyHistogram& ) = delete;
+    LatencyHistogram& operator=( const LatencyHistogram& ) = delete;
+
+    std::atomic< uint64_t > _buckets[ nBuckets ];
+};
+
+/**
+ * Statistics of a cache. The counters are cheap enough to be always on:
+ * they do not share cache lines between threads, the get latency is
+ * measured for every 64th get of a thread only, and the lock wait is
+ * measured only when the lock is contended.
+ *
+ * When tracing is enabled, the loads and evictions are recorded into a
+ * bounded event buffer as well, which can be written as a Chrome trace
+ * ( chrome://tracing ).
+ */
+class CacheStatistics
+{
+public:
+
+    typedef std::chrono::steady_clock Clock;
+
+    /**
+     * The statistics at a point of time.
+     */
+    struct Snapshot
+    {
+        Snapshot()
+            : hits( 0 ), misses( 0 ), loads( 0 ), loadFailures( 0 )
+            , bytesLoaded( 0 ), evictions( 0 ), bytesEvicted( 0 )
+            , lockWaits( 0 ), lockWaitNanoSecs( 0 )
+        {
+            getLatency.fill( 0 );
+            createLatency.fill( 0 );
+        }
+
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t loads;
+        uint64_t loadFailures;
+        uint64_t bytesLoaded;
+        uint64_t evictions;
+        uint64_t bytesEvicted;
+        uint64_t lockWaits;
+        uint64_t lockWaitNanoSecs;
+        LatencyHistogram::Buckets getLatency;
+        LatencyHistogram::Buckets createLatency;
+
+        /** @return the ratio of hits to lookups */
+        double getHitRatio() const
+        {
+            return hits + misses > 0 ? double( hits ) / double( hits + misses ) : 0.0;
+        }
+
+        /** Accumulates the statistics of another cache, i.e. a shard */
+        Snapshot& operator+=( const Snapshot& snapshot )
+        {
+            hits += snapshot.hits;
+            misses += snapshot.misses;
+            loads += snapshot.loads;
+            loadFailures += snapshot.loadFailures;
+            bytesLoaded += snapshot.bytesLoaded;
+            evictions += snapshot.evictions;
+            bytesEvicted += snapshot.bytesEvicted;
+            lockWaits += snapshot.lockWaits;
+            lockWaitNanoSecs += snapshot.lockWaitNanoSecs;
+            for( size_t i = 0; i < LatencyHistogram::nBuckets; ++i )
+            {
+                getLatency[ i ] += snapshot.getLatency[ i ];
+                createLatency[ i ] += snapshot.createLatency[ i ];
+            }
+            return *this;
+        }
+
+        /** Writes the statistics as a JSON object */
+        void writeJSON( std::ostream& os ) const
+        {
+            os << "{\"hits\":" << hits
+               << ",\"misses\":" << misses
+               << ",\"hitRatio\":" << getHitRatio()
+               << ",\"loads\":" << loads
+               << ",\"loadFailures\":" << loadFailures
+               << ",\"bytesLoaded\":" << bytesLoaded
+               << ",\"evictions\":" << evictions
+               << ",\"bytesEvicted\":" << bytesEvicted
+               << ",\"lockWaits\":" << lockWaits
+               << ",\"lockWaitNanoSecs\":" << lockWaitNanoSecs
+               << ",\"getLatencyNanoSecs\":";
+            _writeHistogram( os, getLatency );
+            os << ",\"createLatencyNanoSecs\":";
+            _writeHistogram( os, createLatency );
+            os << "}";
+        }
+
+    private:
+
+        static void _writeHistogram( std::ostream& os,
+                                     const LatencyHistogram::Buckets& buckets )
+        {
+            os << "{\"p50\":" << LatencyHistogram::getPercentile( buckets, 0.5 )
+               << ",\"p99\":" << LatencyHistogram::getPercentile( buckets, 0.99 )
+               << ",\"buckets\":[";
+            for( size_t i = 0; i < buckets.size(); ++i )
+                os << ( i > 0 ? "," : "" ) << buckets[ i ];
+            os << "]}";
+        }
+    };
+
+    /**
+     * @param maxTraceEvents is the size of the trace event buffer. When
+     * it is full, the oldest events are overwritten.
+     */
+    explicit CacheStatistics( size_t maxTraceEvents = 1 << 16 )
+        : _start( Clock::now( ))
+        , _tracing( false )
+        , _maxTraceEvents( maxTraceEvents )
+        , _nTraceEvents( 0 )
+    {}
+
+    /** @return true if the get latency of the calling thread is to be measured */
+    static bool sampleGet()
+    {
+        static thread_local uint32_t nGets = 0;
+        return ( nGets++ & 63 ) == 0;
+    }
+
+    void hit() { _hits.add( 1 ); }
+    void miss() { _misses.add( 1 ); }
+    void recordGet( const Clock::time_point& start ) { _getLatency.record( _getNanoSecs( start )); }
+    void recordCreate( const Clock::time_point& start ) { _createLatency.record( _getNanoSecs( start )); }
+
+    /**
+     * @param start is the time the load started
+     * @param bytes is the size of the loaded object
+     */
+    void recordLoad( const Clock::time_point& start, size_t bytes )
+    {
+        _loads.add( 1 );
+        _bytesLoaded.add( bytes );
+        if( _tracing.load( std::memory_order_relaxed ))
+            _trace( "load", start, 1, bytes );
+    }
+
+    void recordLoadFailure() { _loadFailures.add( 1 ); }
+
+    /**
+     * @param start is the time the eviction started
+     * @param count is the number of evicted objects
+     * @param bytes is the size of the evicted objects
+     */
+    void recordEvictions( const Clock::time_point& start, size_t count, size_t bytes )
+    {
+        _evictions.add( count );
+        _bytesEvicted.add( bytes );
+        if( count > 0 && _tracing.load( std::memory_order_relaxed ))
+            _trace( "evict", start, count, bytes );
+    }
+
+    /** @param start is the time the thread started to wait for the lock */
+    void recordLockWait( const Clock::time_point& start )
+    {
+        _lockWaits.add( 1 );
+        _lockWaitNanoSecs.add( _getNanoSecs( start ));
+    }
+
+    /** @return the current statistics */
+    Snapshot getSnapshot() const
+    {
+        Snapshot snapshot;
+        snapshot.hits = _hits.get();
+        snapshot.misses = _misses.get();
+        snapshot.loads = _loads.get();
+        snapshot.loadFailures = _loadFailures.get();
+        snapshot.bytesLoaded = _bytesLoaded.get();
+        snapshot.evictions = _evictions.get();
+        snapshot.bytesEvicted = _bytesEvicted.get();
+        snapshot.lockWaits = _lockWaits.get();
+        snapshot.lockWaitNanoSecs = _lockWaitNanoSecs.get();
+        snapshot.getLatency = _getLatency.getBuckets();
+        snapshot.createLatency = _createLatency.getBuckets();
+        return snapshot;
+    }
+
+    /** @param tracing enables the recording of the trace events */
+    void setTracing( bool tracing ) { _tracing = tracing; }
+
+    /** @return the number of trace events recorded, including the overwritten ones */
+    size_t getTraceEventCount() const
+    {
+        ScopedLock lock( _traceMutex );
+        return _nTraceEvents;
+    }
+
+    /**
+     * Writes the recorded trace events in the Chrome trace event format.
+     * The timestamps are relative to the construction of the statistics.
+     */
+    void writeChromeTrace( std::ostream& os ) const
+    {
+        ScopedLock lock( _traceMutex );
+        os << "{\"traceEvents\":[";
+        const size_t first = _nTraceEvents > _maxTraceEvents ?
+                                 _nTraceEvents - _maxTraceEvents : 0;
+        for( size_t i = first; i < _nTraceEvents; ++i )
+        {
+            const TraceEvent& event = _traceEvents[ i % _maxTraceEvents ];
+            os << ( i > first ? "," : "" )
+               << "{\"name\":\"" << event.name << "\",\"cat\":\"cache\""
+               << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << event.threadId
+               << ",\"ts\":" << double( event.start ) / 1000.0
+               << ",\"dur\":" << double( event.duration ) / 1000.0
+               << ",\"args\":{\"objects\":" << event.count
+               << ",\"bytes\":" << event.bytes << "}}";
+        }
+        os << "]}";
+    }
+
+private:
+
+    CacheStatistics( const CacheStatistics& ) = delete;
+    CacheStatistics& operator=( const CacheStatistics& ) = delete;
+
+    struct TraceEvent
+    {
+        const char* name;
+        uint64_t start;
+        uint64_t duration;
+        size_t threadId;
+        size_t count;
+        size_t bytes;
+    };
+
+    static uint64_t _getNanoSecs( const Clock::time_point& start )
+    {
+        return uint64_t( std::chrono::duration_cast< std::chrono::nanoseconds >(
+                             Clock::now() - start ).count( ));
+    }
+
+    void _trace( const char* name, const Clock::time_point& start,
+                 size_t count, size_t bytes )
+    {
+        if( _maxTraceEvents == 0 )
+            return;
+
+        const TraceEvent event = {
+            name,
+            uint64_t( std::chrono::duration_cast< std::chrono::nanoseconds >(
+                          start - _start ).count( )),
+            _getNanoSecs( start ),
+            std::hash< std::thread::id >()( std::this_thread::get_id( )),
+            count, bytes };
+
+        ScopedLock lock( _traceMutex );
+        if( _traceEvents.size() < _maxTraceEvents )
+            _traceEvents.push_back( event );
+        else
+            _traceEvents[ _nTraceEvents % _maxTraceEvents ] = event;
+        ++_nTraceEvents;
+    }
+
+    StripedCounter _hits;
+    StripedCounter _misses;
+    StripedCounter _loads;
+    StripedCounter _loadFailures;
+    StripedCounter _bytesLoaded;
+    StripedCounter _evictions;
+    StripedCounter _bytesEvicted;
+    StripedCounter _lockWaits;
+    StripedCounter _lockWaitNanoSecs;
+    LatencyHistogram _getLatency;
+    LatencyHistogram _createLatency;
+
+    const Clock::time_point _start;
+    std::atomic< bool > _tracing;
+    const size_t _maxTraceEvents;
+    size_t _nTraceEvents;
+    std::vector< TraceEvent > _traceEvents;
+    mutable boost::mutex _traceMutex;
+};
+
+}
+
+#endif // _cachestatistics_h_
@@ -0,0 +1,183 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _clockcachepolicy_h_
+#define _clockcachepolicy_h_
+
+#include <zrenderer/common/types.h>
+#include <zrenderer/common/cache/cachable.h>
+
+namespace zrenderer
+{
+
+/**
+ * Second chance ( CLOCK ) policy. The objects are kept on a ring, and a
+ * hand sweeps the ring to find the objects to evict. An object accessed
+ * since the hand passed it last time gets a second chance, so only the
+ * access bit is updated when an object is used.
+ */
+template< class CacheObject,
+          class Hash = std::hash< typename CacheObject::key_type > >
+class ClockCachePolicy
+{
+public:
+
+    typedef typename CacheObject::key_type Key;
+    typedef std::vector< Key > Keys;
+
+    /**
+     * @param maxMemory Max memory for the cache
+     */
+    ClockCachePolicy( size_t maxMemory )
+        : _hand( _ring.end( ))
+        , _maxMemory( maxMemory )
+        , _currentMemory( 0 )
+    {}
+
+    /**
+     * Inserts a cachable object behind the hand. If object is already
+     * on the ring, it is marked as referenced.
+     * @param cachable the cachable object
+     */
+    void insert( const CacheObject& cachable )
+    {
+        typename ClockIndex::iterator it = _clockIndex.find( cachable.getKey( ));
+        if( it != _clockIndex.end( ))
+        {
+            it->second.referenced = true;
+            return;
+        }
+
+        it = _clockIndex.insert( std::make_pair( cachable.getKey(),
+                                                 Entry( ))).first;
+        it->second.position = _ring.insert( _hand, &*it );
+        it->second.size = cachable.getSize();
+        it->second.referenced = false;
+        _currentMemory += it->second.size;
+    }
+
+    /**
+     * Removes a cachable object from the ring.
+     * @param cachable
+     */
+    void remove( const CacheObject& cachable )
+    {
+        typename ClockIndex::iterator it = _clockIndex.find( cachable.getKey( ));
+        if( it == _clockIndex.end( ))
+            return;
+
+        if( _hand == it->second.position )
+            ++_hand;
+        _currentMemory -= it->second.size;
+        _ring.erase( it->second.position );
+        _clockIndex.erase( it );
+    }
+
+    /**
+     * Sweeps the hand at most two times around the ring and visits the
+     * keys which are not referenced. The referenced keys lose their
+     * reference. The visitor may remove the visited key from the policy.
+     * @param visitor is called with each key and returns false to stop
+     * the visiting.
+     */
+    template< class KeyVisitor >
+    void visitKeys( KeyVisitor visitor )
+    {
+        for( size_t i = 2 * _ring.size(); i > 0 && !_ring.empty(); --i )
+        {
+            if( _hand == _ring.end( ))
+                _hand = _ring.begin();
+
+            typename ClockIndex::value_type& value = **_hand;
+            ++_hand;
+            if( value.second.referenced )
+            {
+                value.second.referenced = false;
+                continue;
+            }
+
+            if( !visitor( value.first ))
+                return;
+        }
+    }
+
+    /**
+     * @return the list of cachable keys, starting from the hand
+     */
+    Keys getKeys() const
+    {
+        Keys keys;
+        keys.reserve( _ring.size( ));
+        for( typename Ring::const_iterator it = _hand; it != _ring.end(); ++it )
+            keys.push_back(( *it )->first );
+        for( typename Ring::const_iterator it = _ring.begin(); it != _hand; ++it )
+            keys.push_back(( *it )->first );
+        return keys;
+    }
+
+    /**
+     * @return true if cache has tobe cleaned
+     */
+    bool cleanCache() const
+    {
+        return _currentMemory >= _maxMemory;
+    }
+
+    /**
+     * @return true if cache is empty
+     */
+    bool isEmpty() const
+    {
+        return _ring.empty();
+    }
+
+    /**
+     * @return Return the current memory usage. It can be queried
+     * without holding the cache lock.
+     */
+    size_t getUsage() const { return _currentMemory; }
+
+    /**
+     * @return Return the max memory
+     */
+    size_t getMaxMemory() const { return _maxMemory; }
+
+private:
+
+    struct Entry;
+    typedef std::unordered_map< Key, Entry, Hash > ClockIndex;
+    typedef std::list< typename ClockIndex::value_type* > Ring;
+
+    struct Entry
+    {
+        typename Ring::iterator position;
+        size_t size;
+        bool referenced;
+    };
+
+    Ring _ring;
+    typename Ring::iterator _hand;
+    ClockIndex _clockIndex;
+    size_t _maxMemory;
+    std::atomic< size_t > _currentMemory;
+};
+
+}
+
+#endif
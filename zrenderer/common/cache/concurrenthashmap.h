@@ -0,0 +1,248 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _concurrenthashmap_h_
+#define _concurrenthashmap_h_
+
+#include <zrenderer/common/types.h>
+#include <zrenderer/common/epoch.h>
+
+namespace zrenderer
+{
+
+/**
+ * Hash map with lock free lookups. Modifications have to be serialized
+ * by the caller ( i.e. with a write lock ), while any number of readers
+ * can call find() concurrently, as long as they hold an Epoch::Guard for
+ * as long as they use the found value. Removed entries and outgrown
+ * bucket arrays are deleted only after all readers release them.
+ *
+ * The values are expected to be cheap to copy, i.e. pointers.
+ */
+template< class Key, class Value, class Hash = std::hash< Key > >
+class ConcurrentHashMap
+{
+public:
+
+    /**
+     * @param nBuckets is the initial number of buckets, rounded up to
+     * a power of two.
+     */
+    explicit ConcurrentHashMap( size_t nBuckets = 64 )
+        : _table( new Table( nBuckets ))
+        , _size( 0 )
+    {}
+
+    /**
+     * Deletes all entries. There must not be any reader.
+     */
+    ~ConcurrentHashMap()
+    {
+        Table* table = _table.load();
+        table->clear();
+        delete table;
+    }
+
+    /**
+     * Finds the value for a key. Can be called concurrently with the
+     * modifications, but the caller has to hold an Epoch::Guard.
+     * @param key is the key to search
+     * @return the value, or a default constructed value if key is not
+     * in the map.
+     */
+    Value find( const Key& key ) const
+    {
+        const Table* table = _table.load( std::memory_order_acquire );
+        const Node* node = table->getBucket( _hash( key )).load(
+                               std::memory_order_acquire );
+        for( ; node; node = node->next.load( std::memory_order_acquire ))
+        {
+            if( node->key == key )
+                return node->value;
+        }
+        return Value();
+    }
+
+    /**
+     * Inserts a value. Calls have to be serialized by the caller.
+     * @param key is the key of the value
+     * @param value is the inserted value
+     * @return false if the key is already in the map
+     */
+    bool insert( const Key& key, const Value& value )
+    {
+        _retireList.reclaim();
+        Table* table = _table.load();
+        std::atomic< Node* >& bucket = table->getBucket( _hash( key ));
+        for( Node* node = bucket.load(); node; node = node->next.load( ))
+        {
+            if( node->key == key )
+                return false;
+        }
+
+        bucket.store( new Node( key, value, bucket.load( )));
+        if( ++_size > table->size( ))
+            _grow();
+        return true;
+    }
+
+    /**
+     * Removes a key. Calls have to be serialized by the caller.
+     * @param key is the key to remove
+     * @return false if the key is not in the map
+     */
+    bool erase( const Key& key )
+    {
+        Table* table = _table.load();
+        std::atomic< Node* >* link = &table->getBucket( _hash( key ));
+        for( Node* node = link->load(); node; node = link->load( ))
+        {
+            if( node->key == key )
+            {
+                // Readers may still be on the node, it keeps pointing
+                // to the rest of the chain until it is deleted.
+                link->store( node->next.load( ));
+                _retireList.retire( [node] { delete node; });
+                --_size;
+                return true;
+            }
+            link = &node->next;
+        }
+        return false;
+    }
+
+    /**
+     * Calls the function for every key value pair. Has to be serialized
+     * with the modifications.
+     * @param func is called with the key and the value
+     */
+    template< class Func >
+    void forEach( Func func ) const
+    {
+        const Table* table = _table.load();
+        for( size_t i = 0; i < table->size(); ++i )
+        {
+            const Node* node = table->buckets[ i ].load();
+            for( ; node; node = node->next.load( ))
+                func( node->key, node->value );
+        }
+    }
+
+    /**
+     * @return the number of entries
+     */
+    size_t size() const { return _size; }
+
+private:
+
+    ConcurrentHashMap( const ConcurrentHashMap& ) = delete;
+    ConcurrentHashMap& operator=( const ConcurrentHashMap& ) = delete;
+
+    struct Node
+    {
+        Node( const Key& key_, const Value& value_, Node* next_ )
+            : key( key_ )
+            , value( value_ )
+            , next( next_ )
+        {}
+
+        const Key key;
+        const Value value;
+        std::atomic< Node* > next;
+    };
+
+    struct Table
+    {
+        explicit Table( size_t nBuckets )
+            : mask( _roundUp( nBuckets ) - 1 )
+            , buckets( new std::atomic< Node* >[ mask + 1 ] )
+        {
+            for( size_t i = 0; i <= mask; ++i )
+                buckets[ i ].store( 0, std::memory_order_relaxed );
+        }
+
+        size_t size() const { return mask + 1; }
+
+        std::atomic< Node* >& getBucket( size_t hash ) const
+        {
+            // Mix the hash, as std::hash of integers is the identity
+            hash ^= hash >> 33;
+            hash *= 0xff51afd7ed558ccdull;
+            hash ^= hash >> 33;
+            return buckets[ hash & mask ];
+        }
+
+        void clear()
+        {
+            for( size_t i = 0; i <= mask; ++i )
+            {
+                Node* node = buckets[ i ].load();
+                while( node )
+                {
+                    Node* next = node->next.load();
+                    delete node;
+                    node = next;
+                }
+            }
+        }
+
+        static size_t _roundUp( size_t value )
+        {
+            size_t result = 1;
+            while( result < value )
+                result <<= 1;
+            return result;
+        }
+
+        const size_t mask;
+        std::unique_ptr< std::atomic< Node* >[] > buckets;
+    };
+
+    void _grow()
+    {
+        // Readers may still traverse the old table, so the nodes are
+        // copied to the new table instead of being relinked.
+        Table* table = _table.load();
+        Table* newTable = new Table( 2 * table->size( ));
+        for( size_t i = 0; i < table->size(); ++i )
+        {
+            const Node* node = table->buckets[ i ].load();
+            for( ; node; node = node->next.load( ))
+            {
+                std::atomic< Node* >& bucket = newTable->getBucket(
+                                                   _hash( node->key ));
+                bucket.store( new Node( node->key, node->value,
+                                        bucket.load( )),
+                              std::memory_order_relaxed );
+            }
+        }
+
+        _table.store( newTable );
+        _retireList.retire( [table] { table->clear(); delete table; });
+    }
+
+    std::atomic< Table* > _table;
+    size_t _size;
+    Hash _hash;
+    RetireList _retireList;
+};
+
+}
+
+#endif // _concurrenthashmap_h_
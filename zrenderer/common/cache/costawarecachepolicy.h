@@ -0,0 +1,184 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _costawarecachepolicy_h_
+#define _costawarecachepolicy_h_
+
+#include <zrenderer/common/types.h>
+#include <zrenderer/common/cache/cachable.h>
+
+namespace zrenderer
+{
+
+/**
+ * Cost aware ( GreedyDual-Size ) policy. Every object has a priority of
+ * L + loadCost / size, where L is the priority of the last evicted
+ * object. The object with the lowest priority is evicted first, so small
+ * objects which are expensive to load stay longer in the cache. As L
+ * increases with every eviction, an object accessed recently gets a
+ * higher priority than an object of the same cost accessed long ago.
+ */
+template< class CacheObject,
+          class Hash = std::hash< typename CacheObject::key_type > >
+class CostAwareCachePolicy
+{
+public:
+
+    typedef typename CacheObject::key_type Key;
+    typedef std::vector< Key > Keys;
+
+    /**
+     * @param maxMemory Max memory for the cache
+     */
+    CostAwareCachePolicy( size_t maxMemory )
+        : _maxMemory( maxMemory )
+        , _inflation( 0.0 )
+        , _currentMemory( 0 )
+    {}
+
+    /**
+     * Inserts a cachable object with its priority. If object is already
+     * inserted, its priority is renewed.
+     * @param cachable the cachable object
+     */
+    void insert( const CacheObject& cachable )
+    {
+        typename CostIndex::iterator it = _costIndex.find( cachable.getKey( ));
+        if( it != _costIndex.end( ))
+        {
+            _priorities.erase( it->second.position );
+            it->second.position = _priorities.insert(
+                        std::make_pair( _getPriority( it->second ), &*it ));
+            return;
+        }
+
+        it = _costIndex.insert( std::make_pair( cachable.getKey(),
+                                                Entry( ))).first;
+        it->second.size = cachable.getSize();
+        it->second.cost = cachable.getLoadCost();
+        it->second.position = _priorities.insert(
+                    std::make_pair( _getPriority( it->second ), &*it ));
+        _currentMemory += it->second.size;
+    }
+
+    /**
+     * Removes a cachable object. Its priority becomes the base priority
+     * for the objects inserted afterwards.
+     * @param cachable
+     */
+    void remove( const CacheObject& cachable )
+    {
+        typename CostIndex::iterator it = _costIndex.find( cachable.getKey( ));
+        if( it == _costIndex.end( ))
+            return;
+
+        _inflation = std::max( _inflation, it->second.position->first );
+        _currentMemory -= it->second.size;
+        _priorities.erase( it->second.position );
+        _costIndex.erase( it );
+    }
+
+    /**
+     * Visits the keys from the lowest to the highest priority. The
+     * visitor may remove the visited key from the policy or insert it
+     * again.
+     * @param visitor is called with each key and returns false to stop
+     * the visiting.
+     */
+    template< class KeyVisitor >
+    void visitKeys( KeyVisitor visitor )
+    {
+        typename PriorityMap::iterator it = _priorities.begin();
+        for( size_t i = _priorities.size(); i > 0 && it != _priorities.end(); --i )
+        {
+            const Key& key = it->second->first;
+            ++it;
+            if( !visitor( key ))
+                return;
+        }
+    }
+
+    /**
+     * @return the list of cachable keys in eviction order
+     */
+    Keys getKeys() const
+    {
+        Keys keys;
+        keys.reserve( _priorities.size( ));
+        for( const typename PriorityMap::value_type& priority: _priorities )
+            keys.push_back( priority.second->first );
+        return keys;
+    }
+
+    /**
+     * @return true if cache has tobe cleaned
+     */
+    bool cleanCache() const
+    {
+        return _currentMemory >= _maxMemory;
+    }
+
+    /**
+     * @return true if cache is empty
+     */
+    bool isEmpty() const
+    {
+        return _priorities.empty();
+    }
+
+    /**
+     * @return Return the current memory usage. It can be queried
+     * without holding the cache lock.
+     */
+    size_t getUsage() const { return _currentMemory; }
+
+    /**
+     * @return Return the max memory
+     */
+    size_t getMaxMemory() const { return _maxMemory; }
+
+private:
+
+    struct Entry;
+    typedef std::unordered_map< Key, Entry, Hash > CostIndex;
+    typedef std::multimap< double, typename CostIndex::value_type* > PriorityMap;
+
+    struct Entry
+    {
+        typename PriorityMap::iterator position;
+        size_t size;
+        double cost;
+    };
+
+    double _getPriority( const Entry& entry ) const
+    {
+        return _inflation + entry.cost / double( std::max( entry.size,
+                                                           size_t( 1 )));
+    }
+
+    PriorityMap _priorities;
+    CostIndex _costIndex;
+    size_t _maxMemory;
+    double _inflation;
+    std::atomic< size_t > _currentMemory;
+};
+
+}
+
+#endif
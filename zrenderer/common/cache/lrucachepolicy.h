@@ -26,13 +26,19 @@
 namespace zrenderer
 {
 
-template< class CacheObject >
+/**
+ * Keeps the cachable objects in the least recently used order. The
+ * order is kept in a doubly linked list which is indexed by a hash
+ * map, so inserting, touching and removing an object are constant
+ * time operations.
+ */
+template< class CacheObject,
+          class Hash = std::hash< typename CacheObject::key_type > >
 class LRUCachePolicy
 {
 public:
 
     typedef typename CacheObject::key_type Key;
-    typedef std::deque< Key > LRUQueue;
     typedef std::vector< Key > Keys;
 
     /**
@@ -50,19 +56,55 @@ public:
      */
     void insert( const CacheObject& cachable )
     {
-        if( !_remove( cachable.getKey() ) )
-            _currentMemory += cachable.getSize();
-        _lruQueue.push_back( cachable.getKey( ));
+        typename LRUIndex::iterator it = _lruIndex.find( cachable.getKey( ));
+        if( it != _lruIndex.end( ))
+        {
+            _lruList.splice( _lruList.end(), _lruList, it->second.position );
+            return;
+        }
+
+        it = _lruIndex.insert( std::make_pair( cachable.getKey(),
+                                               Entry( ))).first;
+        it->second.position = _lruList.insert( _lruList.end(), &it->first );
+        it->second.size = cachable.getSize();
+        _currentMemory += it->second.size;
     }
 
     /**
-     * Removes a cachable object from the queue.
+     * Removes a cachable object from the queue. The memory usage
+     * is decreased by the size the object had when it was inserted.
      * @param cachable
      */
     void remove( const CacheObject& cachable )
     {
-        if( _remove( cachable.getKey() ))
-            _currentMemory -= cachable.getSize();
+        typename LRUIndex::iterator it = _lruIndex.find( cachable.getKey( ));
+        if( it == _lruIndex.end( ))
+            return;
+
+        _currentMemory -= it->second.size;
+        _lruList.erase( it->second.position );
+        _lruIndex.erase( it );
+    }
+
+    /**
+     * Visits the keys from the least recently used to the most recently
+     * used one. The visitor may remove the visited key from the policy or
+     * insert it again, keys inserted during the visit are not visited
+     * again.
+     * @param visitor is called with each key and returns false to stop
+     * the visiting.
+     */
+    template< class KeyVisitor >
+    void visitKeys( KeyVisitor visitor )
+    {
+        typename LRUList::iterator it = _lruList.begin();
+        for( size_t i = _lruList.size(); i > 0 && it != _lruList.end(); --i )
+        {
+            const Key& key = **it;
+            ++it;
+            if( !visitor( key ))
+                return;
+        }
     }
 
     /**
@@ -71,9 +113,9 @@ public:
     Keys getKeys() const
     {
         Keys keys;
-        keys.reserve( _lruQueue.size() );
-        for( const Key& key: _lruQueue )
-            keys.push_back( key );
+        keys.reserve( _lruList.size( ));
+        for( const Key* key: _lruList )
+            keys.push_back( *key );
         return keys;
     }
 
@@ -90,11 +132,12 @@ public:
      */
     bool isEmpty() const
     {
-        return _lruQueue.empty();
+        return _lruList.empty();
     }
 
     /**
-     * @return Return the current memory usage
+     * @return Return the current memory usage. It can be queried
+     * without holding the cache lock.
      */
     size_t getUsage() const { return _currentMemory; }
 
@@ -105,24 +148,20 @@ public:
 
 private:
 
-    bool _remove( const Key& key )
+    typedef std::list< const Key* > LRUList;
+
+    struct Entry
     {
-        typename LRUQueue::const_iterator it = _lruQueue.begin();
-        while( it != _lruQueue.end( ))
-        {
-            if( *it == key )
-            {
-                _lruQueue.erase( it );
-                return true;
-            }
-            else ++it;
-        }
-        return false;
-    }
+        typename LRUList::iterator position;
+        size_t size;
+    };
+
+    typedef std::unordered_map< Key, Entry, Hash > LRUIndex;
 
-    LRUQueue _lruQueue;
+    LRUList _lruList;
+    LRUIndex _lruIndex;
     size_t _maxMemory;
-    size_t _currentMemory;
+    std::atomic< size_t > _currentMemory;
 };
 
 }
@@ -0,0 +1,106 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _mappedcachable_h_
+#define _mappedcachable_h_
+
+#include <zrenderer/common/types.h>
+#include <zrenderer/common/mappedfile.h>
+#include <zrenderer/common/cache/cachable.h>
+
+namespace zrenderer
+{
+
+/**
+ * Cachable object, which is a view into a range of a mapped file.
+ * Constructing the object loads the pages of the range, destructing it
+ * releases them, so the data is not copied and the re-reads are served
+ * from the page cache. The size of the object is the size of its pages
+ * in the memory.
+ *
+ * It can be used directly as the cache object, or as the base class of
+ * the objects interpreting the data.
+ */
+template< typename Key >
+class MappedCachable : public Cachable< Key >
+{
+public:
+
+    /**
+     * @param key is the key of the object
+     * @param file is the mapped file
+     * @param offset is the start of the object data in the file
+     * @param size is the size of the object data in bytes
+     * @throw std::out_of_range if the range is beyond the end of the file
+     */
+    MappedCachable( const Key& key,
+                    const MappedFilePtr& file,
+                    size_t offset,
+                    size_t size )
+        : Cachable< Key >( key )
+        , _file( file )
+        , _offset( offset )
+        , _size( size )
+    {
+        if( offset > file->getSize() || size > file->getSize() - offset )
+            throw std::out_of_range( "Range is beyond " + file->getFileName( ));
+        _file->load( _offset, _size );
+    }
+
+    /**
+     * Constructor called by the Cache.
+     * @see MappedCachable
+     */
+    template< typename Allocator >
+    MappedCachable( const Key& key,
+                    const MappedFilePtr& file,
+                    size_t offset,
+                    size_t size,
+                    Allocator& )
+        : MappedCachable( key, file, offset, size )
+    {}
+
+    ~MappedCachable()
+    {
+        _file->dontNeed( _offset, _size );
+    }
+
+    /** @return the size of the object pages in the memory */
+    size_t getSize() const
+    {
+        return _file->getResidentSize( _offset, _size );
+    }
+
+    /** @return the object data */
+    const uint8_t* getData() const { return _file->getData() + _offset; }
+
+    /** @return the size of the object data in bytes */
+    size_t getDataSize() const { return _size; }
+
+    const MappedFilePtr& getFile() const { return _file; }
+
+private:
+    const MappedFilePtr _file;
+    const size_t _offset;
+    const size_t _size;
+};
+
+}
+
+#endif // _mappedcachable_h_
@@ -0,0 +1,521 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _prefetcher_h_
+#define _prefetcher_h_
+
+#include <zrenderer/common/types.h>
+#include <zrenderer/common/threadpool.h>
+
+#include <boost/thread/condition_variable.hpp>
+
+#include <thread>
+#include <type_traits>
+
+namespace zrenderer
+{
+
+/**
+ * Prefetches objects into a cache in the background. The objects to
+ * prefetch are given as hint batches with priorities, i.e. the objects
+ * visible from the predicted camera position of the next frame, or are
+ * predicted from the accesses to the cache:
+ * - a constant stride between the accessed keys, for integral keys
+ * - the key accessed after the same key the last time
+ * - the neighbours of the accessed key, given by a user function
+ *
+ * The accesses and the evictions are only recorded by the cache callbacks,
+ * the prediction runs on the prefetching threads. The strides and the
+ * successors are learned from the accesses of each thread, so concurrent
+ * access streams do not hide each other's patterns. The accesses made
+ * while 65536 recorded events wait for the prefetching threads are not
+ * used for predictions or statistics.
+ *
+ * The prefetcher attaches to the access and eviction callbacks of the
+ * cache, chaining the callbacks set before, and restores them when it is
+ * destructed. So it has to be constructed and destructed while the cache
+ * is not used concurrently.
+ *
+ * The objects are loaded by the load function, which is expected to call
+ * Cache::prefetch, so prefetching does not evict the objects in use.
+ * Higher priority hints are loaded first.
+ */
+template< typename CacheT >
+class Prefetcher
+{
+public:
+
+    typedef typename CacheT::Key Key;
+    typedef typename CacheT::CacheObjectPtr CacheObjectPtr;
+    typedef typename CacheObjectPtr::element_type CacheObject;
+    typedef std::function< CacheObjectPtr( const Key& ) > LoadFunction;
+    typedef std::function< void( const Key&, std::vector< Key >& ) > NeighbourFunction;
+
+    struct Hint
+    {
+        Key key;
+        float priority;
+    };
+
+    typedef std::vector< Hint > Hints;
+
+    struct Statistics
+    {
+        /** Number of prefetched objects */
+        size_t loaded;
+
+        /**
+         * Number of prefetched objects accessed in the cache before
+         * their eviction
+         */
+        size_t useful;
+
+        /** Number of prefetched objects evicted without an access */
+        size_t wasted;
+
+        /** Size of the prefetched objects evicted without an access */
+        size_t wastedBytes;
+
+        /** Number of prefetches, which did not fit into the cache */
+        size_t rejected;
+
+        /** @return the ratio of the prefetched objects accessed */
+        double getAccuracy() const
+        {
+            return loaded > 0 ? double( useful ) / double( loaded ) : 0.0;
+        }
+    };
+
+    /**
+     * @param cache is the cache to prefetch into
+     * @param load is the function loading an object into the cache
+     * @param nThreads is the number of prefetching threads
+     */
+    Prefetcher( CacheT& cache, const LoadFunction& load, size_t nThreads = 1 )
+        : _cache( cache )
+        , _load( load )
+        , _nThreads( nThreads )
+        , _nActive( 0 )
+        , _predictionPriority( 0.0f )
+        , _strideDepth( 2 )
+        , _statistics( Statistics( ))
+        , _accessCallback( cache.getAccessCallback( ))
+        , _evictionCallback( cache.getEvictionCallback( ))
+        , _processing( false )
+        , _threads( nThreads )
+    {
+        _cache.setAccessCallback( std::bind( &Prefetcher::_onAccess, this,
+                                             std::placeholders::_1,
+                                             std::placeholders::_2 ));
+        _cache.setEvictionCallback( std::bind( &Prefetcher::_onEvict, this,
+                                               std::placeholders::_1 ));
+    }
+
+    /**
+     * Stops prefetching the queued objects, waits for the loads in
+     * progress and restores the callbacks of the cache.
+     */
+    ~Prefetcher()
+    {
+        {
+            // The recorded accesses may still queue predictions
+            ScopedLock lock( _mutex );
+            for( ;; )
+            {
+                _clearQueue();
+                if( _nActive == 0 && !_isProcessing( ))
+                    break;
+                _idle.wait( lock );
+            }
+        }
+        _cache.setAccessCallback( _accessCallback );
+        _cache.setEvictionCallback( _evictionCallback );
+    }
+
+    /**
+     * Sets the function returning the neighbours of a key, which are
+     * prefetched when the key is accessed.
+     * @param neighbours is the neighbour function
+     */
+    void setNeighbourFunction( const NeighbourFunction& neighbours )
+    {
+        ScopedLock lock( _mutex );
+        _neighbours = neighbours;
+    }
+
+    /**
+     * @param priority is the priority of the objects predicted from the
+     * accesses. Default is 0.
+     */
+    void setPredictionPriority( float priority )
+    {
+        ScopedLock lock( _mutex );
+        _predictionPriority = priority;
+    }
+
+    /**
+     * @param depth is the number of strides prefetched ahead of the
+     * accessed key. Default is 2.
+     */
+    void setStrideDepth( size_t depth )
+    {
+        ScopedLock lock( _mutex );
+        _strideDepth = depth;
+    }
+
+    /**
+     * Queues a hint batch. The queued objects, which are not loaded yet,
+     * are replaced by the batch.
+     * @param hints are the objects to prefetch with their priorities
+     */
+    void hint( const Hints& hints )
+    {
+        ScopedLock lock( _mutex );
+        _clearQueue();
+        for( const Hint& hint: hints )
+            _push( hint.key, hint.priority );
+        _startThreads();
+    }
+
+    /**
+     * Waits until the recorded accesses are processed and the queued
+     * objects are loaded.
+     */
+    void wait()
+    {
+        ScopedLock lock( _mutex );
+        while( _nActive > 0 || !_queue.empty() || _isProcessing( ))
+            _idle.wait( lock );
+    }
+
+    /**
+     * @return the prefetch counters of the processed accesses, wait()
+     * for the ones of all the accesses
+     */
+    Statistics getStatistics() const
+    {
+        ScopedLock lock( _mutex );
+        return _statistics;
+    }
+
+private:
+
+    Prefetcher( const Prefetcher& ) = delete;
+    Prefetcher& operator=( const Prefetcher& ) = delete;
+
+    typedef std::multimap< float, Key, std::greater< float >> Queue;
+    typedef std::unordered_map< Key, typename Queue::iterator,
+                                typename CacheT::hasher > QueuedMap;
+    typedef std::unordered_map< Key, size_t, typename CacheT::hasher > PrefetchedMap;
+    typedef std::unordered_map< Key, Key, typename CacheT::hasher > SuccessorMap;
+    typedef std::deque< Key > History;
+    typedef std::unordered_map< std::thread::id, History > HistoryMap;
+
+    // An access or an eviction, in the order of the cache callbacks
+    struct Event
+    {
+        Key key;
+        std::thread::id thread;
+        bool found;
+        bool evicted;
+    };
+
+    typedef std::vector< Event > Events;
+
+    // Bounds the memory of the learned successors, the access histories
+    // and the events waiting for the prefetching threads
+    static const size_t _maxSuccessors = 1 << 16;
+    static const size_t _maxHistories = 256;
+    static const size_t _maxEvents = 1 << 16;
+
+    void _onAccess( const Key& key, const bool found )
+    {
+        if( _accessCallback )
+            _accessCallback( key, found );
+
+        const Event event = { key, std::this_thread::get_id(), found, false };
+        _record( event );
+    }
+
+    // Called with the cache lock held, the prefetcher does not lock the
+    // cache while it holds its own lock
+    void _onEvict( const CacheObject& cacheObject )
+    {
+        if( _evictionCallback )
+            _evictionCallback( cacheObject );
+
+        const Event event = { cacheObject.getKey(), std::thread::id(), false,
+                              true };
+        _record( event );
+    }
+
+    // Only the event lock is taken on the access path. The evictions are
+    // always recorded, so no eviction of a prefetched object is missed.
+    void _record( const Event& event )
+    {
+        {
+            ScopedLock lock( _eventMutex );
+            if( !event.evicted && _events.size() >= _maxEvents )
+                return;
+
+            _events.push_back( event );
+            if( _processing )
+                return;
+            _processing = true;
+        }
+        _threads.submit( std::bind( &Prefetcher::_processRecorded, this ));
+    }
+
+    bool _isProcessing() const
+    {
+        ScopedLock lock( _eventMutex );
+        return _processing;
+    }
+
+    void _processRecorded()
+    {
+        ScopedLock lock( _mutex );
+        for( ;; )
+        {
+            _processEvents( lock );
+            ScopedLock eventLock( _eventMutex );
+            if( _events.empty( ))
+            {
+                _processing = false;
+                break;
+            }
+        }
+        _startThreads();
+        _idle.notify_all();
+    }
+
+    // Learns the access patterns and measures the prefetch accuracy from
+    // the recorded events in their order, and queries the neighbours of the
+    // accessed keys without the lock. Only the prefetched objects still in
+    // the cache are useful, the ones evicted and loaded again are not.
+    void _processEvents( ScopedLock& lock )
+    {
+        Events events;
+        {
+            ScopedLock eventLock( _eventMutex );
+            events.swap( _events );
+        }
+
+        std::vector< Key > accessed;
+        for( const Event& event: events )
+        {
+            typename PrefetchedMap::iterator it =
+                    _prefetched.find( event.key );
+            if( event.evicted )
+            {
+                if( it == _prefetched.end( ))
+                    continue;
+                ++_statistics.wasted;
+                _statistics.wastedBytes += it->second;
+                _prefetched.erase( it );
+                continue;
+            }
+
+            if( it != _prefetched.end( ))
+            {
+                if( event.found )
+                    ++_statistics.useful;
+                _prefetched.erase( it );
+            }
+
+            if( _histories.size() >= _maxHistories &&
+                !_histories.count( event.thread ))
+            {
+                _histories.clear();
+            }
+            History& history = _histories[ event.thread ];
+            _predictStride( event.key, history,
+                            std::integral_constant< bool,
+                                        std::is_integral< Key >::value >( ));
+            _predictSuccessor( event.key, history );
+            accessed.push_back( event.key );
+        }
+
+        if( !_neighbours || accessed.empty( ))
+            return;
+
+        const NeighbourFunction neighbours = _neighbours;
+        std::vector< Key > keys;
+        lock.unlock();
+        std::vector< Key > keyNeighbours;
+        for( const Key& key: accessed )
+        {
+            keyNeighbours.clear();
+            neighbours( key, keyNeighbours );
+            keys.insert( keys.end(), keyNeighbours.begin(),
+                         keyNeighbours.end( ));
+        }
+        lock.lock();
+
+        for( const Key& key: keys )
+            _push( key, _predictionPriority );
+    }
+
+    void _push( const Key& key, float priority )
+    {
+        if( _cache.contains( key ) || _prefetched.count( key ))
+            return;
+
+        typename QueuedMap::iterator it = _queued.find( key );
+        if( it != _queued.end( ))
+        {
+            if( it->second->first >= priority )
+                return;
+            _queue.erase( it->second );
+            _queued.erase( it );
+        }
+        _queued.insert( std::make_pair( key, _queue.insert( std::make_pair( priority,
+                                                                            key ))));
+    }
+
+    void _clearQueue()
+    {
+        _queue.clear();
+        _queued.clear();
+    }
+
+    void _predictSuccessor( const Key& key, History& history )
+    {
+        if( !history.empty( ))
+        {
+            if( _successors.size() >= _maxSuccessors )
+                _successors.clear();
+            _successors.erase( history.back( ));
+            _successors.insert( std::make_pair( history.back(), key ));
+        }
+
+        typename SuccessorMap::const_iterator it = _successors.find( key );
+        if( it != _successors.end( ))
+            _push( it->second, _predictionPriority );
+
+        history.push_back( key );
+        if( history.size() > 2 )
+            history.pop_front();
+    }
+
+    void _predictStride( const Key&, const History&, std::false_type ) {}
+
+    void _predictStride( const Key& key, const History& history,
+                         std::true_type )
+    {
+        // Predicts when the stride from the last two accesses repeats
+        if( history.size() < 2 )
+            return;
+
+        const int64_t stride = int64_t( key ) - int64_t( history[ 1 ] );
+        if( stride == 0 || stride != int64_t( history[ 1 ] ) - int64_t( history[ 0 ] ))
+            return;
+
+        for( size_t i = 1; i <= _strideDepth; ++i )
+            _push( Key( int64_t( key ) + stride * int64_t( i )), _predictionPriority );
+    }
+
+    void _startThreads()
+    {
+        while( _nActive < _nThreads && _nActive < _queue.size( ))
+        {
+            ++_nActive;
+            _threads.submit( std::bind( &Prefetcher::_run, this ));
+        }
+    }
+
+    void _run()
+    {
+        ScopedLock lock( _mutex );
+        for( ;; )
+        {
+            _processEvents( lock );
+            if( _queue.empty( ))
+                break;
+
+            const Key key = _queue.begin()->second;
+            _queued.erase( key );
+            _queue.erase( _queue.begin( ));
+            if( _cache.contains( key ))
+                continue;
+
+            lock.unlock();
+            size_t size = 0;
+            try
+            {
+                const CacheObjectPtr cacheObject = _load( key );
+                size = cacheObject ? cacheObject->getSize() : 0;
+            }
+            catch( ... ) {}
+            lock.lock();
+
+            // The events recorded during the load are processed first, so
+            // an earlier eviction or access of the key is not counted
+            _processEvents( lock );
+
+            if( size == 0 )
+            {
+                ++_statistics.rejected;
+                continue;
+            }
+
+            // An object evicted before it is recorded is wasted, a later
+            // eviction waits for the lock and finds the record
+            ++_statistics.loaded;
+            if( _cache.contains( key ))
+                _prefetched[ key ] = size;
+            else
+            {
+                ++_statistics.wasted;
+                _statistics.wastedBytes += size;
+            }
+        }
+
+        --_nActive;
+        _idle.notify_all();
+    }
+
+    CacheT& _cache;
+    const LoadFunction _load;
+    const size_t _nThreads;
+    size_t _nActive;
+    NeighbourFunction _neighbours;
+    float _predictionPriority;
+    size_t _strideDepth;
+    Queue _queue;
+    QueuedMap _queued;
+    PrefetchedMap _prefetched;
+    SuccessorMap _successors;
+    HistoryMap _histories;
+    Statistics _statistics;
+    const typename CacheT::AccessCallback _accessCallback;
+    const typename CacheT::EvictionCallback _evictionCallback;
+    mutable boost::mutex _mutex;
+    boost::condition_variable _idle;
+    Events _events;
+    bool _processing;
+    mutable boost::mutex _eventMutex;
+
+    // Destructed first, as the threads access the members
+    ThreadPool _threads;
+};
+
+}
+
+#endif // _prefetcher_h_
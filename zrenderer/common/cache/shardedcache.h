@@ -0,0 +1,248 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _shardedcache_h_
+#define _shardedcache_h_
+
+#include <zrenderer/common/types.h>
+#include <zrenderer/common/cache/cache.h>
+
+namespace zrenderer
+{
+
+/**
+ * Splits the cached objects into independent caches ( shards ), where
+ * each shard has its own map, policy and lock. Keys are distributed
+ * to the shards by their hash, so threads accessing different keys
+ * rarely contend for the same lock.
+ *
+ * The max memory is a global budget for all shards. When creating an
+ * object exceeds the budget, unreferenced objects are evicted from the
+ * shards in turns, according to their policies. If all objects are
+ * referenced, the budget can be exceeded until they are released.
+ */
+template< typename CacheObject,
+          typename Allocator,
+          typename CachePolicy = LRUCachePolicy< CacheObject >,
+          typename Hash = std::hash< typename CacheObject::key_type > >
+class ShardedCache
+{
+public:
+
+    typedef typename CacheObject::key_type Key;
+    typedef Cache< CacheObject, Allocator, CachePolicy, Hash > Shard;
+    typedef typename Shard::CacheObjectFuture CacheObjectFuture;
+
+    /**
+     * Construct a sharded cache with a given allocator.
+     * @param allocator C++ allocator.
+     * @param maxMemory is the memory budget for all shards
+     * @param nShards is the number of shards
+     * @param loaders is the thread pool executing the asynchronous
+     * creates of all shards. If empty, a pool is created.
+     */
+    ShardedCache( const Allocator& allocator,
+                  size_t maxMemory,
+                  size_t nShards = 16,
+                  const ThreadPoolPtr& loaders = ThreadPoolPtr( ))
+        : _maxMemory( maxMemory )
+        , _evictShard( 0 )
+        , _loaders( loaders ? loaders : std::make_shared< ThreadPool >( ))
+        , _nLoads( 0 )
+    {
+        _shards.reserve( nShards );
+        for( size_t i = 0; i < nShards; ++i )
+            _shards.emplace_back( new Shard( allocator, maxMemory, _loaders ));
+    }
+
+    ~ShardedCache()
+    {
+        ScopedLock lock( _mutex );
+        while( _nLoads > 0 )
+            _condition.wait( lock );
+    }
+
+    /**
+     * Construct a cache object in the shard of the key.
+     * @see Cache::create
+     */
+    template< class... Args >
+    std::shared_ptr< CacheObject > create( const Key& key,
+                                           Args&&... args )
+    {
+        std::shared_ptr< CacheObject > cacheObject =
+                _getShard( key ).create( key, std::forward< Args >( args )... );
+        if( cacheObject )
+            _enforceBudget();
+        return cacheObject;
+    }
+
+    /**
+     * Construct a cache object asynchronously in the shard of the key.
+     * The global budget is enforced by the loader thread. Concurrent
+     * calls for the same key share one load task and its future.
+     * @see Cache::createAsync
+     */
+    template< class... Args >
+    CacheObjectFuture createAsync( const Key& key, Args&&... args )
+    {
+        std::shared_ptr< CacheObject > cacheObject = get( key );
+        if( cacheObject )
+        {
+            std::promise< std::shared_ptr< CacheObject >> promise;
+            promise.set_value( cacheObject );
+            return promise.get_future().share();
+        }
+
+        LoadPromisePtr promise;
+        CacheObjectFuture future;
+        {
+            ScopedLock lock( _mutex );
+            typename LoadingMap::const_iterator it = _loading.find( key );
+            if( it != _loading.end( ))
+                return it->second;
+
+            promise = std::make_shared< LoadPromise >();
+            future = promise->get_future().share();
+            _loading.insert( std::make_pair( key, future ));
+            ++_nLoads;
+        }
+
+        // The task must not keep the promise after the load, as the
+        // promise can hold the last reference to the object
+        _loaders->submit(
+            std::bind( &ShardedCache::_load< typename std::decay< Args >::type&... >,
+                       this, std::make_shared< LoadPromisePtr >( promise ),
+                       key, std::forward< Args >( args )... ));
+        return future;
+    }
+
+    /**
+     * @param key is the key of the cache object
+     * @return a cache object. If there is no cache object with key,
+     * empty ptr is returned.
+     */
+    std::shared_ptr< CacheObject > get( const Key& key ) const
+    {
+        return _getShard( key ).get( key );
+    }
+
+    /**
+     * @return the memory used by all shards
+     */
+    size_t getUsage() const
+    {
+        size_t usage = 0;
+        for( const std::unique_ptr< Shard >& shard: _shards )
+            usage += shard->getPolicy().getUsage();
+        return usage;
+    }
+
+    /**
+     * @return the statistics of all shards
+     */
+    CacheStatistics::Snapshot getStatistics() const
+    {
+        CacheStatistics::Snapshot snapshot;
+        for( const std::unique_ptr< Shard >& shard: _shards )
+            snapshot += shard->getStatistics().getSnapshot();
+        return snapshot;
+    }
+
+    /**
+     * @return the memory budget for all shards
+     */
+    size_t getMaxMemory() const { return _maxMemory; }
+
+    /**
+     * @return the number of shards
+     */
+    size_t getShardCount() const { return _shards.size(); }
+
+    /**
+     * @param index of the shard
+     * @return the shard
+     */
+    const Shard& getShard( size_t index ) const { return *_shards[ index ]; }
+
+private:
+
+    ShardedCache( const ShardedCache& ) = delete;
+    ShardedCache& operator=( const ShardedCache& ) = delete;
+
+    typedef std::promise< std::shared_ptr< CacheObject >> LoadPromise;
+    typedef std::shared_ptr< LoadPromise > LoadPromisePtr;
+    typedef std::unordered_map< Key, CacheObjectFuture, Hash > LoadingMap;
+
+    template< class... Args >
+    void _load( const std::shared_ptr< LoadPromisePtr >& holder, const Key& key,
+                Args&&... args )
+    {
+        LoadPromisePtr promise;
+        promise.swap( *holder );
+
+        // The shard shares the construction with concurrent creates
+        try
+        {
+            promise->set_value( create( key, std::forward< Args >( args )... ));
+        }
+        catch( ... )
+        {
+            promise->set_exception( std::current_exception( ));
+        }
+        promise.reset();
+
+        // The future is dropped with the load, so it does not keep the
+        // object alive
+        ScopedLock lock( _mutex );
+        _loading.erase( key );
+        --_nLoads;
+        _condition.notify_all();
+    }
+
+    Shard& _getShard( const Key& key ) const
+    {
+        return *_shards[ _hash( key ) % _shards.size() ];
+    }
+
+    void _enforceBudget()
+    {
+        size_t usage = getUsage();
+        for( size_t i = 0; i < _shards.size() && usage > _maxMemory; ++i )
+        {
+            const size_t index = _evictShard++ % _shards.size();
+            const size_t released = _shards[ index ]->evict( usage - _maxMemory );
+            usage = released < usage ? usage - released : 0;
+        }
+    }
+
+    std::vector< std::unique_ptr< Shard >> _shards;
+    const size_t _maxMemory;
+    std::atomic< size_t > _evictShard;
+    Hash _hash;
+    ThreadPoolPtr _loaders;
+    LoadingMap _loading;
+    size_t _nLoads;
+    boost::mutex _mutex;
+    boost::condition_variable _condition;
+};
+
+}
+
+#endif
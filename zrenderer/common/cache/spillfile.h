@@ -0,0 +1,292 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _spillfile_h_
+#define _spillfile_h_
+
+#include <zrenderer/common/types.h>
+
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace zrenderer
+{
+
+/**
+ * Stores blocks of data in a local file, within a size budget. The
+ * space of the removed blocks is reused for the new ones. When the
+ * budget is exceeded, the least recently written blocks are dropped.
+ * The file is removed on destruction.
+ *
+ * The class is not thread safe, except that the content of a block
+ * found with find() can be read without synchronization, and checked
+ * with isCurrent() afterwards.
+ */
+template< typename Key, typename Hash = std::hash< Key > >
+class SpillFile
+{
+public:
+
+    /**
+     * Location of a stored block. The version changes with every write,
+     * so a removed or replaced block is detected even if the new block
+     * has the same place in the file.
+     */
+    struct Block
+    {
+        size_t offset;
+        size_t size;
+        uint64_t version;
+    };
+
+    /**
+     * @param fileName is the file to create. An existing file is
+     * truncated.
+     * @param maxSize is the budget for the stored data in bytes
+     * @throw std::runtime_error if the file can not be created
+     */
+    SpillFile( const std::string& fileName, size_t maxSize )
+        : _fileName( fileName )
+        , _fd( ::open( fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600 ))
+        , _maxSize( maxSize )
+        , _usage( 0 )
+        , _fileSize( 0 )
+        , _version( 0 )
+    {
+        if( _fd < 0 )
+            throw std::runtime_error( "Can not create spill file " + fileName );
+    }
+
+    ~SpillFile()
+    {
+        ::close( _fd );
+        ::unlink( _fileName.c_str( ));
+    }
+
+    /**
+     * Writes a block. A block with the same key is replaced. Blocks
+     * larger than the budget are not stored.
+     * @param key is the key of the block
+     * @param data is the content of the block
+     * @return the keys of the blocks dropped to stay within the budget
+     * @throw std::runtime_error if the file can not be written
+     */
+    std::vector< Key > write( const Key& key, const ByteBuffer& data )
+    {
+        remove( key );
+
+        std::vector< Key > dropped;
+        if( data.size() > _maxSize )
+            return dropped;
+
+        while( _usage + data.size() > _maxSize )
+        {
+            dropped.push_back( _order.front( ));
+            remove( _order.front( ));
+        }
+
+        const Extent extent = { { _allocate( data.size( )), data.size(),
+                                  ++_version },
+                                _order.insert( _order.end(), key ) };
+        if( ::pwrite( _fd, data.data(), data.size(), extent.block.offset )
+                != ssize_t( data.size( )))
+        {
+            _free( extent.block.offset, extent.block.size );
+            _order.erase( extent.position );
+            throw std::runtime_error( "Can not write spill file " + _fileName );
+        }
+
+        _extents.insert( std::make_pair( key, extent ));
+        _usage += data.size();
+        return dropped;
+    }
+
+    /**
+     * @param key is the key of the block
+     * @param data is filled with the content of the block
+     * @return false if there is no block with the key
+     * @throw std::runtime_error if the file can not be read
+     */
+    bool read( const Key& key, ByteBuffer& data ) const
+    {
+        Block block;
+        if( !find( key, block ))
+            return false;
+
+        if( !read( block, data ))
+            throw std::runtime_error( "Can not read spill file " + _fileName );
+        return true;
+    }
+
+    /**
+     * @param key is the key of the block
+     * @param block is set to the location of the block
+     * @return false if there is no block with the key
+     */
+    bool find( const Key& key, Block& block ) const
+    {
+        typename ExtentMap::const_iterator it = _extents.find( key );
+        if( it == _extents.end( ))
+            return false;
+
+        block = it->second.block;
+        return true;
+    }
+
+    /**
+     * Reads a block found before, without accessing the state of the
+     * spill file, so it does not have to be synchronized with the other
+     * calls. The content is only valid if isCurrent() is true after it.
+     * @param block is the location of the block
+     * @param data is filled with the content of the block
+     * @return false if the block could not be read completely
+     */
+    bool read( const Block& block, ByteBuffer& data ) const
+    {
+        data.resize( block.size );
+        return ::pread( _fd, data.data(), data.size(), block.offset ) ==
+               ssize_t( data.size( ));
+    }
+
+    /**
+     * @param key is the key of the block
+     * @param block is the location of the block found before
+     * @return true if the block is neither removed nor replaced since
+     */
+    bool isCurrent( const Key& key, const Block& block ) const
+    {
+        typename ExtentMap::const_iterator it = _extents.find( key );
+        return it != _extents.end() &&
+               it->second.block.version == block.version;
+    }
+
+    /**
+     * Removes a block and releases its space in the file
+     * @param key is the key of the block
+     */
+    void remove( const Key& key )
+    {
+        typename ExtentMap::iterator it = _extents.find( key );
+        if( it == _extents.end( ))
+            return;
+
+        _free( it->second.block.offset, it->second.block.size );
+        _order.erase( it->second.position );
+        _usage -= it->second.block.size;
+        _extents.erase( it );
+    }
+
+    /** @return true if there is a block with the key */
+    bool contains( const Key& key ) const { return _extents.count( key ) > 0; }
+
+    /** @return the size of the stored blocks in bytes */
+    size_t getUsage() const { return _usage; }
+
+    /** @return the size budget in bytes */
+    size_t getMaxSize() const { return _maxSize; }
+
+private:
+
+    SpillFile( const SpillFile& ) = delete;
+    SpillFile& operator=( const SpillFile& ) = delete;
+
+    typedef std::list< Key > Order;
+
+    struct Extent
+    {
+        Block block;
+        typename Order::iterator position;
+    };
+
+    typedef std::unordered_map< Key, Extent, Hash > ExtentMap;
+
+    // Free space by offset, adjacent ranges are merged
+    typedef std::map< size_t, size_t > FreeMap;
+
+    size_t _allocate( size_t size )
+    {
+        // First fit in the free ranges, otherwise the file grows
+        for( FreeMap::iterator it = _freeSpace.begin(); it != _freeSpace.end(); ++it )
+        {
+            if( it->second < size )
+                continue;
+
+            const size_t offset = it->first;
+            const size_t remaining = it->second - size;
+            _freeSpace.erase( it );
+            if( remaining > 0 )
+                _freeSpace.insert( std::make_pair( offset + size, remaining ));
+            return offset;
+        }
+
+        const size_t offset = _fileSize;
+        _fileSize += size;
+        return offset;
+    }
+
+    void _free( size_t offset, size_t size )
+    {
+        if( size == 0 )
+            return;
+
+        FreeMap::iterator next = _freeSpace.lower_bound( offset );
+        if( next != _freeSpace.begin( ))
+        {
+            FreeMap::iterator previous = std::prev( next );
+            if( previous->first + previous->second == offset )
+            {
+                offset = previous->first;
+                size += previous->second;
+                _freeSpace.erase( previous );
+            }
+        }
+
+        if( next != _freeSpace.end() && offset + size == next->first )
+        {
+            size += next->second;
+            _freeSpace.erase( next );
+        }
+
+        // Space at the end of the file is given back to the file system
+        if( offset + size == _fileSize && ::ftruncate( _fd, off_t( offset )) == 0 )
+        {
+            _fileSize = offset;
+            return;
+        }
+
+        _freeSpace.insert( std::make_pair( offset, size ));
+    }
+
+    const std::string _fileName;
+    const int _fd;
+    const size_t _maxSize;
+    size_t _usage;
+    size_t _fileSize;
+    uint64_t _version;
+    ExtentMap _extents;
+    Order _order;
+    FreeMap _freeSpace;
+};
+
+}
+
+#endif // _spillfile_h_
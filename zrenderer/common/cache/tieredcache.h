@@ -0,0 +1,345 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _tieredcache_h_
+#define _tieredcache_h_
+
+#include <zrenderer/common/types.h>
+#include <zrenderer/common/cache/cache.h>
+#include <zrenderer/common/cache/spillfile.h>
+#include <zrenderer/common/cache/zlibcodec.h>
+
+namespace zrenderer
+{
+
+/**
+ * Cache with three tiers: the objects in RAM, the compressed objects in
+ * RAM and a spill file on the local disk, each with its own memory
+ * budget. The objects evicted from the hot tier are compressed into
+ * the second tier, whose least recently stored objects are moved to the
+ * spill file. When the budget of the spill file is reached, the objects
+ * are dropped. An object found in a lower tier is moved back to the hot
+ * tier, without loading it from its source again.
+ *
+ * In addition to the Cache requirements, the cache object has to
+ * implement:
+ * - void serialize( ByteBuffer& data ) const, to store its content
+ * - a constructor ( const Key&, const ByteBuffer& data, Allocator& ),
+ * to restore the content stored by serialize.
+ *
+ * The codec provides the static compress( const ByteBuffer&, ByteBuffer& )
+ * and decompress( const ByteBuffer&, ByteBuffer& ) functions.
+ *
+ * The evicted objects are serialized in the hot tier eviction and are
+ * compressed by the thread calling create or get afterwards, without
+ * holding any lock.
+ */
+template< typename CacheObject,
+          typename Allocator,
+          typename CachePolicy = LRUCachePolicy< CacheObject >,
+          typename Codec = ZlibCodec,
+          typename Hash = std::hash< typename CacheObject::key_type > >
+class TieredCache
+{
+public:
+
+    typedef typename CacheObject::key_type Key;
+    typedef Cache< CacheObject, Allocator, CachePolicy, Hash > HotCache;
+
+    enum Tier
+    {
+        TIER_NONE,
+        TIER_HOT,
+        TIER_COMPRESSED,
+        TIER_DISK
+    };
+
+    /**
+     * @param allocator C++ allocator.
+     * @param hotMemory is the memory budget for the objects
+     * @param compressedMemory is the memory budget for the compressed
+     * objects
+     * @param spillFileName is the file storing the objects on the disk
+     * @param diskMemory is the disk budget for the objects
+     * @param loaders is the thread pool of the hot tier
+     * @throw std::runtime_error if the spill file can not be created
+     */
+    TieredCache( const Allocator& allocator,
+                 size_t hotMemory,
+                 size_t compressedMemory,
+                 const std::string& spillFileName,
+                 size_t diskMemory,
+                 const ThreadPoolPtr& loaders = ThreadPoolPtr( ))
+        : _compressedMemory( compressedMemory )
+        , _compressedUsage( 0 )
+        , _spillFile( spillFileName, diskMemory )
+        , _hotCache( allocator, hotMemory, loaders )
+    {
+        _hotCache.setEvictionCallback( std::bind( &TieredCache::_onEvict, this,
+                                                  std::placeholders::_1 ));
+    }
+
+    /**
+     * Construct a cache object. If the object is in a lower tier, it is
+     * restored from there, otherwise constructed with the given
+     * parameters.
+     * @see Cache::create
+     */
+    template< class... Args >
+    std::shared_ptr< CacheObject > create( const Key& key,
+                                           Args&&... args )
+    {
+        std::shared_ptr< CacheObject > cacheObject = _hotCache.get( key );
+        if( !cacheObject && !_promote( key, cacheObject ))
+            cacheObject = _hotCache.create( key, std::forward< Args >( args )... );
+
+        _demote();
+        return cacheObject;
+    }
+
+    /**
+     * @param key is the key of the cache object
+     * @return a cache object, restored to the hot tier if it is in a
+     * lower tier. If there is no cache object with key, empty ptr is
+     * returned.
+     */
+    std::shared_ptr< CacheObject > get( const Key& key )
+    {
+        std::shared_ptr< CacheObject > cacheObject = _hotCache.get( key );
+        if( !cacheObject )
+            _promote( key, cacheObject );
+
+        _demote();
+        return cacheObject;
+    }
+
+    /**
+     * @param key is the key of the cache object
+     * @return the highest tier storing the object
+     */
+    Tier getTier( const Key& key ) const
+    {
+        if( _hotCache.get( key ))
+            return TIER_HOT;
+
+        ScopedLock lock( _mutex );
+        if( _pending.count( key ) || _compressed.count( key ))
+            return TIER_COMPRESSED;
+        if( _spillFile.contains( key ))
+            return TIER_DISK;
+        return TIER_NONE;
+    }
+
+    /** @return the size of the compressed objects in RAM */
+    size_t getCompressedUsage() const
+    {
+        ScopedLock lock( _mutex );
+        return _compressedUsage;
+    }
+
+    /** @return the size of the compressed objects on the disk */
+    size_t getDiskUsage() const
+    {
+        ScopedLock lock( _mutex );
+        return _spillFile.getUsage();
+    }
+
+    const HotCache& getHotCache() const { return _hotCache; }
+
+private:
+
+    TieredCache( const TieredCache& ) = delete;
+    TieredCache& operator=( const TieredCache& ) = delete;
+
+    typedef std::list< Key > Order;
+
+    struct CompressedObject
+    {
+        ByteBuffer data;
+        typename Order::iterator position;
+    };
+
+    struct Demotion
+    {
+        Key key;
+        ByteBufferPtr data;
+    };
+
+    typedef std::unordered_map< Key, CompressedObject, Hash > CompressedMap;
+    typedef std::unordered_map< Key, ByteBufferPtr, Hash > PendingMap;
+    typedef std::deque< Demotion > Demotions;
+
+    void _onEvict( const CacheObject& cacheObject )
+    {
+        // Called with the hot tier lock held, so the compression is
+        // left to _demote()
+        const Demotion demotion = { cacheObject.getKey(),
+                                    std::make_shared< ByteBuffer >() };
+        cacheObject.serialize( *demotion.data );
+
+        ScopedLock lock( _mutex );
+        _pending[ demotion.key ] = demotion.data;
+        _demotions.push_back( demotion );
+    }
+
+    bool _promote( const Key& key, std::shared_ptr< CacheObject >& cacheObject )
+    {
+        ByteBufferPtr data;
+        ByteBuffer compressed;
+        for( ;; )
+        {
+            typename SpillFile< Key, Hash >::Block block = { 0, 0, 0 };
+            {
+                ScopedLock lock( _mutex );
+                typename PendingMap::const_iterator pending =
+                        _pending.find( key );
+                if( pending != _pending.end( ))
+                {
+                    data = pending->second;
+                    break;
+                }
+
+                typename CompressedMap::const_iterator it =
+                        _compressed.find( key );
+                if( it != _compressed.end( ))
+                {
+                    compressed = it->second.data;
+                    break;
+                }
+
+                if( !_spillFile.find( key, block ))
+                    return false;
+            }
+
+            // The disk is read without the lock, like the compression in
+            // _demote(). The block is used if it is not removed or
+            // replaced meanwhile, otherwise the tiers are looked up again.
+            const bool read = _spillFile.read( block, compressed );
+            {
+                ScopedLock lock( _mutex );
+                if( _spillFile.isCurrent( key, block ))
+                {
+                    if( !read )
+                        throw std::runtime_error( "Can not read spill file" );
+                    break;
+                }
+            }
+
+            cacheObject = _hotCache.get( key );
+            if( cacheObject )
+                return true;
+        }
+
+        if( !data )
+        {
+            data = std::make_shared< ByteBuffer >();
+            Codec::decompress( compressed, *data );
+        }
+
+        // The object stays in the lower tier until it is restored, so
+        // concurrent promotions share the restore in the hot tier.
+        const ByteBuffer& content = *data;
+        cacheObject = _hotCache.create( key, content );
+        if( cacheObject )
+        {
+            ScopedLock lock( _mutex );
+            _pending.erase( key );
+            _eraseCompressed( key );
+            _spillFile.remove( key );
+        }
+        return true;
+    }
+
+    void _demote()
+    {
+        Demotions demotions;
+        {
+            ScopedLock lock( _mutex );
+            if( _demotions.empty( ))
+                return;
+            demotions.swap( _demotions );
+        }
+
+        for( const Demotion& demotion: demotions )
+        {
+            ByteBuffer compressed;
+            Codec::compress( *demotion.data, compressed );
+
+            // The object may have been promoted or evicted again meanwhile
+            ScopedLock lock( _mutex );
+            typename PendingMap::iterator it = _pending.find( demotion.key );
+            if( it == _pending.end() || it->second != demotion.data )
+                continue;
+
+            _pending.erase( it );
+            _storeCompressed( demotion.key, compressed );
+        }
+    }
+
+    void _storeCompressed( const Key& key, ByteBuffer& data )
+    {
+        _eraseCompressed( key );
+        _spillFile.remove( key );
+
+        if( data.size() > _compressedMemory )
+        {
+            _spillFile.write( key, data );
+            return;
+        }
+
+        while( _compressedUsage + data.size() > _compressedMemory )
+        {
+            const Key spillKey = _compressedOrder.front();
+            _spillFile.write( spillKey, _compressed.find( spillKey )->second.data );
+            _eraseCompressed( spillKey );
+        }
+
+        CompressedObject& compressed = _compressed[ key ];
+        compressed.data.swap( data );
+        compressed.position = _compressedOrder.insert( _compressedOrder.end(), key );
+        _compressedUsage += compressed.data.size();
+    }
+
+    void _eraseCompressed( const Key& key )
+    {
+        typename CompressedMap::iterator it = _compressed.find( key );
+        if( it == _compressed.end( ))
+            return;
+
+        _compressedUsage -= it->second.data.size();
+        _compressedOrder.erase( it->second.position );
+        _compressed.erase( it );
+    }
+
+    const size_t _compressedMemory;
+    size_t _compressedUsage;
+    CompressedMap _compressed;
+    Order _compressedOrder;
+    PendingMap _pending;
+    Demotions _demotions;
+    SpillFile< Key, Hash > _spillFile;
+    mutable boost::mutex _mutex;
+
+    // Destructed first, as the loads in flight may evict objects
+    HotCache _hotCache;
+};
+
+}
+
+#endif // _tieredcache_h_
@@ -0,0 +1,249 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _twoqcachepolicy_h_
+#define _twoqcachepolicy_h_
+
+#include <zrenderer/common/types.h>
+#include <zrenderer/common/cache/cachable.h>
+
+namespace zrenderer
+{
+
+/**
+ * 2Q policy. New objects enter a FIFO queue ( A1in ) and the keys of
+ * the objects evicted from it are remembered in a ghost queue ( A1out ).
+ * Only objects which are requested again while their key is in the
+ * ghost queue are promoted to the LRU queue ( Am ). Hence, objects which
+ * are used once, i.e. by a camera fly-through, do not flush the objects
+ * which are used repeatedly.
+ */
+template< class CacheObject,
+          class Hash = std::hash< typename CacheObject::key_type > >
+class TwoQCachePolicy
+{
+public:
+
+    typedef typename CacheObject::key_type Key;
+    typedef std::vector< Key > Keys;
+
+    /**
+     * @param maxMemory Max memory for the cache
+     * @param inRatio is the share of the memory for the A1in queue
+     * @param outRatio is the size of the objects remembered in the
+     * A1out queue, relative to the max memory
+     */
+    TwoQCachePolicy( size_t maxMemory,
+                     float inRatio = 0.25f,
+                     float outRatio = 0.5f )
+        : _maxMemory( maxMemory )
+        , _maxInMemory( size_t( float( maxMemory ) * inRatio ))
+        , _maxOutMemory( size_t( float( maxMemory ) * outRatio ))
+        , _currentMemory( 0 )
+    {
+        _memory[ A1IN ] = _memory[ AM ] = _memory[ A1OUT ] = 0;
+    }
+
+    /**
+     * Inserts a cachable object into the A1in queue. If the key of the
+     * object is in the A1out queue, it is inserted into the Am queue. If
+     * object is already in the Am queue, it is pushed to back of it.
+     * @param cachable the cachable object
+     */
+    void insert( const CacheObject& cachable )
+    {
+        typename QueueIndex::iterator it = _queueIndex.find( cachable.getKey( ));
+        if( it == _queueIndex.end( ))
+        {
+            it = _queueIndex.insert( std::make_pair( cachable.getKey(),
+                                                     Entry( ))).first;
+            it->second.queue = A1IN;
+            it->second.position = _queues[ A1IN ].insert(
+                                      _queues[ A1IN ].end(), &*it );
+            it->second.size = cachable.getSize();
+            _memory[ A1IN ] += it->second.size;
+            _currentMemory += it->second.size;
+            return;
+        }
+
+        Entry& entry = it->second;
+        switch( entry.queue )
+        {
+        case AM:
+            _move( entry, AM );
+            break;
+        case A1OUT:
+            _move( entry, AM );
+            _memory[ AM ] -= entry.size;
+            entry.size = cachable.getSize();
+            _memory[ AM ] += entry.size;
+            _currentMemory += entry.size;
+            break;
+        case A1IN:
+            // Correlated references keep the object in the FIFO order
+            break;
+        }
+    }
+
+    /**
+     * Removes a cachable object from the queues. The keys of the objects
+     * removed from A1in are remembered in the A1out queue.
+     * @param cachable
+     */
+    void remove( const CacheObject& cachable )
+    {
+        typename QueueIndex::iterator it = _queueIndex.find( cachable.getKey( ));
+        if( it == _queueIndex.end() || it->second.queue == A1OUT )
+            return;
+
+        Entry& entry = it->second;
+        _currentMemory -= entry.size;
+        if( entry.queue == AM )
+        {
+            _memory[ AM ] -= entry.size;
+            _queues[ AM ].erase( entry.position );
+            _queueIndex.erase( it );
+            return;
+        }
+
+        _move( entry, A1OUT );
+        while( _memory[ A1OUT ] > _maxOutMemory )
+        {
+            typename QueueIndex::value_type* ghost = _queues[ A1OUT ].front();
+            _memory[ A1OUT ] -= ghost->second.size;
+            _queues[ A1OUT ].pop_front();
+            _queueIndex.erase( ghost->first );
+        }
+    }
+
+    /**
+     * Visits the keys in eviction order. If A1in exceeds its share of
+     * the memory, its keys are visited first in FIFO order, followed by
+     * the keys of Am in LRU order. Otherwise Am is visited first. The
+     * visitor may remove the visited key from the policy or insert it
+     * again.
+     * @param visitor is called with each key and returns false to stop
+     * the visiting.
+     */
+    template< class KeyVisitor >
+    void visitKeys( KeyVisitor visitor )
+    {
+        const Queue first = _memory[ A1IN ] > _maxInMemory ? A1IN : AM;
+        if( _visitQueue( first, visitor ))
+            _visitQueue( first == A1IN ? AM : A1IN, visitor );
+    }
+
+    /**
+     * @return the list of cachable keys in eviction order
+     */
+    Keys getKeys() const
+    {
+        Keys keys;
+        const Queue first = _memory[ A1IN ] > _maxInMemory ? A1IN : AM;
+        for( const Queue queue: { first, first == A1IN ? AM : A1IN })
+        {
+            for( const typename QueueIndex::value_type* value: _queues[ queue ])
+                keys.push_back( value->first );
+        }
+        return keys;
+    }
+
+    /**
+     * @return true if cache has tobe cleaned
+     */
+    bool cleanCache() const
+    {
+        return _currentMemory >= _maxMemory;
+    }
+
+    /**
+     * @return true if cache is empty
+     */
+    bool isEmpty() const
+    {
+        return _queues[ A1IN ].empty() && _queues[ AM ].empty();
+    }
+
+    /**
+     * @return Return the current memory usage. It can be queried
+     * without holding the cache lock.
+     */
+    size_t getUsage() const { return _currentMemory; }
+
+    /**
+     * @return Return the max memory
+     */
+    size_t getMaxMemory() const { return _maxMemory; }
+
+private:
+
+    enum Queue
+    {
+        A1IN = 0,
+        AM,
+        A1OUT
+    };
+
+    struct Entry;
+    typedef std::unordered_map< Key, Entry, Hash > QueueIndex;
+    typedef std::list< typename QueueIndex::value_type* > KeyQueue;
+
+    struct Entry
+    {
+        Queue queue;
+        typename KeyQueue::iterator position;
+        size_t size;
+    };
+
+    void _move( Entry& entry, const Queue queue )
+    {
+        _memory[ entry.queue ] -= entry.size;
+        _queues[ queue ].splice( _queues[ queue ].end(),
+                                 _queues[ entry.queue ], entry.position );
+        entry.queue = queue;
+        _memory[ queue ] += entry.size;
+    }
+
+    template< class KeyVisitor >
+    bool _visitQueue( const Queue queue, KeyVisitor& visitor )
+    {
+        KeyQueue& keyQueue = _queues[ queue ];
+        typename KeyQueue::iterator it = keyQueue.begin();
+        for( size_t i = keyQueue.size(); i > 0 && it != keyQueue.end(); --i )
+        {
+            const Key& key = ( *it )->first;
+            ++it;
+            if( !visitor( key ))
+                return false;
+        }
+        return true;
+    }
+
+    KeyQueue _queues[ 3 ];
+    size_t _memory[ 3 ];
+    QueueIndex _queueIndex;
+    size_t _maxMemory;
+    size_t _maxInMemory;
+    size_t _maxOutMemory;
+    std::atomic< size_t > _currentMemory;
+};
+
+}
+
+#endif
@@ -0,0 +1,87 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _zlibcodec_h_
+#define _zlibcodec_h_
+
+#include <zrenderer/common/types.h>
+
+#include <stdexcept>
+#include <zlib.h>
+
+namespace zrenderer
+{
+
+/**
+ * Compresses memory with zlib at its fastest level. A codec used by the
+ * TieredCache has to provide the static compress and decompress
+ * functions.
+ */
+struct ZlibCodec
+{
+    /**
+     * @param input is the data to compress
+     * @param output is filled with the compressed data
+     * @throw std::runtime_error if compression fails
+     */
+    static void compress( const ByteBuffer& input, ByteBuffer& output )
+    {
+        // The uncompressed size is stored in front of the zlib stream
+        const uint64_t inputSize = input.size();
+        uLongf outputSize = compressBound( uLong( inputSize ));
+        output.resize( sizeof( inputSize ) + outputSize );
+        std::copy( reinterpret_cast< const uint8_t* >( &inputSize ),
+                   reinterpret_cast< const uint8_t* >( &inputSize + 1 ),
+                   output.begin( ));
+
+        if( compress2( output.data() + sizeof( inputSize ), &outputSize,
+                       input.data(), uLong( inputSize ), Z_BEST_SPEED ) != Z_OK )
+        {
+            throw std::runtime_error( "zlib compression failed" );
+        }
+        output.resize( sizeof( inputSize ) + outputSize );
+    }
+
+    /**
+     * @param input is the data compressed by compress()
+     * @param output is filled with the uncompressed data
+     * @throw std::runtime_error if the input is not valid
+     */
+    static void decompress( const ByteBuffer& input, ByteBuffer& output )
+    {
+        uint64_t outputSize = 0;
+        if( input.size() < sizeof( outputSize ))
+            throw std::runtime_error( "zlib stream is truncated" );
+
+        std::copy( input.begin(), input.begin() + sizeof( outputSize ),
+                   reinterpret_cast< uint8_t* >( &outputSize ));
+        output.resize( outputSize );
+        uLongf size = uLongf( outputSize );
+        if( uncompress( output.data(), &size, input.data() + sizeof( outputSize ),
+                        uLong( input.size() - sizeof( outputSize ))) != Z_OK ||
+            size != outputSize )
+        {
+            throw std::runtime_error( "zlib decompression failed" );
+        }
+    }
+};
+
+}
+
+#endif // _zlibcodec_h_
@@ -0,0 +1,254 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _epoch_h_
+#define _epoch_h_
+
+#include <zrenderer/common/types.h>
+
+#include <limits>
+
+namespace zrenderer
+{
+
+/**
+ * Epoch based reclamation for data structures which are read without
+ * locking. Readers access shared objects only while holding an
+ * Epoch::Guard. Writers unlink an object from the shared structure and
+ * hand it to a RetireList, which deletes it once every reader that could
+ * have seen the object has released its guard.
+ */
+class Epoch
+{
+    struct ThreadSlot;
+
+public:
+
+    /**
+     * Marks the calling thread as a reader of shared objects for the
+     * life time of the guard. Guards can be nested.
+     */
+    class Guard
+    {
+    public:
+        Guard()
+            : _slot( _getThreadSlot( ))
+        {
+            if( _slot.depth++ == 0 )
+            {
+                _slot.slot->epoch.store( _getEpoch().load( ));
+                std::atomic_thread_fence( std::memory_order_seq_cst );
+            }
+        }
+
+        ~Guard()
+        {
+            if( --_slot.depth == 0 )
+                _slot.slot->epoch.store( idle, std::memory_order_release );
+        }
+
+    private:
+        Guard( const Guard& ) = delete;
+        Guard& operator=( const Guard& ) = delete;
+
+        ThreadSlot& _slot;
+    };
+
+    /**
+     * Advances the global epoch. Objects unlinked before the call are
+     * safe to delete when getMinActiveEpoch() reaches the returned epoch.
+     * @return the new epoch
+     */
+    static uint64_t advance()
+    {
+        return ++_getEpoch();
+    }
+
+    /**
+     * @return the oldest epoch a reader is still in. If there is no
+     * reader, the max value is returned.
+     */
+    static uint64_t getMinActiveEpoch()
+    {
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        uint64_t minEpoch = idle;
+        for( const Slot* slot = _getSlots().load(); slot; slot = slot->next )
+        {
+            const uint64_t epoch = slot->epoch.load();
+            if( epoch < minEpoch )
+                minEpoch = epoch;
+        }
+        return minEpoch;
+    }
+
+private:
+
+    static const uint64_t idle = std::numeric_limits< uint64_t >::max();
+
+    struct Slot
+    {
+        Slot()
+            : epoch( idle )
+            , inUse( true )
+            , next( 0 )
+        {}
+
+        std::atomic< uint64_t > epoch;
+        std::atomic< bool > inUse;
+        Slot* next;
+
+        // Keeps the slots of different threads on different cache lines
+        char padding[ 64 ];
+    };
+
+    struct ThreadSlot
+    {
+        ThreadSlot()
+            : slot( _acquireSlot( ))
+            , depth( 0 )
+        {}
+
+        ~ThreadSlot()
+        {
+            slot->epoch.store( idle );
+            slot->inUse.store( false );
+        }
+
+        Slot* const slot;
+        size_t depth;
+    };
+
+    static ThreadSlot& _getThreadSlot()
+    {
+        static thread_local ThreadSlot threadSlot;
+        return threadSlot;
+    }
+
+    static Slot* _acquireSlot()
+    {
+        std::atomic< Slot* >& slots = _getSlots();
+        for( Slot* slot = slots.load(); slot; slot = slot->next )
+        {
+            bool inUse = false;
+            if( slot->inUse.compare_exchange_strong( inUse, true ))
+                return slot;
+        }
+
+        // Slots are never freed, as readers may be iterating over them
+        Slot* slot = new Slot;
+        slot->next = slots.load();
+        while( !slots.compare_exchange_weak( slot->next, slot ))
+            ;
+        return slot;
+    }
+
+    static std::atomic< uint64_t >& _getEpoch()
+    {
+        static std::atomic< uint64_t > epoch( 1 );
+        return epoch;
+    }
+
+    static std::atomic< Slot* >& _getSlots()
+    {
+        static std::atomic< Slot* > slots( 0 );
+        return slots;
+    }
+};
+
+/**
+ * Keeps the objects unlinked from a shared data structure until no
+ * reader can access them anymore. The list itself is not thread safe,
+ * it is protected by the lock of the writers retiring the objects.
+ */
+class RetireList
+{
+public:
+
+    RetireList() {}
+
+    /**
+     * Deletes all the retired objects. There must not be any reader
+     * accessing them.
+     */
+    ~RetireList()
+    {
+        for( Retired& retired: _retired )
+            retired.deleter();
+    }
+
+    /**
+     * Retires an object which is already unlinked from the shared
+     * data structure.
+     * @param deleter is called when the object can be deleted
+     */
+    void retire( const std::function< void() >& deleter )
+    {
+        _retired.push_back( Retired( Epoch::advance(), deleter ));
+        if( _retired.size() >= _reclaimThreshold )
+            reclaim();
+    }
+
+    /**
+     * Deletes the retired objects which are not accessible by any
+     * reader.
+     */
+    void reclaim()
+    {
+        if( _retired.empty( ))
+            return;
+
+        const uint64_t minEpoch = Epoch::getMinActiveEpoch();
+        std::vector< Retired >::iterator it =
+                std::partition( _retired.begin(), _retired.end(),
+                                [minEpoch]( const Retired& retired )
+                                { return retired.epoch > minEpoch; });
+        for( std::vector< Retired >::iterator i = it; i != _retired.end(); ++i )
+            i->deleter();
+        _retired.erase( it, _retired.end( ));
+        _reclaimThreshold = std::max( size_t( 64 ), 2 * _retired.size( ));
+    }
+
+    /**
+     * @return the number of objects waiting for deletion
+     */
+    size_t size() const { return _retired.size(); }
+
+private:
+
+    RetireList( const RetireList& ) = delete;
+    RetireList& operator=( const RetireList& ) = delete;
+
+    struct Retired
+    {
+        Retired( uint64_t epoch_, const std::function< void() >& deleter_ )
+            : epoch( epoch_ )
+            , deleter( deleter_ )
+        {}
+
+        uint64_t epoch;
+        std::function< void() > deleter;
+    };
+
+    std::vector< Retired > _retired;
+    size_t _reclaimThreshold = 64;
+};
+
+}
+
+#endif // _epoch_h_
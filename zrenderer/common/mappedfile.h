@@ -0,0 +1,209 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _mappedfile_h_
+#define _mappedfile_h_
+
+#include <zrenderer/common/types.h>
+
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace zrenderer
+{
+
+/**
+ * Maps a file read only into the memory. The pages are read from the
+ * file on access and stay in the kernel page cache, so the ranges can be
+ * released and accessed again without copying them. The read ahead of
+ * the kernel is disabled, the ranges are loaded explicitly.
+ */
+class MappedFile
+{
+public:
+
+    /**
+     * @param fileName is the file to map
+     * @throw std::runtime_error if the file can not be mapped
+     */
+    explicit MappedFile( const std::string& fileName )
+        : _fileName( fileName )
+        , _fd( ::open( fileName.c_str(), O_RDONLY ))
+        , _data( 0 )
+        , _size( 0 )
+    {
+        struct stat status;
+        if( _fd < 0 || ::fstat( _fd, &status ) != 0 )
+        {
+            _close();
+            throw std::runtime_error( "Can not open " + fileName );
+        }
+
+        _size = size_t( status.st_size );
+        if( _size == 0 )
+            return;
+
+        void* data = ::mmap( 0, _size, PROT_READ, MAP_SHARED, _fd, 0 );
+        if( data == MAP_FAILED )
+        {
+            _close();
+            throw std::runtime_error( "Can not map " + fileName );
+        }
+        _data = static_cast< const uint8_t* >( data );
+        ::madvise( const_cast< uint8_t* >( _data ), _size, MADV_RANDOM );
+    }
+
+    ~MappedFile()
+    {
+        _close();
+    }
+
+    /** @return the mapped file content */
+    const uint8_t* getData() const { return _data; }
+
+    /** @return the size of the file in bytes */
+    size_t getSize() const { return _size; }
+
+    /** @return the name of the mapped file */
+    const std::string& getFileName() const { return _fileName; }
+
+    /**
+     * Asks the kernel to read a range in the background.
+     * @param offset is the start of the range in bytes
+     * @param size is the size of the range in bytes
+     */
+    void willNeed( size_t offset, size_t size ) const
+    {
+        _advise( offset, size, MADV_WILLNEED );
+    }
+
+    /**
+     * Reads a range into the memory and maps its pages, by accessing
+     * every page of the range.
+     * @param offset is the start of the range in bytes
+     * @param size is the size of the range in bytes
+     */
+    void load( size_t offset, size_t size ) const
+    {
+        willNeed( offset, size );
+
+        const size_t pageSize = getPageSize();
+        const volatile uint8_t* data = _data;
+        for( size_t position = offset; position < offset + size;
+             position += pageSize - position % pageSize )
+        {
+            data[ position ];
+        }
+    }
+
+    /**
+     * Releases the pages of a range from the mapping. The pages stay in
+     * the page cache until the kernel reclaims them. As the pages can be
+     * shared with the neighbour ranges, these may access them again from
+     * the page cache.
+     * @param offset is the start of the range in bytes
+     * @param size is the size of the range in bytes
+     */
+    void dontNeed( size_t offset, size_t size ) const
+    {
+        _advise( offset, size, MADV_DONTNEED );
+    }
+
+    /**
+     * @param offset is the start of the range in bytes
+     * @param size is the size of the range in bytes
+     * @return the size of the pages of the range, which are in the memory
+     */
+    size_t getResidentSize( size_t offset, size_t size ) const
+    {
+        size_t begin, end;
+        if( !_getPages( offset, size, begin, end ))
+            return 0;
+
+        const size_t pageSize = getPageSize();
+        std::vector< unsigned char > pages(( end - begin ) / pageSize );
+        if( ::mincore( const_cast< uint8_t* >( _data ) + begin, end - begin,
+                       pages.data( )) != 0 )
+        {
+            return 0;
+        }
+
+        size_t resident = 0;
+        for( size_t i = 0; i < pages.size(); ++i )
+        {
+            if( pages[ i ] & 1 )
+                resident += pageSize;
+        }
+        return resident;
+    }
+
+    /** @return the size of the memory pages */
+    static size_t getPageSize()
+    {
+        static const size_t pageSize = size_t( ::sysconf( _SC_PAGESIZE ));
+        return pageSize;
+    }
+
+private:
+
+    MappedFile( const MappedFile& ) = delete;
+    MappedFile& operator=( const MappedFile& ) = delete;
+
+    bool _getPages( size_t offset, size_t size, size_t& begin, size_t& end ) const
+    {
+        if( size == 0 || offset >= _size )
+            return false;
+
+        const size_t pageSize = getPageSize();
+        begin = offset - offset % pageSize;
+        end = std::min( offset + size, _size );
+        end += ( pageSize - end % pageSize ) % pageSize;
+        return true;
+    }
+
+    void _advise( size_t offset, size_t size, int advice ) const
+    {
+        size_t begin, end;
+        if( _getPages( offset, size, begin, end ))
+            ::madvise( const_cast< uint8_t* >( _data ) + begin, end - begin, advice );
+    }
+
+    void _close()
+    {
+        if( _data )
+            ::munmap( const_cast< uint8_t* >( _data ), _size );
+        if( _fd >= 0 )
+            ::close( _fd );
+        _data = 0;
+    }
+
+    const std::string _fileName;
+    int _fd;
+    const uint8_t* _data;
+    size_t _size;
+};
+
+}
+
+#endif // _mappedfile_h_
@@ -20,8 +20,11 @@
 #ifndef _mathtypes_h_
 #define _mathtypes_h_
 
-#include <types.h>
+#include <zrenderer/common/types.h>
+
 #include <eigen3/Eigen/Core>
+#include <eigen3/Eigen/Geometry>
+#include <eigen3/Eigen/StdVector>
 
 namespace zrenderer
 {
@@ -42,6 +45,125 @@ using Eigen::Vector2d;
 using Eigen::Vector3d;
 using Eigen::Vector4d;
 
+using Eigen::Matrix4f;
+using Eigen::Affine3f;
+using Eigen::AffineCompact3f;
+using Eigen::AlignedBox3f;
+
+/**
+ * Vectors of fixed size vectorizable Eigen types need the aligned allocator
+ */
+typedef std::vector< Affine3f, Eigen::aligned_allocator< Affine3f >>
+    Affine3fs;
+typedef std::vector< AffineCompact3f,
+                     Eigen::aligned_allocator< AffineCompact3f >>
+    AffineCompact3fs;
+typedef std::vector< AlignedBox3f, Eigen::aligned_allocator< AlignedBox3f >>
+    AlignedBox3fs;
+
+typedef std::vector< Vector3f > Vector3fs;
+
+/**
+ * @param box is the box to transform
+ * @param transform is an affine transform
+ * @return the smallest axis aligned box containing the transformed box
+ */
+template< int Mode >
+AlignedBox3f transformBox( const AlignedBox3f& box,
+                           const Eigen::Transform< float, 3, Mode >& transform )
+{
+    if( box.isEmpty( ))
+        return box;
+
+    const Vector3f center = transform * box.center();
+    const Vector3f halfSize =
+            transform.linear().cwiseAbs() * ( box.sizes() * 0.5f );
+    return AlignedBox3f( center - halfSize, center + halfSize );
+}
+
+/**
+ * @param box is the box
+ * @return half of the surface area of the box, the cost measure of the
+ * surface area heuristic, zero if the box is empty
+ */
+inline float getArea( const AlignedBox3f& box )
+{
+    if( box.isEmpty( ))
+        return 0.0f;
+
+    const Vector3f sizes = box.sizes();
+    return sizes.x() * sizes.y() + sizes.y() * sizes.z() +
+           sizes.z() * sizes.x();
+}
+
+/**
+ * Slab test of a ray against a box.
+ * @param box is the box
+ * @param origin is the origin of the ray
+ * @param inverse is the component wise inverse of the ray direction
+ * @param distance is the maximum distance along the ray
+ * @param entry is set to the distance where the ray enters the box
+ * @return true if the ray hits the box within the distance
+ */
+inline bool intersectRayBox( const AlignedBox3f& box,
+                             const Vector3f& origin,
+                             const Vector3f& inverse,
+                             const float distance,
+                             float& entry )
+{
+    const Vector3f t0 = ( box.min() - origin ).cwiseProduct( inverse );
+    const Vector3f t1 = ( box.max() - origin ).cwiseProduct( inverse );
+    entry = std::max( t0.cwiseMin( t1 ).maxCoeff(), 0.0f );
+    const float exit = t0.cwiseMax( t1 ).minCoeff();
+    return entry <= exit && entry <= distance;
+}
+
+/**
+ * Moeller-Trumbore test of a ray against a triangle, without culling the
+ * back faces.
+ * @param v0 is the first vertex of the triangle
+ * @param v1 is the second vertex of the triangle
+ * @param v2 is the third vertex of the triangle
+ * @param origin is the origin of the ray
+ * @param direction is the direction of the ray, the distances are in its
+ * length
+ * @param distance is the distance of the closest hit so far, set to the
+ * distance of the triangle if it is closer
+ * @return true if the triangle is hit closer than the distance
+ */
+inline bool intersectRayTriangle( const Vector3f& v0,
+                                  const Vector3f& v1,
+                                  const Vector3f& v2,
+                                  const Vector3f& origin,
+                                  const Vector3f& direction,
+                                  float& distance )
+{
+    const Vector3f edge1 = v1 - v0;
+    const Vector3f edge2 = v2 - v0;
+    const Vector3f p = direction.cross( edge2 );
+    const float determinant = edge1.dot( p );
+    if( determinant == 0.0f )
+        return false;
+
+    const float inverse = 1.0f / determinant;
+    const Vector3f s = origin - v0;
+    const float u = s.dot( p ) * inverse;
+    if( u < 0.0f || u > 1.0f )
+        return false;
+
+    const Vector3f q = s.cross( edge1 );
+    const float v = direction.dot( q ) * inverse;
+    if( v < 0.0f || u + v > 1.0f )
+        return false;
+
+    const float t = edge2.dot( q ) * inverse;
+    if( t < 0.0f || t >= distance )
+        return false;
+
+    distance = t;
+    return true;
+}
+
 }
 
 #endif // _mathtypes_h_
@@ -0,0 +1,128 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _mesh_h_
+#define _mesh_h_
+
+#include <zrenderer/common/mathtypes.h>
+
+#include <stdexcept>
+
+namespace zrenderer
+{
+
+/**
+ * Indexed triangle mesh. The mesh is immutable, so it can be shared by
+ * any number of instances and threads.
+ */
+class Mesh
+{
+public:
+
+    typedef std::vector< uint32_t > Indices;
+
+    /**
+     * @param positions are the vertex positions
+     * @param indices are the vertex indices, three per triangle
+     * @throw std::runtime_error if the indices are not triangles or they
+     * refer to missing vertices
+     */
+    Mesh( const Vector3fs& positions, const Indices& indices )
+        : _positions( positions )
+        , _indices( indices )
+    {
+        if( _indices.size() % 3 != 0 )
+            throw std::runtime_error( "Mesh indices are not triangles" );
+
+        for( const uint32_t index: _indices )
+        {
+            if( index >= _positions.size( ))
+                throw std::runtime_error( "Mesh index out of range" );
+            _bounds.extend( _positions[ index ] );
+        }
+    }
+
+    /** @return the vertex positions */
+    const Vector3fs& getPositions() const { return _positions; }
+
+    /** @return the vertex indices, three per triangle */
+    const Indices& getIndices() const { return _indices; }
+
+    /** @return the number of triangles */
+    size_t getTriangleCount() const { return _indices.size() / 3; }
+
+    /** @return the bounds of the triangles */
+    const AlignedBox3f& getBounds() const { return _bounds; }
+
+    /**
+     * @param triangle is the index of the triangle
+     * @return the bounds of the triangle
+     */
+    AlignedBox3f getTriangleBounds( const size_t triangle ) const
+    {
+        AlignedBox3f bounds( _getVertex( triangle, 0 ));
+        bounds.extend( _getVertex( triangle, 1 ));
+        bounds.extend( _getVertex( triangle, 2 ));
+        return bounds;
+    }
+
+    /**
+     * Intersects a ray with a triangle, without culling the back faces.
+     * @param triangle is the index of the triangle
+     * @param origin is the origin of the ray
+     * @param direction is the direction of the ray, the distances are in
+     * its length
+     * @param distance is the distance of the closest hit so far, set to
+     * the distance of the triangle if it is closer
+     * @return true if the triangle is hit closer than the distance
+     */
+    bool intersect( const size_t triangle,
+                    const Vector3f& origin,
+                    const Vector3f& direction,
+                    float& distance ) const
+    {
+        return intersectRayTriangle( _getVertex( triangle, 0 ),
+                                     _getVertex( triangle, 1 ),
+                                     _getVertex( triangle, 2 ),
+                                     origin, direction, distance );
+    }
+
+    /** @return the size of the vertices and the indices in bytes */
+    size_t getMemorySize() const
+    {
+        return _positions.size() * sizeof( Vector3f ) +
+               _indices.size() * sizeof( uint32_t );
+    }
+
+private:
+
+    const Vector3f& _getVertex( const size_t triangle,
+                                const size_t vertex ) const
+    {
+        return _positions[ _indices[ triangle * 3 + vertex ]];
+    }
+
+    const Vector3fs _positions;
+    const Indices _indices;
+    AlignedBox3f _bounds;
+};
+
+}
+
+#endif // _mesh_h_
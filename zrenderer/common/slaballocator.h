@@ -0,0 +1,248 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _slaballocator_h_
+#define _slaballocator_h_
+
+#include <zrenderer/common/types.h>
+
+#include <new>
+
+namespace zrenderer
+{
+
+/**
+ * Allocates memory in power of two size classes. Every size class
+ * carves its slots from large slabs, and the released slots are reused
+ * for the allocations of the same class, so a long running cache of
+ * fixed size objects does not fragment the heap. The slabs are released
+ * on destruction only.
+ *
+ * Allocations larger than the largest size class are forwarded to the
+ * global operator new. The slots are aligned to 16 bytes. The size
+ * classes are locked separately, so the arena is thread safe.
+ */
+class SlabArena
+{
+public:
+
+    /**
+     * @param slabSize is the size of the slabs in bytes
+     * @param maxSlotSize is the largest allocation served by the slabs
+     */
+    explicit SlabArena( size_t slabSize = 1 << 20,
+                        size_t maxSlotSize = 1 << 16 )
+        : _slabSize( slabSize )
+        , _nClasses( _getClass( std::max( maxSlotSize, size_t( _minSlotSize ))) + 1 )
+        , _sizeClasses( new SizeClass[ _nClasses ] )
+        , _reserved( 0 )
+        , _used( 0 )
+    {}
+
+    ~SlabArena()
+    {
+        for( size_t i = 0; i < _nClasses; ++i )
+            for( void* slab: _sizeClasses[ i ].slabs )
+                ::operator delete( slab );
+    }
+
+    /**
+     * @param bytes is the size of the allocation
+     * @return the allocated memory
+     * @throw bad_alloc when the memory can not be allocated
+     */
+    void* allocate( size_t bytes )
+    {
+        const size_t sizeClass = _getClass( bytes );
+        if( sizeClass >= _nClasses )
+        {
+            void* ptr = ::operator new( bytes );
+            _reserved += bytes;
+            _used += bytes;
+            return ptr;
+        }
+
+        const size_t slotSize = _minSlotSize << sizeClass;
+        SizeClass& slots = _sizeClasses[ sizeClass ];
+        ScopedLock lock( slots.mutex );
+        if( !slots.freeList )
+        {
+            const size_t slabSize = std::max( _slabSize, slotSize );
+            uint8_t* slab = static_cast< uint8_t* >( ::operator new( slabSize ));
+            slots.slabs.push_back( slab );
+            _reserved += slabSize;
+
+            for( size_t offset = slabSize - slabSize % slotSize; offset > 0; )
+            {
+                offset -= slotSize;
+                FreeSlot* slot = reinterpret_cast< FreeSlot* >( slab + offset );
+                slot->next = slots.freeList;
+                slots.freeList = slot;
+            }
+        }
+
+        FreeSlot* slot = slots.freeList;
+        slots.freeList = slot->next;
+        _used += slotSize;
+        return slot;
+    }
+
+    /**
+     * @param ptr is the memory returned by allocate
+     * @param bytes is the size given to allocate
+     */
+    void deallocate( void* ptr, size_t bytes )
+    {
+        if( !ptr )
+            return;
+
+        const size_t sizeClass = _getClass( bytes );
+        if( sizeClass >= _nClasses )
+        {
+            ::operator delete( ptr );
+            _reserved -= bytes;
+            _used -= bytes;
+            return;
+        }
+
+        SizeClass& slots = _sizeClasses[ sizeClass ];
+        ScopedLock lock( slots.mutex );
+        FreeSlot* slot = static_cast< FreeSlot* >( ptr );
+        slot->next = slots.freeList;
+        slots.freeList = slot;
+        _used -= _minSlotSize << sizeClass;
+    }
+
+    /** @return the memory allocated from the system in bytes */
+    size_t getReservedBytes() const { return _reserved; }
+
+    /** @return the memory given to the users in bytes, rounded to slots */
+    size_t getUsedBytes() const { return _used; }
+
+private:
+
+    SlabArena( const SlabArena& ) = delete;
+    SlabArena& operator=( const SlabArena& ) = delete;
+
+    struct FreeSlot
+    {
+        FreeSlot* next;
+    };
+
+    struct SizeClass
+    {
+        SizeClass() : freeList( 0 ) {}
+
+        boost::mutex mutex;
+        FreeSlot* freeList;
+        std::vector< void* > slabs;
+    };
+
+    static const size_t _minSlotSize = 16;
+
+    static size_t _getClass( size_t bytes )
+    {
+        size_t sizeClass = 0;
+        while(( size_t( _minSlotSize ) << sizeClass ) < bytes )
+            ++sizeClass;
+        return sizeClass;
+    }
+
+    const size_t _slabSize;
+    const size_t _nClasses;
+    std::unique_ptr< SizeClass[] > _sizeClasses;
+    std::atomic< size_t > _reserved;
+    std::atomic< size_t > _used;
+};
+
+typedef std::shared_ptr< SlabArena > SlabArenaPtr;
+
+/**
+ * C++ allocator allocating from a SlabArena. The copies and the rebound
+ * allocators share the arena, so it can be given to a Cache and the
+ * cache objects can allocate their data from the same arena.
+ */
+template< typename T >
+class SlabAllocator
+{
+public:
+
+    typedef T value_type;
+
+    template< typename U >
+    struct rebind
+    {
+        typedef SlabAllocator< U > other;
+    };
+
+    /** Creates an allocator with a new arena with the default sizes */
+    SlabAllocator()
+        : _arena( std::make_shared< SlabArena >( ))
+    {}
+
+    /** @param arena is the arena to allocate from */
+    explicit SlabAllocator( const SlabArenaPtr& arena )
+        : _arena( arena )
+    {}
+
+    template< typename U >
+    SlabAllocator( const SlabAllocator< U >& allocator )
+        : _arena( allocator.getArena( ))
+    {}
+
+    /**
+     * @param n is the number of objects
+     * @return the memory for the objects
+     * @throw bad_alloc when the memory can not be allocated
+     */
+    T* allocate( size_t n )
+    {
+        return static_cast< T* >( _arena->allocate( n * sizeof( T )));
+    }
+
+    /**
+     * @param ptr is the memory returned by allocate
+     * @param n is the number of objects given to allocate
+     */
+    void deallocate( T* ptr, size_t n )
+    {
+        _arena->deallocate( ptr, n * sizeof( T ));
+    }
+
+    const SlabArenaPtr& getArena() const { return _arena; }
+
+private:
+    SlabArenaPtr _arena;
+};
+
+template< typename T, typename U >
+bool operator==( const SlabAllocator< T >& lhs, const SlabAllocator< U >& rhs )
+{
+    return lhs.getArena() == rhs.getArena();
+}
+
+template< typename T, typename U >
+bool operator!=( const SlabAllocator< T >& lhs, const SlabAllocator< U >& rhs )
+{
+    return !( lhs == rhs );
+}
+
+}
+
+#endif // _slaballocator_h_
@@ -0,0 +1,123 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _threadpool_h_
+#define _threadpool_h_
+
+#include <zrenderer/common/types.h>
+
+#include <boost/thread/condition_variable.hpp>
+
+#include <thread>
+
+namespace zrenderer
+{
+
+/**
+ * Executes the submitted tasks on a fixed number of threads in
+ * submission order. The threads are started with the first task.
+ */
+class ThreadPool
+{
+public:
+
+    /**
+     * @param nThreads is the number of threads. If it is 0, the number
+     * of hardware threads is used.
+     */
+    explicit ThreadPool( size_t nThreads = 0 )
+        : _nThreads( nThreads > 0 ? nThreads
+                                  : std::max( std::thread::hardware_concurrency(),
+                                              1u ))
+        , _stopped( false )
+    {}
+
+    /**
+     * Waits for all the submitted tasks to finish.
+     */
+    ~ThreadPool()
+    {
+        {
+            ScopedLock lock( _mutex );
+            _stopped = true;
+        }
+        _condition.notify_all();
+        for( std::thread& thread: _threads )
+            thread.join();
+    }
+
+    /**
+     * Queues a task for execution.
+     * @param task is the function to execute
+     */
+    void submit( const std::function< void() >& task )
+    {
+        {
+            ScopedLock lock( _mutex );
+            _tasks.push_back( task );
+            if( _threads.empty( ))
+            {
+                for( size_t i = 0; i < _nThreads; ++i )
+                    _threads.emplace_back( &ThreadPool::_run, this );
+            }
+        }
+        _condition.notify_one();
+    }
+
+    /**
+     * @return the number of threads
+     */
+    size_t getThreadCount() const { return _nThreads; }
+
+private:
+
+    ThreadPool( const ThreadPool& ) = delete;
+    ThreadPool& operator=( const ThreadPool& ) = delete;
+
+    void _run()
+    {
+        for( ;; )
+        {
+            std::function< void() > task;
+            {
+                ScopedLock lock( _mutex );
+                while( _tasks.empty() && !_stopped )
+                    _condition.wait( lock );
+
+                if( _tasks.empty( ))
+                    return;
+
+                task = std::move( _tasks.front( ));
+                _tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    const size_t _nThreads;
+    bool _stopped;
+    std::deque< std::function< void() >> _tasks;
+    std::vector< std::thread > _threads;
+    boost::mutex _mutex;
+    boost::condition_variable _condition;
+};
+
+}
+
+#endif // _threadpool_h_
@@ -26,7 +26,9 @@
 #include <unordered_map>
 #include <set>
 #include <deque>
+#include <list>
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <functional>
 
@@ -58,11 +60,23 @@ using std::uint64_t;
 
 class CacheObject;
 class Mesh;
+class MappedFile;
+class ThreadPool;
+class WorkStealingPool;
 
 /**
  * SmartPtr definition
  */
 typedef std::shared_ptr< Mesh > MeshPtr;
+typedef std::shared_ptr< MappedFile > MappedFilePtr;
+typedef std::shared_ptr< ThreadPool > ThreadPoolPtr;
+typedef std::shared_ptr< WorkStealingPool > WorkStealingPoolPtr;
+
+/**
+ * Raw memory definitions
+ */
+typedef std::vector< uint8_t > ByteBuffer;
+typedef std::shared_ptr< ByteBuffer > ByteBufferPtr;
 
 /**
  * Locking object definitions
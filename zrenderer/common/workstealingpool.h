@@ -0,0 +1,335 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _workstealingpool_h_
+#define _workstealingpool_h_
+
+#include <zrenderer/common/types.h>
+
+#include <boost/thread/condition_variable.hpp>
+
+#include <exception>
+#include <thread>
+
+namespace zrenderer
+{
+
+/**
+ * Executes a task and the tasks it spawns on a fixed number of workers.
+ * Every worker has its own task queue: a worker takes its newest task
+ * first and, when its queue is empty, steals the oldest task of another
+ * worker. The thread calling run() is worker 0. Idle workers spin for a
+ * while and then sleep until a task is spawned or the run ends.
+ */
+class WorkStealingPool
+{
+public:
+
+    /**
+     * Task function, its parameter is the index of the executing worker
+     */
+    typedef std::function< void( size_t ) > Task;
+
+    /**
+     * @param nWorkers is the number of workers, including the calling
+     * thread. If it is 0, the number of hardware threads is used.
+     */
+    explicit WorkStealingPool( size_t nWorkers = 0 )
+        : _queues( nWorkers > 0 ? nWorkers
+                                : std::max( std::thread::hardware_concurrency(),
+                                            1u ))
+        , _pending( 0 )
+        , _nSleeping( 0 )
+        , _runCount( 0 )
+        , _stopped( false )
+    {
+        for( size_t i = 1; i < _queues.size(); ++i )
+            _threads.emplace_back( &WorkStealingPool::_run, this, i );
+    }
+
+    ~WorkStealingPool()
+    {
+        {
+            ScopedLock lock( _mutex );
+            _stopped = true;
+        }
+        _condition.notify_all();
+        _taskCondition.notify_all();
+        for( std::thread& thread: _threads )
+            thread.join();
+    }
+
+    /**
+     * Executes the task and all the tasks spawned from it. The calling
+     * thread takes part in the execution. The runs of different threads
+     * are serialized. A run from a task of this pool executes its tasks on
+     * the calling worker, as the other workers may be blocked by the outer
+     * run.
+     * @param task is the function to execute
+     * @throw the first exception thrown by the tasks
+     */
+    void run( const Task& task )
+    {
+        Context& context = _getContext();
+        if( context.pool == this )
+        {
+            _runInline( task, context );
+            return;
+        }
+
+        ScopedLock runLock( _runMutex );
+        _exception = std::exception_ptr();
+        _pending = 1;
+        _queues[ 0 ].push( task );
+        {
+            ScopedLock lock( _mutex );
+            ++_runCount;
+        }
+        _condition.notify_all();
+
+        _work( 0 );
+        if( _exception )
+            std::rethrow_exception( _exception );
+    }
+
+    /**
+     * Queues a task during a run. It has to be called from a task.
+     * @param worker is the index of the calling worker
+     * @param task is the function to execute
+     */
+    void spawn( const size_t worker, const Task& task )
+    {
+        Context& context = _getContext();
+        if( context.pool == this && context.inlineTasks )
+        {
+            context.inlineTasks->push_back( task );
+            return;
+        }
+
+        ++_pending;
+        _queues[ worker ].push( task );
+        if( _nSleeping > 0 )
+        {
+            ScopedLock lock( _mutex );
+            _taskCondition.notify_one();
+        }
+    }
+
+    /**
+     * @return the number of workers, including the thread calling run()
+     */
+    size_t getWorkerCount() const { return _queues.size(); }
+
+private:
+
+    WorkStealingPool( const WorkStealingPool& ) = delete;
+    WorkStealingPool& operator=( const WorkStealingPool& ) = delete;
+
+    typedef std::deque< Task > Tasks;
+
+    // Number of failed steal rounds before an idle worker sleeps
+    static const size_t _maxSpins = 64;
+
+    // The pool whose task the thread executes, and the tasks of the
+    // inline run of the thread, if any
+    struct Context
+    {
+        WorkStealingPool* pool;
+        size_t worker;
+        Tasks* inlineTasks;
+    };
+
+    static Context& _getContext()
+    {
+        static thread_local Context context = { nullptr, 0, nullptr };
+        return context;
+    }
+
+    // The queues are padded instead of aligned, as std::vector ignores
+    // the over-alignment before C++17. The data of two queues is at
+    // least a cache line apart wherever the vector is allocated.
+    struct Queue
+    {
+        void push( const Task& task )
+        {
+            ScopedLock lock( mutex );
+            tasks.push_back( task );
+        }
+
+        bool pop( Task& task )
+        {
+            ScopedLock lock( mutex );
+            if( tasks.empty( ))
+                return false;
+            task = std::move( tasks.back( ));
+            tasks.pop_back();
+            return true;
+        }
+
+        bool steal( Task& task )
+        {
+            ScopedLock lock( mutex );
+            if( tasks.empty( ))
+                return false;
+            task = std::move( tasks.front( ));
+            tasks.pop_front();
+            return true;
+        }
+
+        boost::mutex mutex;
+        Tasks tasks;
+        char padding[ 64 ];
+    };
+
+    void _run( const size_t worker )
+    {
+        uint64_t runCount = 0;
+        for( ;; )
+        {
+            {
+                ScopedLock lock( _mutex );
+                while( _runCount == runCount && !_stopped )
+                    _condition.wait( lock );
+
+                if( _stopped )
+                    return;
+                runCount = _runCount;
+            }
+            _work( worker );
+        }
+    }
+
+    // Executes the tasks of a run from a task and the tasks they spawn
+    // depth first on the calling worker
+    void _runInline( const Task& task, Context& context )
+    {
+        Tasks tasks( 1, task );
+        Tasks* const outerTasks = context.inlineTasks;
+        context.inlineTasks = &tasks;
+
+        std::exception_ptr exception;
+        while( !tasks.empty( ))
+        {
+            const Task next = std::move( tasks.back( ));
+            tasks.pop_back();
+            try
+            {
+                next( context.worker );
+            }
+            catch( ... )
+            {
+                if( !exception )
+                    exception = std::current_exception();
+            }
+        }
+
+        context.inlineTasks = outerTasks;
+        if( exception )
+            std::rethrow_exception( exception );
+    }
+
+    bool _hasTasks()
+    {
+        for( Queue& queue: _queues )
+        {
+            ScopedLock lock( queue.mutex );
+            if( !queue.tasks.empty( ))
+                return true;
+        }
+        return false;
+    }
+
+    // Sleeps until a task is spawned or the run ends. The sleeping count
+    // is raised before the queues are checked, so a spawn after the check
+    // sees it and notifies under the lock.
+    void _sleep()
+    {
+        ScopedLock lock( _mutex );
+        ++_nSleeping;
+        if( _pending > 0 && !_stopped && !_hasTasks( ))
+            _taskCondition.wait( lock );
+        --_nSleeping;
+    }
+
+    void _work( const size_t worker )
+    {
+        Context& context = _getContext();
+        const Context outerContext = context;
+        context.pool = this;
+        context.worker = worker;
+        context.inlineTasks = nullptr;
+
+        const size_t nQueues = _queues.size();
+        size_t nSpins = 0;
+        Task task;
+        while( _pending > 0 )
+        {
+            bool found = _queues[ worker ].pop( task );
+            for( size_t i = 1; !found && i < nQueues; ++i )
+                found = _queues[( worker + i ) % nQueues ].steal( task );
+
+            if( !found )
+            {
+                if( ++nSpins < _maxSpins )
+                    std::this_thread::yield();
+                else
+                {
+                    nSpins = 0;
+                    _sleep();
+                }
+                continue;
+            }
+
+            nSpins = 0;
+            try
+            {
+                task( worker );
+            }
+            catch( ... )
+            {
+                ScopedLock lock( _mutex );
+                if( !_exception )
+                    _exception = std::current_exception();
+            }
+            task = Task();
+            if( --_pending == 0 )
+            {
+                ScopedLock lock( _mutex );
+                _taskCondition.notify_all();
+            }
+        }
+        context = outerContext;
+    }
+
+    std::vector< Queue > _queues;
+    std::atomic< size_t > _pending;
+    std::atomic< size_t > _nSleeping;
+    std::exception_ptr _exception;
+    uint64_t _runCount;
+    bool _stopped;
+    std::vector< std::thread > _threads;
+    boost::mutex _runMutex;
+    boost::mutex _mutex;
+    boost::condition_variable _condition;
+    boost::condition_variable _taskCondition;
+};
+
+}
+
+#endif // _workstealingpool_h_
@@ -0,0 +1,171 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _changejournal_h_
+#define _changejournal_h_
+
+#include <zrenderer/scenegraph/types.h>
+
+namespace zrenderer
+{
+
+/**
+ * Types of the scene graph changes
+ */
+enum ChangeType
+{
+    CHANGE_NODE_ADDED,
+
+    // The parent is the parent of the node before the removal
+    CHANGE_NODE_REMOVED,
+
+    // The parent is the new parent, INVALID_NODE_ID when the parent of
+    // the node is removed
+    CHANGE_PARENT_CHANGED,
+
+    // The node data is replaced or the node is marked dirty
+    CHANGE_NODE_DATA_CHANGED,
+
+    // Changes are dropped before they are delivered to the subscribers,
+    // which have to rebuild their state
+    CHANGE_RESET
+};
+
+/**
+ * A change of a scene graph node
+ */
+struct Change
+{
+    /** Version of the journal after the change, starting from 1 */
+    uint64_t version;
+
+    ChangeType type;
+
+    NodeId id;
+
+    NodeId parent;
+};
+
+typedef std::vector< Change > Changes;
+typedef std::function< void( const Change& ) > ChangeCallback;
+
+/**
+ * Append only log of the scene graph changes, read with a cursor which
+ * is the version of the last read change. The journal keeps the latest
+ * changes up to its capacity, the readers falling further behind have
+ * to rebuild their state from the scene graph. The journal is not
+ * thread safe, the scene graph synchronizes the access.
+ */
+class ChangeJournal
+{
+public:
+
+    /**
+     * Default number of kept changes
+     */
+    static const size_t DEFAULT_CAPACITY = 65536;
+
+    /**
+     * @param capacity is the maximum number of kept changes, zero
+     * disables the journal
+     */
+    explicit ChangeJournal( const size_t capacity = DEFAULT_CAPACITY )
+        : _version( 0 )
+        , _dropped( 0 )
+        , _capacity( capacity )
+    {}
+
+    /**
+     * Sets the maximum number of kept changes and drops the kept ones,
+     * so the readers have to rebuild their state.
+     * @param capacity is the maximum number of kept changes, zero
+     * disables the journal
+     */
+    void setCapacity( const size_t capacity )
+    {
+        _capacity = capacity;
+        _dropped = _version;
+        _changes.clear();
+        _changes.shrink_to_fit();
+    }
+
+    /** @return the maximum number of kept changes */
+    size_t getCapacity() const { return _capacity; }
+
+    /** @return the version of the last change, 0 if there is none */
+    uint64_t getVersion() const { return _version; }
+
+    /**
+     * Appends a change, replacing the oldest one if the journal is full.
+     * @param type of the change
+     * @param id of the changed node
+     * @param parent of the node, see ChangeType
+     */
+    void append( const ChangeType type,
+                 const NodeId id,
+                 const NodeId parent = INVALID_NODE_ID )
+    {
+        ++_version;
+        if( _capacity == 0 )
+            return;
+
+        const size_t slot = size_t(( _version - 1 ) % _capacity );
+        if( slot >= _changes.size( ))
+            _changes.resize( slot + 1 );
+        _changes[ slot ] = Change{ _version, type, id, parent };
+    }
+
+    /**
+     * Reads the changes after a cursor.
+     * @param cursor is the version of the last read change, set to the
+     * version of the journal
+     * @param changes the changes after the cursor are appended to
+     * @return false if changes after the cursor are not kept anymore,
+     * in which case no change is appended
+     */
+    bool read( uint64_t& cursor, Changes& changes ) const
+    {
+        const uint64_t oldest = std::max( _dropped, _version -
+                                          std::min< uint64_t >( _version,
+                                                                _capacity ));
+        if( cursor < oldest || cursor > _version )
+        {
+            cursor = _version;
+            return false;
+        }
+
+        for( uint64_t version = cursor + 1; version <= _version; ++version )
+            changes.push_back( _changes[( version - 1 ) % _capacity ] );
+        cursor = _version;
+        return true;
+    }
+
+private:
+
+    Changes _changes;
+    uint64_t _version;
+
+    // The version of the last change dropped by setCapacity
+    uint64_t _dropped;
+    size_t _capacity;
+};
+
+}
+
+#endif // _changejournal_h_
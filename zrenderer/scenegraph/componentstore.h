@@ -0,0 +1,320 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _componentstore_h_
+#define _componentstore_h_
+
+#include <zrenderer/scenegraph/types.h>
+
+namespace zrenderer
+{
+
+/**
+ * Stores components of any type for the scene graph nodes. Every
+ * component type has its own dense array, so the components of a type
+ * are contiguous in memory and can be iterated without casts or
+ * reference counting. A node has at most one component of a type.
+ *
+ * The store is locked internally with a read-write lock, as the scene
+ * graph removes the components of the removed nodes concurrently with
+ * the users of the store. forEach() iterates under the read lock; the
+ * pointers returned by get() are only valid while no component of the
+ * type is added or removed, which includes the removal of nodes.
+ */
+class ComponentStore
+{
+public:
+
+    ComponentStore() {}
+
+    /**
+     * Adds or replaces the component of a node.
+     * @param id of the node
+     * @param args are the arguments of the component constructor
+     * @return the component
+     */
+    template< class T, class... Args >
+    T& add( const NodeId id, Args&&... args )
+    {
+        WriteLock writeLock( _mutex );
+        return _getArray< T >().add( id, std::forward< Args >( args )... );
+    }
+
+    /**
+     * Removes the component of a node.
+     * @param id of the node
+     * @return true if the node had the component
+     */
+    template< class T >
+    bool remove( const NodeId id )
+    {
+        WriteLock writeLock( _mutex );
+        Array< T >* array = _findArray< T >();
+        return array && array->remove( id );
+    }
+
+    /**
+     * Removes all the components of a node.
+     * @param id of the node
+     */
+    void removeNode( const NodeId id )
+    {
+        WriteLock writeLock( _mutex );
+        for( const std::unique_ptr< ArrayBase >& array: _arrays )
+        {
+            if( array )
+                array->remove( id );
+        }
+    }
+
+    /**
+     * @param id of the node
+     * @return the component of the node, 0 if it has none. It is valid
+     * until a component of the same type is added or removed.
+     */
+    template< class T >
+    T* get( const NodeId id )
+    {
+        ReadLock readLock( _mutex );
+        Array< T >* array = _findArray< T >();
+        return array ? array->get( id ) : 0;
+    }
+
+    /**
+     * @param id of the node
+     * @return the component of the node, 0 if it has none
+     */
+    template< class T >
+    const T* get( const NodeId id ) const
+    {
+        ReadLock readLock( _mutex );
+        const Array< T >* array = _findArray< T >();
+        return array ? array->get( id ) : 0;
+    }
+
+    /**
+     * @param id of the node
+     * @return true if the node has the component
+     */
+    template< class T >
+    bool has( const NodeId id ) const
+    {
+        return get< T >( id ) != 0;
+    }
+
+    /**
+     * @return the number of components of the type
+     */
+    template< class T >
+    size_t getSize() const
+    {
+        ReadLock readLock( _mutex );
+        const Array< T >* array = _findArray< T >();
+        return array ? array->ids.size() : 0;
+    }
+
+    /**
+     * Calls a function for every node having all the component types.
+     * The smallest component array is iterated and the other components
+     * are looked up. The store is read locked during the iteration, so
+     * the function must not add or remove components, and the nodes are
+     * not removed meanwhile.
+     * @param function is called with the node id and the components
+     */
+    template< class... T, class F >
+    void forEach( F function )
+    {
+        ReadLock readLock( _mutex );
+        const ArrayBase* smallest = _getSmallest( _findArray< T >()... );
+        if( !smallest )
+            return;
+
+        _forEach( function, smallest->ids, *_findArray< T >()... );
+    }
+
+private:
+
+    ComponentStore( const ComponentStore& ) = delete;
+    ComponentStore& operator=( const ComponentStore& ) = delete;
+
+    struct ArrayBase
+    {
+        virtual ~ArrayBase() {}
+        virtual bool remove( NodeId id ) = 0;
+
+        // The node ids in the order of the components
+        NodeIds ids;
+    };
+
+    template< class T >
+    struct Array : public ArrayBase
+    {
+        T& add( const NodeId id, T component )
+        {
+            T* existing = get( id );
+            if( existing )
+            {
+                *existing = std::move( component );
+                return *existing;
+            }
+
+            const uint32_t index = uint32_t( id );
+            if( index >= positions.size( ))
+                positions.resize( size_t( index ) + 1,
+                                  uint32_t( INVALID_POSITION ));
+            positions[ index ] = uint32_t( ids.size( ));
+            ids.push_back( id );
+            components.push_back( std::move( component ));
+            return components.back();
+        }
+
+        template< class... Args >
+        T& add( const NodeId id, Args&&... args )
+        {
+            return add( id, T( std::forward< Args >( args )... ));
+        }
+
+        bool remove( const NodeId id ) final
+        {
+            const uint32_t position = getPosition( id );
+            if( position == INVALID_POSITION )
+                return false;
+
+            // The last component fills the gap
+            const NodeId last = ids.back();
+            ids[ position ] = last;
+            components[ position ] = std::move( components.back( ));
+            positions[ uint32_t( last )] = position;
+            positions[ uint32_t( id )] = INVALID_POSITION;
+            ids.pop_back();
+            components.pop_back();
+            return true;
+        }
+
+        uint32_t getPosition( const NodeId id ) const
+        {
+            const uint32_t index = uint32_t( id );
+            if( index >= positions.size( ))
+                return INVALID_POSITION;
+
+            const uint32_t position = positions[ index ];
+            if( position == INVALID_POSITION || ids[ position ] != id )
+                return INVALID_POSITION;
+            return position;
+        }
+
+        T* get( const NodeId id )
+        {
+            const uint32_t position = getPosition( id );
+            return position == INVALID_POSITION ? 0 : &components[ position ];
+        }
+
+        const T* get( const NodeId id ) const
+        {
+            const uint32_t position = getPosition( id );
+            return position == INVALID_POSITION ? 0 : &components[ position ];
+        }
+
+        static const uint32_t INVALID_POSITION = 0xffffffffu;
+
+        // The positions of the components, indexed by the node index
+        std::vector< uint32_t > positions;
+        std::vector< T > components;
+    };
+
+    static size_t _getNextTypeIndex()
+    {
+        static std::atomic< size_t > nextTypeIndex( 0 );
+        return nextTypeIndex++;
+    }
+
+    template< class T >
+    static size_t _getTypeIndex()
+    {
+        static const size_t typeIndex = _getNextTypeIndex();
+        return typeIndex;
+    }
+
+    template< class T >
+    Array< T >& _getArray()
+    {
+        const size_t typeIndex = _getTypeIndex< T >();
+        if( typeIndex >= _arrays.size( ))
+            _arrays.resize( typeIndex + 1 );
+
+        std::unique_ptr< ArrayBase >& array = _arrays[ typeIndex ];
+        if( !array )
+            array.reset( new Array< T >( ));
+        return static_cast< Array< T >& >( *array );
+    }
+
+    template< class T >
+    Array< T >* _findArray() const
+    {
+        const size_t typeIndex = _getTypeIndex< T >();
+        if( typeIndex >= _arrays.size( ))
+            return 0;
+        return static_cast< Array< T >* >( _arrays[ typeIndex ].get( ));
+    }
+
+    static const ArrayBase* _getSmallest( const ArrayBase* array )
+    {
+        return array;
+    }
+
+    template< class... Arrays >
+    static const ArrayBase* _getSmallest( const ArrayBase* array,
+                                          const Arrays*... arrays )
+    {
+        const ArrayBase* smallest = _getSmallest( arrays... );
+        if( !array || !smallest )
+            return 0;
+        return array->ids.size() < smallest->ids.size() ? array : smallest;
+    }
+
+    static bool _isValid() { return true; }
+
+    template< class T, class... Ts >
+    static bool _isValid( const T* component, const Ts*... components )
+    {
+        return component && _isValid( components... );
+    }
+
+    template< class F, class... T >
+    static void _forEach( F& function, const NodeIds& ids,
+                          Array< T >&... arrays )
+    {
+        for( size_t i = 0; i < ids.size(); ++i )
+            _call( function, ids[ i ], arrays.get( ids[ i ])... );
+    }
+
+    template< class F, class... T >
+    static void _call( F& function, const NodeId id, T*... components )
+    {
+        if( _isValid( components... ))
+            function( id, *components... );
+    }
+
+    std::vector< std::unique_ptr< ArrayBase >> _arrays;
+    mutable ReadWriteMutex _mutex;
+};
+
+}
+
+#endif // _componentstore_h_
@@ -0,0 +1,196 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _geometrydata_h_
+#define _geometrydata_h_
+
+#include <zrenderer/scenegraph/transformdata.h>
+#include <zrenderer/common/boundshierarchy.h>
+#include <zrenderer/common/mesh.h>
+
+#include <limits>
+#include <mutex>
+
+namespace zrenderer
+{
+
+/**
+ * Node data for a mesh, which is shared by the nodes and the instances
+ * placing it. The bounds are the bounds of the mesh.
+ */
+class GeometryData : public BoundsData
+{
+public:
+
+    /**
+     * @param mesh is the shared mesh
+     * @param material is the material of the mesh
+     */
+    explicit GeometryData( const MeshPtr& mesh, const uint32_t material = 0 )
+        : BoundsData( mesh->getBounds( ))
+        , _mesh( mesh )
+        , _material( material )
+    {}
+
+    /** @return the mesh */
+    const Mesh& getMesh() const { return *_mesh; }
+
+    /** @return the material of the mesh */
+    uint32_t getMaterial() const { return _material; }
+
+    /**
+     * The hierarchy of the triangles is the bottom level of the instance
+     * hierarchy. It is built on the first call, once for all instances.
+     * @return the hierarchy of the triangles of the mesh
+     */
+    const BoundsHierarchy& getHierarchy() const
+    {
+        std::call_once( _hierarchyBuilt, [this]
+        {
+            AlignedBox3fs bounds( _mesh->getTriangleCount( ));
+            for( size_t i = 0; i < bounds.size(); ++i )
+                bounds[ i ] = _mesh->getTriangleBounds( i );
+            _hierarchy = BoundsHierarchy( bounds );
+        });
+        return _hierarchy;
+    }
+
+private:
+
+    const MeshPtr _mesh;
+    const uint32_t _material;
+    mutable std::once_flag _hierarchyBuilt;
+    mutable BoundsHierarchy _hierarchy;
+};
+
+/**
+ * Node data for the instances of a geometry. An instance has only a
+ * transform relative to the node and an optional material, so a node
+ * can place a geometry any number of times at a small cost per
+ * instance. The bounds contain the bounds of the instances, which are
+ * extended when the instances are added or moved.
+ * SceneGraph::markDirty has to be called for the node after changing
+ * the instances.
+ */
+class InstanceData : public BoundsData
+{
+public:
+
+    /**
+     * The material of an instance without its own one, which uses the
+     * material of the geometry
+     */
+    static const uint32_t GEOMETRY_MATERIAL =
+            std::numeric_limits< uint32_t >::max();
+
+    /**
+     * @param geometry is the instanced geometry
+     */
+    explicit InstanceData( const ConstGeometryDataPtr& geometry )
+        : _geometry( geometry )
+    {}
+
+    /** @return the instanced geometry */
+    const ConstGeometryDataPtr& getGeometry() const { return _geometry; }
+
+    /**
+     * Reserves the memory for the instances.
+     * @param nInstances is the number of instances
+     */
+    void reserve( const size_t nInstances )
+    {
+        _transforms.reserve( nInstances );
+        _materials.reserve( nInstances );
+    }
+
+    /**
+     * Adds an instance.
+     * @param transform is the transform relative to the node
+     * @param material overrides the material of the geometry
+     * @return the index of the instance
+     */
+    size_t addInstance( const AffineCompact3f& transform,
+                        const uint32_t material = GEOMETRY_MATERIAL )
+    {
+        _transforms.push_back( transform );
+        _materials.push_back( material );
+        _extendBounds( transform );
+        return _transforms.size() - 1;
+    }
+
+    /** @return the number of instances */
+    size_t getInstanceCount() const { return _transforms.size(); }
+
+    /**
+     * @param instance is the index of the instance
+     * @return the transform of the instance relative to the node
+     */
+    const AffineCompact3f& getTransform( const size_t instance ) const
+    {
+        return _transforms[ instance ];
+    }
+
+    /**
+     * Moves an instance. The bounds are only extended, so they stay
+     * conservative when an instance moves inwards.
+     * @param instance is the index of the instance
+     * @param transform is the transform relative to the node
+     */
+    void setTransform( const size_t instance, const AffineCompact3f& transform )
+    {
+        _transforms[ instance ] = transform;
+        _extendBounds( transform );
+    }
+
+    /**
+     * @param instance is the index of the instance
+     * @return the material of the instance, or of the geometry if the
+     * instance has none
+     */
+    uint32_t getMaterial( const size_t instance ) const
+    {
+        const uint32_t material = _materials[ instance ];
+        return material == GEOMETRY_MATERIAL ? _geometry->getMaterial()
+                                             : material;
+    }
+
+    /** @return the size of the instances in bytes */
+    size_t getMemorySize() const
+    {
+        return _transforms.capacity() * sizeof( AffineCompact3f ) +
+               _materials.capacity() * sizeof( uint32_t );
+    }
+
+private:
+
+    void _extendBounds( const AffineCompact3f& transform )
+    {
+        AlignedBox3f bounds = getBounds();
+        bounds.extend( transformBox( _geometry->getBounds(), transform ));
+        setBounds( bounds );
+    }
+
+    const ConstGeometryDataPtr _geometry;
+    AffineCompact3fs _transforms;
+    std::vector< uint32_t > _materials;
+};
+
+}
+
+#endif // _geometrydata_h_
@@ -0,0 +1,257 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <zrenderer/scenegraph/instancehierarchy.h>
+#include <zrenderer/scenegraph/geometrydata.h>
+#include <zrenderer/scenegraph/scenegraph.h>
+#include <zrenderer/scenegraph/snapshot.h>
+#include <zrenderer/scenegraph/transformdata.h>
+#include <zrenderer/scenegraph/visitor.h>
+
+#include <zrenderer/common/boundshierarchy.h>
+
+namespace zrenderer
+{
+
+namespace
+{
+Affine3f getWorldTransform( const Snapshot& snapshot, NodeId id )
+{
+    Affine3f world = Affine3f::Identity();
+    for( ; id != INVALID_NODE_ID; id = snapshot.getParent( id ))
+    {
+        const TransformData* transform = dynamic_cast< const TransformData* >(
+                                             snapshot.getNodeData( id ).get( ));
+        if( transform )
+            world = transform->getTransform() * world;
+    }
+    return world;
+}
+
+// Gathers the geometry nodes with their world transforms, which are
+// accumulated from the snapshot as updateTransforms does for the graph
+class GeometryVisitor : public Visitor
+{
+public:
+
+    GeometryVisitor( const Snapshot& snapshot, const NodeId id )
+        : _ancestors( 1, snapshot.getParent( id ))
+        , _ancestorWorlds( 1, getWorldTransform( snapshot,
+                                                 snapshot.getParent( id )))
+    {}
+
+    void visit( const Snapshot& snapshot, const NodeId id ) final
+    {
+        // The traversal is in preorder, so the parent is on the stack
+        const NodeId parent = snapshot.getParent( id );
+        while( _ancestors.size() > 1 && _ancestors.back() != parent )
+        {
+            _ancestors.pop_back();
+            _ancestorWorlds.pop_back();
+        }
+
+        const NodeDataPtr& data = snapshot.getNodeData( id );
+        const TransformData* transform =
+                dynamic_cast< const TransformData* >( data.get( ));
+        const Affine3f world = transform ? _ancestorWorlds.back() *
+                                           transform->getTransform()
+                                         : _ancestorWorlds.back();
+        _ancestors.push_back( id );
+        _ancestorWorlds.push_back( world );
+
+        if( dynamic_cast< const GeometryData* >( data.get( )) ||
+            dynamic_cast< const InstanceData* >( data.get( )))
+        {
+            ids.push_back( id );
+            nodeData.push_back( data );
+            worlds.push_back( world );
+        }
+    }
+
+    NodeIds ids;
+    std::vector< NodeDataPtr > nodeData;
+    Affine3fs worlds;
+
+private:
+
+    NodeIds _ancestors;
+    Affine3fs _ancestorWorlds;
+};
+}
+
+struct InstanceHierarchy::Impl
+{
+    Impl( SceneGraph& sceneGraph, const NodeId id )
+    {
+        sceneGraph.updateTransforms();
+
+        // The nodes and their world transforms are read from one
+        // snapshot, without locking the scene graph per node
+        const ConstSnapshotPtr snapshot = sceneGraph.publish();
+        GeometryVisitor visitor( *snapshot, id );
+        snapshot->traverse( visitor, id );
+
+        std::unordered_map< const GeometryData*, uint32_t > geometryIndices;
+        AlignedBox3fs bounds;
+        for( size_t i = 0; i < visitor.ids.size(); ++i )
+        {
+            const Affine3f& world = visitor.worlds[ i ];
+            const NodeData* data = visitor.nodeData[ i ].get();
+            const InstanceData* instances =
+                    dynamic_cast< const InstanceData* >( data );
+            const GeometryData* geometry =
+                    instances ? instances->getGeometry().get()
+                              : static_cast< const GeometryData* >( data );
+
+            const auto inserted = geometryIndices.insert(
+                std::make_pair( geometry, uint32_t( _geometries.size( ))));
+            if( inserted.second )
+            {
+                _geometries.push_back( instances ? instances->getGeometry()
+                                                 : std::static_pointer_cast<
+                                                       const GeometryData >(
+                                                       visitor.nodeData[ i ] ));
+            }
+            const uint32_t geometryIndex = inserted.first->second;
+
+            const size_t nInstances = instances ? instances->getInstanceCount()
+                                                : 1;
+            _reserve( _nodes.size() + nInstances );
+            bounds.reserve( _nodes.size() + nInstances );
+            for( size_t j = 0; j < nInstances; ++j )
+            {
+                const AffineCompact3f transform(
+                    instances ? world * instances->getTransform( j ) : world );
+                _inverseTransforms.push_back( transform.inverse( ));
+                _geometryIndices.push_back( geometryIndex );
+                _nodes.push_back( visitor.ids[ i ] );
+                _instances.push_back( uint32_t( j ));
+                _materials.push_back( instances ? instances->getMaterial( j )
+                                                : geometry->getMaterial( ));
+                bounds.push_back( transformBox( geometry->getBounds(),
+                                                transform ));
+            }
+        }
+        _topLevel = BoundsHierarchy( bounds );
+    }
+
+    void _reserve( const size_t size )
+    {
+        // Keeps the growth geometric for many small reservations
+        if( size <= _nodes.capacity( ))
+            return;
+
+        const size_t capacity = std::max( size, 2 * _nodes.capacity( ));
+        _inverseTransforms.reserve( capacity );
+        _geometryIndices.reserve( capacity );
+        _nodes.reserve( capacity );
+        _instances.reserve( capacity );
+        _materials.reserve( capacity );
+    }
+
+    bool intersect( const Vector3f& origin,
+                    const Vector3f& direction,
+                    Hit& hit,
+                    float distance ) const
+    {
+        bool found = false;
+        _topLevel.intersect( origin, direction, distance,
+                             [&]( const uint32_t instance, float& closest )
+        {
+            // The distances are in the length of the transformed
+            // direction, so they are the same in both spaces
+            const AffineCompact3f& inverse = _inverseTransforms[ instance ];
+            const Vector3f localOrigin = inverse * origin;
+            const Vector3f localDirection = inverse.linear() * direction;
+            const GeometryData& geometry =
+                    *_geometries[ _geometryIndices[ instance ]];
+            const Mesh& mesh = geometry.getMesh();
+
+            geometry.getHierarchy().intersect( localOrigin, localDirection,
+                                               closest,
+                                               [&]( const uint32_t triangle,
+                                                    float& triangleClosest )
+            {
+                if( !mesh.intersect( triangle, localOrigin, localDirection,
+                                     triangleClosest ))
+                {
+                    return;
+                }
+
+                found = true;
+                hit.distance = triangleClosest;
+                hit.node = _nodes[ instance ];
+                hit.instance = _instances[ instance ];
+                hit.triangle = triangle;
+                hit.material = _materials[ instance ];
+            });
+        });
+        return found;
+    }
+
+    std::vector< ConstGeometryDataPtr > _geometries;
+    BoundsHierarchy _topLevel;
+
+    // Per instance
+    AffineCompact3fs _inverseTransforms;
+    std::vector< uint32_t > _geometryIndices;
+    NodeIds _nodes;
+    std::vector< uint32_t > _instances;
+    std::vector< uint32_t > _materials;
+};
+
+InstanceHierarchy::InstanceHierarchy( SceneGraph& sceneGraph, const NodeId id )
+    : _impl( new InstanceHierarchy::Impl( sceneGraph, id ))
+{}
+
+InstanceHierarchy::~InstanceHierarchy()
+{}
+
+bool InstanceHierarchy::intersect( const Vector3f& origin,
+                                   const Vector3f& direction,
+                                   Hit& hit,
+                                   const float maxDistance ) const
+{
+    return _impl->intersect( origin, direction, hit, maxDistance );
+}
+
+AlignedBox3f InstanceHierarchy::getBounds() const
+{
+    return _impl->_topLevel.getBounds();
+}
+
+size_t InstanceHierarchy::getInstanceCount() const
+{
+    return _impl->_nodes.size();
+}
+
+size_t InstanceHierarchy::getGeometryCount() const
+{
+    return _impl->_geometries.size();
+}
+
+size_t InstanceHierarchy::getMemorySize() const
+{
+    const size_t nInstances = _impl->_nodes.capacity();
+    return _impl->_topLevel.getMemorySize() +
+           nInstances * ( sizeof( AffineCompact3f ) + sizeof( NodeId ) +
+                          3 * sizeof( uint32_t ));
+}
+
+}
@@ -0,0 +1,120 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _instancehierarchy_h_
+#define _instancehierarchy_h_
+
+#include <zrenderer/scenegraph/types.h>
+#include <zrenderer/common/mathtypes.h>
+
+namespace zrenderer
+{
+
+class BoundsHierarchy;
+
+/**
+ * Two level acceleration structure of the geometries in a scene graph.
+ * The top level is a hierarchy of the instances in world space and the
+ * bottom level is the triangle hierarchy of the geometries, which is
+ * built once per geometry and shared by its instances. A node with
+ * GeometryData is one instance of its geometry and a node with
+ * InstanceData is one instance per entry. The hierarchy is built from
+ * the state of the scene graph at construction, it has to be built
+ * again after the scene graph changes.
+ */
+class InstanceHierarchy
+{
+public:
+
+    /**
+     * The closest hit of a ray
+     */
+    struct Hit
+    {
+        /** Distance in the length of the ray direction */
+        float distance;
+
+        /** Node of the instance */
+        NodeId node;
+
+        /** Index of the instance in the InstanceData of the node */
+        uint32_t instance;
+
+        /** Index of the triangle in the mesh */
+        uint32_t triangle;
+
+        /** Material of the instance */
+        uint32_t material;
+    };
+
+    /**
+     * Builds the hierarchy of the geometries in a subtree. The world
+     * transforms of the scene graph are updated first. The geometries
+     * and their world transforms are gathered from one snapshot, which
+     * is published, so concurrent changes of the scene graph do not mix
+     * into the hierarchy.
+     * @param sceneGraph is the scene graph
+     * @param id of the root node of the subtree
+     */
+    explicit InstanceHierarchy( SceneGraph& sceneGraph,
+                                NodeId id = ROOT_NODE_ID );
+    ~InstanceHierarchy();
+
+    /**
+     * Intersects a ray with the geometries.
+     * @param origin is the origin of the ray in world space
+     * @param direction is the direction of the ray in world space
+     * @param hit is set to the closest hit
+     * @param maxDistance is the maximum distance in the length of the
+     * direction
+     * @return true if a triangle is hit
+     */
+    bool intersect( const Vector3f& origin,
+                    const Vector3f& direction,
+                    Hit& hit,
+                    float maxDistance =
+                        std::numeric_limits< float >::max( )) const;
+
+    /** @return the bounds of the instances in world space */
+    AlignedBox3f getBounds() const;
+
+    /** @return the number of instances */
+    size_t getInstanceCount() const;
+
+    /** @return the number of distinct geometries */
+    size_t getGeometryCount() const;
+
+    /**
+     * @return the size of the top level and the instances in bytes, the
+     * geometries and their hierarchies are not included
+     */
+    size_t getMemorySize() const;
+
+private:
+
+    InstanceHierarchy( const InstanceHierarchy& ) = delete;
+    InstanceHierarchy& operator=( const InstanceHierarchy& ) = delete;
+
+    struct Impl;
+    std::unique_ptr<Impl> _impl;
+};
+
+}
+
+#endif // _instancehierarchy_h_
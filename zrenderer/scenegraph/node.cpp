@@ -7,11 +7,11 @@ namespace zrenderer
 
 struct Node::Impl
 {
-    Impl( const std::string& name,
-          const NodeDataPtr& nodeData,
+    Impl( const NodeId id,
+          const std::string& name,
           SceneGraph& sceneGraph )
-        : _name( name )
-        , _nodeData( nodeData )
+        : _id( id )
+        , _name( name )
         , _sceneGraph( sceneGraph )
             {}
 
@@ -19,47 +19,59 @@ struct Node::Impl
 
     NodePtr getParent() const
     {
-        return _sceneGraph.getParent( _name );
+        return _sceneGraph.getNode( _sceneGraph.getParent( _id ));
     }
 
     bool addChild( const NodePtr& node )
     {
-        return _sceneGraph.addChild( _name, node->getName() );
+        return _sceneGraph.addChild( _id, node->getId() );
     }
 
     bool removeChild( const NodePtr& node )
     {
-        if( !_sceneGraph.hasChild( _name,node->getName() ))
+        if( !_sceneGraph.hasChild( _id, node->getId() ))
             return false;
 
-        return _sceneGraph.removeNode( node->getName() );
+        return _sceneGraph.removeNode( node->getId() );
     }
 
     NodePtrs getChildren() const
     {
-        return _sceneGraph.getChildren( _name );
+        NodeIds ids;
+        _sceneGraph.getChildren( _id, ids );
+
+        NodePtrs children;
+        children.reserve( ids.size( ));
+        for( const NodeId id: ids )
+            children.push_back( _sceneGraph.getNode( id ));
+        return children;
     }
 
     bool hasChild( const NodePtr& node ) const
     {
-        return _sceneGraph.hasChild( _name, node->getName() );
+        return _sceneGraph.hasChild( _id, node->getId() );
     }
 
+    const NodeId _id;
     const std::string _name;
-    NodeDataPtr _nodeData;
     SceneGraph& _sceneGraph;
 };
 
-Node::Node( const std::string& name,
-            const NodeDataPtr& nodeData,
+Node::Node( const NodeId id,
+            const std::string& name,
             SceneGraph& sceneGraph )
-    : _impl( new Node::Impl( name,
-                             nodeData,
+    : _impl( new Node::Impl( id,
+                             name,
                              sceneGraph ) )
 {
 
 }
 
+NodeId Node::getId() const
+{
+    return _impl->_id;
+}
+
 const std::string& Node::getName() const
 {
     return _impl->_name;
@@ -92,14 +104,19 @@ bool Node::hasChild( const NodePtr& node ) const
 
 Node::~Node() {}
 
+ComponentStore& Node::_getComponents()
+{
+    return _impl->_sceneGraph.getComponents();
+}
+
 NodeDataPtr Node::_getNodeData()
 {
-    return _impl->_nodeData;
+    return _impl->_sceneGraph.getNodeData( _impl->_id );
 }
 
 ConstNodeDataPtr Node::_getNodeData() const
 {
-    return _impl->_nodeData;
+    return _impl->_sceneGraph.getNodeData( _impl->_id );
 }
 
 
@@ -21,6 +21,7 @@
 #define _node_h_
 
 #include <zrenderer/scenegraph/types.h>
+#include <zrenderer/scenegraph/componentstore.h>
 
 namespace zrenderer
 {
@@ -46,7 +47,7 @@ public:
     template<class T>
     std::shared_ptr<T> getNodeData()
     {
-        return boost::dynamic_pointer_cast<T>( _getNodeData() );
+        return std::dynamic_pointer_cast<T>( _getNodeData() );
     }
 
     /**
@@ -57,11 +58,29 @@ public:
     template<class T>
     std::shared_ptr<const T> getNodeData() const
     {
-        return boost::dynamic_pointer_cast<T>( _getNodeData() );
+        return std::dynamic_pointer_cast<T>( _getNodeData() );
     }
 
     /**
-     * @return the node name
+     * Get a component of the node from the component store of the
+     * scene graph, without casting.
+     * @return the component. If the node does not have it, 0 is
+     * returned.
+     */
+    template<class T>
+    T* getComponent()
+    {
+        return _getComponents().get<T>( getId( ));
+    }
+
+    /**
+     * @return the id of the node in the scene graph
+     */
+    NodeId getId() const;
+
+    /**
+     * @return the node name. It is empty for the nodes created
+     * without a name.
      */
     const std::string& getName() const;
 
@@ -103,10 +122,11 @@ private:
 
     friend class SceneGraph;
 
-    Node( const std::string& name,
-          const NodeDataPtr& nodeData,
+    Node( NodeId id,
+          const std::string& name,
           SceneGraph& sceneGraph );
 
+    ComponentStore& _getComponents();
     NodeDataPtr _getNodeData();
     ConstNodeDataPtr _getNodeData() const;
 
@@ -17,8 +17,8 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
-#ifndef _node_h_
-#define _node_h_
+#ifndef _nodedata_h_
+#define _nodedata_h_
 
 #include <zrenderer/scenegraph/types.h>
 
@@ -37,4 +37,4 @@ protected:
 
 }
 
-#endif // _node_h_
+#endif // _nodedata_h_
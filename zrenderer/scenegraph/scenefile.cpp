@@ -0,0 +1,522 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <zrenderer/scenegraph/scenefile.h>
+#include <zrenderer/scenegraph/scenegraph.h>
+#include <zrenderer/scenegraph/snapshot.h>
+#include <zrenderer/scenegraph/transformdata.h>
+#include <zrenderer/scenegraph/visitor.h>
+
+#include <zrenderer/common/mappedfile.h>
+
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+#include <stdexcept>
+#include <typeinfo>
+
+namespace zrenderer
+{
+
+namespace
+{
+const char MAGIC[ 8 ] = { 'Z', 'S', 'C', 'E', 'N', 'E', 0, 0 };
+const uint32_t INVALID_INDEX = std::numeric_limits< uint32_t >::max();
+const size_t SECTION_ALIGNMENT = 64;
+
+enum DataType
+{
+    DATA_NONE,
+    DATA_TRANSFORM,
+    DATA_BOUNDS
+};
+
+const size_t TRANSFORM_BLOB_SIZE = 16 * sizeof( float );
+const size_t BOUNDS_BLOB_SIZE = 6 * sizeof( float );
+
+struct FileHeader
+{
+    char magic[ 8 ];
+    uint32_t version;
+    uint32_t nodeCount;
+    uint64_t nodesOffset;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+    uint64_t blobsOffset;
+    uint64_t blobsSize;
+};
+
+struct FileNode
+{
+    // Indices in the node array
+    uint32_t parent;
+    uint32_t firstChild;
+    uint32_t nextSibling;
+    uint32_t subtreeSize;
+
+    // Offset in the string table
+    uint32_t name;
+
+    uint32_t dataType;
+
+    // Offset in the blob section
+    uint64_t dataOffset;
+};
+
+static_assert( sizeof( FileHeader ) == 56, "Unexpected file header size" );
+static_assert( sizeof( FileNode ) == 32, "Unexpected file node size" );
+
+uint64_t alignSection( const uint64_t offset )
+{
+    return ( offset + SECTION_ALIGNMENT - 1 ) & ~uint64_t( SECTION_ALIGNMENT - 1 );
+}
+
+class GatherVisitor : public Visitor
+{
+public:
+
+    void visit( const Snapshot&, const NodeId id ) final
+    {
+        ids.push_back( id );
+    }
+
+    NodeIds ids;
+};
+
+void writeAt( std::ofstream& file, const uint64_t offset,
+              const void* data, const size_t size )
+{
+    file.seekp( std::streamoff( offset ));
+    file.write( static_cast< const char* >( data ), std::streamsize( size ));
+}
+}
+
+struct SceneFile::Impl
+{
+    Impl( const std::string& fileName )
+        : _file( fileName )
+        , _header( 0 )
+        , _nodes( 0 )
+        , _strings( 0 )
+        , _blobs( 0 )
+        , _nMaterialized( 0 )
+        , _sceneGraph( 0 )
+        , _subscription( 0 )
+    {
+        const uint8_t* data = _file.getData();
+        const uint64_t size = _file.getSize();
+        if( size < sizeof( FileHeader ))
+            throw std::runtime_error( "Invalid scene file " + fileName );
+
+        _header = reinterpret_cast< const FileHeader* >( data );
+        if( std::memcmp( _header->magic, MAGIC, sizeof( MAGIC )) != 0 )
+            throw std::runtime_error( "Invalid scene file " + fileName );
+        if( _header->version != VERSION )
+            throw std::runtime_error( "Unsupported scene file version in " +
+                                      fileName );
+
+        const uint64_t nodesSize = uint64_t( _header->nodeCount ) *
+                                   sizeof( FileNode );
+        if( _header->nodeCount == 0 ||
+            _header->nodesOffset % alignof( FileNode ) != 0 ||
+            !_isInFile( _header->nodesOffset, nodesSize ) ||
+            !_isInFile( _header->stringsOffset, _header->stringsSize ) ||
+            !_isInFile( _header->blobsOffset, _header->blobsSize ))
+        {
+            throw std::runtime_error( "Invalid scene file " + fileName );
+        }
+
+        _nodes = reinterpret_cast< const FileNode* >(
+                    data + _header->nodesOffset );
+        _strings = reinterpret_cast< const char* >(
+                    data + _header->stringsOffset );
+        _blobs = data + _header->blobsOffset;
+    }
+
+    bool _isInFile( const uint64_t offset, const uint64_t size ) const
+    {
+        return offset <= _file.getSize() && size <= _file.getSize() - offset;
+    }
+
+    std::string _getName( const FileNode& node ) const
+    {
+        if( node.name >= _header->stringsSize )
+            return std::string();
+
+        const char* name = _strings + node.name;
+        return std::string( name, strnlen( name, _header->stringsSize -
+                                                 node.name ));
+    }
+
+    NodeDataPtr _createNodeData( const FileNode& node ) const
+    {
+        switch( node.dataType )
+        {
+        case DATA_TRANSFORM:
+        {
+            if( node.dataOffset > _header->blobsSize ||
+                _header->blobsSize - node.dataOffset < TRANSFORM_BLOB_SIZE )
+            {
+                return NodeDataPtr();
+            }
+
+            Affine3f transform;
+            std::memcpy( transform.data(), _blobs + node.dataOffset,
+                         TRANSFORM_BLOB_SIZE );
+            return NodeDataPtr( new TransformData( transform ));
+        }
+        case DATA_BOUNDS:
+        {
+            if( node.dataOffset > _header->blobsSize ||
+                _header->blobsSize - node.dataOffset < BOUNDS_BLOB_SIZE )
+            {
+                return NodeDataPtr();
+            }
+
+            const uint8_t* blob = _blobs + node.dataOffset;
+            Vector3f min, max;
+            std::memcpy( min.data(), blob, BOUNDS_BLOB_SIZE / 2 );
+            std::memcpy( max.data(), blob + BOUNDS_BLOB_SIZE / 2,
+                         BOUNDS_BLOB_SIZE / 2 );
+            return NodeDataPtr( new BoundsData( AlignedBox3f( min, max )));
+        }
+        default:
+            return NodeDataPtr();
+        }
+    }
+
+    NodeId _addNode( SceneGraph::Transaction& transaction,
+                     const SceneGraph& sceneGraph,
+                     const uint32_t index ) const
+    {
+        const FileNode& node = _nodes[ index ];
+        const std::string& name = _getName( node );
+
+        // The names are unique in the scene graph
+        if( name.empty() || sceneGraph.findNodeId( name ) != INVALID_NODE_ID )
+            return transaction.addNode( _createNodeData( node ));
+        return transaction.addNode( name, _createNodeData( node ));
+    }
+
+    ~Impl()
+    {
+        if( _sceneGraph )
+            _sceneGraph->unsubscribe( _subscription );
+    }
+
+    // Subscribes to the changes of the scene graph on the first attach,
+    // to drop the removed nodes
+    void _subscribe( SceneGraph& sceneGraph )
+    {
+        std::call_once( _subscribed, [&]
+        {
+            _subscription = sceneGraph.subscribe(
+                [this]( const Change& change ) { _onChange( change ); });
+            _sceneGraph = &sceneGraph;
+        });
+
+        if( _sceneGraph != &sceneGraph )
+            throw std::runtime_error( "The scene file is attached to another "
+                                      "scene graph" );
+    }
+
+    void _onChange( const Change& change )
+    {
+        ScopedLock lock( _mutex );
+        switch( change.type )
+        {
+        case CHANGE_NODE_REMOVED:
+            _expandable.erase( change.id );
+            break;
+        case CHANGE_RESET:
+            for( auto it = _expandable.begin(); it != _expandable.end(); )
+            {
+                if( _sceneGraph->hasNode( it->first ))
+                    ++it;
+                else
+                    it = _expandable.erase( it );
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    void _addExpandable( const NodeId id, const uint32_t index )
+    {
+        if( id == INVALID_NODE_ID )
+            return;
+
+        ++_nMaterialized;
+        if( _nodes[ index ].firstChild < _header->nodeCount )
+            _expandable[ id ] = index;
+    }
+
+    MappedFile _file;
+    const FileHeader* _header;
+    const FileNode* _nodes;
+    const char* _strings;
+    const uint8_t* _blobs;
+
+    // The file node indices of the created nodes, whose children are not
+    // created yet
+    std::unordered_map< NodeId, uint32_t > _expandable;
+    size_t _nMaterialized;
+    mutable boost::mutex _mutex;
+
+    SceneGraph* _sceneGraph;
+    size_t _subscription;
+    std::once_flag _subscribed;
+};
+
+void SceneFile::write( const Snapshot& snapshot,
+                       const NodeId id,
+                       const std::string& fileName )
+{
+    GatherVisitor visitor;
+    snapshot.traverse( visitor, id );
+    const NodeIds& ids = visitor.ids;
+    if( ids.empty( ))
+        throw std::runtime_error( "No node to write to " + fileName );
+
+    std::unordered_map< NodeId, uint32_t > indices;
+    for( size_t i = 0; i < ids.size(); ++i )
+        indices[ ids[ i ]] = uint32_t( i );
+
+    std::vector< FileNode > nodes( ids.size( ));
+    std::vector< uint32_t > lastChildren( ids.size(), INVALID_INDEX );
+    std::string strings;
+    ByteBuffer blobs;
+    for( size_t i = 0; i < ids.size(); ++i )
+    {
+        FileNode& node = nodes[ i ];
+        node.parent = i == 0 ? INVALID_INDEX
+                             : indices[ snapshot.getParent( ids[ i ])];
+        node.firstChild = INVALID_INDEX;
+        node.nextSibling = INVALID_INDEX;
+        node.subtreeSize = 1;
+        node.name = INVALID_INDEX;
+        node.dataType = DATA_NONE;
+        node.dataOffset = 0;
+
+        // The children are in preorder, so they are linked in order
+        if( node.parent != INVALID_INDEX )
+        {
+            uint32_t& last = lastChildren[ node.parent ];
+            if( last == INVALID_INDEX )
+                nodes[ node.parent ].firstChild = uint32_t( i );
+            else
+                nodes[ last ].nextSibling = uint32_t( i );
+            last = uint32_t( i );
+        }
+
+        const std::string& name = snapshot.getName( ids[ i ]);
+        if( !name.empty( ))
+        {
+            node.name = uint32_t( strings.size( ));
+            strings.append( name.c_str(), name.size() + 1 );
+        }
+
+        // The types are matched exactly, as the derived types of
+        // BoundsData, e.g. GeometryData, have more than the bounds
+        const NodeDataPtr& data = snapshot.getNodeData( ids[ i ]);
+        if( !data )
+            continue;
+        const std::type_info& type = typeid( *data );
+        const TransformData* transform = type == typeid( TransformData ) ?
+                static_cast< const TransformData* >( data.get( )) : 0;
+        const BoundsData* bounds = type == typeid( BoundsData ) ?
+                static_cast< const BoundsData* >( data.get( )) : 0;
+        if( transform )
+        {
+            node.dataType = DATA_TRANSFORM;
+            node.dataOffset = blobs.size();
+            const uint8_t* matrix = reinterpret_cast< const uint8_t* >(
+                                        transform->getTransform().data( ));
+            blobs.insert( blobs.end(), matrix, matrix + TRANSFORM_BLOB_SIZE );
+        }
+        else if( bounds )
+        {
+            node.dataType = DATA_BOUNDS;
+            node.dataOffset = blobs.size();
+            const uint8_t* min = reinterpret_cast< const uint8_t* >(
+                                     bounds->getBounds().min().data( ));
+            const uint8_t* max = reinterpret_cast< const uint8_t* >(
+                                     bounds->getBounds().max().data( ));
+            blobs.insert( blobs.end(), min, min + BOUNDS_BLOB_SIZE / 2 );
+            blobs.insert( blobs.end(), max, max + BOUNDS_BLOB_SIZE / 2 );
+        }
+    }
+
+    for( size_t i = nodes.size() - 1; i > 0; --i )
+        nodes[ nodes[ i ].parent ].subtreeSize += nodes[ i ].subtreeSize;
+
+    FileHeader header;
+    std::memcpy( header.magic, MAGIC, sizeof( MAGIC ));
+    header.version = VERSION;
+    header.nodeCount = uint32_t( nodes.size( ));
+    header.nodesOffset = alignSection( sizeof( FileHeader ));
+    header.stringsOffset = alignSection( header.nodesOffset +
+                                         nodes.size() * sizeof( FileNode ));
+    header.stringsSize = strings.size();
+    header.blobsOffset = alignSection( header.stringsOffset +
+                                       strings.size( ));
+    header.blobsSize = blobs.size();
+
+    std::ofstream file( fileName.c_str(),
+                        std::ios::binary | std::ios::trunc );
+    writeAt( file, 0, &header, sizeof( header ));
+    writeAt( file, header.nodesOffset, nodes.data(),
+             nodes.size() * sizeof( FileNode ));
+    writeAt( file, header.stringsOffset, strings.data(), strings.size( ));
+    writeAt( file, header.blobsOffset, blobs.data(), blobs.size( ));
+    file.close();
+    if( !file )
+        throw std::runtime_error( "Can not write " + fileName );
+}
+
+SceneFile::SceneFile( const std::string& fileName )
+    : _impl( new SceneFile::Impl( fileName ))
+{}
+
+SceneFile::~SceneFile()
+{}
+
+size_t SceneFile::getNodeCount() const
+{
+    return _impl->_header->nodeCount;
+}
+
+NodeId SceneFile::attach( SceneGraph& sceneGraph, const NodeId parent )
+{
+    _impl->_subscribe( sceneGraph );
+
+    SceneGraph::Transaction transaction( sceneGraph );
+    const NodeId staged = _impl->_addNode( transaction, sceneGraph, 0 );
+    transaction.addChild( parent, staged );
+    if( transaction.commit() > 0 )
+    {
+        sceneGraph.removeNode( transaction.getNodeId( staged ));
+        return INVALID_NODE_ID;
+    }
+
+    const NodeId id = transaction.getNodeId( staged );
+    ScopedLock lock( _impl->_mutex );
+    _impl->_addExpandable( id, 0 );
+    return id;
+}
+
+size_t SceneFile::expand( SceneGraph& sceneGraph, const NodeId id )
+{
+    uint32_t index;
+    {
+        ScopedLock lock( _impl->_mutex );
+        auto it = _impl->_expandable.find( id );
+        if( it == _impl->_expandable.end( ))
+            return 0;
+        index = it->second;
+        _impl->_expandable.erase( it );
+    }
+
+    const FileNode* nodes = _impl->_nodes;
+    const uint32_t nodeCount = _impl->_header->nodeCount;
+    std::vector< std::pair< NodeId, uint32_t >> children;
+    SceneGraph::Transaction transaction( sceneGraph );
+    for( uint32_t child = nodes[ index ].firstChild; child < nodeCount;
+         child = nodes[ child ].nextSibling )
+    {
+        const NodeId staged = _impl->_addNode( transaction, sceneGraph, child );
+        transaction.addChild( id, staged );
+        children.push_back( std::make_pair( staged, child ));
+
+        // A corrupt file must not make the sibling list endless
+        if( children.size() >= nodeCount )
+            break;
+    }
+    if( transaction.commit() > 0 )
+    {
+        // The node is removed or a name is taken concurrently: the
+        // created children would be orphans, so they are removed
+        SceneGraph::Transaction removal( sceneGraph );
+        for( const auto& child: children )
+        {
+            const NodeId childId = transaction.getNodeId( child.first );
+            if( childId != INVALID_NODE_ID )
+                removal.removeNode( childId );
+        }
+        removal.commit();
+
+        // A node which still exists can be expanded again. It is checked
+        // after the insertion, as a later removal erases it.
+        ScopedLock lock( _impl->_mutex );
+        _impl->_expandable[ id ] = index;
+        lock.unlock();
+        if( !sceneGraph.hasNode( id ))
+        {
+            lock.lock();
+            _impl->_expandable.erase( id );
+        }
+        return 0;
+    }
+
+    ScopedLock lock( _impl->_mutex );
+    for( const auto& child: children )
+        _impl->_addExpandable( transaction.getNodeId( child.first ),
+                               child.second );
+    return children.size();
+}
+
+void SceneFile::traverse( SceneGraph& sceneGraph,
+                          Visitor& visitor,
+                          const NodeId id )
+{
+    if( !sceneGraph.hasNode( id ))
+        return;
+
+    visitor.onBegin( sceneGraph );
+    NodeIds stack( 1, id );
+    NodeIds children;
+    while( !stack.empty( ))
+    {
+        const NodeId current = stack.back();
+        stack.pop_back();
+        expand( sceneGraph, current );
+        visitor.visit( sceneGraph, current );
+
+        sceneGraph.getChildren( current, children );
+        stack.insert( stack.end(), children.rbegin(), children.rend( ));
+    }
+    visitor.onEnd( sceneGraph );
+}
+
+bool SceneFile::isExpandable( const NodeId id ) const
+{
+    ScopedLock lock( _impl->_mutex );
+    return _impl->_expandable.count( id ) > 0;
+}
+
+size_t SceneFile::getMaterializedCount() const
+{
+    ScopedLock lock( _impl->_mutex );
+    return _impl->_nMaterialized;
+}
+
+}
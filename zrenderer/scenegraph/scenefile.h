@@ -0,0 +1,138 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _scenefile_h_
+#define _scenefile_h_
+
+#include <zrenderer/scenegraph/types.h>
+
+namespace zrenderer
+{
+
+/**
+ * Binary scene file, which is memory mapped and used without parsing.
+ * The file has a header, the nodes of a subtree in preorder as a flat
+ * array, a string table for the names and the blobs of the node data.
+ * The subtree of a file node is the contiguous range of its subtree
+ * size, so the node array is the offset index of the subtrees. Only
+ * node data of exactly the TransformData and BoundsData types is stored,
+ * the nodes with other types, including GeometryData and InstanceData,
+ * are written without node data.
+ *
+ * The nodes are materialized into a scene graph lazily: attach() adds
+ * the root node of the file and the children of a node are created when
+ * it is expanded, which traverse() does the first time it reaches the
+ * node. Only expand() and traverse() create the children: the scene
+ * graph traversals, updateTransforms() and the InstanceHierarchy see the
+ * nodes which are not expanded yet as leaves. The numbers are stored in
+ * the byte order of the host.
+ *
+ * A scene file is attached to a single scene graph, which has to outlive
+ * it. The removed nodes of the scene graph are not expandable anymore.
+ */
+class SceneFile
+{
+public:
+
+    /**
+     * Current version of the file format
+     */
+    static const uint32_t VERSION = 1;
+
+    /**
+     * Writes the subtree of a node in a snapshot to a file.
+     * @param snapshot is the snapshot to write
+     * @param id of the root node of the subtree
+     * @param fileName is the name of the file
+     * @throw std::runtime_error if the file can not be written
+     */
+    static void write( const Snapshot& snapshot,
+                       NodeId id,
+                       const std::string& fileName );
+
+    /**
+     * Maps the scene file, validating only its header and section sizes.
+     * @param fileName is the name of the file
+     * @throw std::runtime_error if the file can not be mapped or it is
+     * not a valid scene file
+     */
+    explicit SceneFile( const std::string& fileName );
+    ~SceneFile();
+
+    /**
+     * @return the number of nodes in the file
+     */
+    size_t getNodeCount() const;
+
+    /**
+     * Creates the root node of the file in the scene graph, without
+     * its children.
+     * @param sceneGraph is the scene graph to add the node to
+     * @param parent is the node to attach the root node to
+     * @return the id of the created node, INVALID_NODE_ID if it can not
+     * be attached to the parent
+     * @throw std::runtime_error if the file is attached to another scene
+     * graph
+     */
+    NodeId attach( SceneGraph& sceneGraph, NodeId parent );
+
+    /**
+     * Creates the children of a materialized node which is not expanded
+     * yet.
+     * @param sceneGraph is the scene graph the node is attached to
+     * @param id of the node
+     * @return the number of created nodes. It is 0 if the children can
+     * not be attached, e.g. the node is removed concurrently, in which
+     * case no node is created.
+     */
+    size_t expand( SceneGraph& sceneGraph, NodeId id );
+
+    /**
+     * Traverses a subtree in depth first order, expanding the nodes
+     * when they are reached for the first time.
+     * @param sceneGraph is the scene graph the nodes are attached to
+     * @param visitor the visitor class that is executed per vertex
+     * @param id of the node to start traversing.
+     */
+    void traverse( SceneGraph& sceneGraph, Visitor& visitor, NodeId id );
+
+    /**
+     * @param id of a node
+     * @return true if the node is created from the file and its
+     * children are not created yet
+     */
+    bool isExpandable( NodeId id ) const;
+
+    /**
+     * @return the number of nodes created from the file
+     */
+    size_t getMaterializedCount() const;
+
+private:
+
+    SceneFile( const SceneFile& ) = delete;
+    SceneFile& operator=( const SceneFile& ) = delete;
+
+    struct Impl;
+    std::unique_ptr<Impl> _impl;
+};
+
+}
+
+#endif // _scenefile_h_
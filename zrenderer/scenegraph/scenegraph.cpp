@@ -19,216 +19,1304 @@
 
 #include <zrenderer/scenegraph/scenegraph.h>
 #include <zrenderer/scenegraph/node.h>
+#include <zrenderer/scenegraph/snapshot.h>
+#include <zrenderer/scenegraph/transformdata.h>
 #include <zrenderer/scenegraph/visitor.h>
 
-#include <boost/graph/adjacency_list.hpp>
-#include <boost/graph/depth_first_search.hpp>
+#include <zrenderer/common/epoch.h>
+#include <zrenderer/common/workstealingpool.h>
+
+#include <boost/thread/recursive_mutex.hpp>
+
+#include <limits>
 
 namespace zrenderer
 {
 
-typedef boost::adjacency_list< boost::listS,
-                               boost::listS,
-                               boost::bidirectionalS,
-                               NodePtr > Graph;
+namespace
+{
+const uint32_t INVALID_INDEX = std::numeric_limits< uint32_t >::max();
+
+// Number of nodes below which a parallel traversal does not split
+const uint32_t TRAVERSAL_GRAIN = 1024;
+
+// Number of nodes in a chunk of a snapshot
+const uint32_t SNAPSHOT_CHUNK_SIZE = 4096;
+
+// Generation of the ids of the nodes staged in a transaction
+const uint32_t STAGED_GENERATION = std::numeric_limits< uint32_t >::max();
+
+uint32_t getIndex( const NodeId id )
+{
+    return uint32_t( id );
+}
+
+uint32_t getGeneration( const NodeId id )
+{
+    return uint32_t( id >> 32 );
+}
+
+NodeId makeId( const uint32_t index, const uint32_t generation )
+{
+    return ( NodeId( generation ) << 32 ) | index;
+}
+
+typedef std::vector< uint32_t > Indices;
+typedef boost::unique_lock< boost::recursive_mutex > SubscriberLock;
+
+/**
+ * The preorder of all nodes, parents before children, with the size of
+ * the subtree at every position and the position of every node index.
+ */
+struct TraversalOrder
+{
+    NodeIds ids;
+    Indices subtreeSizes;
+    Indices positions;
+};
+
+typedef std::shared_ptr< const TraversalOrder > ConstTraversalOrderPtr;
+
+typedef std::unordered_map< std::string, NodeId > NameMap;
+
+template< class T >
+void reserveFor( std::vector< T >& vector, const size_t size )
+{
+    // Keeps the growth geometric for many small reservations
+    if( size > vector.capacity( ))
+        vector.reserve( std::max( size, 2 * vector.capacity( )));
+}
+}
+
+struct Snapshot::Impl
+{
+    struct Slot
+    {
+        uint32_t parent;
+        uint32_t firstChild;
+        uint32_t nextSibling;
+        uint32_t generation;
+        bool alive;
+        NodeDataPtr nodeData;
+    };
+
+    // The snapshots share the chunks without changes
+    typedef std::vector< Slot > Chunk;
+    typedef std::shared_ptr< const Chunk > ConstChunkPtr;
+
+    struct Names
+    {
+        NameMap ids;
+        std::unordered_map< NodeId, const std::string* > names;
+    };
+
+    Impl( const SceneGraph& sceneGraph_ )
+        : sceneGraph( sceneGraph_ )
+        , version( 0 )
+        , nodeCount( 0 )
+    {}
+
+    const Slot* getSlot( const NodeId id ) const
+    {
+        const uint32_t index = getIndex( id );
+        const size_t chunk = index / SNAPSHOT_CHUNK_SIZE;
+        if( chunk >= chunks.size( ))
+            return 0;
+
+        const Chunk& slots = *chunks[ chunk ];
+        const size_t offset = index % SNAPSHOT_CHUNK_SIZE;
+        if( offset >= slots.size( ))
+            return 0;
+
+        const Slot& slot = slots[ offset ];
+        if( !slot.alive || slot.generation != getGeneration( id ))
+            return 0;
+        return &slot;
+    }
+
+    const Slot& getSlot( const uint32_t index ) const
+    {
+        return ( *chunks[ index / SNAPSHOT_CHUNK_SIZE ])
+                [ index % SNAPSHOT_CHUNK_SIZE ];
+    }
+
+    NodeId getId( const uint32_t index ) const
+    {
+        if( index == INVALID_INDEX )
+            return INVALID_NODE_ID;
+        return makeId( index, getSlot( index ).generation );
+    }
+
+    const SceneGraph& sceneGraph;
+    uint64_t version;
+    size_t nodeCount;
+    std::vector< ConstChunkPtr > chunks;
+    ConstTraversalOrderPtr order;
+    std::shared_ptr< const Names > names;
+};
+
+Snapshot::Snapshot( const SceneGraph& sceneGraph )
+    : _impl( new Snapshot::Impl( sceneGraph ))
+{}
+
+Snapshot::~Snapshot()
+{}
+
+uint64_t Snapshot::getVersion() const
+{
+    return _impl->version;
+}
+
+const SceneGraph& Snapshot::getSceneGraph() const
+{
+    return _impl->sceneGraph;
+}
+
+size_t Snapshot::getNodeCount() const
+{
+    return _impl->nodeCount;
+}
+
+bool Snapshot::hasNode( const NodeId id ) const
+{
+    return _impl->getSlot( id ) != 0;
+}
+
+NodeId Snapshot::findNodeId( const std::string& name ) const
+{
+    const NameMap& ids = _impl->names->ids;
+    NameMap::const_iterator it = ids.find( name );
+    return it == ids.end() ? INVALID_NODE_ID : it->second;
+}
+
+std::string Snapshot::getName( const NodeId id ) const
+{
+    const auto& names = _impl->names->names;
+    const auto it = names.find( id );
+    return it == names.end() ? std::string() : *it->second;
+}
+
+NodeDataPtr Snapshot::getNodeData( const NodeId id ) const
+{
+    const Impl::Slot* slot = _impl->getSlot( id );
+    return slot ? slot->nodeData : NodeDataPtr();
+}
+
+NodeId Snapshot::getParent( const NodeId child ) const
+{
+    const Impl::Slot* slot = _impl->getSlot( child );
+    return slot ? _impl->getId( slot->parent ) : INVALID_NODE_ID;
+}
+
+void Snapshot::getChildren( const NodeId parent, NodeIds& children ) const
+{
+    children.clear();
+    const Impl::Slot* slot = _impl->getSlot( parent );
+    if( !slot )
+        return;
+
+    for( uint32_t child = slot->firstChild; child != INVALID_INDEX;
+         child = _impl->getSlot( child ).nextSibling )
+    {
+        children.push_back( _impl->getId( child ));
+    }
+}
+
+size_t Snapshot::getChildCount( const NodeId parent ) const
+{
+    const Impl::Slot* slot = _impl->getSlot( parent );
+    if( !slot )
+        return 0;
+
+    size_t count = 0;
+    for( uint32_t child = slot->firstChild; child != INVALID_INDEX;
+         child = _impl->getSlot( child ).nextSibling )
+    {
+        ++count;
+    }
+    return count;
+}
+
+bool Snapshot::hasChild( const NodeId parent, const NodeId child ) const
+{
+    const Impl::Slot* slot = _impl->getSlot( child );
+    return slot && _impl->getSlot( parent ) &&
+           slot->parent == getIndex( parent );
+}
+
+void Snapshot::traverse( Visitor& visitor, const NodeId id ) const
+{
+    if( !_impl->getSlot( id ))
+        return;
+
+    const TraversalOrder& order = *_impl->order;
+    const uint32_t begin = order.positions[ getIndex( id )];
+    const uint32_t end = begin + order.subtreeSizes[ begin ];
+    visitor.onBegin( _impl->sceneGraph );
+    for( uint32_t i = begin; i < end; ++i )
+        visitor.visit( *this, order.ids[ i ] );
+    visitor.onEnd( _impl->sceneGraph );
+}
+
+void Visitor::visit( const SceneGraph& scenegraph, const NodeId id )
+{
+    // The nodes removed since the traversal began are skipped
+    const NodePtr node = scenegraph.getNode( id );
+    if( node )
+        visit( scenegraph, node );
+}
+
+struct SceneGraph::Impl
+{
+    // Holds the published snapshot for the lock free readers
+    struct Published
+    {
+        explicit Published( const ConstSnapshotPtr& snapshot_ )
+            : snapshot( snapshot_ )
+        {}
+
+        const ConstSnapshotPtr snapshot;
+    };
+
+    struct ParallelTraversal
+    {
+        ConstTraversalOrderPtr order;
+        std::vector< Visitor* > visitors;
+        WorkStealingPool* pool;
+    };
+
+    Impl( SceneGraph& sceneGraph, const size_t nThreads )
+        : _nodeCount( 0 )
+        , _orderValid( false )
+        , _version( 0 )
+        , _changed( true )
+        , _namesChanged( true )
+        , _published( 0 )
+        , _allDirty( true )
+        , _nextSubscription( 0 )
+        , _notifiedVersion( 0 )
+        , _hasSubscribers( false )
+        , _notifying( false )
+        , _nThreads( nThreads )
+        , _sceneGraph( sceneGraph )
+    {
+        _addNode( &ROOT_NODE, NodeDataPtr( ));
+        _rootNode = _getNode( 0 );
+        publish();
+    }
+
+    ~Impl()
+    {
+        delete _published.load();
+    }
+
+    NodeId addNode( const std::string* name,
+                    const NodeDataPtr& nodeData )
+    {
+        NodeId id;
+        {
+            WriteLock writeLock( _mutex );
+            id = _addNode( name, nodeData );
+        }
+        _notify();
+        return id;
+    }
+
+    NodeId findNodeId( const std::string& name ) const
+    {
+        ReadLock readLock( _mutex );
+        NameMap::const_iterator it = _nameMap.find( name );
+        return it == _nameMap.end() ? INVALID_NODE_ID : it->second;
+    }
+
+    bool hasNode( const NodeId id ) const
+    {
+        ReadLock readLock( _mutex );
+        return _getIndex( id ) != INVALID_INDEX;
+    }
+
+    NodePtr getNode( const NodeId id ) const
+    {
+        ReadLock readLock( _mutex );
+        const uint32_t index = _getIndex( id );
+        return index == INVALID_INDEX ? NodePtr() : _getNode( index );
+    }
+
+    NodePtr findNode( const std::string& name ) const
+    {
+        ReadLock readLock( _mutex );
+        NameMap::const_iterator it = _nameMap.find( name );
+        if( it == _nameMap.end( ))
+            return NodePtr();
+        return _getNode( getIndex( it->second ));
+    }
+
+    NodeDataPtr getNodeData( const NodeId id ) const
+    {
+        ReadLock readLock( _mutex );
+        const uint32_t index = _getIndex( id );
+        return index == INVALID_INDEX ? NodeDataPtr() : _nodeData[ index ];
+    }
+
+    bool setNodeData( const NodeId id, const NodeDataPtr& nodeData )
+    {
+        bool set;
+        {
+            WriteLock writeLock( _mutex );
+            set = _setNodeData( id, nodeData );
+        }
+        _notify();
+        return set;
+    }
+
+    std::string getName( const NodeId id ) const
+    {
+        ReadLock readLock( _mutex );
+        const uint32_t index = _getIndex( id );
+        if( index == INVALID_INDEX || !_names[ index ] )
+            return std::string();
+        return *_names[ index ];
+    }
+
+    bool removeNode( const NodeId id )
+    {
+        bool removed;
+        {
+            WriteLock writeLock( _mutex );
+            removed = _removeNode( id );
+        }
+        _notify();
+        return removed;
+    }
+
+    bool addChild( const NodeId parent, const NodeId child )
+    {
+        bool added;
+        {
+            WriteLock writeLock( _mutex );
+            added = _addChild( parent, child );
+        }
+        _notify();
+        return added;
+    }
+
+    NodeId getParent( const NodeId child ) const
+    {
+        ReadLock readLock( _mutex );
+        const uint32_t index = _getIndex( child );
+        return index == INVALID_INDEX ? INVALID_NODE_ID
+                                      : _getId( _parents[ index ] );
+    }
+
+    void getChildren( const NodeId parent, NodeIds& children ) const
+    {
+        children.clear();
+        ReadLock readLock( _mutex );
+        const uint32_t index = _getIndex( parent );
+        if( index == INVALID_INDEX )
+            return;
+
+        for( uint32_t child = _firstChildren[ index ];
+             child != INVALID_INDEX; child = _nextSiblings[ child ] )
+        {
+            children.push_back( _getId( child ));
+        }
+    }
+
+    NodePtrs getChildren( const NodeId parent ) const
+    {
+        NodePtrs children;
+        ReadLock readLock( _mutex );
+        const uint32_t index = _getIndex( parent );
+        if( index == INVALID_INDEX )
+            return children;
+
+        for( uint32_t child = _firstChildren[ index ];
+             child != INVALID_INDEX; child = _nextSiblings[ child ] )
+        {
+            children.push_back( _getNode( child ));
+        }
+        return children;
+    }
+
+    size_t getChildCount( const NodeId parent ) const
+    {
+        ReadLock readLock( _mutex );
+        const uint32_t index = _getIndex( parent );
+        if( index == INVALID_INDEX )
+            return 0;
+
+        size_t count = 0;
+        for( uint32_t child = _firstChildren[ index ];
+             child != INVALID_INDEX; child = _nextSiblings[ child ] )
+        {
+            ++count;
+        }
+        return count;
+    }
+
+    bool hasChild( const NodeId parent, const NodeId child ) const
+    {
+        ReadLock readLock( _mutex );
+        const uint32_t parentIndex = _getIndex( parent );
+        const uint32_t childIndex = _getIndex( child );
+        return parentIndex != INVALID_INDEX && childIndex != INVALID_INDEX &&
+               _parents[ childIndex ] == parentIndex;
+    }
+
+    void traverse( Visitor& visitor, const NodeId id )
+    {
+        uint32_t position = 0;
+        const ConstTraversalOrderPtr order = _getOrder( id, position );
+        if( !order )
+            return;
+
+        // The subtree is a contiguous range of the preorder
+        const uint32_t end = position + order->subtreeSizes[ position ];
+        visitor.onBegin( _sceneGraph );
+        for( uint32_t i = position; i < end; ++i )
+            visitor.visit( _sceneGraph, order->ids[ i ] );
+        visitor.onEnd( _sceneGraph );
+    }
+
+    void traverseParallel( Visitor& visitor, const NodeId id )
+    {
+        uint32_t position = 0;
+        ParallelTraversal traversal;
+        traversal.order = _getOrder( id, position );
+        if( !traversal.order )
+            return;
+
+        traversal.pool = &_getPool();
+        std::vector< VisitorPtr > forks;
+        traversal.visitors.push_back( &visitor );
+        const size_t nWorkers = traversal.pool->getWorkerCount();
+        for( size_t i = 1; i < nWorkers; ++i )
+        {
+            forks.push_back( visitor.fork( ));
+            traversal.visitors.push_back( forks.back() ? forks.back().get()
+                                                       : &visitor );
+        }
+
+        visitor.onBegin( _sceneGraph );
+        traversal.pool->run(
+            [ this, position, &traversal ]( const size_t worker )
+            { _visitSubtree( position, worker, traversal ); });
+
+        for( const VisitorPtr& fork: forks )
+        {
+            if( fork )
+                visitor.join( *fork );
+        }
+        visitor.onEnd( _sceneGraph );
+    }
+
+    size_t getNodeCount() const
+    {
+        ReadLock readLock( _mutex );
+        return _nodeCount;
+    }
+
+    void markDirty( const NodeId id )
+    {
+        {
+            WriteLock writeLock( _mutex );
+            const uint32_t index = _getIndex( id );
+            if( index == INVALID_INDEX )
+                return;
+
+            _markDirty( index );
+            _journal.append( CHANGE_NODE_DATA_CHANGED, id );
+        }
+        _notify();
+    }
+
+    bool getChanges( uint64_t& cursor, Changes& changes ) const
+    {
+        ReadLock readLock( _mutex );
+        return _journal.read( cursor, changes );
+    }
+
+    uint64_t getChangeVersion() const
+    {
+        ReadLock readLock( _mutex );
+        return _journal.getVersion();
+    }
+
+    void setChangeJournalCapacity( const size_t capacity )
+    {
+        WriteLock writeLock( _mutex );
+        _journal.setCapacity( capacity );
+    }
+
+    size_t subscribe( const ChangeCallback& callback )
+    {
+        SubscriberLock lock( _subscriberMutex );
+
+        // The new subscriber gets only the later changes, a subscriber
+        // added by a callback the changes after the delivered ones
+        _notifySubscribers();
+        const size_t subscription = _nextSubscription++;
+        _subscribers[ subscription ] = callback;
+        _hasSubscribers = true;
+        return subscription;
+    }
+
+    bool unsubscribe( const size_t subscription )
+    {
+        SubscriberLock lock( _subscriberMutex );
+        const bool erased = _subscribers.erase( subscription ) > 0;
+        _hasSubscribers = !_subscribers.empty();
+        return erased;
+    }
+
+    void _notify()
+    {
+        if( !_hasSubscribers )
+            return;
+
+        SubscriberLock lock( _subscriberMutex );
+        _notifySubscribers();
+    }
+
+    void _notifySubscribers()
+    {
+        // The calls from the callbacks do not deliver, the outer delivery
+        // is not finished
+        if( _notifying )
+            return;
+
+        Changes changes;
+        uint64_t version;
+        {
+            ReadLock readLock( _mutex );
+            version = _journal.getVersion();
+            if( _subscribers.empty( ))
+            {
+                _notifiedVersion = version;
+                return;
+            }
+
+            if( !_journal.read( _notifiedVersion, changes ))
+            {
+                changes.push_back( Change{ version, CHANGE_RESET,
+                                           INVALID_NODE_ID,
+                                           INVALID_NODE_ID });
+            }
+        }
+
+        // The callbacks may subscribe and unsubscribe, so a copy of the
+        // subscribers is called, skipping the unsubscribed ones
+        const std::vector< std::pair< size_t, ChangeCallback >> subscribers(
+            _subscribers.begin(), _subscribers.end( ));
+        _notifying = true;
+        try
+        {
+            for( const Change& change: changes )
+            {
+                for( const auto& subscriber: subscribers )
+                {
+                    if( _subscribers.count( subscriber.first ))
+                        subscriber.second( change );
+                }
+            }
+        }
+        catch( ... )
+        {
+            _notifying = false;
+            throw;
+        }
+        _notifying = false;
+    }
+
+    size_t updateTransforms()
+    {
+        WriteLock writeLock( _mutex );
+        if( !_orderValid )
+            _updateOrder();
+
+        _worldTransforms.resize( _alive.size(), Affine3f::Identity( ));
+        _worldBounds.resize( _alive.size( ));
+
+        const TraversalOrder& order = *_order;
+        Indices positions;
+        if( _allDirty )
+        {
+            for( uint32_t i = 0; i < order.ids.size();
+                 i += order.subtreeSizes[ i ] )
+            {
+                positions.push_back( i );
+            }
+        }
+        else
+        {
+            for( const uint32_t index: _dirtyIndices )
+            {
+                if( _alive[ index ] )
+                    positions.push_back( order.positions[ index ]);
+            }
+            std::sort( positions.begin(), positions.end( ));
+        }
+        // The nodes with removed children only need new bounds
+        Indices ancestors;
+        for( const uint32_t index: _dirtyBounds )
+        {
+            for( uint32_t parent = index; parent != INVALID_INDEX;
+                 parent = _parents[ parent ] )
+            {
+                if( _alive[ parent ] )
+                    ancestors.push_back( order.positions[ parent ]);
+            }
+        }
+        _dirtyIndices.clear();
+        _dirtyBounds.clear();
+        _allDirty = false;
+
+        // The subtrees inside other dirty subtrees are skipped
+        size_t nUpdated = 0;
+        uint32_t end = 0;
+        for( const uint32_t position: positions )
+        {
+            if( position < end )
+                continue;
+
+            end = position + order.subtreeSizes[ position ];
+            nUpdated += _updateSubtree( position );
+            const uint32_t index = getIndex( order.ids[ position ]);
+            for( uint32_t parent = _parents[ index ]; parent != INVALID_INDEX;
+                 parent = _parents[ parent ] )
+            {
+                ancestors.push_back( order.positions[ parent ]);
+            }
+        }
+
+        // The ancestors are updated after their descendants
+        std::sort( ancestors.begin(), ancestors.end(),
+                   std::greater< uint32_t >( ));
+        ancestors.erase( std::unique( ancestors.begin(), ancestors.end( )),
+                         ancestors.end( ));
+        for( const uint32_t position: ancestors )
+            _updateBounds( getIndex( order.ids[ position ]));
+        return nUpdated + ancestors.size();
+    }
+
+    bool getWorldTransform( const NodeId id, Affine3f& transform ) const
+    {
+        ReadLock readLock( _mutex );
+        const uint32_t index = _getIndex( id );
+        if( index == INVALID_INDEX || index >= _worldTransforms.size( ))
+            return false;
+
+        transform = _worldTransforms[ index ];
+        return true;
+    }
+
+    bool getWorldBounds( const NodeId id, AlignedBox3f& bounds ) const
+    {
+        ReadLock readLock( _mutex );
+        const uint32_t index = _getIndex( id );
+        if( index == INVALID_INDEX || index >= _worldBounds.size( ))
+            return false;
+
+        bounds = _worldBounds[ index ];
+        return true;
+    }
+
+    ConstSnapshotPtr publish()
+    {
+        WriteLock writeLock( _mutex );
+        if( !_changed )
+            return _published.load()->snapshot;
+
+        if( !_orderValid )
+            _updateOrder();
+
+        std::shared_ptr< Snapshot > snapshot( new Snapshot( _sceneGraph ));
+        Snapshot::Impl& data = *snapshot->_impl;
+        data.version = ++_version;
+        data.nodeCount = _nodeCount;
+        data.order = _order;
+
+        if( _namesChanged )
+        {
+            std::shared_ptr< Snapshot::Impl::Names > names(
+                        new Snapshot::Impl::Names );
+            names->ids = _nameMap;
+            for( const auto& entry: names->ids )
+                names->names[ entry.second ] = &entry.first;
+            _publishedNames = names;
+            _namesChanged = false;
+        }
+        data.names = _publishedNames;
+
+        // Only the changed chunks are copied
+        _chunks.resize( _changedChunks.size( ));
+        for( size_t i = 0; i < _changedChunks.size(); ++i )
+        {
+            if( !_changedChunks[ i ] )
+                continue;
+
+            const size_t begin = i * SNAPSHOT_CHUNK_SIZE;
+            const size_t end = std::min( begin + SNAPSHOT_CHUNK_SIZE,
+                                         _alive.size( ));
+            std::shared_ptr< Snapshot::Impl::Chunk > chunk(
+                        new Snapshot::Impl::Chunk( end - begin ));
+            for( size_t j = begin; j < end; ++j )
+            {
+                Snapshot::Impl::Slot& slot = ( *chunk )[ j - begin ];
+                slot.parent = _parents[ j ];
+                slot.firstChild = _firstChildren[ j ];
+                slot.nextSibling = _nextSiblings[ j ];
+                slot.generation = _generations[ j ];
+                slot.alive = _alive[ j ];
+                slot.nodeData = _nodeData[ j ];
+            }
+            _chunks[ i ] = chunk;
+            _changedChunks[ i ] = false;
+        }
+        data.chunks = _chunks;
+        _changed = false;
+
+        // The readers may still be copying the previous snapshot pointer
+        Published* previous = _published.exchange( new Published( snapshot ));
+        if( previous )
+            _retired.retire( [previous] { delete previous; });
+        _retired.reclaim();
+        return snapshot;
+    }
+
+    ConstSnapshotPtr getSnapshot() const
+    {
+        Epoch::Guard guard;
+        return _published.load()->snapshot;
+    }
+
+    NodeId _addNode( const std::string* name,
+                     const NodeDataPtr& nodeData )
+    {
+        NameMap::iterator nameIt = _nameMap.end();
+        if( name )
+        {
+            const std::pair< NameMap::iterator, bool > result =
+                    _nameMap.insert( std::make_pair( *name, INVALID_NODE_ID ));
+            if( !result.second )
+                return INVALID_NODE_ID;
+            nameIt = result.first;
+        }
+
+        uint32_t index;
+        if( _freeIndices.empty( ))
+        {
+            index = uint32_t( _alive.size( ));
+            _parents.push_back( INVALID_INDEX );
+            _firstChildren.push_back( INVALID_INDEX );
+            _lastChildren.push_back( INVALID_INDEX );
+            _nextSiblings.push_back( INVALID_INDEX );
+            _prevSiblings.push_back( INVALID_INDEX );
+            _generations.push_back( 0 );
+            _alive.push_back( true );
+            _nodeData.push_back( nodeData );
+            _nodes.push_back( NodePtr( ));
+            _names.push_back( 0 );
+        }
+        else
+        {
+            index = _freeIndices.back();
+            _freeIndices.pop_back();
+            _alive[ index ] = true;
+            _nodeData[ index ] = nodeData;
+        }
+        ++_nodeCount;
+        _orderValid = false;
+        _touch( index );
+        _markDirty( index );
+
+        const NodeId id = makeId( index, _generations[ index ] );
+        if( name )
+        {
+            nameIt->second = id;
+            _names[ index ] = &nameIt->first;
+            _namesChanged = true;
+        }
+        _journal.append( CHANGE_NODE_ADDED, id );
+        return id;
+    }
+
+    bool _removeNode( const NodeId id )
+    {
+        const uint32_t index = _getIndex( id );
+        if( index == INVALID_INDEX || id == ROOT_NODE_ID )
+            return false;
+
+        const NodeId parent = _getId( _parents[ index ]);
+        if( !_allDirty && _parents[ index ] != INVALID_INDEX )
+            _dirtyBounds.push_back( _parents[ index ]);
+        _unlink( index );
+        uint32_t child = _firstChildren[ index ];
+        while( child != INVALID_INDEX )
+        {
+            _touch( child );
+            _markDirty( child );
+            _journal.append( CHANGE_PARENT_CHANGED, _getId( child ));
+            const uint32_t next = _nextSiblings[ child ];
+            _parents[ child ] = INVALID_INDEX;
+            _prevSiblings[ child ] = INVALID_INDEX;
+            _nextSiblings[ child ] = INVALID_INDEX;
+            child = next;
+        }
+
+        if( _names[ index ] )
+        {
+            _nameMap.erase( *_names[ index ] );
+            _namesChanged = true;
+        }
+        _components.removeNode( id );
+        _journal.append( CHANGE_NODE_REMOVED, id, parent );
+
+        // The generation change invalidates the handles of the node. The
+        // generation of the staged ids is skipped.
+        if( ++_generations[ index ] == STAGED_GENERATION )
+            _generations[ index ] = 0;
+        _alive[ index ] = false;
+        _firstChildren[ index ] = INVALID_INDEX;
+        _lastChildren[ index ] = INVALID_INDEX;
+        _nodeData[ index ].reset();
+        _nodes[ index ].reset();
+        _names[ index ] = 0;
+        _freeIndices.push_back( index );
+        --_nodeCount;
+        _orderValid = false;
+        _touch( index );
+        return true;
+    }
 
-typedef Graph::vertex_descriptor NodeDescriptor;
-typedef std::unordered_map< std::string, NodeDescriptor > NodeMap;
+    bool _addChild( const NodeId parent, const NodeId child )
+    {
+        const uint32_t parentIndex = _getIndex( parent );
+        const uint32_t childIndex = _getIndex( child );
+        if( parentIndex == INVALID_INDEX || childIndex == INVALID_INDEX ||
+            _parents[ childIndex ] != INVALID_INDEX || childIndex == 0 )
+        {
+            return false;
+        }
 
-class DFSNodeVisitor : public boost::default_dfs_visitor
-{
-public:
-    DFSNodeVisitor( const SceneGraph& scenegraph,
-                    Visitor& visitor )
-    : _scenegraph( scenegraph )
-    , _visitor( visitor )
-    {}
+        // A node without children is not an ancestor of another node
+        if( _firstChildren[ childIndex ] == INVALID_INDEX )
+        {
+            if( parentIndex == childIndex )
+                return false;
+        }
+        else
+        {
+            for( uint32_t ancestor = parentIndex; ancestor != INVALID_INDEX;
+                 ancestor = _parents[ ancestor ] )
+            {
+                if( ancestor == childIndex )
+                    return false;
+            }
+        }
 
-    void discover_vertex( NodeDescriptor nd, const Graph& graph ) const
-    {
-        _visitor.visit( _scenegraph, graph[ nd ] );
+        const uint32_t last = _lastChildren[ parentIndex ];
+        if( last == INVALID_INDEX )
+            _firstChildren[ parentIndex ] = childIndex;
+        else
+            _nextSiblings[ last ] = childIndex;
+        _prevSiblings[ childIndex ] = last;
+        _lastChildren[ parentIndex ] = childIndex;
+        _parents[ childIndex ] = parentIndex;
+        _orderValid = false;
+        _touch( parentIndex );
+        _touch( last );
+        _touch( childIndex );
+        _markDirty( childIndex );
+        _journal.append( CHANGE_PARENT_CHANGED, child, parent );
+        return true;
     }
 
-    const SceneGraph& _scenegraph;
-    Visitor& _visitor;
-};
-
-struct SceneGraph::Impl
-{
-    Impl( SceneGraph& sceneGraph )
-        : _rootNode( new Node( ROOT_NODE,
-                               NodeDataPtr(),
-                               sceneGraph ))
-        , _sceneGraph( sceneGraph )
+    bool _setNodeData( const NodeId id, const NodeDataPtr& nodeData )
     {
-        const NodeDescriptor& nd =
-                boost::add_vertex( _rootNode, _graph );
-        _nodeMap[ ROOT_NODE ] = nd;
+        const uint32_t index = _getIndex( id );
+        if( index == INVALID_INDEX )
+            return false;
+
+        _nodeData[ index ] = nodeData;
+        _touch( index );
+        _markDirty( index );
+        _journal.append( CHANGE_NODE_DATA_CHANGED, id );
+        return true;
     }
 
-    ~Impl() {}
+    void _reserve( const size_t nNodes, const size_t nNames )
+    {
+        const size_t size = _alive.size() + nNodes;
+        reserveFor( _parents, size );
+        reserveFor( _firstChildren, size );
+        reserveFor( _lastChildren, size );
+        reserveFor( _nextSiblings, size );
+        reserveFor( _prevSiblings, size );
+        reserveFor( _generations, size );
+        reserveFor( _alive, size );
+        reserveFor( _nodeData, size );
+        reserveFor( _nodes, size );
+        reserveFor( _names, size );
+        _nameMap.reserve( _nameMap.size() + nNames );
+    }
 
-    bool nodeExists( const std::string& name ) const
+    uint32_t _getIndex( const NodeId id ) const
     {
-        ReadLock readLock( _mutex );
-        return _nodeMap.count( name ) == 1;
+        const uint32_t index = getIndex( id );
+        if( index >= _alive.size() || !_alive[ index ] ||
+            _generations[ index ] != getGeneration( id ))
+        {
+            return INVALID_INDEX;
+        }
+        return index;
     }
 
-    NodePtr createNode( const std::string& name,
-                        const NodeDataPtr& nodeData )
+    NodeId _getId( const uint32_t index ) const
     {
-        if( nodeExists( name ) )
-            return NodePtr();
+        if( index == INVALID_INDEX )
+            return INVALID_NODE_ID;
+        return makeId( index, _generations[ index ] );
+    }
 
-        WriteLock writeLock( _mutex );
-        NodePtr node( new Node( name,
-                                nodeData,
-                                _sceneGraph ) );
+    NodePtr _getNode( const uint32_t index ) const
+    {
+        // Readers create the node objects concurrently under the read
+        // lock, the first one to store its node wins
+        NodePtr* slot = &_nodes[ index ];
+        NodePtr node = std::atomic_load( slot );
+        if( node )
+            return node;
 
-        _nodeMap[ name ] =
-                boost::add_vertex( node, _graph );
+        const NodePtr created( new Node( _getId( index ),
+                                         _names[ index ] ? *_names[ index ]
+                                                         : std::string(),
+                                         _sceneGraph ));
+        if( std::atomic_compare_exchange_strong( slot, &node, created ))
+            return created;
         return node;
     }
 
-    NodePtr findNode( const std::string& name ) const
+    void _unlink( const uint32_t index )
     {
-        ReadLock readLock( _mutex );
-        NodeMap::const_iterator it = _nodeMap.find( name );
-        if( it != _nodeMap.end( ))
-            return _graph[ it->second ];
+        const uint32_t parent = _parents[ index ];
+        if( parent == INVALID_INDEX )
+            return;
+
+        const uint32_t prev = _prevSiblings[ index ];
+        const uint32_t next = _nextSiblings[ index ];
+        if( prev == INVALID_INDEX )
+            _firstChildren[ parent ] = next;
+        else
+            _nextSiblings[ prev ] = next;
+
+        if( next == INVALID_INDEX )
+            _lastChildren[ parent ] = prev;
+        else
+            _prevSiblings[ next ] = prev;
 
-        return NodePtr();
+        _touch( parent );
+        _touch( prev );
+        _parents[ index ] = INVALID_INDEX;
+        _prevSiblings[ index ] = INVALID_INDEX;
+        _nextSiblings[ index ] = INVALID_INDEX;
     }
 
-    bool removeNode( const std::string& name )
+    void _touch( const uint32_t index )
     {
-        if( !nodeExists( name ) )
-            return false;
+        _changed = true;
+        if( index == INVALID_INDEX )
+            return;
 
-        WriteLock writeLock( _mutex );
-        boost::clear_vertex( _nodeMap[ name ], _graph );
-        boost::remove_vertex( _nodeMap[ name ], _graph );
+        const size_t chunk = index / SNAPSHOT_CHUNK_SIZE;
+        if( chunk >= _changedChunks.size( ))
+            _changedChunks.resize( chunk + 1, true );
+        _changedChunks[ chunk ] = true;
+    }
 
-        _nodeMap.erase( name );
-        return true;
+    void _markDirty( const uint32_t index )
+    {
+        if( _allDirty || index == INVALID_INDEX )
+            return;
+
+        // Many marks are cheaper to handle as a full update
+        _dirtyIndices.push_back( index );
+        if( _dirtyIndices.size() > 2 * _nodeCount + 64 )
+        {
+            _allDirty = true;
+            _dirtyIndices.clear();
+            _dirtyBounds.clear();
+        }
     }
 
-    bool addChild( const std::string& parent,
-                   const std::string& child )
+    size_t _updateSubtree( const uint32_t position )
     {
-        if( !nodeExists( parent ) ||
-            !nodeExists( child ))
+        const TraversalOrder& order = *_order;
+        const uint32_t end = position + order.subtreeSizes[ position ];
+
+        // The parents come before their children in the preorder
+        for( uint32_t i = position; i < end; ++i )
         {
-            return false;
+            const uint32_t index = getIndex( order.ids[ i ]);
+            const uint32_t parent = _parents[ index ];
+            const TransformData* transform =
+                    dynamic_cast< const TransformData* >(
+                        _nodeData[ index ].get( ));
+
+            Affine3f& world = _worldTransforms[ index ];
+            if( parent == INVALID_INDEX )
+                world.setIdentity();
+            else
+                world = _worldTransforms[ parent ];
+            if( transform )
+                world = world * transform->getTransform();
         }
 
-        WriteLock writeLock( _mutex );
-        boost::add_edge( _nodeMap[ parent ],
-                         _nodeMap[ child ],
-                         _graph );
-        return true;
+        for( uint32_t i = end; i > position; --i )
+            _updateBounds( getIndex( order.ids[ i - 1 ]));
+        return end - position;
     }
 
-    NodePtr getParent(const std::string& child ) const
+    void _updateBounds( const uint32_t index )
     {
-        if( nodeExists( child ) )
-            return NodePtr();
+        const BoundsData* boundsData =
+                dynamic_cast< const BoundsData* >( _nodeData[ index ].get( ));
 
-        ReadLock readLock( _mutex );
-        const NodeDescriptor& nd = _nodeMap.find( child )->second;
-        Graph::in_edge_iterator begin, end;
-        boost::tie( begin, end ) = boost::in_edges( nd, _graph );
-        if( begin == end )
-            return NodePtr();
+        AlignedBox3f bounds;
+        if( boundsData )
+            bounds = transformBox( boundsData->getBounds(),
+                                   _worldTransforms[ index ] );
 
-        return _graph[ boost::source( *begin, _graph ) ];
+        for( uint32_t child = _firstChildren[ index ];
+             child != INVALID_INDEX; child = _nextSiblings[ child ] )
+        {
+            bounds.extend( _worldBounds[ child ] );
+        }
+        _worldBounds[ index ] = bounds;
     }
 
-    NodePtrs getChildren( const std::string& parent ) const
+    WorkStealingPool& _getPool()
     {
-        NodePtrs children;
-        if( !nodeExists( parent ) )
-            return children;
-
-        ReadLock readLock( _mutex );
-        const NodeDescriptor& nd = _nodeMap.find( parent )->second;
+        ScopedLock lock( _poolMutex );
+        if( !_pool )
+            _pool.reset( new WorkStealingPool( _nThreads ));
+        return *_pool;
+    }
 
-        Graph::out_edge_iterator begin, end;
-        for( boost::tie( begin, end) = boost::out_edges( nd, _graph );
-             begin != end; ++begin )
+    // Returns the traversal order and the position of a node in it, empty
+    // if the node does not exist. The traversals visit the returned order
+    // without the lock, so the visitors can use the scene graph, and the
+    // changes in the meantime allocate a new order.
+    ConstTraversalOrderPtr _getOrder( const NodeId id,
+                                      uint32_t& position )
+    {
         {
-            const NodeDescriptor& child =
-                    boost::target( *begin, _graph );
-            children.push_back( _graph[ child ] );
+            ReadLock readLock( _mutex );
+            if( _orderValid )
+                return _getOrderAt( _getIndex( id ), position );
         }
-        return children;
+
+        // Taken under the write lock, so the writers can not invalidate
+        // the order before it is returned
+        WriteLock writeLock( _mutex );
+        if( !_orderValid )
+            _updateOrder();
+        return _getOrderAt( _getIndex( id ), position );
+    }
+
+    ConstTraversalOrderPtr _getOrderAt( const uint32_t index,
+                                        uint32_t& position ) const
+    {
+        if( index == INVALID_INDEX )
+            return ConstTraversalOrderPtr();
+
+        position = _order->positions[ index ];
+        return _order;
+    }
+
+    void _visitRange( const uint32_t begin, const uint32_t end,
+                      const size_t worker,
+                      ParallelTraversal& traversal ) const
+    {
+        Visitor& visitor = *traversal.visitors[ worker ];
+        const NodeIds& ids = traversal.order->ids;
+        for( uint32_t i = begin; i < end; ++i )
+            visitor.visit( _sceneGraph, ids[ i ] );
     }
 
-    bool hasChild( const std::string& parent,
-                   const std::string& child ) const
+    void _spawnRange( const uint32_t begin, const uint32_t end,
+                      const size_t worker,
+                      ParallelTraversal& traversal ) const
     {
+        traversal.pool->spawn( worker,
+            [ this, begin, end, &traversal ]( const size_t thief )
+            { _visitRange( begin, end, thief, traversal ); });
+    }
 
-        if( !nodeExists( parent ) ||
-            !nodeExists( child ))
+    void _visitSubtree( const uint32_t position, const size_t worker,
+                        ParallelTraversal& traversal ) const
+    {
+        const Indices& subtreeSizes = traversal.order->subtreeSizes;
+        const uint32_t end = position + subtreeSizes[ position ];
+        if( subtreeSizes[ position ] <= TRAVERSAL_GRAIN )
         {
-            return false;
+            _visitRange( position, end, worker, traversal );
+            return;
         }
 
-        ReadLock readLock( _mutex );
-        const NodeDescriptor& nd = _nodeMap.find( parent )->second;
+        traversal.visitors[ worker ]->visit( _sceneGraph,
+                                             traversal.order->ids[ position ]);
 
-        Graph::out_edge_iterator begin, end;
-        for( boost::tie( begin, end) = boost::out_edges( nd, _graph );
-             begin != end; ++begin )
+        // The subtrees of the siblings are adjacent in the preorder, so
+        // the small ones are batched into ranges
+        uint32_t rangeBegin = position + 1;
+        for( uint32_t child = position + 1; child < end;
+             child += subtreeSizes[ child ] )
         {
-            const NodeDescriptor& cnd =
-                    boost::target( *begin, _graph );
-            const NodePtr& node = _graph[ cnd ];
-            if( node->getName() == child )
-                return true;
+            const uint32_t childEnd = child + subtreeSizes[ child ];
+            if( subtreeSizes[ child ] > TRAVERSAL_GRAIN )
+            {
+                if( rangeBegin < child )
+                    _spawnRange( rangeBegin, child, worker, traversal );
+                traversal.pool->spawn( worker,
+                    [ this, child, &traversal ]( const size_t thief )
+                    { _visitSubtree( child, thief, traversal ); });
+                rangeBegin = childEnd;
+            }
+            else if( childEnd - rangeBegin >= TRAVERSAL_GRAIN )
+            {
+                _spawnRange( rangeBegin, childEnd, worker, traversal );
+                rangeBegin = childEnd;
+            }
         }
-        return false;
+        _visitRange( rangeBegin, end, worker, traversal );
     }
 
-    void traverse( Visitor& visitor,
-                   const std::string& name )
+    void _updateOrder()
     {
-        if( !nodeExists( name ) )
-            return;
+        // The published snapshots keep their order
+        if( !_order || !_order.unique( ))
+            _order = std::make_shared< TraversalOrder >();
 
-        ReadLock readLock( _mutex );
-        typedef std::unordered_map< NodeDescriptor,
-                                    boost::default_color_type >
-                                    NodeDescriptorIndexMap;
-        typedef boost::associative_property_map< NodeDescriptorIndexMap >
-                                    IndexMap;
+        _order->ids.clear();
+        _order->subtreeSizes.clear();
+        _order->ids.reserve( _nodeCount );
+        _order->subtreeSizes.reserve( _nodeCount );
+        _order->positions.assign( _alive.size(), INVALID_INDEX );
 
-        NodeDescriptorIndexMap ndIndexMap;
-        IndexMap indexMap =
-                boost::make_assoc_property_map( ndIndexMap );
+        // The root tree comes first, then the detached trees
+        for( uint32_t index = 0; index < _alive.size(); ++index )
+        {
+            if( _alive[ index ] && _parents[ index ] == INVALID_INDEX )
+                _appendSubtree( index );
+        }
+        _orderValid = true;
+    }
+
+    void _appendSubtree( const uint32_t root )
+    {
+        // Walks the tree without a stack, through the parent and
+        // sibling links
+        TraversalOrder& order = *_order;
+        uint32_t index = root;
+        for( ;; )
+        {
+            order.positions[ index ] = uint32_t( order.ids.size( ));
+            order.ids.push_back( _getId( index ));
+            order.subtreeSizes.push_back( 0 );
 
-        for( auto vd : boost::make_iterator_range( boost::vertices( _graph ) ))
-            ndIndexMap[ vd ] = boost::default_color_type();
+            if( _firstChildren[ index ] != INVALID_INDEX )
+            {
+                index = _firstChildren[ index ];
+                continue;
+            }
 
-        visitor.onBegin( _sceneGraph );
-        DFSNodeVisitor dfs( _sceneGraph, visitor );
-        boost::depth_first_visit( _graph,
-                                  _nodeMap[ name ],
-                                  dfs,
-                                  indexMap );
-        visitor.onEnd( _sceneGraph );
+            for( ;; )
+            {
+                const uint32_t position = order.positions[ index ];
+                order.subtreeSizes[ position ] =
+                        uint32_t( order.ids.size( )) - position;
+                if( index == root )
+                    return;
+
+                if( _nextSiblings[ index ] != INVALID_INDEX )
+                {
+                    index = _nextSiblings[ index ];
+                    break;
+                }
+                index = _parents[ index ];
+            }
+        }
     }
 
     NodePtr _rootNode;
-    NodeMap _nodeMap;
+
+    // The node slots as parallel arrays, indexed by the lower bits of
+    // the NodeId. The children of a node are a doubly linked list
+    // through the sibling arrays.
+    Indices _parents;
+    Indices _firstChildren;
+    Indices _lastChildren;
+    Indices _nextSiblings;
+    Indices _prevSiblings;
+    Indices _generations;
+    std::vector< uint8_t > _alive;
+    std::vector< NodeDataPtr > _nodeData;
+    mutable std::vector< NodePtr > _nodes;
+    std::vector< const std::string* > _names;
+    Indices _freeIndices;
+    size_t _nodeCount;
+    NameMap _nameMap;
+
+    // The preorder of all nodes, parents before children, rebuilt by
+    // the first traversal after a change of the hierarchy
+    std::shared_ptr< TraversalOrder > _order;
+    bool _orderValid;
+
+    // The state of the last published snapshot
+    uint64_t _version;
+    bool _changed;
+    bool _namesChanged;
+    std::vector< bool > _changedChunks;
+    std::vector< Snapshot::Impl::ConstChunkPtr > _chunks;
+    std::shared_ptr< const Snapshot::Impl::Names > _publishedNames;
+    std::atomic< Published* > _published;
+    RetireList _retired;
+
+    // The world transforms and bounds of the last update, indexed like
+    // the node arrays
+    Affine3fs _worldTransforms;
+    AlignedBox3fs _worldBounds;
+    Indices _dirtyIndices;
+    Indices _dirtyBounds;
+    bool _allDirty;
+
+    ComponentStore _components;
+
+    // The subscribers are notified of the journal changes in order, up
+    // to the notified version
+    ChangeJournal _journal;
+    std::map< size_t, ChangeCallback > _subscribers;
+    size_t _nextSubscription;
+    uint64_t _notifiedVersion;
+    std::atomic< bool > _hasSubscribers;
+
+    // Recursive, as the callbacks are called under it and may subscribe
+    // and unsubscribe. It serializes the deliveries.
+    boost::recursive_mutex _subscriberMutex;
+    bool _notifying;
+
+    const size_t _nThreads;
+    WorkStealingPoolPtr _pool;
+    boost::mutex _poolMutex;
 
     mutable ReadWriteMutex _mutex;
-    Graph _graph;
     SceneGraph& _sceneGraph;
 };
 
-SceneGraph::SceneGraph()
-    : _impl( new SceneGraph::Impl( *this ) )
+SceneGraph::SceneGraph( const size_t nThreads )
+    : _impl( new SceneGraph::Impl( *this, nThreads ) )
 {}
 
 SceneGraph::~SceneGraph()
@@ -247,7 +1335,8 @@ NodePtr SceneGraph::getRoot()
 NodePtr SceneGraph::createNode( const std::string& name,
                                 const NodeDataPtr& nodeData )
 {
-    return _impl->createNode( name, nodeData );
+    const NodeId id = _impl->addNode( &name, nodeData );
+    return id == INVALID_NODE_ID ? NodePtr() : _impl->getNode( id );
 }
 
 NodePtr SceneGraph::findNode( const std::string& name ) const
@@ -257,36 +1346,360 @@ NodePtr SceneGraph::findNode( const std::string& name ) const
 
 bool SceneGraph::removeNode( const std::string& name )
 {
-    return _impl->removeNode( name );
+    return _impl->removeNode( _impl->findNodeId( name ));
 }
 
 bool SceneGraph::addChild( const std::string& parent,
                            const std::string& child )
 {
-    return _impl->addChild( parent, child );
+    return _impl->addChild( _impl->findNodeId( parent ),
+                            _impl->findNodeId( child ));
 }
 
 NodePtr SceneGraph::getParent( const std::string& child ) const
 {
-    return _impl->getParent( child );
+    return _impl->getNode( _impl->getParent( _impl->findNodeId( child )));
 }
 
 NodePtrs SceneGraph::getChildren( const std::string& parent ) const
 {
-    return _impl->getChildren( parent );
+    return _impl->getChildren( _impl->findNodeId( parent ));
 }
 
 bool SceneGraph::hasChild (const std::string& parent,
                            const std::string& child ) const
 {
-    return _impl->hasChild( parent, child );
+    return _impl->hasChild( _impl->findNodeId( parent ),
+                            _impl->findNodeId( child ));
 }
 
 void SceneGraph::traverse( Visitor& visitor,
                            const std::string& name )
 {
-    _impl->traverse( visitor, name );
+    _impl->traverse( visitor, _impl->findNodeId( name ));
+}
+
+NodeId SceneGraph::addNode( const NodeDataPtr& nodeData )
+{
+    return _impl->addNode( 0, nodeData );
+}
+
+NodeId SceneGraph::addNode( const std::string& name,
+                            const NodeDataPtr& nodeData )
+{
+    return _impl->addNode( &name, nodeData );
+}
+
+NodeId SceneGraph::findNodeId( const std::string& name ) const
+{
+    return _impl->findNodeId( name );
+}
+
+bool SceneGraph::hasNode( const NodeId id ) const
+{
+    return _impl->hasNode( id );
+}
+
+NodePtr SceneGraph::getNode( const NodeId id ) const
+{
+    return _impl->getNode( id );
+}
+
+NodeDataPtr SceneGraph::getNodeData( const NodeId id ) const
+{
+    return _impl->getNodeData( id );
+}
+
+std::string SceneGraph::getName( const NodeId id ) const
+{
+    return _impl->getName( id );
+}
+
+bool SceneGraph::removeNode( const NodeId id )
+{
+    return _impl->removeNode( id );
+}
+
+bool SceneGraph::addChild( const NodeId parent, const NodeId child )
+{
+    return _impl->addChild( parent, child );
+}
+
+NodeId SceneGraph::getParent( const NodeId child ) const
+{
+    return _impl->getParent( child );
+}
+
+void SceneGraph::getChildren( const NodeId parent, NodeIds& children ) const
+{
+    _impl->getChildren( parent, children );
+}
+
+size_t SceneGraph::getChildCount( const NodeId parent ) const
+{
+    return _impl->getChildCount( parent );
+}
+
+bool SceneGraph::hasChild( const NodeId parent, const NodeId child ) const
+{
+    return _impl->hasChild( parent, child );
+}
+
+void SceneGraph::traverse( Visitor& visitor, const NodeId id )
+{
+    _impl->traverse( visitor, id );
+}
+
+void SceneGraph::traverseParallel( Visitor& visitor, const NodeId id )
+{
+    _impl->traverseParallel( visitor, id );
+}
+
+size_t SceneGraph::getNodeCount() const
+{
+    return _impl->getNodeCount();
+}
+
+ComponentStore& SceneGraph::getComponents()
+{
+    return _impl->_components;
+}
+
+const ComponentStore& SceneGraph::getComponents() const
+{
+    return _impl->_components;
+}
+
+void SceneGraph::markDirty( const NodeId id )
+{
+    _impl->markDirty( id );
+}
+
+size_t SceneGraph::updateTransforms()
+{
+    return _impl->updateTransforms();
+}
+
+bool SceneGraph::getWorldTransform( const NodeId id,
+                                    Affine3f& transform ) const
+{
+    return _impl->getWorldTransform( id, transform );
+}
+
+bool SceneGraph::getWorldBounds( const NodeId id,
+                                 AlignedBox3f& bounds ) const
+{
+    return _impl->getWorldBounds( id, bounds );
+}
+
+ConstSnapshotPtr SceneGraph::publish()
+{
+    return _impl->publish();
+}
+
+ConstSnapshotPtr SceneGraph::getSnapshot() const
+{
+    return _impl->getSnapshot();
+}
+
+bool SceneGraph::setNodeData( const NodeId id, const NodeDataPtr& nodeData )
+{
+    return _impl->setNodeData( id, nodeData );
+}
+
+uint64_t SceneGraph::getChangeVersion() const
+{
+    return _impl->getChangeVersion();
+}
+
+bool SceneGraph::getChanges( uint64_t& cursor, Changes& changes ) const
+{
+    return _impl->getChanges( cursor, changes );
+}
+
+void SceneGraph::setChangeJournalCapacity( const size_t capacity )
+{
+    _impl->setChangeJournalCapacity( capacity );
+}
+
+size_t SceneGraph::subscribe( const ChangeCallback& callback )
+{
+    return _impl->subscribe( callback );
+}
+
+bool SceneGraph::unsubscribe( const size_t subscription )
+{
+    return _impl->unsubscribe( subscription );
+}
+
+struct SceneGraph::Transaction::Impl
+{
+    enum OperationType
+    {
+        OP_ADD_NODE,
+        OP_ADD_CHILD,
+        OP_REMOVE_NODE,
+        OP_SET_NODE_DATA
+    };
+
+    struct Operation
+    {
+        Operation( const OperationType type_,
+                   const NodeId first_,
+                   const NodeId second_ = INVALID_NODE_ID,
+                   const uint32_t data_ = INVALID_INDEX,
+                   const uint32_t name_ = INVALID_INDEX )
+            : type( type_ )
+            , first( first_ )
+            , second( second_ )
+            , data( data_ )
+            , name( name_ )
+        {}
+
+        OperationType type;
+        NodeId first;
+        NodeId second;
+
+        // Indices in the node data and name arrays
+        uint32_t data;
+        uint32_t name;
+    };
+
+    Impl( SceneGraph& sceneGraph_ )
+        : sceneGraph( sceneGraph_ )
+        , nStaged( 0 )
+    {}
+
+    NodeId addNode( const NodeDataPtr& nodeData, const uint32_t name )
+    {
+        const NodeId id = makeId( nStaged++, STAGED_GENERATION );
+        operations.push_back( Operation( OP_ADD_NODE, id, INVALID_NODE_ID,
+                                         uint32_t( data.size( )), name ));
+        data.push_back( nodeData );
+        return id;
+    }
+
+    NodeId getNodeId( const NodeId id ) const
+    {
+        if( getGeneration( id ) != STAGED_GENERATION )
+            return id;
+
+        const uint32_t index = getIndex( id );
+        return index < createdIds.size() ? createdIds[ index ]
+                                         : INVALID_NODE_ID;
+    }
+
+    bool apply( SceneGraph::Impl& graph, const Operation& operation )
+    {
+        switch( operation.type )
+        {
+        case OP_ADD_NODE:
+        {
+            const std::string* name = operation.name == INVALID_INDEX ?
+                                          0 : &names[ operation.name ];
+            const NodeId id = graph._addNode( name, data[ operation.data ] );
+            createdIds[ getIndex( operation.first )] = id;
+            return id != INVALID_NODE_ID;
+        }
+        case OP_ADD_CHILD:
+            return graph._addChild( getNodeId( operation.first ),
+                                    getNodeId( operation.second ));
+        case OP_REMOVE_NODE:
+            return graph._removeNode( getNodeId( operation.first ));
+        case OP_SET_NODE_DATA:
+            return graph._setNodeData( getNodeId( operation.first ),
+                                       data[ operation.data ] );
+        }
+        return false;
+    }
+
+    void clear()
+    {
+        operations.clear();
+        data.clear();
+        names.clear();
+        nStaged = 0;
+    }
+
+    SceneGraph& sceneGraph;
+    std::vector< Operation > operations;
+    std::vector< NodeDataPtr > data;
+    std::vector< std::string > names;
+    uint32_t nStaged;
+
+    // The scene graph ids of the nodes staged in the last commit
+    NodeIds createdIds;
+};
+
+SceneGraph::Transaction::Transaction( SceneGraph& sceneGraph )
+    : _impl( new SceneGraph::Transaction::Impl( sceneGraph ))
+{}
+
+SceneGraph::Transaction::~Transaction()
+{}
+
+NodeId SceneGraph::Transaction::addNode( const NodeDataPtr& nodeData )
+{
+    return _impl->addNode( nodeData, INVALID_INDEX );
+}
+
+NodeId SceneGraph::Transaction::addNode( const std::string& name,
+                                         const NodeDataPtr& nodeData )
+{
+    _impl->names.push_back( name );
+    return _impl->addNode( nodeData, uint32_t( _impl->names.size() - 1 ));
+}
+
+void SceneGraph::Transaction::addChild( const NodeId parent,
+                                        const NodeId child )
+{
+    _impl->operations.push_back( Impl::Operation( Impl::OP_ADD_CHILD,
+                                                  parent, child ));
+}
+
+void SceneGraph::Transaction::removeNode( const NodeId id )
+{
+    _impl->operations.push_back( Impl::Operation( Impl::OP_REMOVE_NODE,
+                                                  id ));
 }
 
+void SceneGraph::Transaction::setNodeData( const NodeId id,
+                                           const NodeDataPtr& nodeData )
+{
+    _impl->operations.push_back(
+                Impl::Operation( Impl::OP_SET_NODE_DATA, id, INVALID_NODE_ID,
+                                 uint32_t( _impl->data.size( ))));
+    _impl->data.push_back( nodeData );
+}
+
+size_t SceneGraph::Transaction::commit()
+{
+    SceneGraph::Impl& graph = *_impl->sceneGraph._impl;
+    _impl->createdIds.assign( _impl->nStaged, INVALID_NODE_ID );
+
+    size_t nFailed = 0;
+    {
+        WriteLock writeLock( graph._mutex );
+        graph._reserve( _impl->nStaged, _impl->names.size( ));
+        for( const Impl::Operation& operation: _impl->operations )
+        {
+            if( !_impl->apply( graph, operation ))
+                ++nFailed;
+        }
+    }
+    graph._notify();
+    _impl->clear();
+    return nFailed;
+}
+
+NodeId SceneGraph::Transaction::getNodeId( const NodeId id ) const
+{
+    return _impl->getNodeId( id );
 }
 
+size_t SceneGraph::Transaction::getSize() const
+{
+    return _impl->operations.size();
+}
+
+}
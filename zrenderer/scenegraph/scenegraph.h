@@ -18,6 +18,9 @@
  */
 
 #include <zrenderer/scenegraph/types.h>
+#include <zrenderer/scenegraph/changejournal.h>
+#include <zrenderer/scenegraph/componentstore.h>
+#include <zrenderer/common/mathtypes.h>
 
 namespace zrenderer
 {
@@ -25,14 +28,112 @@ namespace zrenderer
 /**
  * This class holds the tree structure of the scene and
  * provides thread-safe function for querying and generating
- * nodes. Every node in the tree has a unique name
- * identifier
+ * nodes. Every node in the tree has a NodeId handle and
+ * optionally a unique name.
+ *
+ * The NodeId functions do not hash strings or allocate memory,
+ * the name based functions look the names up in a side index.
+ * A node has at most one parent. Readers which should not wait for
+ * the writers use the published snapshots.
  */
 class SceneGraph
 {
 public:
 
-    SceneGraph();
+    /**
+     * Stages node creations, reparents, removals and data updates, which
+     * are applied to the scene graph at once by commit(), in the order
+     * they are staged. The staged nodes get temporary ids, which can be
+     * used in the later operations of the transaction and are mapped to
+     * the scene graph ids by getNodeId() after the commit. A transaction
+     * is not thread safe.
+     */
+    class Transaction
+    {
+    public:
+
+        /**
+         * @param sceneGraph is the scene graph to change
+         */
+        explicit Transaction( SceneGraph& sceneGraph );
+
+        /**
+         * Discards the operations which are not committed.
+         */
+        ~Transaction();
+
+        /**
+         * Stages the creation of a node without a name
+         * @param nodeData is the data of the node
+         * @return the temporary id of the node
+         */
+        NodeId addNode( const NodeDataPtr& nodeData = NodeDataPtr( ));
+
+        /**
+         * Stages the creation of a node. It fails if a node with the
+         * same name exists at commit time.
+         * @param name of the node
+         * @param nodeData is the data of the node
+         * @return the temporary id of the node
+         */
+        NodeId addNode( const std::string& name,
+                        const NodeDataPtr& nodeData );
+
+        /**
+         * Stages adding a child, see SceneGraph::addChild
+         * @param parent node id, it can be a temporary id
+         * @param child node id, it can be a temporary id
+         */
+        void addChild( NodeId parent, NodeId child );
+
+        /**
+         * Stages the removal of a node, see SceneGraph::removeNode
+         * @param id of the node, it can be a temporary id
+         */
+        void removeNode( NodeId id );
+
+        /**
+         * Stages the replacement of the node data
+         * @param id of the node, it can be a temporary id
+         * @param nodeData is the new data of the node
+         */
+        void setNodeData( NodeId id, const NodeDataPtr& nodeData );
+
+        /**
+         * Applies the staged operations under a single lock of the scene
+         * graph and clears them.
+         * @return the number of operations which could not be applied
+         */
+        size_t commit();
+
+        /**
+         * @param id is a temporary id of the last commit or a scene
+         * graph id
+         * @return the scene graph id. It is INVALID_NODE_ID if the
+         * node could not be created.
+         */
+        NodeId getNodeId( NodeId id ) const;
+
+        /**
+         * @return the number of staged operations
+         */
+        size_t getSize() const;
+
+    private:
+
+        Transaction( const Transaction& ) = delete;
+        Transaction& operator=( const Transaction& ) = delete;
+
+        struct Impl;
+        std::unique_ptr<Impl> _impl;
+    };
+
+    /**
+     * @param nThreads is the number of threads of traverseParallel,
+     * including the calling thread. If it is 0, the number of hardware
+     * threads is used.
+     */
+    explicit SceneGraph( size_t nThreads = 0 );
     ~SceneGraph();
 
     /**
@@ -111,6 +212,252 @@ public:
     void traverse( Visitor& visitor,
                    const std::string& name = ROOT_NODE );
 
+    /**
+     * Creates a new node without a name
+     * @param nodeData is the data of the node
+     * @return the id of the node
+     */
+    NodeId addNode( const NodeDataPtr& nodeData = NodeDataPtr( ));
+
+    /**
+     * Creates a new node in the tree with given name
+     * @param name of the node
+     * @param nodeData is the data of the node
+     * @return the id of the node. If a node with the same name
+     * is there, INVALID_NODE_ID is returned.
+     */
+    NodeId addNode( const std::string& name,
+                    const NodeDataPtr& nodeData );
+
+    /**
+     * @param name of the node
+     * @return the id of the node. If there is no node with the name,
+     * INVALID_NODE_ID is returned.
+     */
+    NodeId findNodeId( const std::string& name ) const;
+
+    /**
+     * @param id of the node
+     * @return true if the node is in the scene graph
+     */
+    bool hasNode( NodeId id ) const;
+
+    /**
+     * @param id of the node
+     * @return the node. If there is no node with the id, an empty
+     * NodePtr is returned.
+     */
+    NodePtr getNode( NodeId id ) const;
+
+    /**
+     * @param id of the node
+     * @return the data of the node
+     */
+    NodeDataPtr getNodeData( NodeId id ) const;
+
+    /**
+     * Replaces the data of the node
+     * @param id of the node
+     * @param nodeData is the new data of the node
+     * @return true if there is a node with the id
+     */
+    bool setNodeData( NodeId id, const NodeDataPtr& nodeData );
+
+    /**
+     * @param id of the node
+     * @return the name of the node. It is empty if the node has no
+     * name or there is no node with the id.
+     */
+    std::string getName( NodeId id ) const;
+
+    /**
+     * Removes the node from the scene graph. Its children are
+     * detached from it.
+     * @param id of the node
+     * @return true if node can be removed.
+     */
+    bool removeNode( NodeId id );
+
+    /**
+     * Add a child to the parent node.
+     * @param parent node id
+     * @param child node id
+     * @return true if child can be added to parent, i.e. both nodes
+     * exist, the child has no parent and it is not an ancestor of
+     * the parent.
+     */
+    bool addChild( NodeId parent, NodeId child );
+
+    /**
+     * @param child node id
+     * @return the id of the parent node. If there is not,
+     * INVALID_NODE_ID is returned.
+     */
+    NodeId getParent( NodeId child ) const;
+
+    /**
+     * Get the children of a node
+     * @param parent node id
+     * @param children is filled with the ids of the children, in the
+     * order they are added. Its memory is reused.
+     */
+    void getChildren( NodeId parent, NodeIds& children ) const;
+
+    /**
+     * @param parent node id
+     * @return the number of children of the node
+     */
+    size_t getChildCount( NodeId parent ) const;
+
+    /**
+     * @param parent node id
+     * @param child node id
+     * @return true if parent has the child
+     */
+    bool hasChild( NodeId parent, NodeId child ) const;
+
+    /**
+     * Traverse the scene graph with depth first search algorithm
+     * using the visitor and starting point. The children are visited
+     * in the order they are added. The first traversal after a change
+     * of the hierarchy linearizes the graph, the following ones scan
+     * the stored order. The scene graph is not locked while the visitor
+     * runs, so it may use or change the graph; it visits the nodes of the
+     * hierarchy when the traversal began. The nodes of a SceneFile which
+     * are not expanded yet are leaves, SceneFile::traverse expands them.
+     * @param visitor the visitor class that is executed per vertex
+     * @param id of the node to start traversing.
+     */
+    void traverse( Visitor& visitor, NodeId id );
+
+    /**
+     * Traverse the subtree of a node on several threads. The subtrees
+     * are split into tasks of a work stealing thread pool, so the
+     * visiting order is not defined, except that a node is visited
+     * before its children. Each thread visits with a visitor forked
+     * from the given one. As in traverse, the graph is not locked while
+     * the visitors run.
+     * @param visitor the visitor class that is executed per vertex
+     * @param id of the node to start traversing.
+     */
+    void traverseParallel( Visitor& visitor, NodeId id = ROOT_NODE_ID );
+
+    /**
+     * @return the number of nodes, including the root node
+     */
+    size_t getNodeCount() const;
+
+    /**
+     * @return the components of the nodes. The components of a node are
+     * removed with the node; the store is locked internally, so it can be
+     * read and iterated with ComponentStore::forEach while nodes are
+     * removed.
+     */
+    ComponentStore& getComponents();
+
+    /**
+     * @return the components of the nodes
+     */
+    const ComponentStore& getComponents() const;
+
+    /**
+     * Marks the world transform and bounds of a node for update, after
+     * its TransformData or BoundsData is changed in place. The changes
+     * of the hierarchy and setNodeData mark the nodes themselves.
+     * @param id of the node
+     */
+    void markDirty( NodeId id );
+
+    /**
+     * Recomputes the world transforms and bounds of the subtrees of
+     * the marked nodes, and the bounds of their ancestors. A node
+     * without TransformData has the world transform of its parent. The
+     * world bounds of a node contain its BoundsData and its subtree.
+     * The update runs under the write lock of the scene graph, so the
+     * readers of the world transforms and bounds get either the values
+     * before or after it, never torn ones.
+     * @return the number of updated nodes
+     */
+    size_t updateTransforms();
+
+    /**
+     * @param id of the node
+     * @param transform is set to the world transform of the node at
+     * the last update
+     * @return false if there is no node with the id or it is not
+     * updated yet
+     */
+    bool getWorldTransform( NodeId id, Affine3f& transform ) const;
+
+    /**
+     * @param id of the node
+     * @param bounds is set to the world bounds of the subtree of the
+     * node at the last update
+     * @return false if there is no node with the id or it is not
+     * updated yet
+     */
+    bool getWorldBounds( NodeId id, AlignedBox3f& bounds ) const;
+
+    /**
+     * Publishes the current state of the scene graph as a new snapshot.
+     * The hierarchy chunks without changes are shared with the previous
+     * snapshot. If nothing has changed, the previous snapshot is returned.
+     * @return the published snapshot
+     */
+    ConstSnapshotPtr publish();
+
+    /**
+     * Gets the last published snapshot without locking. A snapshot is
+     * deleted when the last reference to it is released.
+     * @return the last published snapshot
+     */
+    ConstSnapshotPtr getSnapshot() const;
+
+    /**
+     * @return the version of the last change in the change journal
+     */
+    uint64_t getChangeVersion() const;
+
+    /**
+     * Reads the changes after a cursor from the change journal. A
+     * consumer keeps its cursor between the calls and updates only the
+     * changed parts of its state.
+     * @param cursor is the version of the last read change, 0 for all
+     * changes, set to the version of the last change
+     * @param changes the changes after the cursor are appended to
+     * @return false if the changes after the cursor are not kept
+     * anymore, in which case the consumer has to rebuild its state
+     */
+    bool getChanges( uint64_t& cursor, Changes& changes ) const;
+
+    /**
+     * Sets the maximum number of changes kept in the change journal,
+     * which drops the kept changes.
+     * @param capacity is the number of changes, zero disables the journal
+     */
+    void setChangeJournalCapacity( size_t capacity );
+
+    /**
+     * Subscribes to the changes. The callbacks are called in the order
+     * of the changes after the scene graph is unlocked, never
+     * concurrently. The changes of concurrent writers are delivered by
+     * one of them, so a callback may run on the thread of another
+     * writer. A callback may read the scene graph, subscribe and
+     * unsubscribe, but must not change the graph or wait for a thread
+     * which does.
+     * @param callback is called for each change
+     * @return the id of the subscription
+     */
+    size_t subscribe( const ChangeCallback& callback );
+
+    /**
+     * Removes a subscription. It waits for a delivery on another thread
+     * to finish, so the callback is not called after it returns.
+     * @param subscription is the id returned by subscribe()
+     * @return false if there is no subscription with the id
+     */
+    bool unsubscribe( size_t subscription );
+
 private:
 
     SceneGraph( const SceneGraph& ) = delete;
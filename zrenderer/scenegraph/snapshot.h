@@ -0,0 +1,133 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _snapshot_h_
+#define _snapshot_h_
+
+#include <zrenderer/scenegraph/types.h>
+
+namespace zrenderer
+{
+
+/**
+ * Immutable version of the scene graph hierarchy, published by
+ * SceneGraph::publish(). Its functions do not lock, so render threads
+ * can query and traverse a consistent frame while the scene graph is
+ * being changed. The node data objects are shared with the scene graph.
+ */
+class Snapshot
+{
+public:
+
+    ~Snapshot();
+
+    /**
+     * @return the version of the snapshot. It increases with every
+     * published snapshot of a scene graph.
+     */
+    uint64_t getVersion() const;
+
+    /**
+     * @return the scene graph the snapshot is taken from
+     */
+    const SceneGraph& getSceneGraph() const;
+
+    /**
+     * @return the number of nodes, including the root node
+     */
+    size_t getNodeCount() const;
+
+    /**
+     * @param id of the node
+     * @return true if the node is in the snapshot
+     */
+    bool hasNode( NodeId id ) const;
+
+    /**
+     * @param name of the node
+     * @return the id of the node. If there is no node with the name,
+     * INVALID_NODE_ID is returned.
+     */
+    NodeId findNodeId( const std::string& name ) const;
+
+    /**
+     * @param id of the node
+     * @return the name of the node. It is empty if the node has no
+     * name or there is no node with the id.
+     */
+    std::string getName( NodeId id ) const;
+
+    /**
+     * @param id of the node
+     * @return the data of the node
+     */
+    NodeDataPtr getNodeData( NodeId id ) const;
+
+    /**
+     * @param child node id
+     * @return the id of the parent node. If there is not,
+     * INVALID_NODE_ID is returned.
+     */
+    NodeId getParent( NodeId child ) const;
+
+    /**
+     * Get the children of a node
+     * @param parent node id
+     * @param children is filled with the ids of the children, in the
+     * order they are added. Its memory is reused.
+     */
+    void getChildren( NodeId parent, NodeIds& children ) const;
+
+    /**
+     * @param parent node id
+     * @return the number of children of the node
+     */
+    size_t getChildCount( NodeId parent ) const;
+
+    /**
+     * @param parent node id
+     * @param child node id
+     * @return true if parent has the child
+     */
+    bool hasChild( NodeId parent, NodeId child ) const;
+
+    /**
+     * Traverse the snapshot in depth first order. The visitor is
+     * executed with the snapshot for every node, onBegin and onEnd are
+     * executed with the scene graph, which has to be alive.
+     * @param visitor the visitor class that is executed per vertex
+     * @param id of the node to start traversing.
+     */
+    void traverse( Visitor& visitor, NodeId id = ROOT_NODE_ID ) const;
+
+private:
+
+    friend class SceneGraph;
+
+    explicit Snapshot( const SceneGraph& sceneGraph );
+    Snapshot( const Snapshot& ) = delete;
+    Snapshot& operator=( const Snapshot& ) = delete;
+
+    struct Impl;
+    std::unique_ptr<Impl> _impl;
+};
+
+}
+
+#endif // _snapshot_h_
@@ -0,0 +1,99 @@
+/* Copyright (c) 2015, Zombie Rendering
+ *                     ahmetbilgili@gmail.com
+ *
+ * This file is part of Z-Renderer <https://github.com/ZombieRendering/Z-Renderer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _transformdata_h_
+#define _transformdata_h_
+
+#include <zrenderer/scenegraph/nodedata.h>
+#include <zrenderer/common/mathtypes.h>
+
+namespace zrenderer
+{
+
+/**
+ * Node data for the transformation of a subtree. The world
+ * transform of a node is the product of the transforms on its path
+ * from the root, see SceneGraph::updateTransforms.
+ */
+class TransformData : public NodeData
+{
+public:
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    /**
+     * @param transform is the transform relative to the parent node
+     */
+    explicit TransformData( const Affine3f& transform = Affine3f::Identity( ))
+        : _transform( transform )
+    {}
+
+    /**
+     * @return the transform relative to the parent node
+     */
+    const Affine3f& getTransform() const { return _transform; }
+
+    /**
+     * Sets the transform. SceneGraph::markDirty has to be called for
+     * the node to update the world transforms.
+     * @param transform is the transform relative to the parent node
+     */
+    void setTransform( const Affine3f& transform ) { _transform = transform; }
+
+private:
+
+    Affine3f _transform;
+};
+
+/**
+ * Node data for the bounds of the geometry of a node. The world
+ * bounds of a node contain the bounds of its subtree, see
+ * SceneGraph::updateTransforms.
+ */
+class BoundsData : public NodeData
+{
+public:
+
+    /**
+     * @param bounds are the bounds in the space of the node
+     */
+    explicit BoundsData( const AlignedBox3f& bounds = AlignedBox3f( ))
+        : _bounds( bounds )
+    {}
+
+    /**
+     * @return the bounds in the space of the node
+     */
+    const AlignedBox3f& getBounds() const { return _bounds; }
+
+    /**
+     * Sets the bounds. SceneGraph::markDirty has to be called for
+     * the node to update the world bounds.
+     * @param bounds are the bounds in the space of the node
+     */
+    void setBounds( const AlignedBox3f& bounds ) { _bounds = bounds; }
+
+private:
+
+    AlignedBox3f _bounds;
+};
+
+}
+
+#endif // _transformdata_h_
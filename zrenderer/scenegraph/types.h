@@ -22,13 +22,17 @@
 
 #include <zrenderer/common/types.h>
 
+#include <limits>
+
 namespace zrenderer
 {
 
 class GeometryData;
+class InstanceData;
 class Node;
 class NodeData;
 class SceneGraph;
+class Snapshot;
 class Visitor;
 
 typedef std::shared_ptr<Node> NodePtr;
@@ -36,10 +40,25 @@ typedef std::shared_ptr<const Node> ConstNodePtr;
 typedef std::shared_ptr<NodeData> NodeDataPtr;
 typedef std::shared_ptr<const NodeData> ConstNodeDataPtr;
 typedef std::shared_ptr<GeometryData> GeometryDataPtr;
+typedef std::shared_ptr<const GeometryData> ConstGeometryDataPtr;
+typedef std::shared_ptr<InstanceData> InstanceDataPtr;
+typedef std::shared_ptr<Visitor> VisitorPtr;
+typedef std::shared_ptr<const Snapshot> ConstSnapshotPtr;
 
 typedef std::vector<NodePtr> NodePtrs;
 typedef std::vector<ConstNodePtr> ConstNodePtrs;
 
+/**
+ * Handle of a scene graph node. The lower 32 bits are the index of the
+ * node and the upper 32 bits the generation of the index, so the handles
+ * of removed nodes do not refer to the nodes reusing their index.
+ */
+typedef uint64_t NodeId;
+typedef std::vector<NodeId> NodeIds;
+
+const NodeId INVALID_NODE_ID = std::numeric_limits< NodeId >::max();
+const NodeId ROOT_NODE_ID = 0;
+
 const std::string ROOT_NODE = "RootNode";
 
 }
@@ -24,7 +24,8 @@ namespace zrenderer
 
 /**
  * This class is the visitor interface for scenegraph
- * traversal.
+ * traversal. In parallel traversals, onBegin, join and onEnd
+ * are executed on the visitor given to the traversal.
  */
 class Visitor
 {
@@ -39,11 +40,49 @@ public:
     virtual void onBegin( const SceneGraph& scenegraph UNUSED ) {}
 
     /**
-     * Executed while visiting a node
+     * Executed while visiting a node. The default implementation
+     * calls visit with the node, unless it is removed since the
+     * traversal began.
      * @param scenegraph is the traversed scene graph
+     * @param id is the id of the visited node
      */
     virtual void visit( const SceneGraph& scenegraph,
-                        NodePtr node ) = 0;
+                        NodeId id );
+
+    /**
+     * Executed while visiting a node, if visit with the node id
+     * is not overridden. The node objects are created on first use,
+     * with a copy of the name, and are looked up under the read lock
+     * of the scene graph, so the traversals of large graphs should
+     * override visit with the node id instead.
+     * @param scenegraph is the traversed scene graph
+     */
+    virtual void visit( const SceneGraph& scenegraph UNUSED,
+                        NodePtr node UNUSED ) {}
+
+    /**
+     * Executed while visiting a node in Snapshot::traverse.
+     * @param snapshot is the traversed snapshot
+     * @param id is the id of the visited node
+     */
+    virtual void visit( const Snapshot& snapshot UNUSED,
+                        NodeId id UNUSED ) {}
+
+    /**
+     * Creates the visitor of a worker thread in
+     * SceneGraph::traverseParallel. The worker visits the nodes with
+     * it and it is joined into this visitor at the end of the traversal.
+     * @return the worker visitor. If it is empty, the workers share
+     * this visitor, so visit has to be thread safe.
+     */
+    virtual VisitorPtr fork() const { return VisitorPtr(); }
+
+    /**
+     * Merges the state of a worker visitor created with fork. It is
+     * executed in the thread of the traversal, before onEnd.
+     * @param visitor is the worker visitor
+     */
+    virtual void join( Visitor& visitor UNUSED ) {}
 
     /**
      * Executed at the end of the traversal